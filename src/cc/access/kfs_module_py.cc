@@ -71,6 +71,7 @@ static PyObject *qfs_readdir(PyObject *pself, PyObject *args);
 static PyObject *qfs_readdirplus(PyObject *pself, PyObject *args);
 static PyObject *qfs_create(PyObject *pself, PyObject *args);
 static PyObject *qfs_stat(PyObject *pself, PyObject *args);
+static PyObject *qfs_statbatch(PyObject *pself, PyObject *args);
 static PyObject *qfs_fullstat(PyObject *pself, PyObject *args);
 static PyObject *qfs_getNumChunks(PyObject *pself, PyObject *args);
 static PyObject *qfs_getChunkSize(PyObject *pself, PyObject *args);
@@ -80,6 +81,7 @@ static PyObject *qfs_coalesceblocks(PyObject *pself, PyObject *args);
 static PyObject *qfs_open(PyObject *pself, PyObject *args);
 static PyObject *qfs_cd(PyObject *pself, PyObject *args);
 static PyObject *qfs_log_level(PyObject *pself, PyObject *args);
+static PyObject *package_stat(const KfsFileAttr &attr);
 
 inline static void SetPyIoError(int64_t err)
 {
@@ -103,6 +105,7 @@ static PyMethodDef Client_methods[] = {
     { "readdir",          qfs_readdir,        METH_VARARGS, "Read directory." },
     { "readdirplus",      qfs_readdirplus,    METH_VARARGS, "Read directory with attributes." },
     { "stat",             qfs_stat,           METH_VARARGS, "Stat file." },
+    { "statbatch",        qfs_statbatch,      METH_VARARGS, "Stat list of files." },
     { "fullstat",         qfs_fullstat,       METH_VARARGS, "Stat file for QFS attributes." },
     { "getNumChunks",     qfs_getNumChunks,   METH_VARARGS, "Get # of chunks in a file." },
     { "getChunkSize",     qfs_getChunkSize,   METH_VARARGS, "Get default chunksize for a file." },
@@ -135,6 +138,7 @@ PyDoc_STRVAR(Client_doc,
 "\tisdir(path) -- return TRUE if path is a directory\n"
 "\tisfile(path) -- return TRUE if path is a file\n"
 "\tstat(path)   --  file attributes, compatible with os.stat\n"
+"\tstatbatch(paths)   --  tuple of stat(path) results, None if stat failed\n"
 "\tfullstat(path)   --  file attributes, including QFS attributes\n"
 "\tgetNumChunks(path)   --  return the # of chunks in a file\n"
 "\tgetChunkSize(path)   --  return the default size of chunks in a file\n"
@@ -1014,6 +1018,59 @@ qfs_stat(PyObject *pself, PyObject *args)
         SetPyIoError(status);
         return NULL;
     }
+    return package_stat(attr);
+}
+
+static PyObject *
+qfs_statbatch(PyObject *pself, PyObject *args)
+{
+    qfs_Client *self = (qfs_Client *)pself;
+    PyObject *pathsarg;
+
+    if (!PyArg_ParseTuple(args, "O", &pathsarg))
+        return NULL;
+
+    PyObject *seq = PySequence_Fast(pathsarg, "expected sequence of paths");
+    if (seq == NULL)
+        return NULL;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    vector <string> paths;
+    paths.reserve(n);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        const char *patharg = PyString_AsString(
+            PySequence_Fast_GET_ITEM(seq, i));
+        if (patharg == NULL) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+        paths.push_back(build_path(self->cwd, patharg));
+    }
+    Py_DECREF(seq);
+    vector <KfsFileAttr> attrs;
+    vector <int> statuses;
+    int status = self->client->StatBatch(paths, attrs, statuses, true);
+    if (status < 0) {
+        SetPyIoError(status);
+        return NULL;
+    }
+    PyObject *tuple = PyTuple_New(n);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        if (statuses[i] == 0) {
+            PyTuple_SetItem(tuple, i, package_stat(attrs[i]));
+        } else {
+            Py_INCREF(Py_None);
+            PyTuple_SetItem(tuple, i, Py_None);
+        }
+    }
+    return tuple;
+}
+
+/*!
+ * \brief Package a KfsFileAttr into os.stat compatible tuple
+ */
+static PyObject *
+package_stat(const KfsFileAttr &attr)
+{
     /*
      * Return the stat information in the same format as
      * os.stat() so that we can use the standard stat module
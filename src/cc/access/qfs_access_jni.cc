@@ -191,6 +191,10 @@ extern "C" {
     jint Java_com_quantcast_qfs_access_KfsAccess_stat(
         JNIEnv *jenv, jclass jcls, jlong jptr, jstring jpath, jobject attr);
 
+    jint Java_com_quantcast_qfs_access_KfsAccess_statBatch(
+        JNIEnv *jenv, jclass jcls, jlong jptr, jobjectArray jpaths,
+        jobjectArray attrs, jintArray jstatuses);
+
     jstring Java_com_quantcast_qfs_access_KfsAccess_strerror(
         JNIEnv *jenv, jclass jcls, jlong jptr, jint jerr);
 
@@ -1057,37 +1061,9 @@ jshort Java_com_quantcast_qfs_access_KfsAccess_setReplication(
     return clnt->SetReplicationFactor(path.c_str(), jnumReplicas);
 }
 
-jint Java_com_quantcast_qfs_access_KfsAccess_stat(
-    JNIEnv *jenv, jclass jcls, jlong jptr, jstring jpath, jobject attr)
+static int setFileAttrFields(JNIEnv *jenv, jclass acls,
+    const KfsFileAttr& kfsAttr, const string* names, jobject attr)
 {
-    if (! jptr) {
-        return -EFAULT;
-    }
-    if (! jpath || ! attr) {
-        return -EINVAL;
-    }
-
-    jclass const acls = jenv->GetObjectClass(attr);
-    if (! acls) {
-        return -EINVAL;
-    }
-
-    string path;
-    setStr(path, jenv, jpath);
-    KfsFileAttr kfsAttr;
-    KfsClient* const clnt = (KfsClient*)jptr;
-    int ret = clnt->Stat(path.c_str(), kfsAttr);
-    if (ret != 0) {
-        return (jint)ret;
-    }
-    string names[3];
-    names[0] = kfsAttr.filename;
-    ret = clnt->GetUserAndGroupNames(
-        kfsAttr.user, kfsAttr.group, names[1], names[2]);
-    if (ret != 0) {
-        return (jint)ret;
-    }
-
     jfieldID fid = jenv->GetFieldID(acls, "isDirectory", "Z");
     if (! fid) {
         return -EFAULT;
@@ -1183,11 +1159,102 @@ jint Java_com_quantcast_qfs_access_KfsAccess_stat(
         }
         fid = jenv->GetFieldID(acls, fieldNames[i], "Ljava/lang/String;");
         if (! fid) {
+            jenv->DeleteLocalRef(nm);
             return -EFAULT;
         }
         jenv->SetObjectField(attr, fid, nm);
+        jenv->DeleteLocalRef(nm);
+    }
+
+    return 0;
+}
+
+static int setFileAttr(
+    JNIEnv *jenv, KfsClient& clnt, const KfsFileAttr& kfsAttr, jobject attr)
+{
+    string names[3];
+    names[0] = kfsAttr.filename;
+    const int ret = clnt.GetUserAndGroupNames(
+        kfsAttr.user, kfsAttr.group, names[1], names[2]);
+    if (ret != 0) {
+        return ret;
+    }
+    jclass const acls = jenv->GetObjectClass(attr);
+    if (! acls) {
+        return -EINVAL;
+    }
+    const int res = setFileAttrFields(jenv, acls, kfsAttr, names, attr);
+    jenv->DeleteLocalRef(acls);
+    return res;
+}
+
+jint Java_com_quantcast_qfs_access_KfsAccess_stat(
+    JNIEnv *jenv, jclass jcls, jlong jptr, jstring jpath, jobject attr)
+{
+    if (! jptr) {
+        return -EFAULT;
+    }
+    if (! jpath || ! attr) {
+        return -EINVAL;
+    }
+
+    string path;
+    setStr(path, jenv, jpath);
+    KfsFileAttr kfsAttr;
+    KfsClient* const clnt = (KfsClient*)jptr;
+    const int ret = clnt->Stat(path.c_str(), kfsAttr);
+    if (ret != 0) {
+        return (jint)ret;
     }
+    return (jint)setFileAttr(jenv, *clnt, kfsAttr, attr);
+}
 
+jint Java_com_quantcast_qfs_access_KfsAccess_statBatch(
+    JNIEnv *jenv, jclass jcls, jlong jptr, jobjectArray jpaths,
+    jobjectArray attrs, jintArray jstatuses)
+{
+    if (! jptr) {
+        return -EFAULT;
+    }
+    if (! jpaths || ! attrs || ! jstatuses) {
+        return -EINVAL;
+    }
+    const jsize cnt = jenv->GetArrayLength(jpaths);
+    if (jenv->GetArrayLength(attrs) != cnt ||
+            jenv->GetArrayLength(jstatuses) != cnt) {
+        return -EINVAL;
+    }
+
+    vector<string> paths(cnt);
+    for (jsize i = 0; i < cnt; i++) {
+        jstring const jpath = (jstring)jenv->GetObjectArrayElement(jpaths, i);
+        setStr(paths[i], jenv, jpath);
+        jenv->DeleteLocalRef(jpath);
+    }
+    vector<KfsFileAttr> results;
+    vector<int>         statuses;
+    KfsClient* const    clnt = (KfsClient*)jptr;
+    const int ret = clnt->StatBatch(paths, results, statuses);
+    if (ret != 0) {
+        return (jint)ret;
+    }
+    vector<jint> jstatus(cnt);
+    for (jsize i = 0; i < cnt; i++) {
+        jstatus[i] = (jint)statuses[i];
+        if (statuses[i] != 0) {
+            continue;
+        }
+        jobject const attr = jenv->GetObjectArrayElement(attrs, i);
+        if (! attr) {
+            jstatus[i] = -EINVAL;
+            continue;
+        }
+        jstatus[i] = (jint)setFileAttr(jenv, *clnt, results[i], attr);
+        jenv->DeleteLocalRef(attr);
+    }
+    if (0 < cnt) {
+        jenv->SetIntArrayRegion(jstatuses, 0, cnt, &jstatus[0]);
+    }
     return 0;
 }
 
@@ -846,6 +846,7 @@ public:
           mRenamesInFlight(0),
           mWritesInFlight(0),
           mPendingSpaceReservationSize(0),
+          mHelloVersion(-1),
           mWriteMetaOpsHead(0),
           mWriteMetaOpsTail(0),
           mReadableNotifyHead(0),
@@ -1161,6 +1162,14 @@ public:
     bool GetWriteIdIssuedFlag() const {
         return mWriteIdIssuedFlag;
     }
+    // Version reported to the meta server as stable with the last hello, or
+    // -1. Used to build incremental hello chunk inventory.
+    kfsSeq_t GetHelloVersion() const {
+        return mHelloVersion;
+    }
+    void SetHelloVersion(kfsSeq_t version) {
+        mHelloVersion = version;
+    }
     inline bool ScheduleObjTableCleanup(
         ChunkLists* chunkInfoLists);
 
@@ -1182,6 +1191,7 @@ private:
     // write in flight.
     int                         mWritesInFlight;
     int                         mPendingSpaceReservationSize;
+    kfsSeq_t                    mHelloVersion;
     WriteChunkMetaOp*           mWriteMetaOpsHead;
     WriteChunkMetaOp*           mWriteMetaOpsTail;
     KfsOp*                      mReadableNotifyHead;
@@ -1396,6 +1406,25 @@ ChunkManager::Delete(ChunkInfoHandle& cih)
     DeleteSelf(cih);
 }
 
+inline void
+ChunkManager::HelloChunkDeleted(const ChunkInfoHandle& cih)
+{
+    if (! mHelloDeltaValidFlag || cih.chunkInfo.chunkVersion < 0) {
+        return;
+    }
+    if (mHelloDeltaMaxDeletedChunks <= mHelloDeletedChunks.size()) {
+        // Too many deletes, the next hello will have full inventory.
+        mHelloDeltaValidFlag = false;
+        HelloDeletedChunks().swap(mHelloDeletedChunks);
+        return;
+    }
+    mHelloDeletedChunks.push_back(HelloDeletedChunk(
+        cih.chunkInfo.fileId,
+        cih.chunkInfo.chunkId,
+        cih.chunkInfo.chunkVersion
+    ));
+}
+
 inline bool
 ChunkManager::Remove(ChunkInfoHandle& cih)
 {
@@ -1407,6 +1436,7 @@ ChunkManager::Remove(ChunkInfoHandle& cih)
         if (mChunkTable.Erase(cih.chunkInfo.chunkId) <= 0) {
             return false;
         }
+        HelloChunkDeleted(cih);
     } else {
         ObjPendingWrites::Key const key(
             cih.chunkInfo.chunkId, cih.chunkInfo.chunkVersion);
@@ -1858,7 +1888,10 @@ ChunkManager::ChunkManager()
       mObjBlockDiscardMinMetaUptime(90),
       mObjStoreIoThreadCount(-1),
       mRand(),
-      mChunkHeaderBuffer()
+      mChunkHeaderBuffer(),
+      mHelloDeletedChunks(),
+      mHelloDeltaMaxDeletedChunks(1 << 20),
+      mHelloDeltaValidFlag(false)
 {
     mDirChecker.SetInterval(180 * 1000);
     srand48((long)globalNetManager().Now());
@@ -2232,6 +2265,9 @@ ChunkManager::SetParameters(const Properties& prop)
     mObjStoreIoThreadCount = prop.getValue(
         "chunkServer.objStoreIoThreadCount",
         mObjStoreIoThreadCount);
+    mHelloDeltaMaxDeletedChunks = prop.getValue(
+        "chunkServer.helloDeltaMaxDeletedChunks",
+        mHelloDeltaMaxDeletedChunks);
     if (0 < mObjStoreBlockWriteBufferSize &&
             mObjStoreBlockWriteBufferSize < (int)KFS_CHUNK_HEADER_SIZE) {
         mObjStoreBlockWriteBufferSize = KFS_CHUNK_HEADER_SIZE;
@@ -3328,6 +3364,7 @@ ChunkManager::StaleChunk(ChunkInfoHandle* cih,
                         cih->chunkInfo.chunkVersion))) <= 0) {
         return -EBADF;
     }
+    HelloChunkDeleted(*cih);
     gLeaseClerk.UnRegisterLease(
         cih->chunkInfo.chunkId, cih->chunkInfo.chunkVersion);
     if (! cih->IsStale() && ! mPendingWrites.Delete(
@@ -3989,6 +4026,7 @@ ChunkManager::OpenChunk(ChunkInfoHandle* cih, int openFlags)
                     mChunkTable.Erase(cih->chunkInfo.chunkId) :
                     mObjTable.Erase(make_pair(cih->chunkInfo.chunkId,
                         cih->chunkInfo.chunkVersion))) > 0) {
+                HelloChunkDeleted(*cih);
                 const int64_t size = 0 <= cih->chunkInfo.chunkVersion ?
                     min(mUsedSpace, cih->chunkInfo.chunkSize) :
                     cih->chunkInfo.chunkSize;
@@ -4939,6 +4977,7 @@ ChunkManager::NotifyMetaChunksLost(
                 if (mChunkTable.Erase(chunkId) <= 0) {
                     die("corrupted chunk table");
                 }
+                HelloChunkDeleted(*cih);
             }
             const int64_t size = min(mUsedSpace, cih->chunkInfo.chunkSize);
             UpdateDirSpace(cih, -size);
@@ -5271,36 +5310,74 @@ ChunkManager::Restore()
 static inline void
 AppendToHostedList(
     const ChunkManager::HostedChunkList& list,
-    const ChunkInfo_t&                   chunkInfo,
+    kfsFileId_t                          fileId,
+    kfsChunkId_t                         chunkId,
     kfsSeq_t                             chunkVersion,
     bool                                 noFidsFlag)
 {
     (*list.first)++;
     if (! noFidsFlag) {
         (*list.second) <<
-            chunkInfo.fileId  << ' ';
+            fileId  << ' ';
     }
     (*list.second) <<
-        chunkInfo.chunkId << ' ' <<
-        chunkVersion      << ' '
+        chunkId      << ' ' <<
+        chunkVersion << ' '
     ;
 }
 
-void
+static inline void
+AppendToHostedList(
+    const ChunkManager::HostedChunkList& list,
+    ChunkInfoHandle&                     cih,
+    kfsSeq_t                             chunkVersion,
+    bool                                 stableFlag,
+    bool                                 deltaFlag,
+    bool                                 noFidsFlag)
+{
+    if (stableFlag) {
+        if (deltaFlag && cih.GetHelloVersion() == chunkVersion) {
+            return; // Unchanged since the last hello.
+        }
+        cih.SetHelloVersion(chunkVersion);
+    } else {
+        cih.SetHelloVersion(-1);
+    }
+    AppendToHostedList(list, cih.chunkInfo.fileId, cih.chunkInfo.chunkId,
+        chunkVersion, noFidsFlag);
+}
+
+bool
 ChunkManager::GetHostedChunks(
     const ChunkManager::HostedChunkList& stable,
     const ChunkManager::HostedChunkList& notStableAppend,
     const ChunkManager::HostedChunkList& notStable,
-    bool                                 noFidsFlag)
-{
+    bool                                 noFidsFlag,
+    const ChunkManager::HostedChunkList* deleted)
+{
+    // Incremental inventory is only possible if all chunk table deletes since
+    // the last inventory were recorded.
+    const bool deltaFlag = deleted && mHelloDeltaValidFlag;
+    if (deltaFlag) {
+        for (HelloDeletedChunks::const_iterator
+                it = mHelloDeletedChunks.begin();
+                it != mHelloDeletedChunks.end();
+                ++it) {
+            AppendToHostedList(*deleted, it->fileId, it->chunkId,
+                it->chunkVersion, noFidsFlag);
+        }
+    }
+    HelloDeletedChunks().swap(mHelloDeletedChunks);
+    mHelloDeltaValidFlag = true;
     // walk thru the table and pick up the chunk-ids
     mChunkTable.First();
     const CMapEntry* p;
     while ((p = mChunkTable.Next())) {
-        const ChunkInfoHandle* const cih = p->GetVal();
+        ChunkInfoHandle* const cih = p->GetVal();
         if (cih->IsBeingReplicated()) {
             // Do not report replicated chunks, replications should be canceled
             // on reconnect.
+            cih->SetHelloVersion(-1);
             continue;
         }
         if (cih->IsRenameInFlight()) {
@@ -5318,23 +5395,29 @@ ChunkManager::GetHostedChunks(
                 stableFlag ? stable :
                     (cih->IsWriteAppenderOwns() ?
                         notStableAppend : notStable),
-                    cih->chunkInfo,
+                    *cih,
                     vers,
+                    stableFlag,
+                    deltaFlag,
                     noFidsFlag
             );
         } else {
+            const bool stableFlag = IsChunkStable(cih);
             AppendToHostedList(
-                IsChunkStable(cih) ?
+                stableFlag ?
                     stable :
                     (cih->IsWriteAppenderOwns() ?
                         notStableAppend :
                         notStable),
-                cih->chunkInfo,
+                *cih,
                 cih->chunkInfo.chunkVersion,
+                stableFlag,
+                deltaFlag,
                 noFidsFlag
             );
         }
     }
+    return deltaFlag;
 }
 
 ChunkInfoHandle*
@@ -259,12 +259,18 @@ public:
     int Restart();
 
     /// Retrieve the chunks hosted on this chunk server.
+    /// If deleted list is specified, and all chunk deletes since the previous
+    /// invocation were recorded, then only the stable chunks that were added
+    /// or changed since the previous invocation are returned, and the deleted
+    /// list has the chunks deleted since the previous invocation.
+    /// @retval true if incremental inventory was returned.
     typedef pair<int64_t*, ostream*> HostedChunkList;
-    void GetHostedChunks(
+    bool GetHostedChunks(
         const HostedChunkList& stable,
         const HostedChunkList& notStableAppend,
         const HostedChunkList& notStable,
-        bool                   noFidsFlag);
+        bool                   noFidsFlag,
+        const HostedChunkList* deleted = 0);
 
     typedef EvacuateChunksOp::StorageTierInfo  StorageTierInfo;
     typedef EvacuateChunksOp::StorageTiersInfo StorageTiersInfo;
@@ -948,6 +954,27 @@ private:
     PrngIsaac64       mRand;
     ChunkHeaderBuffer mChunkHeaderBuffer;
 
+    // Chunks deleted since the last hello inventory, for incremental hello.
+    struct HelloDeletedChunk
+    {
+        HelloDeletedChunk(
+            kfsFileId_t  fid,
+            kfsChunkId_t cid,
+            kfsSeq_t     vers)
+            : fileId(fid),
+              chunkId(cid),
+              chunkVersion(vers)
+            {}
+        kfsFileId_t  fileId;
+        kfsChunkId_t chunkId;
+        kfsSeq_t     chunkVersion;
+    };
+    typedef vector<HelloDeletedChunk> HelloDeletedChunks;
+    HelloDeletedChunks mHelloDeletedChunks;
+    size_t             mHelloDeltaMaxDeletedChunks;
+    bool               mHelloDeltaValidFlag;
+
+    inline void HelloChunkDeleted(const ChunkInfoHandle& cih);
     inline void Delete(ChunkInfoHandle& cih);
     inline void Release(ChunkInfoHandle& cih);
 
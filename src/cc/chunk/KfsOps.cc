@@ -3741,6 +3741,13 @@ HelloMetaOp::Request(ostream& os, IOBuffer& buf)
     if (sendCurrentKeyFlag) {
         SendCryptoKey(os, currentKeyId, currentKey);
     }
+    if (0 < inventoryGeneration) {
+        os <<
+            "Inventory-generation: " << inventoryGeneration << "\r\n"
+            "Num-deleted-chunks: " <<
+                chunkLists[kDeletedChunkList].count << "\r\n"
+        ;
+    }
     int64_t contentLength = 0;
     for (int i = 0; i < kChunkListCount; i++) {
         contentLength += chunkLists[i].ioBuf.BytesConsumable();
@@ -3751,7 +3758,8 @@ HelloMetaOp::Request(ostream& os, IOBuffer& buf)
     const int kChunkListsOrder[kChunkListCount] = {
         kStableChunkList,
         kNotStableAppendChunkList,
-        kNotStableChunkList
+        kNotStableChunkList,
+        kDeletedChunkList
     };
     for (int i = 0; i < kChunkListCount; i++) {
         buf.Move(&chunkLists[kChunkListsOrder[i]].ioBuf);
@@ -3828,12 +3836,17 @@ HelloMetaOp::Execute()
         lists[i].first  = &(chunkLists[i].count);
         lists[i].second = &(streams[i].Set(chunkLists[i].ioBuf) << hex);
     }
-    gChunkManager.GetHostedChunks(
-        lists[kStableChunkList],
-        lists[kNotStableAppendChunkList],
-        lists[kNotStableChunkList],
-        noFidsFlag
-    );
+    // With non 0 inventory generation only the chunks changed since the
+    // last hello are reported, unless the chunk manager cannot produce
+    // incremental inventory.
+    if (! gChunkManager.GetHostedChunks(
+            lists[kStableChunkList],
+            lists[kNotStableAppendChunkList],
+            lists[kNotStableChunkList],
+            noFidsFlag,
+            0 < inventoryGeneration ? &lists[kDeletedChunkList] : 0)) {
+        inventoryGeneration = 0;
+    }
     for (int i = 0; i < kChunkListCount; i++) {
         lists[i].second->flush();
         streams[i].Reset();
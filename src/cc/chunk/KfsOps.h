@@ -2140,7 +2140,8 @@ struct HelloMetaOp : public KfsOp {
         kStableChunkList          = 0,
         kNotStableAppendChunkList = 1,
         kNotStableChunkList       = 2,
-        kChunkListCount           = 3
+        kDeletedChunkList         = 3,
+        kChunkListCount           = 4
     };
 
     ServerLocation    myLocation;
@@ -2159,6 +2160,7 @@ struct HelloMetaOp : public KfsOp {
     int64_t           metaFileSystemId;
     bool              deleteAllChunksFlag;
     bool              noFidsFlag;
+    int64_t           inventoryGeneration;
 
     HelloMetaOp(kfsSeq_t s, const ServerLocation& l,
             const string& k, const string& m, int r)
@@ -2178,7 +2180,8 @@ struct HelloMetaOp : public KfsOp {
           fileSystemId(-1),
           metaFileSystemId(-1),
           deleteAllChunksFlag(false),
-          noFidsFlag(false)
+          noFidsFlag(false),
+          inventoryGeneration(0)
         {}
     void Execute();
     void Request(ostream& os, IOBuffer& buf);
@@ -2196,6 +2199,8 @@ struct HelloMetaOp : public KfsOp {
             " chunks: "      << chunkLists[kStableChunkList].count <<
             " not-stable: "  << chunkLists[kNotStableChunkList].count <<
             " append: "      << chunkLists[kNotStableAppendChunkList].count <<
+            " deleted: "     << chunkLists[kDeletedChunkList].count <<
+            " generation: "  << inventoryGeneration <<
             " fsid: "        << fileSystemId <<
             " metafsid: "    << metaFileSystemId <<
             " delete flag: " << deleteAllChunksFlag
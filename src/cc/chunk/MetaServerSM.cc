@@ -87,6 +87,7 @@ MetaServerSM::MetaServerSM()
       mCurrentKeyId(),
       mUpdateCurrentKeyFlag(false),
       mNoFidsFlag(true),
+      mInventoryGeneration(0),
       mOp(0),
       mRequestFlag(false),
       mContentLength(0),
@@ -393,8 +394,10 @@ MetaServerSM::SendHello()
         mHelloOp = new HelloMetaOp(
             nextSeq(), gChunkServer.GetLocation(),
             mClusterKey, mMD5Sum, mRackId);
-        mHelloOp->noFidsFlag = mNoFidsFlag;
-        mHelloOp->clnt       = this;
+        mHelloOp->noFidsFlag          = mNoFidsFlag;
+        mHelloOp->inventoryGeneration = mInventoryGeneration;
+        mHelloOp->clnt                = this;
+        mInventoryGeneration = 0;
         // Send the op and wait for the reply.
         SubmitOp(mHelloOp);
     }
@@ -733,6 +736,11 @@ MetaServerSM::HandleReply(IOBuffer& iobuf, int msgLen)
                         mHelloOp->metaFileSystemId,
                         mHelloOp->deleteAllChunksFlag);
                 }
+                // Inventory generation allows the next hello to send only
+                // the chunk inventory changes since this hello.
+                mInventoryGeneration = mHelloOp->deleteAllChunksFlag ?
+                    int64_t(0) :
+                    prop.getValue("Inventory-generation", int64_t(0));
             }
             HelloMetaOp::LostChunkDirs lostDirs;
             lostDirs.swap(mHelloOp->lostChunkDirs);
@@ -1125,8 +1133,10 @@ MetaServerSM::HandleAuthResponse(IOBuffer& ioBuf)
     mHelloOp = new HelloMetaOp(
         nextSeq(), gChunkServer.GetLocation(), mClusterKey, mMD5Sum, mRackId);
     mHelloOp->sendCurrentKeyFlag = true;
-    mHelloOp->noFidsFlag = mNoFidsFlag;
-    mHelloOp->clnt       = this;
+    mHelloOp->noFidsFlag          = mNoFidsFlag;
+    mHelloOp->inventoryGeneration = mInventoryGeneration;
+    mHelloOp->clnt                = this;
+    mInventoryGeneration = 0;
     // Send the op and wait for the reply.
     SubmitOp(mHelloOp);
 }
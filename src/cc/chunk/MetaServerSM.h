@@ -221,6 +221,7 @@ private:
     kfsKeyId_t                    mCurrentKeyId;
     bool                          mUpdateCurrentKeyFlag;
     bool                          mNoFidsFlag;
+    int64_t                       mInventoryGeneration;
     KfsOp*                        mOp;
     bool                          mRequestFlag;
     int                           mContentLength;
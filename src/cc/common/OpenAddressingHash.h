@@ -0,0 +1,557 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/16
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// Open addressing (linear probing) hash table with 32 bit item indexes, and
+// the supporting indexed item pool and index linked list.
+//
+// The items are allocated from the pool with large blocks, thus the item
+// addresses and indexes never change. The hash table slot is 8 bytes: 32 bit
+// item index and 32 bit hash tag. The tag comparison avoids dereferencing the
+// item with the probe sequence, therefore the lookup cost is typically single
+// dram cache miss on the table, plus one on the item. The hash low order bits
+// select the slot, thus with identity hash sequential keys, like chunk ids,
+// occupy adjacent slots, and have no collisions. The table grows
+// incrementally: the old table slots are moved into the new table with each
+// insert, in order to bound the insert latency with large tables.
+//
+// Unlike the LinearHash the overhead per item is on average less than 1.5
+// slots or 12 bytes, and there is no per item allocation overhead.
+//
+//----------------------------------------------------------------------------
+
+#ifndef OPEN_ADDRESSING_HASH_H
+#define OPEN_ADDRESSING_HASH_H
+
+#include "LinearHash.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace KFS
+{
+
+// Fixed size item pool. Items are addressed by 32 bit index. The items memory
+// is never released while the pool has items in use.
+template<typename T, std::size_t TBlockBits = 16>
+class IndexedPool
+{
+public:
+    typedef uint32_t    Index;
+    typedef std::size_t size_t;
+
+    static const Index kNullIndex = ~Index(0);
+    // Two high index values are reserved for the hash table slot encoding.
+    static const Index kMaxIndex  = ~Index(0) - 3;
+
+    IndexedPool()
+        : mBlocks(),
+          mFreeList(kNullIndex),
+          mNextIdx(0),
+          mInUseCount(0)
+        {}
+    ~IndexedPool()
+    {
+        if (mInUseCount > 0) {
+            return; // Memory leak
+        }
+        for (Blocks::const_iterator theIt = mBlocks.begin();
+                theIt != mBlocks.end();
+                ++theIt) {
+            delete [] *theIt;
+        }
+    }
+    Index Allocate()
+    {
+        Index theIdx;
+        if (mFreeList != kNullIndex) {
+            theIdx    = mFreeList;
+            mFreeList = *reinterpret_cast<const Index*>(GetPtr(theIdx));
+        } else {
+            if (kMaxIndex < mNextIdx) {
+                return kNullIndex;
+            }
+            if ((mNextIdx & (kBlockSize - 1)) == 0) {
+                mBlocks.push_back(new char[kBlockSize * sizeof(T)]);
+            }
+            theIdx = mNextIdx++;
+        }
+        mInUseCount++;
+        return theIdx;
+    }
+    void Deallocate(
+        Index inIdx)
+    {
+        assert(inIdx < mNextIdx && mInUseCount > 0);
+        *reinterpret_cast<Index*>(GetPtr(inIdx)) = mFreeList;
+        mFreeList = inIdx;
+        mInUseCount--;
+    }
+    T* Get(
+        Index inIdx) const
+        { return reinterpret_cast<T*>(GetPtr(inIdx)); }
+    size_t GetInUseCount() const
+        { return mInUseCount; }
+    size_t GetItemSize() const
+        { return sizeof(T); }
+    size_t GetStorageSize() const
+        { return (mBlocks.size() * kBlockSize * sizeof(T)); }
+private:
+    typedef std::vector<char*> Blocks;
+    enum { kBlockSize = size_t(1) << TBlockBits };
+
+    Blocks mBlocks;
+    Index  mFreeList;
+    Index  mNextIdx;
+    size_t mInUseCount;
+
+    char* GetPtr(
+        Index inIdx) const
+    {
+        return (mBlocks[inIdx >> TBlockBits] +
+            (inIdx & (kBlockSize - 1)) * sizeof(T));
+    }
+    IndexedPool(const IndexedPool&);
+    IndexedPool& operator=(const IndexedPool&);
+};
+
+// Doubly linked list with 32 bit indexes instead of pointers. Each node has
+// to have mPrevIdx[K] and mNextIdx[K] indexes, and NodeAccessorT::Get(index)
+// must return node reference. The node's own index is not stored: the node
+// that is in the list can be found from its predecessor, and the node that is
+// not in the list keeps its own index in mPrevIdx, with mNextIdx set to null.
+// The node initialized with Init(node) can not be inserted into the list, and
+// can only be used as the argument to IsInList() and Remove().
+// The API mirrors QCDLListOp.
+template <typename NodeT, typename NodeAccessorT, unsigned int ListT = 0>
+class IndexedDLListOp
+{
+public:
+    typedef uint32_t Index;
+
+    static const Index kNullIndex = ~Index(0);
+
+    static void Init(
+        NodeT& inNode)
+    {
+        inNode.mPrevIdx[ListT] = kNullIndex;
+        inNode.mNextIdx[ListT] = kNullIndex;
+    }
+    static void Init(
+        NodeT& inNode,
+        Index  inIdx)
+    {
+        inNode.mPrevIdx[ListT] = inIdx;
+        inNode.mNextIdx[ListT] = kNullIndex;
+    }
+    static Index GetIndex(
+        const NodeT& inNode)
+    {
+        return (inNode.mNextIdx[ListT] == kNullIndex ?
+            inNode.mPrevIdx[ListT] :
+            Get(inNode.mPrevIdx[ListT]).mNextIdx[ListT]);
+    }
+    static void Insert(
+        NodeT& inNode,
+        NodeT& inAfter)
+    {
+        if (&inNode == &inAfter) {
+            return;
+        }
+        const Index theIdx = GetIndex(inNode);
+        assert(theIdx != kNullIndex);
+        Unlink(inNode);
+        const Index theAfterIdx = GetIndex(inAfter);
+        assert(theAfterIdx != kNullIndex);
+        if (inAfter.mNextIdx[ListT] == kNullIndex) {
+            // Single node list.
+            inAfter.mNextIdx[ListT] = theAfterIdx;
+        }
+        NodeT& theNext = Get(inAfter.mNextIdx[ListT]);
+        inNode.mPrevIdx[ListT]  = theAfterIdx;
+        inNode.mNextIdx[ListT]  = inAfter.mNextIdx[ListT];
+        theNext.mPrevIdx[ListT] = theIdx;
+        inAfter.mNextIdx[ListT] = theIdx;
+    }
+    static void Remove(
+        NodeT& inNode)
+    {
+        if (inNode.mNextIdx[ListT] == kNullIndex) {
+            return;
+        }
+        const Index theIdx = GetIndex(inNode);
+        Unlink(inNode);
+        Init(inNode, theIdx);
+    }
+    static bool IsInList(
+        const NodeT& inNode)
+    {
+        return (
+            inNode.mNextIdx[ListT] != kNullIndex &&
+            &Get(inNode.mNextIdx[ListT]) != &inNode
+        );
+    }
+    static NodeT& GetPrev(
+        const NodeT& inNode)
+    {
+        return (inNode.mNextIdx[ListT] == kNullIndex ?
+            const_cast<NodeT&>(inNode) : Get(inNode.mPrevIdx[ListT]));
+    }
+    static NodeT& GetNext(
+        const NodeT& inNode)
+    {
+        return (inNode.mNextIdx[ListT] == kNullIndex ?
+            const_cast<NodeT&>(inNode) : Get(inNode.mNextIdx[ListT]));
+    }
+private:
+    static NodeT& Get(
+        Index inIdx)
+        { return NodeAccessorT::Get(inIdx); }
+    static void Unlink(
+        NodeT& inNode)
+    {
+        const Index thePrevIdx = inNode.mPrevIdx[ListT];
+        const Index theNextIdx = inNode.mNextIdx[ListT];
+        if (theNextIdx == kNullIndex) {
+            return;
+        }
+        Get(thePrevIdx).mNextIdx[ListT] = theNextIdx;
+        Get(theNextIdx).mPrevIdx[ListT] = thePrevIdx;
+    }
+};
+
+// The KVPairT must be constructible from (key, val, index), where index is the
+// item's pool index. The PoolAccessorT::GetPool() must return the pool
+// reference. The pool can be shared between multiple tables, and can contain
+// items that are not in any table.
+// Iteration with First() and Next() is stable with Erase(), but not with
+// Insert().
+template<
+  typename KVPairT,
+  typename PoolAccessorT,
+  typename KeyIdT          = KeyCompare<typename KVPairT::Key>,
+  typename DeleteObserverT = DeleteObserver<KVPairT>
+>
+class OpenAddressingHash
+{
+public:
+    typedef typename KVPairT::Key     Key;
+    typedef typename KVPairT::Val     Val;
+    typedef IndexedPool<KVPairT>      Allocator;
+    typedef typename Allocator::Index Index;
+    typedef std::size_t               size_t;
+
+    OpenAddressingHash()
+        : mTable(),
+          mOldTable(),
+          mSize(0),
+          mMigrateIdx(0),
+          mNextTable(0),
+          mNextIdx(0),
+          mKeyId(),
+          mDelObserverPtr(0)
+        {}
+    ~OpenAddressingHash()
+        { OpenAddressingHash::Clear(); }
+    void SetDeleteObserver(
+        DeleteObserverT* inObserverPtr)
+        { mDelObserverPtr = inObserverPtr; }
+    const Allocator& GetAllocator() const
+        { return GetPool(); }
+    size_t GetSize() const
+        { return mSize; }
+    bool IsEmpty() const
+        { return (mSize <= 0); }
+    size_t GetTableByteCount() const
+        { return ((mTable.mCapacity + mOldTable.mCapacity) * sizeof(Slot)); }
+    void Clear()
+    {
+        ClearTable(mOldTable);
+        ClearTable(mTable);
+        mSize       = 0;
+        mMigrateIdx = 0;
+        mNextTable  = 0;
+        mNextIdx    = 0;
+    }
+    Val* Find(
+        const Key& inKey) const
+    {
+        if (IsEmpty()) {
+            return 0;
+        }
+        const uint64_t theHash = Hash(inKey);
+        const Slot*    thePtr  = Lookup(mTable, inKey, theHash);
+        if (! thePtr && mOldTable.mSlots) {
+            thePtr = Lookup(mOldTable, inKey, theHash);
+        }
+        return (thePtr ? &(GetItem(*thePtr).GetVal()) : 0);
+    }
+    Val* Insert(
+        const Key& inKey,
+        const Val& inVal,
+        bool&      outInsertedFlag)
+    {
+        outInsertedFlag = false;
+        const uint64_t theHash = Hash(inKey);
+        if (! IsEmpty()) {
+            const Slot* thePtr = Lookup(mTable, inKey, theHash);
+            if (! thePtr && mOldTable.mSlots) {
+                thePtr = Lookup(mOldTable, inKey, theHash);
+            }
+            if (thePtr) {
+                return &(GetItem(*thePtr).GetVal());
+            }
+        }
+        if (mTable.mCapacity * kMaxLoadNum <=
+                (mTable.mUsed + 1) * kMaxLoadDen) {
+            Grow();
+        }
+        Allocator&  thePool = GetPool();
+        const Index theIdx  = thePool.Allocate();
+        if (theIdx == Allocator::kNullIndex) {
+            return 0;
+        }
+        KVPairT* const theItemPtr =
+            new (thePool.Get(theIdx)) KVPairT(inKey, inVal, theIdx);
+        Put(mTable, theHash, theIdx);
+        mSize++;
+        outInsertedFlag = true;
+        Migrate(kMigrateStep);
+        return &(theItemPtr->GetVal());
+    }
+    size_t Erase(
+        const Key& inKey)
+    {
+        if (IsEmpty()) {
+            return 0;
+        }
+        const uint64_t theHash = Hash(inKey);
+        Slot*          thePtr  = Lookup(mTable, inKey, theHash);
+        if (! thePtr && mOldTable.mSlots) {
+            thePtr = Lookup(mOldTable, inKey, theHash);
+        }
+        if (! thePtr) {
+            return 0;
+        }
+        const Index theIdx = GetIndex(*thePtr);
+        *thePtr = kTombstone;
+        mSize--;
+        Delete(theIdx);
+        return 1;
+    }
+    void First()
+    {
+        mNextTable = 0;
+        mNextIdx   = 0;
+    }
+    const KVPairT* Next()
+    {
+        for (; mNextTable < 2; mNextTable++, mNextIdx = 0) {
+            const Table& theTable = mNextTable == 0 ? mOldTable : mTable;
+            while (mNextIdx < theTable.mCapacity) {
+                const Slot theSlot = theTable.mSlots[mNextIdx++];
+                if (IsItem(theSlot)) {
+                    return &GetItem(theSlot);
+                }
+            }
+        }
+        return 0;
+    }
+private:
+    // The slot contains 32 bit hash tag in the high order bits, and the item
+    // index plus 2 in the low order bits. 0 is empty slot, 1 is deleted slot.
+    typedef uint64_t Slot;
+    struct Table
+    {
+        Table()
+            : mSlots(0),
+              mCapacity(0),
+              mUsed(0)
+            {}
+        Slot*  mSlots;
+        size_t mCapacity;
+        size_t mUsed;     // Items and deleted slots.
+    };
+    enum
+    {
+        kMinCapacity = 64,
+        kMaxLoadNum  = 7,   // Max load factor 7/8.
+        kMaxLoadDen  = 8,
+        // Number of the old table slots moved with each insert. With the new
+        // table load factor 7/16 after resize, the migration completes long
+        // before the new table needs to grow.
+        kMigrateStep = 8
+    };
+    static const Slot kEmpty     = 0;
+    static const Slot kTombstone = 1;
+
+    Table            mTable;
+    Table            mOldTable;
+    size_t           mSize;
+    size_t           mMigrateIdx;
+    int              mNextTable; // Cursor.
+    size_t           mNextIdx;   // Cursor.
+    KeyIdT           mKeyId;
+    DeleteObserverT* mDelObserverPtr;
+
+    static Allocator& GetPool()
+        { return PoolAccessorT::GetPool(); }
+    static bool IsItem(
+        Slot inSlot)
+        { return (kTombstone < (inSlot & 0xFFFFFFFF)); }
+    static Index GetIndex(
+        Slot inSlot)
+        { return (Index)((inSlot & 0xFFFFFFFF) - 2); }
+    static uint32_t GetTag(
+        uint64_t inHash)
+        { return (uint32_t)(inHash ^ (inHash >> 32)); }
+    static Slot MakeSlot(
+        uint64_t inHash,
+        Index    inIdx)
+        { return ((Slot(GetTag(inHash)) << 32) | (Slot(inIdx) + 2)); }
+    static KVPairT& GetItem(
+        Slot inSlot)
+        { return *GetPool().Get(GetIndex(inSlot)); }
+    uint64_t Hash(
+        const Key& inKey) const
+    {
+        // No mixing: the key order is preserved in the table in order to keep
+        // the locality of the sequential keys. The keys with the same low
+        // order bits go into the same probe sequence, and have different tags.
+        return (uint64_t)mKeyId.Hash(inKey);
+    }
+    Slot* Lookup(
+        const Table& inTable,
+        const Key&   inKey,
+        uint64_t     inHash) const
+    {
+        if (! inTable.mSlots) {
+            return 0;
+        }
+        const size_t   theMask = inTable.mCapacity - 1;
+        const uint32_t theTag  = GetTag(inHash);
+        for (size_t theIdx = (size_t)inHash & theMask; ;
+                theIdx = (theIdx + 1) & theMask) {
+            Slot& theSlot = inTable.mSlots[theIdx];
+            if (theSlot == kEmpty) {
+                return 0;
+            }
+            if (IsItem(theSlot) && (uint32_t)(theSlot >> 32) == theTag &&
+                    mKeyId.Equals(inKey, GetItem(theSlot).GetKey())) {
+                return &theSlot;
+            }
+        }
+    }
+    static void Put(
+        Table&   inTable,
+        uint64_t inHash,
+        Index    inIdx)
+    {
+        // The key is known not to be in the table, use first empty or
+        // deleted slot.
+        const size_t theMask = inTable.mCapacity - 1;
+        for (size_t theIdx = (size_t)inHash & theMask; ;
+                theIdx = (theIdx + 1) & theMask) {
+            Slot& theSlot = inTable.mSlots[theIdx];
+            if (! IsItem(theSlot)) {
+                if (theSlot == kEmpty) {
+                    inTable.mUsed++;
+                }
+                theSlot = MakeSlot(inHash, inIdx);
+                return;
+            }
+        }
+    }
+    void Grow()
+    {
+        // Finish the previous migration, if any. This isn't expected to
+        // happen with the present migration step and load factor.
+        Migrate(mOldTable.mCapacity);
+        // Size the table by the number of items, the resize also purges
+        // deleted slots.
+        size_t theCapacity = kMinCapacity;
+        while (theCapacity * kMaxLoadNum < (mSize + 1) * 2 * kMaxLoadDen) {
+            theCapacity += theCapacity;
+        }
+        mOldTable = mTable;
+        mTable.mSlots    = new Slot[theCapacity];
+        mTable.mCapacity = theCapacity;
+        mTable.mUsed     = 0;
+        memset(mTable.mSlots, 0, theCapacity * sizeof(mTable.mSlots[0]));
+        mMigrateIdx = 0;
+    }
+    void Migrate(
+        size_t inCount)
+    {
+        if (! mOldTable.mSlots) {
+            return;
+        }
+        const size_t theEnd = mOldTable.mCapacity - mMigrateIdx <= inCount ?
+            mOldTable.mCapacity : mMigrateIdx + inCount;
+        while (mMigrateIdx < theEnd) {
+            Slot& theSlot = mOldTable.mSlots[mMigrateIdx++];
+            if (IsItem(theSlot)) {
+                const Index theIdx = GetIndex(theSlot);
+                Put(mTable, Hash(GetPool().Get(theIdx)->GetKey()), theIdx);
+                theSlot = kTombstone;
+            }
+        }
+        if (mOldTable.mCapacity <= mMigrateIdx) {
+            delete [] mOldTable.mSlots;
+            mOldTable   = Table();
+            mMigrateIdx = 0;
+        }
+    }
+    void Delete(
+        Index inIdx)
+    {
+        Allocator& thePool = GetPool();
+        KVPairT&   theItem = *thePool.Get(inIdx);
+        if (mDelObserverPtr) {
+            (*mDelObserverPtr)(theItem);
+        }
+        theItem.~KVPairT();
+        thePool.Deallocate(inIdx);
+    }
+    void ClearTable(
+        Table& inTable)
+    {
+        for (size_t i = 0; i < inTable.mCapacity; i++) {
+            const Slot theSlot = inTable.mSlots[i];
+            if (IsItem(theSlot)) {
+                inTable.mSlots[i] = kTombstone;
+                Delete(GetIndex(theSlot));
+            }
+        }
+        delete [] inTable.mSlots;
+        inTable = Table();
+    }
+    OpenAddressingHash(const OpenAddressingHash&);
+    OpenAddressingHash& operator=(const OpenAddressingHash&);
+};
+
+} // namespace KFS
+
+#endif /* OPEN_ADDRESSING_HASH_H */
@@ -75,6 +75,8 @@ const size_t CHUNKSIZE = 64u << 20; //!< (64MB)
 const int MAX_RPC_HEADER_LEN = 16 << 10; //!< Max length of header in RPC req/response
 const size_t MAX_FILE_NAME_LENGTH = 4 << 10;
 const size_t MAX_PATH_NAME_LENGTH = MAX_FILE_NAME_LENGTH * 3;
+const int MAX_LOOKUP_BATCH_ENTRIES = 16 << 10; //!< Max entries in batch lookup
+const int MAX_LOOKUP_BATCH_CONTENT_LENGTH = 4 << 20; //!< Max batch lookup request
 const short int NUM_REPLICAS_PER_FILE = 3; //!< default degree of replication
 const short int MAX_REPLICAS_PER_FILE = 64; //!< max. replicas per chunk of file
 
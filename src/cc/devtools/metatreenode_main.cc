@@ -0,0 +1,274 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/16
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Meta tree node fanout performance test: builds fully packed trees
+// with different node fanouts, and reports memory per entry, tree height,
+// and lookup latency. The node key search is validated against
+// std::lower_bound, and the vector compare key search against the scalar
+// one.
+//
+//----------------------------------------------------------------------------
+
+#include "meta/kfstree.h"
+#include "common/time.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+namespace KFS
+{
+using std::cout;
+using std::cerr;
+using std::setw;
+using std::vector;
+using std::sort;
+using std::lower_bound;
+
+typedef vector<Key> Keys;
+
+static inline uint64_t
+Rand64(uint64_t& state)
+{
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ull;
+}
+
+static bool
+ValidateSearch(const Keys& keys, uint64_t& rnd)
+{
+    const int kMaxLen = 256;
+    uint64_t  hi[kMaxLen];
+    uint64_t  lo[kMaxLen];
+    for (int i = 0; i < 20000; i++) {
+        const int   len   = (int)(Rand64(rnd) % kMaxLen);
+        const size_t start = (size_t)(Rand64(rnd) % (keys.size() - len));
+        for (int k = 0; k < len; k++) {
+            hi[k] = keys[start + k].getHi();
+            lo[k] = keys[start + k].getLo();
+        }
+        const Key& test = keys[(size_t)(Rand64(rnd) % keys.size())];
+        const int  pos  = keyLowerBound(hi, lo, len,
+            test.getHi(), test.getLo(), test.getLoMask());
+        const Key* const b = &keys[start];
+        if (pos != lower_bound(b, b + len, test) - b) {
+            cerr << "key search mismatch: len: " << len << "\n";
+            return false;
+        }
+        if (pos != keyLowerBoundScalar(hi, lo, len,
+                test.getHi(), test.getLo(), test.getLoMask())) {
+            cerr << "scalar key search mismatch: len: " << len << "\n";
+            return false;
+        }
+        const PartialMatch pm(KFS_DENTRY, (KeyData)(Rand64(rnd) % 1024));
+        const int ppos = keyLowerBound(hi, lo, len,
+            pm.getHi(), pm.getLo(), pm.getLoMask());
+        if (ppos != lower_bound(b, b + len, pm) - b) {
+            cerr << "partial key search mismatch: len: " << len << "\n";
+            return false;
+        }
+        if (ppos != keyLowerBoundScalar(hi, lo, len,
+                pm.getHi(), pm.getLo(), pm.getLoMask())) {
+            cerr << "scalar partial key search mismatch: len: " << len <<
+                "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+template<int TNKey>
+class TreeBench
+{
+public:
+    typedef NodeT<TNKey> TNode;
+
+    TreeBench()
+        : mLevels(),
+          mNodeCount(0)
+        {}
+    void Run(const Keys& keys, const Keys& probes)
+    {
+        const int64_t start = microseconds();
+        for (typename Keys::const_iterator it = keys.begin();
+                it != keys.end();
+                ++it) {
+            Append(*it, 0, 0);
+        }
+        TNode* const root = Finish();
+        const int64_t built = microseconds();
+        size_t found = 0;
+        for (typename Keys::const_iterator it = probes.begin();
+                it != probes.end();
+                ++it) {
+            TNode* n = root;
+            int    p = n->findplace(*it);
+            while (! n->hasleaves()) {
+                n = n->child(p);
+                p = n->findplace(*it);
+            }
+            if (p < n->children() && n->getkey(p) == *it) {
+                found++;
+            }
+        }
+        const int64_t end = microseconds();
+        if (found != probes.size()) {
+            cerr << "fanout: " << TNKey << " lookup failures: " <<
+                (probes.size() - found) << "\n";
+        }
+        cout <<
+            "fanout: "          << setw(4) << TNKey <<
+            " node size: "      << setw(6) << sizeof(TNode) <<
+            " height: "         << setw(2) << mLevels.size() <<
+            " bytes per entry: " << setw(6) << std::fixed <<
+                std::setprecision(2) <<
+                (double)mNodeCount * sizeof(TNode) / keys.size() <<
+            " build: "          << setw(8) <<
+                (built - start) * 1e-3 << " ms." <<
+            " lookup: "         << setw(8) <<
+                (end - built) * 1e3 / probes.size() << " ns." <<
+        "\n";
+    }
+private:
+    vector<TNode*> mLevels;
+    size_t         mNodeCount;
+
+    void Append(const Key& k, MetaNode* child, size_t level)
+    {
+        if (mLevels.size() <= level) {
+            mLevels.push_back(Create(level));
+        }
+        TNode* n = mLevels[level];
+        if (n->isfull()) {
+            TNode* const brother = Create(level);
+            n->linkToPeer(brother);
+            mLevels[level] = brother;
+            Append(n->keySelf(), n, level + 1);
+            n = brother;
+        }
+        n->appendChild(k, child);
+    }
+    TNode* Finish()
+    {
+        size_t level = 0;
+        for (; level + 1 < mLevels.size(); level++) {
+            Append(mLevels[level]->keySelf(), mLevels[level], level + 1);
+        }
+        return mLevels[level];
+    }
+    TNode* Create(size_t level)
+    {
+        mNodeCount++;
+        return TNode::create(level == 0 ? META_LEVEL1 : 0);
+    }
+private:
+    TreeBench(const TreeBench&);
+    TreeBench& operator=(const TreeBench&);
+};
+
+static int
+MetaTreeNodeMain(int argc, char** argv)
+{
+    int    optchar;
+    bool   help    = false;
+    int    status  = 0;
+    size_t count   = 4 << 20;
+    size_t lookups = 4 << 20;
+    bool   validateOnlyFlag = false;
+
+    while ((optchar = getopt(argc, argv, "hcn:l:")) != -1) {
+        switch (optchar) {
+            case 'c':
+                validateOnlyFlag = true;
+                break;
+            case 'n':
+                count = (size_t)atof(optarg);
+                break;
+            case 'l':
+                lookups = (size_t)atof(optarg);
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                status = 1;
+                break;
+        }
+    }
+    if (help || status != 0 || count < 1024 || lookups <= 0) {
+        (status ? cerr : cout) << "Usage: " << argv[0] <<
+            " [-n <number of keys> default: 4M, min 1024]"
+            " [-l <number of lookups> default: 4M]"
+            " [-c validate key search only]\n"
+            "Meta tree node fanout memory use and lookup performance test.\n"
+        ;
+        return (help ? 0 : 1);
+    }
+    // Directory entry keys: ~8 entries per directory.
+    uint64_t rnd = 0x9E3779B97F4A7C15ull;
+    Keys     keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        keys.push_back(Key(KFS_DENTRY,
+            (KeyData)(Rand64(rnd) % (count / 8 + 1)),
+            (KeyData)(Rand64(rnd) & 0xFFFFFFFF) << 4));
+    }
+    sort(keys.begin(), keys.end());
+    Keys probes;
+    probes.reserve(lookups);
+    for (size_t i = 0; i < lookups; i++) {
+        probes.push_back(keys[(size_t)(Rand64(rnd) % count)]);
+    }
+    if (! ValidateSearch(keys, rnd)) {
+        return 1;
+    }
+    cout << "keys: " << count << " lookups: " << lookups <<
+        " search: " << (keyLowerBoundIsSimd() ? "sse4.2" : "scalar") <<
+    "\n";
+    if (validateOnlyFlag) {
+        cout << "key search validation passed\n";
+        return 0;
+    }
+    TreeBench<8>().Run(keys, probes);
+    TreeBench<16>().Run(keys, probes);
+    TreeBench<32>().Run(keys, probes);
+    TreeBench<64>().Run(keys, probes);
+    TreeBench<128>().Run(keys, probes);
+    TreeBench<256>().Run(keys, probes);
+    return 0;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+    return KFS::MetaTreeNodeMain(argc, argv);
+}
@@ -34,14 +34,22 @@
 #include "common/StBuffer.h"
 #include "meta/kfstree.h"
 #include "meta/util.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/qcstutils.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <zlib.h>
 
 #include <algorithm>
 #include <cerrno>
 #include <fstream>
+#include <sstream>
+#include <deque>
 #include <boost/bind.hpp>
 
 namespace KFS
@@ -51,6 +59,8 @@ using std::string;
 using std::ifstream;
 using std::for_each;
 using std::ofstream;
+using std::ostringstream;
+using std::deque;
 using boost::bind;
 
 static inline ChunkServerEmulator&
@@ -59,47 +69,393 @@ GetCSEmulator(ChunkServer& server)
     return static_cast<ChunkServerEmulator&>(server);
 }
 
+template<typename T> static void
+PutVal(char*& ioPtr, T val)
+{
+    char* const endPtr = ioPtr + sizeof(val);
+    char*       ptr    = endPtr;
+    while (ioPtr < ptr) {
+        *--ptr = (char)(val & 0xFF);
+        val >>= 8;
+    }
+    ioPtr = endPtr;
+}
+
+template<typename T> static void
+GetVal(const char*& ioPtr, T& outVal)
+{
+    const char*       ptr    = ioPtr;
+    ioPtr += sizeof(outVal);
+    const char* const endPtr = ioPtr;
+    outVal = 0;
+    while (ptr < endPtr) {
+        outVal <<= 8;
+        outVal |= (*ptr++ & 0xFF);
+    }
+}
+
+static int
+ReadFully(int fd, char* buf, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len) {
+        const ssize_t nrd = read(fd, buf + pos, len - pos);
+        if (nrd < 0) {
+            const int err = errno;
+            return (err > 0 ? -err : -EIO);
+        }
+        if (nrd == 0) {
+            break;
+        }
+        pos += nrd;
+    }
+    return (int)pos;
+}
+
+/*
+ * Parallel chunk map loader. The chunk map is split into sections: at the
+ * line boundaries with the text format, and by blocks with the binary
+ * format. The worker threads read the sections sequentially, and parse
+ * sections in parallel into chunk ids and server lists. The server location
+ * to server lookup is done by the workers as well, as the location map does
+ * not change during the load. The main thread applies the parsed sections in
+ * the file order, therefore the result is the same as with the sequential
+ * load.
+ */
+class LayoutEmulator::ChunkmapLoader : public QCRunnable
+{
+public:
+    ChunkmapLoader(
+        LayoutEmulator& emulator,
+        const string&   name,
+        int             fd,
+        int             threadCount,
+        bool            addChunksToReplicationChecker)
+        : QCRunnable(),
+          mEmulator(emulator),
+          mName(name),
+          mFd(fd),
+          mThreadCount(max(1, threadCount)),
+          mMaxPending((size_t)mThreadCount * 2 + 2),
+          mAddChunksToReplicationCheckerFlag(addChunksToReplicationChecker),
+          mBinaryFlag(false),
+          mMutex(),
+          mReadMutex(),
+          mDoneCond(),
+          mSpaceCond(),
+          mThreads(0),
+          mSections(),
+          mCarry(),
+          mServerTable(),
+          mLineCount(0),
+          mReadEofFlag(false),
+          mEofFlag(false),
+          mStopFlag(false)
+        {}
+    ~ChunkmapLoader()
+    {
+        Stop();
+        delete [] mThreads;
+        for (Sections::iterator it = mSections.begin();
+                it != mSections.end();
+                ++it) {
+            delete *it;
+        }
+    }
+    int Load();
+    virtual void Run();
+private:
+    enum
+    {
+        kSectionSize    = 4 << 20,
+        kMaxLineSize    = 256 << 10,
+        kMaxBlockSize   = 256 << 20,
+        kMaxHostNameLen = 4 << 10
+    };
+    typedef vector<const ChunkServerPtr*> SectionServers;
+    struct Section
+    {
+        Section()
+            : mData(),
+              mChunkIds(),
+              mServerCounts(),
+              mServers(),
+              mLineCount(0),
+              mErrorLine(),
+              mStatus(0),
+              mDoneFlag(false)
+            {}
+        string            mData;
+        vector<chunkId_t> mChunkIds;
+        vector<uint16_t>  mServerCounts;
+        SectionServers    mServers;
+        size_t            mLineCount;
+        string            mErrorLine;
+        int               mStatus;
+        bool              mDoneFlag;
+    };
+    typedef deque<Section*>               Sections;
+    typedef vector<const ChunkServerPtr*> ServerTable;
+
+    LayoutEmulator& mEmulator;
+    const string    mName;
+    const int       mFd;
+    const int       mThreadCount;
+    const size_t    mMaxPending;
+    const bool      mAddChunksToReplicationCheckerFlag;
+    bool            mBinaryFlag;
+    QCMutex         mMutex;
+    QCMutex         mReadMutex;
+    QCCondVar       mDoneCond;
+    QCCondVar       mSpaceCond;
+    QCThread*       mThreads;
+    Sections        mSections;
+    string          mCarry;
+    ServerTable     mServerTable;
+    size_t          mLineCount;
+    bool            mReadEofFlag;
+    bool            mEofFlag;
+    bool            mStopFlag;
+
+    int ReadHeader();
+    int Read(Section& section);
+    int ReadText(Section& section);
+    int ReadBlock(Section& section);
+    void Parse(Section& section);
+    bool ParseLine(const char* p, const char* end, Section& section,
+        ServerLocation& loc);
+    bool ParseBlock(Section& section);
+    bool Apply(const Section& section);
+    void Stop()
+    {
+        if (! mThreads) {
+            return;
+        }
+        QCStMutexLocker locker(mMutex);
+        mStopFlag = true;
+        mSpaceCond.NotifyAll();
+        locker.Unlock();
+        for (int i = 0; i < mThreadCount; i++) {
+            if (mThreads[i].IsStarted()) {
+                mThreads[i].Join();
+            }
+        }
+    }
+private:
+    ChunkmapLoader(const ChunkmapLoader&);
+    ChunkmapLoader& operator=(const ChunkmapLoader&);
+};
+
+/*
+ * Detect the chunk map format, and load the binary format server table.
+ * With the text format the bytes read are carried over into the first
+ * section.
+ */
 int
-LayoutEmulator::LoadChunkmap(
-    const string& chunkLocationFn, bool addChunksToReplicationChecker)
+LayoutEmulator::ChunkmapLoader::ReadHeader()
 {
-    ifstream file(chunkLocationFn.c_str());
-    if (! file) {
-        const int err = errno;
-        KFS_LOG_STREAM_INFO << chunkLocationFn << ": " << strerror(err) <<
+    char buf[3 * sizeof(uint32_t)];
+    int  nrd = ReadFully(mFd, buf, sizeof(uint32_t));
+    if (nrd < 0) {
+        return nrd;
+    }
+    const char* ptr   = buf;
+    uint32_t    magic = 0;
+    if ((size_t)nrd < sizeof(magic) ||
+            (GetVal(ptr, magic), magic != (uint32_t)kBinaryChunkmapMagic)) {
+        mCarry.assign(buf, nrd);
+        mReadEofFlag = (size_t)nrd < sizeof(magic);
+        return 0;
+    }
+    mBinaryFlag = true;
+    if ((nrd = ReadFully(mFd, buf, 2 * sizeof(uint32_t))) !=
+            (int)(2 * sizeof(uint32_t))) {
+        return (nrd < 0 ? nrd : -EINVAL);
+    }
+    ptr = buf;
+    uint32_t version = 0;
+    uint32_t count   = 0;
+    GetVal(ptr, version);
+    GetVal(ptr, count);
+    if (version != (uint32_t)kBinaryChunkmapVersion) {
+        KFS_LOG_STREAM_ERROR << mName <<
+            ": unsupported version: " << version <<
         KFS_LOG_EOM;
-        return (err > 0 ? -err : -1);
+        return -EINVAL;
     }
-    const size_t       kMaxLineSize = 256 << 10;
-    StBufferT<char, 1> buf;
-    char* const        line         = buf.Resize(kMaxLineSize);
-    size_t             lineno       = 1;
-    size_t             len          = 0;
-    ServerLocation     loc;
-    line[0] = 0;
-    while (file.getline(line, kMaxLineSize) &&
-            (len = file.gcount()) < kMaxLineSize - 1 &&
-            Parse(line, len, addChunksToReplicationChecker, loc)) {
-        lineno++;
+    mServerTable.reserve(count);
+    ServerLocation loc;
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t len = 0;
+        if ((nrd = ReadFully(mFd, buf, sizeof(len))) != (int)sizeof(len)) {
+            return (nrd < 0 ? nrd : -EINVAL);
+        }
+        ptr = buf;
+        GetVal(ptr, len);
+        if (kMaxHostNameLen < len) {
+            return -EINVAL;
+        }
+        loc.hostname.resize(len);
+        if (0 < len && (nrd = ReadFully(mFd, &loc.hostname[0], len)) !=
+                (int)len) {
+            return (nrd < 0 ? nrd : -EINVAL);
+        }
+        if ((nrd = ReadFully(mFd, buf, 2 * sizeof(int32_t))) !=
+                (int)(2 * sizeof(int32_t))) {
+            return (nrd < 0 ? nrd : -EINVAL);
+        }
+        ptr = buf;
+        int32_t port = 0;
+        GetVal(ptr, port);
+        loc.port = port;
+        Loc2Server::const_iterator const it = mEmulator.mLoc2Server.find(loc);
+        if (it == mEmulator.mLoc2Server.end()) {
+            KFS_LOG_STREAM_ERROR << mName <<
+                ": no such server: " << loc <<
+            KFS_LOG_EOM;
+            mServerTable.push_back(0);
+        } else {
+            mServerTable.push_back(&it->second);
+        }
     }
-    const bool badFlag = file.bad();
-    if (! badFlag && file.eof()) {
-        return 0;
+    return 0;
+}
+
+int
+LayoutEmulator::ChunkmapLoader::Read(Section& section)
+{
+    return (mBinaryFlag ? ReadBlock(section) : ReadText(section));
+}
+
+/*
+ * Read next text section. The section ends at the line boundary.
+ * Return 0 on success, 1 on eof, and negative error code on failure.
+ */
+int
+LayoutEmulator::ChunkmapLoader::ReadText(Section& section)
+{
+    if (mReadEofFlag && mCarry.empty()) {
+        return 1;
+    }
+    string& data = section.mData;
+    data.swap(mCarry);
+    mCarry.clear();
+    while (! mReadEofFlag) {
+        const size_t size = data.size();
+        data.resize(size + kSectionSize);
+        const ssize_t nrd = read(mFd, &data[size], kSectionSize);
+        if (nrd < 0) {
+            const int err = errno;
+            data.resize(size);
+            KFS_LOG_STREAM_ERROR << mName << ": " << strerror(err) <<
+            KFS_LOG_EOM;
+            mReadEofFlag = true;
+            return (err > 0 ? -err : -EIO);
+        }
+        data.resize(size + nrd);
+        mReadEofFlag = nrd == 0;
+        if (! mReadEofFlag) {
+            const size_t pos = data.rfind('\n');
+            if (pos == string::npos) {
+                if (size_t(kMaxLineSize) <= data.size()) {
+                    KFS_LOG_STREAM_ERROR << mName <<
+                        ": line exceeds max size: " << kMaxLineSize <<
+                    KFS_LOG_EOM;
+                    mReadEofFlag = true;
+                    return -EINVAL;
+                }
+                continue;
+            }
+            mCarry.assign(data, pos + 1, string::npos);
+            data.resize(pos + 1);
+        }
+        break;
+    }
+    return (data.empty() ? 1 : 0);
+}
+
+int
+LayoutEmulator::ChunkmapLoader::ReadBlock(Section& section)
+{
+    if (mReadEofFlag) {
+        return 1;
+    }
+    char      header[kBinaryChunkmapBlockHeaderSize];
+    const int nrd = ReadFully(mFd, header, sizeof(header));
+    if (nrd == 0) {
+        mReadEofFlag = true;
+        return 1;
+    }
+    if (nrd != (int)sizeof(header)) {
+        mReadEofFlag = true;
+        KFS_LOG_STREAM_ERROR << mName << ": " <<
+            (nrd < 0 ? strerror(-nrd) : "truncated block header") <<
+        KFS_LOG_EOM;
+        return (nrd < 0 ? nrd : -EINVAL);
+    }
+    const char* ptr   = header;
+    uint32_t    magic = 0;
+    uint32_t    count = 0;
+    uint32_t    len   = 0;
+    GetVal(ptr, magic);
+    GetVal(ptr, count);
+    GetVal(ptr, len);
+    if (magic != (uint32_t)kBinaryChunkmapBlockMagic || kMaxBlockSize < len) {
+        mReadEofFlag = true;
+        KFS_LOG_STREAM_ERROR << mName << ": invalid block header" <<
+        KFS_LOG_EOM;
+        return -EINVAL;
+    }
+    // Keep the header, the block is validated by the parser.
+    string& data = section.mData;
+    data.resize(sizeof(header) + len);
+    memcpy(&data[0], header, sizeof(header));
+    const int res = len <= 0 ? 0 :
+        ReadFully(mFd, &data[sizeof(header)], len);
+    if (res != (int)len) {
+        mReadEofFlag = true;
+        KFS_LOG_STREAM_ERROR << mName << ": " <<
+            (res < 0 ? strerror(-res) : "truncated block") <<
+        KFS_LOG_EOM;
+        return (res < 0 ? res : -EINVAL);
+    }
+    return 0;
+}
+
+void
+LayoutEmulator::ChunkmapLoader::Parse(Section& section)
+{
+    if (mBinaryFlag) {
+        section.mStatus = ParseBlock(section) ? 0 : -EINVAL;
+        return;
+    }
+    const char*       p   = section.mData.data();
+    const char* const end = p + section.mData.size();
+    ServerLocation    loc;
+    section.mChunkIds.reserve(section.mData.size() / 64);
+    section.mServerCounts.reserve(section.mData.size() / 64);
+    section.mServers.reserve(section.mData.size() / 32);
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (! eol) {
+            eol = end;
+        }
+        if (! ParseLine(p, eol, section, loc)) {
+            section.mErrorLine.assign(p, eol - p);
+            section.mStatus = -EINVAL;
+            return;
+        }
+        section.mLineCount++;
+        p = eol + 1;
     }
-    const int err = badFlag ? errno : EINVAL;
-    KFS_LOG_STREAM_ERROR << chunkLocationFn << ":" << lineno <<
-        (badFlag ? " " : " malformed: ") <<
-        (badFlag ? strerror(err) : line ) <<
-    KFS_LOG_EOM;
-    return (err > 0 ? -err : -1);
 }
 
 bool
-LayoutEmulator::Parse(
-    const char*       line,
-    size_t            size,
-    bool              addChunksToReplicationChecker,
-    ServerLocation&   loc)
+LayoutEmulator::ChunkmapLoader::ParseLine(
+    const char*     line,
+    const char*     end,
+    Section&        section,
+    ServerLocation& loc)
 {
     // format of the file:
     // <chunkid> <fileid> <# of servers> [server location]
@@ -111,17 +467,14 @@ LayoutEmulator::Parse(
     fid_t              fid;
     int                numServers;
     const char*        p   = line;
-    const char* const  end = p + size;
     if (! DecIntParser::Parse(p, end - p, cid) ||
             ! DecIntParser::Parse(p, end - p, fid) ||
-            ! DecIntParser::Parse(p, end - p, numServers)) {
+            ! DecIntParser::Parse(p, end - p, numServers) ||
+            numServers < 0 || 0xFFFF < numServers) {
         return false;
     }
-    CSMap::Entry* const ci = mChunkToServerMap.Find(cid);
-    if (! ci) {
-        KFS_LOG_STREAM_ERROR << "no such chunk: " << cid << KFS_LOG_EOM;
-        return true;
-    }
+    section.mChunkIds.push_back(cid);
+    section.mServerCounts.push_back((uint16_t)numServers);
     for (int i = 0; i < numServers; i++) {
         while (p < end && (*p & 0xFF) <= ' ') {
             p++;
@@ -150,28 +503,342 @@ LayoutEmulator::Parse(
         while (p < end && (*p & 0xFF) > ' ') {
             p++;
         }
-        Loc2Server::const_iterator const it = mLoc2Server.find(loc);
-        if (it == mLoc2Server.end()) {
+        Loc2Server::const_iterator const it = mEmulator.mLoc2Server.find(loc);
+        if (it == mEmulator.mLoc2Server.end()) {
             KFS_LOG_STREAM_ERROR <<
                 "chunk: " << cid <<
                 " no such server: "  << loc <<
             KFS_LOG_EOM;
+            section.mServers.push_back(0);
+        } else {
+            section.mServers.push_back(&it->second);
+        }
+    }
+    return true;
+}
+
+bool
+LayoutEmulator::ChunkmapLoader::ParseBlock(Section& section)
+{
+    const string&     data   = section.mData;
+    const char*       ptr    = data.data();
+    const char* const endPtr = ptr + data.size();
+    uint32_t          magic  = 0;
+    uint32_t          count  = 0;
+    uint32_t          len    = 0;
+    uint32_t          crc    = 0;
+    GetVal(ptr, magic);
+    GetVal(ptr, count);
+    GetVal(ptr, len);
+    GetVal(ptr, crc);
+    if (crc != (uint32_t)crc32(crc32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(ptr), (uInt)len)) {
+        section.mErrorLine = "block checksum mismatch";
+        return false;
+    }
+    section.mChunkIds.reserve(count);
+    section.mServerCounts.reserve(count);
+    const size_t kFixedSize = 2 * sizeof(int64_t) + sizeof(uint16_t);
+    for (uint32_t i = 0; i < count; i++) {
+        if (endPtr < ptr + kFixedSize) {
+            section.mErrorLine = "truncated record";
+            return false;
+        }
+        int64_t  cid = 0;
+        int64_t  fid = 0;
+        uint16_t n   = 0;
+        GetVal(ptr, cid);
+        GetVal(ptr, fid);
+        GetVal(ptr, n);
+        if (endPtr < ptr + n * sizeof(uint32_t)) {
+            section.mErrorLine = "truncated record";
+            return false;
+        }
+        section.mChunkIds.push_back((chunkId_t)cid);
+        section.mServerCounts.push_back(n);
+        for (uint16_t k = 0; k < n; k++) {
+            uint32_t idx = 0;
+            GetVal(ptr, idx);
+            if (mServerTable.size() <= idx) {
+                section.mErrorLine = "invalid server index";
+                return false;
+            }
+            section.mServers.push_back(mServerTable[idx]);
+        }
+        section.mLineCount++;
+    }
+    if (ptr != endPtr) {
+        section.mErrorLine = "invalid block length";
+        return false;
+    }
+    return true;
+}
+
+bool
+LayoutEmulator::ChunkmapLoader::Apply(const Section& section)
+{
+    if (section.mStatus != 0) {
+        KFS_LOG_STREAM_ERROR << mName << ":" <<
+            (mLineCount + section.mLineCount + 1) <<
+            (mBinaryFlag ? " record" : "") <<
+            (section.mStatus == -EINVAL ? " malformed: " : " ") <<
+            (section.mErrorLine.empty() ?
+                strerror(-section.mStatus) : section.mErrorLine.c_str()) <<
+        KFS_LOG_EOM;
+        return false;
+    }
+    SectionServers::const_iterator sit = section.mServers.begin();
+    for (size_t i = 0; i < section.mChunkIds.size(); i++) {
+        const chunkId_t                      cid = section.mChunkIds[i];
+        SectionServers::const_iterator const end =
+            sit + section.mServerCounts[i];
+        CSMap::Entry* const ci = mEmulator.mChunkToServerMap.Find(cid);
+        if (! ci) {
+            KFS_LOG_STREAM_ERROR << "no such chunk: " << cid << KFS_LOG_EOM;
+            sit = end;
             continue;
         }
-        if (! AddReplica(*ci, it->second)) {
+        const size_t size = mEmulator.GetChunkSize(*ci);
+        for (; sit != end; ++sit) {
+            if (! *sit) {
+                continue;
+            }
+            const ChunkServerPtr& srv = **sit;
+            if (! mEmulator.AddReplica(*ci, srv)) {
+                KFS_LOG_STREAM_ERROR <<
+                    "chunk: "        << cid <<
+                    " add server: "  << srv->GetServerLocation() <<
+                    " failed" <<
+                KFS_LOG_EOM;
+                continue;
+            }
+            GetCSEmulator(*srv).HostingChunk(cid, size);
+        }
+        if (mAddChunksToReplicationCheckerFlag) {
+            mEmulator.CheckChunkReplication(*ci);
+        }
+    }
+    mLineCount += section.mLineCount;
+    return true;
+}
+
+void
+LayoutEmulator::ChunkmapLoader::Run()
+{
+    for (; ;) {
+        QCStMutexLocker readLocker(mReadMutex);
+        QCStMutexLocker locker(mMutex);
+        while (! mStopFlag && ! mEofFlag && mMaxPending <= mSections.size()) {
+            mSpaceCond.Wait(mMutex);
+        }
+        if (mStopFlag || mEofFlag) {
+            break;
+        }
+        Section* const section = new Section();
+        int            status;
+        {
+            QCStMutexUnlocker unlocker(mMutex);
+            status = Read(*section);
+        }
+        if (status != 0) {
+            if (status < 0) {
+                section->mStatus   = status;
+                section->mDoneFlag = true;
+                mSections.push_back(section);
+            } else {
+                delete section;
+            }
+            mEofFlag = true;
+            mDoneCond.Notify();
+            break;
+        }
+        mSections.push_back(section);
+        locker.Unlock();
+        readLocker.Unlock();
+        Parse(*section);
+        QCStMutexLocker doneLocker(mMutex);
+        section->mDoneFlag = true;
+        mDoneCond.Notify();
+    }
+}
+
+int
+LayoutEmulator::ChunkmapLoader::Load()
+{
+    const int64_t start  = microseconds();
+    int           status = ReadHeader();
+    if (status != 0) {
+        KFS_LOG_STREAM_ERROR << mName << ": invalid header: " <<
+            strerror(-status) <<
+        KFS_LOG_EOM;
+        return status;
+    }
+    mThreads = new QCThread[mThreadCount];
+    for (int i = 0; i < mThreadCount; i++) {
+        const int err = mThreads[i].TryToStart(this, -1, "ChunkmapLoader");
+        if (err) {
             KFS_LOG_STREAM_ERROR <<
-                "chunk: "        << cid <<
-                " add server: "  << loc <<
-                " failed" <<
+                "failed to start chunk map loader thread: " <<
+                strerror(err) <<
             KFS_LOG_EOM;
-            continue;
+            return (err > 0 ? -err : -1);
         }
-        GetCSEmulator(*(it->second)).HostingChunk(cid, GetChunkSize(*ci));
     }
-    if (addChunksToReplicationChecker) {
-        CheckChunkReplication(*ci);
+    for (; ;) {
+        QCStMutexLocker locker(mMutex);
+        while (mSections.empty() ? ! mEofFlag :
+                ! mSections.front()->mDoneFlag) {
+            mDoneCond.Wait(mMutex);
+        }
+        if (mSections.empty()) {
+            break;
+        }
+        Section* const section = mSections.front();
+        mSections.pop_front();
+        mSpaceCond.Notify();
+        locker.Unlock();
+        const bool ok = Apply(*section);
+        delete section;
+        if (! ok) {
+            status = -EINVAL;
+            break;
+        }
     }
-    return true;
+    Stop();
+    KFS_LOG_STREAM_INFO <<
+        "chunk map load: " << mName <<
+        " format: "        << (mBinaryFlag ? "binary" : "text") <<
+        " threads: "       << mThreadCount <<
+        " chunks: "        << mLineCount <<
+        " total: "         << ((microseconds() - start) * 1e-6) <<
+        " sec." <<
+    KFS_LOG_EOM;
+    return status;
+}
+
+int
+LayoutEmulator::LoadChunkmap(
+    const string& chunkLocationFn, bool addChunksToReplicationChecker)
+{
+    const int fd = open(chunkLocationFn.c_str(), O_RDONLY);
+    if (fd < 0) {
+        const int err = errno;
+        KFS_LOG_STREAM_INFO << chunkLocationFn << ": " << strerror(err) <<
+        KFS_LOG_EOM;
+        return (err > 0 ? -err : -1);
+    }
+    int status;
+    {
+        ChunkmapLoader loader(*this, chunkLocationFn, fd, mThreadCount,
+            addChunksToReplicationChecker);
+        status = loader.Load();
+    }
+    close(fd);
+    return status;
+}
+
+static void
+WriteChunkmapBlock(ostream& os, vector<char>& buf, uint32_t count)
+{
+    const size_t   kHeaderSize = LayoutEmulator::kBinaryChunkmapBlockHeaderSize;
+    const uint32_t len         = (uint32_t)(buf.size() - kHeaderSize);
+    char*          ptr         = &buf[0];
+    PutVal(ptr, (uint32_t)LayoutEmulator::kBinaryChunkmapBlockMagic);
+    PutVal(ptr, count);
+    PutVal(ptr, len);
+    PutVal(ptr, (uint32_t)crc32(crc32(0L, Z_NULL, 0),
+        reinterpret_cast<const Bytef*>(&buf[kHeaderSize]), (uInt)len));
+    os.write(&buf[0], buf.size());
+    buf.resize(kHeaderSize);
+}
+
+int
+LayoutEmulator::WriteBinaryChunkmap(const string& fileName)
+{
+    ofstream file(fileName.c_str(),
+        ofstream::out | ofstream::binary | ofstream::trunc);
+    if (! file) {
+        const int err = errno;
+        KFS_LOG_STREAM_ERROR << fileName << ": " << strerror(err) <<
+        KFS_LOG_EOM;
+        return (err > 0 ? -err : -1);
+    }
+    typedef map<const ChunkServer*, uint32_t> ServerIndex;
+    ServerIndex  index;
+    vector<char> buf;
+    buf.resize(3 * sizeof(uint32_t));
+    char* ptr = &buf[0];
+    PutVal(ptr, (uint32_t)kBinaryChunkmapMagic);
+    PutVal(ptr, (uint32_t)kBinaryChunkmapVersion);
+    PutVal(ptr, (uint32_t)mChunkServers.size());
+    for (Servers::const_iterator it = mChunkServers.begin();
+            it != mChunkServers.end();
+            ++it) {
+        const ServerLocation& loc = (*it)->GetServerLocation();
+        const size_t          len = min(loc.hostname.size(), size_t(0xFFFF));
+        const size_t          pos = buf.size();
+        index.insert(make_pair(&**it, (uint32_t)index.size()));
+        buf.resize(pos + sizeof(uint16_t) + len + 2 * sizeof(int32_t));
+        ptr = &buf[pos];
+        PutVal(ptr, (uint16_t)len);
+        memcpy(ptr, loc.hostname.data(), len);
+        ptr += len;
+        PutVal(ptr, (int32_t)loc.port);
+        PutVal(ptr, (int32_t)(*it)->GetRack());
+    }
+    file.write(&buf[0], buf.size());
+
+    const uint32_t kBlockRecords = 64 << 10;
+    StTmp<Servers> serversTmp(mServersTmp);
+    uint32_t       count         = 0;
+    int64_t        total         = 0;
+    buf.resize(kBinaryChunkmapBlockHeaderSize);
+    mChunkToServerMap.First();
+    for (const CSMap::Entry* p; file && (p = mChunkToServerMap.Next()); ) {
+        Servers& servers = serversTmp.Get();
+        mChunkToServerMap.GetServers(*p, servers);
+        const size_t n   = min(servers.size(), size_t(0xFFFF));
+        const size_t pos = buf.size();
+        buf.resize(pos + 2 * sizeof(int64_t) + sizeof(uint16_t) +
+            n * sizeof(uint32_t));
+        ptr = &buf[pos];
+        PutVal(ptr, (int64_t)p->GetChunkId());
+        PutVal(ptr, (int64_t)p->GetFileId());
+        char* const cntPtr = ptr;
+        ptr += sizeof(uint16_t);
+        uint16_t cnt = 0;
+        for (size_t i = 0; i < n; i++) {
+            ServerIndex::const_iterator const it = index.find(&*servers[i]);
+            if (it != index.end()) {
+                PutVal(ptr, it->second);
+                cnt++;
+            }
+        }
+        buf.resize(ptr - &buf[0]);
+        ptr = cntPtr;
+        PutVal(ptr, cnt);
+        total++;
+        if (kBlockRecords <= ++count) {
+            WriteChunkmapBlock(file, buf, count);
+            count = 0;
+        }
+    }
+    if (0 < count) {
+        WriteChunkmapBlock(file, buf, count);
+    }
+    file.close();
+    if (file.fail()) {
+        const int err = errno;
+        KFS_LOG_STREAM_ERROR << fileName << ": write failure: " <<
+            strerror(err) <<
+        KFS_LOG_EOM;
+        return (err > 0 ? -err : -1);
+    }
+    KFS_LOG_STREAM_INFO << "binary chunk map: " << fileName <<
+        " chunks: "  << total <<
+        " servers: " << mChunkServers.size() <<
+    KFS_LOG_EOM;
+    return 0;
 }
 
 // override what is in the layout manager (only for the emulator code)
@@ -456,7 +1123,8 @@ LayoutEmulator::BuildRebalancePlan()
             (opsCount <= 0 &&
             ! mCleanupScheduledFlag &&
             mRebalanceCtrs.GetRoundCount() > round &&
-            ! mChunkToServerMap.Front(CSMap::Entry::kStateCheckReplication));
+            ! mChunkToServerMap.Front(CSMap::Entry::kStateCheckReplication) &&
+            ! mChunkToServerMap.Front(CSMap::Entry::kStateQueuedReplication));
         RebalanceCtrs::Counter const scanned = mRebalanceCtrs.GetTotalScanned();
         if (doneFlag || nextScanned < scanned) {
             KFS_LOG_STREAM_START(MsgLogger::kLogLevelINFO, logStream);
@@ -497,6 +1165,7 @@ LayoutEmulator::ExecuteRebalancePlan()
             mChunkServers.empty() ||
             (RunChunkserverOps() <= 0 &&
             ! mChunkToServerMap.Front(CSMap::Entry::kStateCheckReplication) &&
+            ! mChunkToServerMap.Front(CSMap::Entry::kStateQueuedReplication) &&
             ! mIsExecutingRebalancePlan &&
             ! mCleanupScheduledFlag);
         RebalanceCtrs::Counter const scanned = mRebalanceCtrs.GetTotalScanned();
@@ -643,6 +1312,15 @@ public:
     }
     bool IsHealthy() const
         { return (missing <= 0); }
+    void Add(const PlacementVerifier& verifier)
+    {
+        sameRack        += verifier.sameRack;
+        underReplicated += verifier.underReplicated;
+        overReplicated  += verifier.overReplicated;
+        missing         += verifier.missing;
+        sameNode        += verifier.sameNode;
+        stripeSameNode  += verifier.stripeSameNode;
+    }
 };
 
 inline const string&
@@ -773,6 +1451,172 @@ LayoutEmulator::VerifyPlacement(
     }
 }
 
+/*
+ * Chunk scanners process the chunk map entry ranges in parallel. The scanners
+ * must not modify the layout emulator state, with the exception of chunk map
+ * servers "stale" entries cleanup, in which case the scan runs in the
+ * calling thread.
+ */
+class LayoutEmulator::ChunkScanner : public QCRunnable
+{
+public:
+    ChunkScanner()
+        : QCRunnable(),
+          mEntries(0),
+          mStart(0),
+          mEnd(0)
+        {}
+    virtual ~ChunkScanner()
+        {}
+    void SetRange(const ChunkEntries& entries, size_t start, size_t end)
+    {
+        mEntries = &entries;
+        mStart   = start;
+        mEnd     = end;
+    }
+    virtual void Run()
+    {
+        for (size_t i = mStart; i < mEnd; i++) {
+            Process(*(*mEntries)[i]);
+        }
+    }
+protected:
+    virtual void Process(const CSMap::Entry& entry) = 0;
+private:
+    const ChunkEntries* mEntries;
+    size_t              mStart;
+    size_t              mEnd;
+private:
+    ChunkScanner(const ChunkScanner&);
+    ChunkScanner& operator=(const ChunkScanner&);
+};
+
+class LayoutEmulator::PlacementScanner : public ChunkScanner
+{
+public:
+    PlacementScanner()
+        : ChunkScanner(),
+          mEmulator(0),
+          mReportAllFlag(false),
+          mVerboseFlag(false),
+          mVerifier(),
+          mOs(),
+          mPlacement(),
+          mServers(),
+          mBlockServers(),
+          mCblk()
+        {}
+    void Init(LayoutEmulator& emulator, bool reportAllFlag, bool verboseFlag)
+    {
+        mEmulator      = &emulator;
+        mReportAllFlag = reportAllFlag;
+        mVerboseFlag   = verboseFlag;
+    }
+    const PlacementVerifier& GetVerifier() const
+        { return mVerifier; }
+    string GetOutput() const
+        { return mOs.str(); }
+protected:
+    virtual void Process(const CSMap::Entry& entry)
+    {
+        mPlacement.clear();
+        mServers.clear();
+        mCblk.clear();
+        mEmulator->mChunkToServerMap.GetServers(entry, mServers);
+        if (! mServers.empty()) {
+            mEmulator->GetBlockPlacementExcludes(
+                entry, mPlacement, mCblk, mBlockServers);
+        }
+        mEmulator->VerifyPlacement(entry, mServers, mCblk, mPlacement,
+            mOs, mVerboseFlag, mReportAllFlag, mVerifier);
+    }
+private:
+    LayoutEmulator*        mEmulator;
+    bool                   mReportAllFlag;
+    bool                   mVerboseFlag;
+    PlacementVerifier      mVerifier;
+    ostringstream          mOs;
+    ChunkPlacement         mPlacement;
+    Servers                mServers;
+    Servers                mBlockServers;
+    vector<MetaChunkInfo*> mCblk;
+};
+
+void
+LayoutEmulator::GetChunkEntries(LayoutEmulator::ChunkEntries& entries)
+{
+    entries.clear();
+    entries.reserve(mChunkToServerMap.Size());
+    mChunkToServerMap.First();
+    for (const CSMap::Entry* p; (p = mChunkToServerMap.Next()); ) {
+        entries.push_back(p);
+    }
+}
+
+template<typename T> void
+LayoutEmulator::RunChunkScanners(
+    T* scanners, int count, const LayoutEmulator::ChunkEntries& entries)
+{
+    const size_t cnt  = mChunkToServerMap.HasStaleServers() ?
+        size_t(1) : (size_t)max(1, count);
+    const size_t size = entries.size();
+    const size_t step = (size + cnt - 1) / cnt;
+    QCThread* const threads = 1 < cnt ? new QCThread[cnt - 1] : 0;
+    for (size_t i = 0; i < cnt; i++) {
+        scanners[i].SetRange(
+            entries, min(size, i * step), min(size, (i + 1) * step));
+        if (0 < i) {
+            threads[i - 1].Start(&scanners[i], -1, "ChunkScanner");
+        }
+    }
+    scanners[0].Run();
+    for (size_t i = 1; i < cnt; i++) {
+        threads[i - 1].Join();
+    }
+    delete [] threads;
+}
+
+/*
+ * Thread safe version of GetPlacementExcludes(), excluding the servers and
+ * racks of the other chunks in the same RS block. The in flight chunk
+ * operations are not taken into the account, as the layout emulator does not
+ * execute any while verifying placement.
+ */
+void
+LayoutEmulator::GetBlockPlacementExcludes(
+    const CSMap::Entry&                c,
+    LayoutEmulator::ChunkPlacement&    placement,
+    vector<MetaChunkInfo*>&            cblk,
+    LayoutEmulator::Servers&           servers) const
+{
+    const MetaFattr* const fa = c.GetFattr();
+    if (! fa->IsStriped()) {
+        return;
+    }
+    const MetaChunkInfo* const chunk  = c.GetChunkInfo();
+    chunkOff_t                 offset = chunk->offset;
+    chunkOff_t                 start  = -1;
+    MetaFattr*                 mfa    = 0;
+    MetaChunkInfo*             mci    = 0;
+    cblk.reserve(fa->numStripes + fa->numRecoveryStripes);
+    if (metatree.getalloc(fa->id(), offset, mfa, mci, &cblk, &start) != 0 ||
+            mfa != fa || mci != chunk) {
+        panic("chunk mapping / getalloc mismatch");
+        return;
+    }
+    for (vector<MetaChunkInfo*>::const_iterator it = cblk.begin();
+            it != cblk.end();
+            ++it) {
+        if (chunk == *it) {
+            continue;
+        }
+        const CSMap::Entry& ce = CSMap::Entry::GetCsEntry(**it);
+        servers.clear();
+        mChunkToServerMap.GetServers(ce, servers);
+        placement.ExcludeServerAndRack(servers, ce.GetChunkId());
+    }
+}
+
 int
 LayoutEmulator::VerifyRackAwareReplication(
     bool reportAllFlag, bool verboseFlag, ostream& os)
@@ -782,29 +1626,257 @@ LayoutEmulator::VerifyRackAwareReplication(
     " KFS Replica Checker\n"
     "************************************************\n"
     ;
-    StTmp<Servers>                 serversTmp(mServersTmp);
-    StTmp<ChunkPlacement>          placementTmp(mChunkPlacementTmp);
-    StTmp<vector<MetaChunkInfo*> > cinfoTmp(mChunkInfosTmp);
-    PlacementVerifier     verifier;
-    const bool kIncludeThisChunkFlag             = false;
-    const bool kStopIfHasAnyReplicationsInFlight = false;
-    mChunkToServerMap.First();
-    for (const CSMap::Entry* p; (p = mChunkToServerMap.Next()); ) {
-        ChunkPlacement& placement = placementTmp.Get();
-        Servers& servers = serversTmp.Get();
-        mChunkToServerMap.GetServers(*p, servers);
-        vector<MetaChunkInfo*>& cblk = cinfoTmp.Get();
-        if (! servers.empty()) {
-            GetPlacementExcludes(*p, placement, kIncludeThisChunkFlag,
-                kStopIfHasAnyReplicationsInFlight, &cblk);
-        }
-        VerifyPlacement(*p, servers, cblk, placement,
-            os, verboseFlag, reportAllFlag, verifier);
+    PlacementVerifier       verifier;
+    ChunkEntries            entries;
+    GetChunkEntries(entries);
+    PlacementScanner* const scanners = new PlacementScanner[mThreadCount];
+    for (int i = 0; i < mThreadCount; i++) {
+        scanners[i].Init(*this, reportAllFlag, verboseFlag);
     }
+    RunChunkScanners(scanners, mThreadCount, entries);
+    for (int i = 0; i < mThreadCount; i++) {
+        os << scanners[i].GetOutput();
+        verifier.Add(scanners[i].GetVerifier());
+    }
+    delete [] scanners;
     verifier.report(os, mChunkToServerMap.Size());
     return (verifier.IsHealthy() ? 0 : 1);
 }
 
+/*
+ * Rack failure "what if" chunk scanner. Chunks with replicas left are
+ * re-replicated. Chunks of RS files without replicas left are recovered, if
+ * the number of lost chunks in the RS block does not exceed the number of
+ * recovery stripes; recovery reads the data stripes' worth of chunks.
+ */
+class LayoutEmulator::WhatIfScanner : public ChunkScanner
+{
+public:
+    WhatIfScanner()
+        : ChunkScanner(),
+          mReplicateChunks(0),
+          mReplicateBytes(0),
+          mRecoverChunks(0),
+          mRecoverReadBytes(0),
+          mRecoverWriteBytes(0),
+          mLostChunks(0),
+          mLostBytes(0),
+          mEmulator(0),
+          mFailRack(-1),
+          mServers(),
+          mCblk()
+        {}
+    void Init(LayoutEmulator& emulator, int failRack)
+    {
+        mEmulator = &emulator;
+        mFailRack = failRack;
+    }
+    void Add(const WhatIfScanner& scanner)
+    {
+        mReplicateChunks   += scanner.mReplicateChunks;
+        mReplicateBytes    += scanner.mReplicateBytes;
+        mRecoverChunks     += scanner.mRecoverChunks;
+        mRecoverReadBytes  += scanner.mRecoverReadBytes;
+        mRecoverWriteBytes += scanner.mRecoverWriteBytes;
+        mLostChunks        += scanner.mLostChunks;
+        mLostBytes         += scanner.mLostBytes;
+    }
+    int64_t mReplicateChunks;
+    int64_t mReplicateBytes;
+    int64_t mRecoverChunks;
+    int64_t mRecoverReadBytes;
+    int64_t mRecoverWriteBytes;
+    int64_t mLostChunks;
+    int64_t mLostBytes;
+protected:
+    virtual void Process(const CSMap::Entry& entry)
+    {
+        mServers.clear();
+        const size_t cnt  = mEmulator->mChunkToServerMap.GetServers(
+            entry, mServers);
+        const size_t lost = GetFailedCount();
+        if (lost <= 0) {
+            return;
+        }
+        const MetaFattr* const fa   = entry.GetFattr();
+        const int64_t          size = (int64_t)mEmulator->GetChunkSize(entry);
+        if (lost < cnt) {
+            const int64_t copies = min((int64_t)lost,
+                (int64_t)fa->numReplicas - (int64_t)(cnt - lost));
+            if (0 < copies) {
+                mReplicateChunks++;
+                mReplicateBytes += copies * size;
+            }
+            return;
+        }
+        if (! fa->HasRecovery() || ! IsRecoverable(entry)) {
+            mLostChunks++;
+            mLostBytes += size;
+            return;
+        }
+        mRecoverChunks++;
+        mRecoverReadBytes  += size * fa->numStripes;
+        mRecoverWriteBytes += size;
+    }
+private:
+    LayoutEmulator*        mEmulator;
+    int                    mFailRack;
+    Servers                mServers;
+    vector<MetaChunkInfo*> mCblk;
+
+    size_t GetFailedCount() const
+    {
+        size_t ret = 0;
+        for (Servers::const_iterator it = mServers.begin();
+                it != mServers.end();
+                ++it) {
+            if ((*it)->GetRack() == mFailRack) {
+                ret++;
+            }
+        }
+        return ret;
+    }
+    bool IsRecoverable(const CSMap::Entry& entry)
+    {
+        const MetaFattr* const fa     = entry.GetFattr();
+        chunkOff_t             offset = entry.GetChunkInfo()->offset;
+        chunkOff_t             start  = -1;
+        MetaFattr*             mfa    = 0;
+        MetaChunkInfo*         mci    = 0;
+        mCblk.clear();
+        if (metatree.getalloc(fa->id(), offset, mfa, mci, &mCblk, &start) !=
+                0) {
+            return false;
+        }
+        int lost = 0;
+        for (vector<MetaChunkInfo*>::const_iterator it = mCblk.begin();
+                it != mCblk.end();
+                ++it) {
+            mServers.clear();
+            const size_t cnt = mEmulator->mChunkToServerMap.GetServers(
+                CSMap::Entry::GetCsEntry(**it), mServers);
+            if (GetFailedCount() < cnt) {
+                continue;
+            }
+            // Missing chunks at the end of the block past the end of file
+            // are not accounted for here, as these do not need recovery.
+            lost++;
+        }
+        const int missing = (int)(fa->numStripes + fa->numRecoveryStripes) -
+            (int)mCblk.size();
+        return (lost + max(0, missing) <= (int)fa->numRecoveryStripes);
+    }
+};
+
+int
+LayoutEmulator::RunWhatIf(
+    int      failRack,
+    int      addServerCount,
+    int64_t  addServerSpace,
+    int64_t  serverBandwidth,
+    ostream& os)
+{
+    if ((failRack < 0 && addServerCount <= 0) || serverBandwidth <= 0) {
+        KFS_LOG_STREAM_ERROR << "what if: invalid parameters" <<
+        KFS_LOG_EOM;
+        return -EINVAL;
+    }
+    const int64_t startTime   = microseconds();
+    int64_t       totalSpace  = 0;
+    int64_t       usedSpace   = 0;
+    int64_t       failedSpace = 0;
+    int64_t       failedUsed  = 0;
+    int64_t       failedCount = 0;
+    for (Servers::const_iterator it = mChunkServers.begin();
+            it != mChunkServers.end();
+            ++it) {
+        const ChunkServer& srv   = **it;
+        const int64_t      total = srv.GetTotalSpace(mUseFsTotalSpaceFlag);
+        const int64_t      used  = srv.GetUsedSpace();
+        totalSpace += total;
+        usedSpace  += used;
+        if (0 <= failRack && srv.GetRack() == failRack) {
+            failedSpace += total;
+            failedUsed  += used;
+            failedCount++;
+        }
+    }
+    if (0 <= failRack && failedCount <= 0) {
+        KFS_LOG_STREAM_ERROR << "what if: no servers in rack: " << failRack <<
+        KFS_LOG_EOM;
+        return -EINVAL;
+    }
+    const int64_t serverCount = (int64_t)mChunkServers.size();
+    const int64_t addCount    = max(0, addServerCount);
+    const int64_t addSpace    = 0 < addServerSpace ? addServerSpace :
+        (0 < serverCount ? totalSpace / serverCount : int64_t(0));
+    WhatIfScanner stats;
+    if (0 <= failRack) {
+        ChunkEntries entries;
+        GetChunkEntries(entries);
+        WhatIfScanner* const scanners = new WhatIfScanner[mThreadCount];
+        for (int i = 0; i < mThreadCount; i++) {
+            scanners[i].Init(*this, failRack);
+        }
+        RunChunkScanners(scanners, mThreadCount, entries);
+        for (int i = 0; i < mThreadCount; i++) {
+            stats.Add(scanners[i]);
+        }
+        delete [] scanners;
+    }
+    const int64_t liveCount  = serverCount - failedCount + addCount;
+    const int64_t writeBytes = stats.mReplicateBytes + stats.mRecoverWriteBytes;
+    const int64_t readBytes  = stats.mReplicateBytes + stats.mRecoverReadBytes;
+    const double  recoveryTime = liveCount <= 0 ? -1. :
+        (double)max(writeBytes, readBytes) /
+            ((double)liveCount * serverBandwidth);
+    const int64_t liveSpace  = totalSpace - failedSpace + addCount * addSpace;
+    const int64_t liveUsed   = usedSpace - failedUsed + writeBytes;
+    const double  util       = liveSpace <= 0 ? 0. :
+        (double)liveUsed / (double)liveSpace;
+    const int64_t moveBytes  = (int64_t)(util * addCount * addSpace);
+    const double  moveTime   = addCount <= 0 ? 0. :
+        (double)moveBytes / ((double)addCount * serverBandwidth);
+    os <<
+    "************************************************\n"
+    " KFS Layout What If\n"
+    "************************************************\n"
+    " Chunk servers : "                 << serverCount         << "\n"
+    " Total space : "                   << totalSpace          << "\n"
+    " Used space : "                    << usedSpace           << "\n"
+    " Server bandwidth : "              << serverBandwidth     << "\n"
+    ;
+    if (0 <= failRack) {
+        os <<
+        " Failed rack : "                   << failRack                 << "\n"
+        " Failed servers : "                << failedCount              << "\n"
+        " Failed servers used space : "     << failedUsed               << "\n"
+        " Chunks to re-replicate : "        << stats.mReplicateChunks   << "\n"
+        " Re-replication bytes : "          << stats.mReplicateBytes    << "\n"
+        " Chunks to recover : "             << stats.mRecoverChunks     << "\n"
+        " Recovery read bytes : "           << stats.mRecoverReadBytes  << "\n"
+        " Recovery write bytes : "          << stats.mRecoverWriteBytes << "\n"
+        " Chunks lost : "                   << stats.mLostChunks        << "\n"
+        " Bytes lost : "                    << stats.mLostBytes         << "\n"
+        " Estimated recovery time sec : "   << recoveryTime             << "\n"
+        ;
+    }
+    if (0 < addCount) {
+        os <<
+        " Added servers : "                 << addCount                 << "\n"
+        " Added server space : "            << addSpace                 << "\n"
+        " Re-balance bytes : "              << moveBytes                << "\n"
+        " Estimated re-balance time sec : " << moveTime                 << "\n"
+        ;
+    }
+    os <<
+    " Space utilization after : "       << util                << "\n"
+    " Run time : " << ((microseconds() - startTime) * 1e-6)    << "\n"
+    "************************************************\n"
+    ;
+    return 0;
+}
+
 int
 LayoutEmulator::RunFsck(
     const string& fileName)
@@ -34,11 +34,13 @@
 #include <map>
 #include <vector>
 #include <fstream>
+#include <ostream>
 #include "meta/LayoutManager.h"
 
 namespace KFS
 {
 using std::ofstream;
+using std::ostream;
 using std::map;
 using std::vector;
 using std::string;
@@ -49,6 +51,7 @@ public:
     LayoutEmulator()
         : mVariationFromMean(0),
           mNumBlksRebalanced(0),
+          mThreadCount(1),
           mStopFlag(false),
           mPlanFile(),
           mLoc2Server()
@@ -60,10 +63,27 @@ public:
     {
         mPlanFile.close();
     }
+    // Binary chunk map format: file header with magic, version, and server
+    // table, followed by blocks. The server table has server count, and
+    // for each server host name length (2 bytes), host name, port (4) and
+    // rack (4). Each block has magic, record count, data length, and crc32
+    // of the data, followed by the records: chunk id (8), file id (8),
+    // server count (2), and server table indexes (4 each). All integers are
+    // big endian.
+    enum
+    {
+        kBinaryChunkmapMagic           = 0x5146434D,
+        kBinaryChunkmapBlockMagic      = 0x51464342,
+        kBinaryChunkmapVersion         = 1,
+        kBinaryChunkmapBlockHeaderSize = 4 * 4
+    };
     // Given a chunk->location data in a file, rebuild the chunk->location map.
+    // Both text and binary chunk map formats are supported. The chunk map is
+    // parsed by the worker threads, and applied in the file order.
     //
     int LoadChunkmap(const string& chunkLocationFn,
         bool addChunksToReplicationChecker = false);
+    int WriteBinaryChunkmap(const string& fileName);
     void AddServer(const ServerLocation& loc,
         int rack, uint64_t totalSpace, uint64_t usedSpace);
     void SetupForRebalancePlanning(
@@ -80,6 +100,15 @@ public:
     int ReadNetworkDefn(const string& networkFn);
     int VerifyRackAwareReplication(
         bool reportAllFlag, bool verbose, ostream& os);
+    // Estimate re-replication, recovery and re-balancing volume and time
+    // resulting from the rack failure and / or adding servers, without
+    // running the layout manager re-balancing and replication logic.
+    int RunWhatIf(
+        int      failRack,
+        int      addServerCount,
+        int64_t  addServerSpace,
+        int64_t  serverBandwidth,
+        ostream& os);
     seq_t  GetChunkversion(chunkId_t cid) const;
     size_t GetChunkSize(chunkId_t cid) const;
     void MarkServerDown(const ServerLocation& loc);
@@ -91,16 +120,35 @@ public:
     {
         mStopFlag = true;
     }
+    void SetThreadCount(int count)
+    {
+        mThreadCount = max(1, count);
+    }
+    int GetThreadCount() const
+    {
+        return mThreadCount;
+    }
     int RunFsck(const string& fileName);
 private:
     typedef map<ServerLocation, ChunkServerPtr> Loc2Server;
+    typedef vector<const CSMap::Entry*> ChunkEntries;
     class PlacementVerifier;
+    class ChunkmapLoader;
+    class ChunkScanner;
+    class PlacementScanner;
+    class WhatIfScanner;
 
     size_t RunChunkserverOps();
     void CalculateRebalaceThresholds();
     void PrepareRebalance(bool enableRebalanceFlag);
-    bool Parse(const char* line, size_t size,
-        bool addChunksToReplicationChecker, ServerLocation& loc);
+    void GetChunkEntries(ChunkEntries& entries);
+    template<typename T> void RunChunkScanners(
+        T* scanners, int count, const ChunkEntries& entries);
+    void GetBlockPlacementExcludes(
+        const CSMap::Entry&     c,
+        ChunkPlacement&         placement,
+        vector<MetaChunkInfo*>& cblk,
+        Servers&                servers) const;
     void ShowPlacementError(
         ostream&            os,
         const CSMap::Entry& c,
@@ -125,6 +173,7 @@ private:
     // which nodes are candidates for migration.
     double     mVariationFromMean;
     int        mNumBlksRebalanced;
+    int        mThreadCount;
     bool       mStopFlag;
     ofstream   mPlanFile;
     Loc2Server mLoc2Server;
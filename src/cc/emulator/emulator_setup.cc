@@ -61,7 +61,7 @@ EmulatorSetup(
     KFS_LOG_EOM;
     int status;
     if (file_exists(LASTCP)) {
-        Restorer r;
+        Restorer r(gLayoutEmulator.GetThreadCount());
         status = r.rebuild(LASTCP, minReplicasPerFile) ? 0 : -EIO;
         // gLayoutEmulator.InitRecoveryStartTime();
     } else {
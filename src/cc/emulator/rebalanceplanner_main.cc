@@ -58,13 +58,20 @@ main(int argc, char** argv)
     string  chunkmapFn("chunkmap.txt");
     string  propsFn;
     string  chunkMapDir;
+    string  binaryChunkmapFn;
     int     optchar;
     int16_t minReplication   = -1;
     double  variationFromAvg = 0;
     bool    helpFlag         = false;
     bool    debugFlag        = false;
+    int     threadCount      = 1;
+    int     failRack         = -1;
+    int     addServerCount   = 0;
+    int64_t addServerSpace   = 0;
+    int64_t serverBandwidth  = 50;
 
-    while ((optchar = getopt(argc, argv, "c:l:n:b:r:hp:o:dm:t:")) != -1) {
+    while ((optchar = getopt(argc, argv, "c:l:n:b:r:hp:o:dm:t:T:B:F:A:S:W:"))
+            != -1) {
         switch (optchar) {
             case 'l':
                 logdir = optarg;
@@ -99,6 +106,24 @@ main(int argc, char** argv)
             case 'm':
                 minReplication = atoi(optarg);
                 break;
+            case 'T':
+                threadCount = atoi(optarg);
+                break;
+            case 'B':
+                binaryChunkmapFn = optarg;
+                break;
+            case 'F':
+                failRack = atoi(optarg);
+                break;
+            case 'A':
+                addServerCount = atoi(optarg);
+                break;
+            case 'S':
+                addServerSpace = (int64_t)strtoll(optarg, 0, 10);
+                break;
+            case 'W':
+                serverBandwidth = (int64_t)strtoll(optarg, 0, 10);
+                break;
             default:
                 cerr << "Unrecognized flag: " << (char)optchar << "\n";
                 helpFlag = true;
@@ -121,6 +146,20 @@ main(int argc, char** argv)
             "[-o <new chunk map output directory> (default none)]\n"
             "[-d debug -- print chunk layout before and after]\n"
             "[-m <min replicas per file> (default -1 -- no change)]\n"
+            "[-T <threads> checkpoint and chunk map load threads (default " <<
+                threadCount << ")]\n"
+            "[-B <binary chunk map output file> (default none)]\n"
+            "[-F <rack id> what if: report re-replication volume and time"
+                " resulting from the rack failure, instead of creating"
+                " re-balance plan]\n"
+            "[-A <count> what if: report re-balance volume and time"
+                " resulting from adding servers, instead of creating"
+                " re-balance plan]\n"
+            "[-S <bytes> what if: added server space"
+                " (default average server space)]\n"
+            "[-W <MB/sec> what if: per server re-replication bandwidth"
+                " (default " << serverBandwidth << ")]\n"
+            "The chunk map file can be in text or binary format.\n"
             "To create network defininiton file and chunk map files:\n"
             "telnet to the meta server, and issue DUMP_CHUNKTOSERVERMAP\n"
             "followed by an empty line.\n"
@@ -155,9 +194,16 @@ main(int argc, char** argv)
             == 0) {
         gLayoutEmulator.SetParameters(props);
         gLayoutEmulator.SetupForRebalancePlanning(variationFromAvg);
+        gLayoutEmulator.SetThreadCount(threadCount);
         status = EmulatorSetup(logdir, cpdir, networkFn, chunkmapFn,
             minReplication, minReplication > 1);
-        if (status == 0 &&
+        if (status == 0 && ! binaryChunkmapFn.empty()) {
+            status = gLayoutEmulator.WriteBinaryChunkmap(binaryChunkmapFn);
+        }
+        if (status == 0 && (0 <= failRack || 0 < addServerCount)) {
+            status = gLayoutEmulator.RunWhatIf(failRack, addServerCount,
+                addServerSpace, serverBandwidth * (int64_t(1) << 20), cout);
+        } else if (status == 0 &&
                 (status = gLayoutEmulator.SetRebalancePlanOutFile(
                     rebalancePlanFn)) == 0) {
             if (debugFlag) {
@@ -54,8 +54,9 @@ main(int argc, char** argv)
     bool   helpFlag      = false;
     bool   reportAllFlag = false;
     bool   verboseFlag   = false;
+    int    threadCount   = 1;
 
-    while ((optchar = getopt(argc, argv, "avc:l:n:b:r:hf:p:")) != -1) {
+    while ((optchar = getopt(argc, argv, "avc:l:n:b:r:hf:p:T:")) != -1) {
         switch (optchar) {
             case 'l':
                 logdir = optarg;
@@ -84,6 +85,9 @@ main(int argc, char** argv)
             case 'p':
                 propsFn = optarg;
                 break;
+            case 'T':
+                threadCount = atoi(optarg);
+                break;
             default:
                 cerr << "Unrecognized flag " << (char)optchar << "\n";
                 helpFlag = true;
@@ -103,6 +107,9 @@ main(int argc, char** argv)
                 fsckFn << ")]\n"
             "[-v verbose replica check output]\n"
             "[-a report all placement problems]\n"
+            "[-T <threads> checkpoint, chunk map load, and placement"
+                " verification threads (default " << threadCount << ")]\n"
+            "The chunk map file can be in text or binary format.\n"
         ;
         return 1;
     }
@@ -116,6 +123,7 @@ main(int argc, char** argv)
             (status = props.loadProperties(propsFn.c_str(), char('=')))
             == 0) {
         gLayoutEmulator.SetParameters(props);
+        gLayoutEmulator.SetThreadCount(threadCount);
         if ((status = EmulatorSetup(logdir, cpdir, networkFn, chunkmapFn)) ==
                 0) {
             if (! fsckFn.empty()) {
@@ -36,8 +36,10 @@
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <openssl/crypto.h>
 
 #include <string.h>
+#include <pthread.h>
 
 #include <ostream>
 #include <istream>
@@ -54,6 +56,7 @@ using std::noshowbase;
 using std::setfill;
 using std::setw;
 using std::min;
+using std::max;
 
 namespace {
 
@@ -144,12 +147,21 @@ public:
         const char* theSubjectPtr = 0;
         const int   theSubjectLen = inSubjectPtr ?
             inSubjectPtr->Get(inToken, theSubjectPtr) : 0;
-        HMAC_CTX theCtx;
-        HMAC_CTX_init(&theCtx);
+        ThreadState& theState = GetThreadState();
+        HMAC_CTX&    theCtx   = theState.mHmacCtx;
+        // Re-use pre-computed inner and outer pads if the key is the same as
+        // the one used with the previous invocation.
+        const bool theSameKeyFlag = 0 < inKeyLen &&
+            theState.mHmacKeyLen == inKeyLen &&
+            memcmp(theState.mHmacKey, inKeyPtr, inKeyLen) == 0;
+        const char* const theKeyPtr = theSameKeyFlag ? 0 : inKeyPtr;
+        const int         theKeyLen = theSameKeyFlag ? 0 : inKeyLen;
+        const EVP_MD*     theMdPtr  = theSameKeyFlag ? 0 : EVP_sha1();
+        theState.mHmacKeyLen = -1;
         unsigned int theLen = 0;
 #if OPENSSL_VERSION_NUMBER < 0x1000000fL
         const bool theRetFlag = true;
-        HMAC_Init_ex(&theCtx, inKeyPtr, inKeyLen, EVP_sha1(), 0);
+        HMAC_Init_ex(&theCtx, theKeyPtr, theKeyLen, theMdPtr, 0);
         if (0 < theSubjectLen) {
             HMAC_Update(
                 &theCtx,
@@ -169,7 +181,7 @@ public:
         );
 #else
         const bool theRetFlag =
-            HMAC_Init_ex(&theCtx, inKeyPtr, inKeyLen, EVP_sha1(), 0) &&
+            HMAC_Init_ex(&theCtx, theKeyPtr, theKeyLen, theMdPtr, 0) &&
             (theSubjectLen <= 0 ||
                 HMAC_Update(
                     &theCtx,
@@ -195,11 +207,81 @@ public:
                     "HMAC failure: " << EvpError() <<
                 KFS_LOG_EOM;
             }
+        } else if (0 < inKeyLen && inKeyLen <= ThreadState::kMaxHmacKeyLen) {
+            if (! theSameKeyFlag) {
+                memcpy(theState.mHmacKey, inKeyPtr, inKeyLen);
+            }
+            theState.mHmacKeyLen = inKeyLen;
         }
         QCRTASSERT(! theRetFlag || theLen == kSignatureLength);
-        HMAC_CTX_cleanup(&theCtx);
         return theRetFlag;
     }
+    // Verified token cache lookup. The token must be already de-serialized
+    // into the work buffer by FromBase64(). The token time checks must be
+    // performed prior to the lookup, the cache matches the token bytes,
+    // including signature, subject, and the key, and therefore retiring or
+    // changing the key invalidates the corresponding entries.
+    // Returns session key length, 0 if no session key was requested, or -1 if
+    // the token is not in the cache.
+    int GetVerified(
+        const DelegationToken&  inToken,
+        const CryptoKeys::Key&  inKey,
+        Subject*                inSubjectPtr,
+        char*                   inSessionKeyPtr,
+        int                     inMaxSessionKeyLength)
+    {
+        const char* theSubjectPtr = 0;
+        const int   theSubjectLen = inSubjectPtr ?
+            inSubjectPtr->Get(inToken, theSubjectPtr) : 0;
+        if (ThreadState::kMaxSubjectLen < theSubjectLen) {
+            return -1;
+        }
+        const ThreadState::VerifiedEntry& theEntry =
+            GetThreadState().GetVerifiedEntry(mBuffer + kTokenFiledsSize);
+        if (theEntry.mSubjectLen != max(0, theSubjectLen) ||
+                memcmp(theEntry.mToken, mBuffer, kTokenSize) != 0 ||
+                memcmp(theEntry.mKey, inKey.GetPtr(), inKey.GetSize()) != 0 ||
+                (0 < theSubjectLen && memcmp(
+                    theEntry.mSubject, theSubjectPtr, theSubjectLen) != 0)) {
+            return -1;
+        }
+        if (inMaxSessionKeyLength <= 0) {
+            return 0;
+        }
+        if (theEntry.mSessionKeyLen <= 0 ||
+                inMaxSessionKeyLength < theEntry.mSessionKeyLen) {
+            return -1;
+        }
+        memcpy(inSessionKeyPtr, theEntry.mSessionKey, theEntry.mSessionKeyLen);
+        return theEntry.mSessionKeyLen;
+    }
+    void SetVerified(
+        const DelegationToken&  inToken,
+        const CryptoKeys::Key&  inKey,
+        Subject*                inSubjectPtr,
+        const char*             inSessionKeyPtr,
+        int                     inSessionKeyLength)
+    {
+        const char* theSubjectPtr = 0;
+        const int   theSubjectLen = inSubjectPtr ?
+            inSubjectPtr->Get(inToken, theSubjectPtr) : 0;
+        if (ThreadState::kMaxSubjectLen < theSubjectLen ||
+                CryptoKeys::Key::kLength < inSessionKeyLength) {
+            return;
+        }
+        ThreadState::VerifiedEntry& theEntry =
+            GetThreadState().GetVerifiedEntry(mBuffer + kTokenFiledsSize);
+        memcpy(theEntry.mToken, mBuffer, kTokenSize);
+        memcpy(theEntry.mKey, inKey.GetPtr(), inKey.GetSize());
+        theEntry.mSubjectLen = max(0, theSubjectLen);
+        if (0 < theSubjectLen) {
+            memcpy(theEntry.mSubject, theSubjectPtr, theSubjectLen);
+        }
+        theEntry.mSessionKeyLen = max(0, inSessionKeyLength);
+        if (0 < inSessionKeyLength) {
+            memcpy(theEntry.mSessionKey, inSessionKeyPtr, inSessionKeyLength);
+        }
+    }
     void Serialize(
         const DelegationToken& inToken)
     {
@@ -776,8 +858,115 @@ private:
             CryptoKeys::Key::kLength + kEncryptedKeyPadding
     };
 
+    // Per thread state: HMAC context, and direct mapped cache of recently
+    // verified tokens. Each thread has its own cache, therefore no
+    // synchronization is required. The state is deleted on thread exit by
+    // the thread specific key destructor, the key material is erased.
+    class ThreadState
+    {
+    public:
+        enum { kMaxHmacKeyLen     = 64 };
+        enum { kMaxSubjectLen     = 32 };
+        enum { kVerifiedCacheSize = 1 << 10 };
+        struct VerifiedEntry
+        {
+            VerifiedEntry()
+                : mSubjectLen(-1),
+                  mSessionKeyLen(0)
+                {}
+            int  mSubjectLen;
+            int  mSessionKeyLen;
+            char mToken[kTokenSize];
+            char mSubject[kMaxSubjectLen];
+            char mKey[CryptoKeys::Key::kLength];
+            char mSessionKey[CryptoKeys::Key::kLength];
+        };
+
+        ThreadState()
+            : mHmacKeyLen(-1),
+              mVerifiedPtr(0)
+            { HMAC_CTX_init(&mHmacCtx); }
+        ~ThreadState()
+        {
+            HMAC_CTX_cleanup(&mHmacCtx);
+            OPENSSL_cleanse(mHmacKey, sizeof(mHmacKey));
+            if (mVerifiedPtr) {
+                OPENSSL_cleanse(mVerifiedPtr,
+                    sizeof(*mVerifiedPtr) * kVerifiedCacheSize);
+                delete [] mVerifiedPtr;
+            }
+        }
+        VerifiedEntry& GetVerifiedEntry(
+            const char* inSignaturePtr)
+        {
+            if (! mVerifiedPtr) {
+                mVerifiedPtr = new VerifiedEntry[kVerifiedCacheSize];
+            }
+            // Signature is HMAC, use its first bytes as hash.
+            uint32_t    theHash = 0;
+            const char* thePtr  = inSignaturePtr;
+            Read(thePtr, theHash);
+            return mVerifiedPtr[theHash & (kVerifiedCacheSize - 1)];
+        }
+
+        HMAC_CTX       mHmacCtx;
+        int            mHmacKeyLen;
+        char           mHmacKey[kMaxHmacKeyLen];
+        VerifiedEntry* mVerifiedPtr;
+    private:
+        ThreadState(
+            const ThreadState& inState);
+        ThreadState& operator=(
+            const ThreadState& inState);
+    };
+
     char mBuffer[kTokenSize + 1];
 
+    static ThreadState*& ThreadStatePtr()
+    {
+        static __thread ThreadState* sThreadStatePtr = 0;
+        return sThreadStatePtr;
+    }
+    static pthread_key_t& ThreadStateKey()
+    {
+        static pthread_key_t sKey;
+        return sKey;
+    }
+    static void DeleteThreadState(
+        void* inStatePtr)
+    {
+        ThreadState*& thePtr = ThreadStatePtr();
+        if (thePtr == inStatePtr) {
+            thePtr = 0;
+        }
+        delete reinterpret_cast<ThreadState*>(inStatePtr);
+    }
+    static void CreateThreadStateKey()
+    {
+        const int theErr = pthread_key_create(
+            &ThreadStateKey(), &DeleteThreadState);
+        if (theErr != 0) {
+            QCUtils::FatalError("pthread_key_create", theErr);
+        }
+    }
+    static ThreadState& GetThreadState()
+    {
+        ThreadState*& thePtr = ThreadStatePtr();
+        if (! thePtr) {
+            static pthread_once_t sKeyOnce = PTHREAD_ONCE_INIT;
+            int theErr = pthread_once(&sKeyOnce, &CreateThreadStateKey);
+            if (theErr != 0) {
+                QCUtils::FatalError("pthread_once", theErr);
+            }
+            thePtr = new ThreadState();
+            if ((theErr = pthread_setspecific(ThreadStateKey(), thePtr))
+                    != 0) {
+                QCUtils::FatalError("pthread_setspecific", theErr);
+            }
+        }
+        return *thePtr;
+    }
+
     template<typename T>
     static void Write(
         char*& ioPtr,
@@ -975,6 +1164,16 @@ DelegationToken::Process(
         }
         return -EINVAL;
     }
+    const int theCachedRet = theBuf.GetVerified(
+        *this,
+        theKey,
+        inSubjectPtr,
+        inSessionKeyPtr,
+        inMaxSessionKeyLength
+    );
+    if (0 <= theCachedRet) {
+        return theCachedRet;
+    }
     char theSignature[kSignatureLength];
     if (! theBuf.Sign(
             *this,
@@ -991,7 +1190,7 @@ DelegationToken::Process(
         }
         return -EINVAL;
     }
-    return (inMaxSessionKeyLength <= 0 ? 0 : theBuf.MakeSessionKey(
+    const int theRet = inMaxSessionKeyLength <= 0 ? 0 : theBuf.MakeSessionKey(
         *this,
         theKey.GetPtr(),
         theKey.GetSize(),
@@ -1000,7 +1199,17 @@ DelegationToken::Process(
         inMaxSessionKeyLength,
         0,
         outErrMsgPtr
-    ));
+    );
+    if (0 <= theRet) {
+        theBuf.SetVerified(
+            *this,
+            theKey,
+            inSubjectPtr,
+            inSessionKeyPtr,
+            theRet
+        );
+    }
+    return theRet;
 }
 
     ostream&
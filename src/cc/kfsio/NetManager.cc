@@ -63,6 +63,7 @@ NetManager::NetManager(int timeoutMs)
       mTimerRunningFlag(false),
       mPollFlag(false),
       mTimeoutMs(timeoutMs),
+      mNextPollTimeoutMs(-1),
       mStartTime(time(0)),
       mNow(mStartTime),
       mLastTimerTime(mNow - 1),
@@ -405,7 +406,9 @@ NetManager::MainLoop(
             dispatcher->DispatchEnd();
         }
         const int timeout = PendingReadList::IsInList(mPendingReadList) ?
-            0 : mTimeoutMs;
+            0 : (mNextPollTimeoutMs < 0 ?
+                mTimeoutMs : min(mTimeoutMs, mNextPollTimeoutMs));
+        mNextPollTimeoutMs = -1;
         const int fdCount = mConnectionsCount + 1;
         assert(mPendingUpdate.empty());
         mPollFlag = true;
@@ -104,6 +104,15 @@ public:
         Dispatcher* dispatcher           = 0,
         bool        runOnceFlag          = false);
     void Wakeup();
+    /// Limit the next poll timeout, in order to let the dispatcher
+    /// re-dispatch at the specified time. Must be invoked from the main
+    /// loop thread, the limit applies to one poll call.
+    void SetNextPollTimeoutMs(int timeoutMs)
+    {
+        if (mNextPollTimeoutMs < 0 || timeoutMs < mNextPollTimeoutMs) {
+            mNextPollTimeoutMs = timeoutMs < 0 ? 0 : timeoutMs;
+        }
+    }
 
     void Shutdown()
         { mRunFlag = false; }
@@ -229,6 +238,8 @@ private:
     bool            mPollFlag;
     /// timeout interval specified in the call to select().
     const int       mTimeoutMs;
+    /// one time poll timeout limit, negative if not set.
+    int             mNextPollTimeoutMs;
     const time_t    mStartTime;
     time_t          mNow;
     time_t          mLastTimerTime;
@@ -98,6 +98,7 @@ using client::KfsNetClient;
 // Set read dir limit larger than meta server's default 8K, to allow to
 // make it larger, if required, by changing the meta server configuration.
 const int kMaxReaddirEntries = 16 << 10;
+const int kMaxReaddirPageRespSize = 4 << 20;
 const int kMaxReadDirRetries = 16;
 
 KfsClient*
@@ -312,6 +313,15 @@ KfsClient::ReaddirPlus(const char *pathname, vector<KfsFileAttr> &result,
         computeFilesize, updateClientCache, fileIdAndTypeOnly);
 }
 
+int
+KfsClient::ReaddirPlus(const char* pathname, string& cursor,
+    vector<KfsFileAttr>& result, bool& hasMoreEntries, int maxEntries,
+    bool computeFilesize, bool approxFilesize)
+{
+    return mImpl->ReaddirPlus(pathname, cursor, result, hasMoreEntries,
+        maxEntries, computeFilesize, approxFilesize);
+}
+
 int
 KfsClient::OpenDirectory(const char *pathname)
 {
@@ -330,6 +340,20 @@ KfsClient::Stat(int fd, KfsFileAttr& result)
     return mImpl->Stat(fd, result);
 }
 
+int
+KfsClient::StatBatch(const vector<string>& pathnames,
+    vector<KfsFileAttr>& results, vector<int>& statuses, bool computeFilesize)
+{
+    return mImpl->StatBatch(pathnames, results, statuses, computeFilesize);
+}
+
+int
+KfsClient::GetContentSummary(const char* pathname, int64_t& dirCount,
+    int64_t& fileCount, int64_t& byteCount)
+{
+    return mImpl->GetContentSummary(pathname, dirCount, fileCount, byteCount);
+}
+
 int
 KfsClient::GetNumChunks(const char *pathname)
 {
@@ -1548,6 +1572,7 @@ KfsClientImpl::KfsClientImpl(
       mCreateId(RandomSeqNo()),
       mUseOsUserAndGroupFlag(true),
       mInitLookupRootFlag(true),
+      mRmdirsFastFlag(true),
       mUserNames(),
       mGroupNames(),
       mUserIds(),
@@ -1741,6 +1766,7 @@ int KfsClientImpl::Init(const string& metaServerHost, int metaServerPort,
         "will use metaserver at: " <<
         metaServerHost << ":" << metaServerPort <<
     KFS_LOG_EOM;
+    mRmdirsFastFlag = true;
     mIsInitialized = mMetaServerLoc.IsValid();
     if (! mIsInitialized) {
         KFS_LOG_STREAM_ERROR <<
@@ -2144,6 +2170,29 @@ KfsClientImpl::RmdirsFast(const char *pathname,
         assert(! "internal error: invalid path name");
         return -EFAULT;
     }
+    if (mRmdirsFastFlag && (pos != 0 || dirname != "/")) {
+        // Let the meta server detach the whole tree in one step. Fall back
+        // to client side traversal if the permission check fails somewhere
+        // in the tree, in order to remove as much as possible, and report
+        // individual errors, or if the meta server does not support rmdirs.
+        RmdirsOp op(0, parentFid, dirname.c_str(), path.c_str());
+        DoMetaOpWithRetry(&op);
+        ret = GetOpStatus(op);
+        if (ret == 0) {
+            InvalidateAllCachedAttrs();
+            return 0;
+        }
+        if (ret == -ENXIO || ret == -ENOSYS || ret == -EINVAL) {
+            KFS_LOG_STREAM_INFO <<
+                "rmdirs: " << op.statusMsg << " status: " << ret <<
+                " meta server does not support rmdirs,"
+                " using client side traversal" <<
+            KFS_LOG_EOM;
+            mRmdirsFastFlag = false;
+        } else if (ret != -EACCES && ret != -EPERM) {
+            return ret;
+        }
+    }
     DefaultErrHandler errorHandler;
     ret = RmdirsSelf(
         path.substr(0, pos),
@@ -3119,6 +3168,84 @@ KfsClientImpl::ReaddirPlus(const string& pathname, kfsFileId_t dirFid,
     return 0;
 }
 
+int
+KfsClientImpl::ReaddirPlus(const char* pathname, string& cursor,
+    vector<KfsFileAttr>& result, bool& hasMoreEntries, int maxEntries,
+    bool computeFilesize, bool approxFilesize)
+{
+    QCStMutexLocker l(mMutex);
+
+    result.clear();
+    hasMoreEntries = false;
+    KfsFileAttr attr;
+    const int res = StatSelf(pathname, attr, false);
+    if (res < 0) {
+        return res;
+    }
+    if (! attr.isDirectory) {
+        return -ENOTDIR;
+    }
+    time_t const              now                 = time(0);
+    const bool                computeFilesizeFlag =
+        computeFilesize && ! approxFilesize;
+    ReadDirPlusResponseParser parser(
+        *this, result, computeFilesizeFlag, attr.fileId, now);
+    const bool                kGetLastChunkInfoIfSizeUnknown = true;
+    const bool                kFileIdAndTypeOnly             = false;
+    ReaddirPlusOp             op(
+        0, attr.fileId, kGetLastChunkInfoIfSizeUnknown,
+        ! computeFilesizeFlag, kFileIdAndTypeOnly);
+    op.approxFileSizeFlag = approxFilesize;
+    // Resume past the cursor entry if it was removed since the previous
+    // page was returned, instead of failing the listing.
+    op.resumeFlag         = true;
+    op.fnameStart         = cursor;
+    op.numEntries         = 0 < maxEntries ?
+        min(maxEntries, kMaxReaddirEntries) : kMaxReaddirEntries;
+    op.maxRespSize        = kMaxReaddirPageRespSize;
+
+    DoMetaOpWithRetry(&op);
+
+    if (op.status < 0) {
+        return GetOpStatus(op);
+    }
+    if (op.numEntries <= 0) {
+        return 0;
+    }
+    if (op.contentLength <= 0) {
+        return -EIO;
+    }
+    const PropertiesTokenizer::Token nameToken("Name");
+    const PropertiesTokenizer::Token nameTokenShort("N");
+    const PropertiesTokenizer::Token* beginEntryToken = &parser.beginEntry;
+    const PropertiesTokenizer::Token* nameEntryToken  = &nameToken;
+    if (op.hasMoreEntriesFlag) {
+        PropertiesTokenizer tokenizer(op.contentBuf, op.contentLength, false);
+        tokenizer.Next();
+        if (tokenizer.GetKey() == parser.shortBeginEntry) {
+            nameEntryToken  = &nameTokenShort;
+            beginEntryToken = &parser.shortBeginEntry;
+        }
+    }
+    const bool    hasMoreFlag = op.hasMoreEntriesFlag;
+    ReaddirResult opResult;
+    opResult.Set(op);
+    string next;
+    if (hasMoreFlag &&
+            ! opResult.GetLast(*beginEntryToken, *nameEntryToken, next)) {
+        return -EIO;
+    }
+    const int status = opResult.Parse(parser);
+    if (status != 0) {
+        result.clear();
+        return status;
+    }
+    ComputeFilesizes(result, parser.fileChunkInfo);
+    cursor.swap(next);
+    hasMoreEntries = hasMoreFlag;
+    return 0;
+}
+
 int
 KfsClientImpl::Stat(const char *pathname, KfsFileAttr& kfsattr, bool computeFilesize)
 {
@@ -3200,6 +3327,133 @@ KfsClientImpl::StatSelf(const char* pathname, KfsFileAttr& kfsattr,
     return 0;
 }
 
+int
+KfsClientImpl::StatBatch(const vector<string>& pathnames,
+    vector<KfsFileAttr>& results, vector<int>& statuses, bool computeFilesize)
+{
+    QCStMutexLocker l(mMutex);
+
+    const size_t count = pathnames.size();
+    results.clear();
+    results.resize(count);
+    statuses.assign(count, 0);
+    // Use valid cached attributes, and look up the remaining paths in
+    // batches.
+    vector<string> paths;
+    vector<size_t> indexes;
+    time_t         now = time(0);
+    for (size_t i = 0; i < count; i++) {
+        const string& name = pathnames[i];
+        if (name.empty()) {
+            statuses[i] = -EINVAL;
+            continue;
+        }
+        if (name[0] == '/') {
+            mTmpAbsPathStr = name;
+        } else {
+            mTmpAbsPathStr.assign(mCwd.data(), mCwd.length());
+            mTmpAbsPathStr.append("/", 1);
+            mTmpAbsPathStr.append(name);
+        }
+        FAttr* const fa = LookupFAttr(mTmpAbsPathStr, 0);
+        if (fa && ! fa->staleSubCountsFlag &&
+                (! computeFilesize || fa->isDirectory || fa->fileSize >= 0) &&
+                IsValid(*fa, now)) {
+            results[i]          = *fa;
+            results[i].filename = fa->fidNameIt->first.second;
+            continue;
+        }
+        paths.push_back(mTmpAbsPathStr);
+        indexes.push_back(i);
+    }
+    const bool kValidSubCountsRequiredFlag = true;
+    size_t     start                       = 0;
+    while (start < paths.size()) {
+        size_t end  = start;
+        size_t size = 0;
+        while (end < paths.size() &&
+                end - start < (size_t)MAX_LOOKUP_BATCH_ENTRIES &&
+                (size += paths[end].size() + 32) <=
+                    (size_t)MAX_LOOKUP_BATCH_CONTENT_LENGTH) {
+            end++;
+        }
+        if (end <= start) {
+            end = start + 1;
+        }
+        LookupBatchOp op(0, &paths[start], 0, (int)(end - start));
+        DoMetaOpWithRetry(&op);
+        const int res = op.status < 0 ? GetOpStatus(op) : op.ParseResults();
+        now = time(0);
+        for (size_t k = start; k < end; k++) {
+            const size_t i = indexes[k];
+            if (res < 0) {
+                // Fall back to the individual lookups, for example if the
+                // batch response exceeds max. size.
+                statuses[i] = StatSelf(pathnames[i].c_str(), results[i],
+                    computeFilesize, 0, 0, kValidSubCountsRequiredFlag);
+                continue;
+            }
+            LookupBatchOp::Result& r = op.results[k - start];
+            if (r.status != 0) {
+                statuses[i] = r.status;
+                continue;
+            }
+            if (! r.userName.empty()) {
+                UpdateUserId(r.userName, r.fattr.user, now);
+            }
+            if (! r.groupName.empty()) {
+                UpdateGroupId(r.groupName, r.fattr.group, now);
+            }
+            if (! r.fattr.isDirectory && computeFilesize &&
+                    r.fattr.fileSize < 0) {
+                r.fattr.fileSize = ComputeFilesize(r.fattr.fileId);
+                if (r.fattr.fileSize < 0) {
+                    statuses[i] = -EIO;
+                    continue;
+                }
+            }
+            const string&          path = paths[k];
+            const string::size_type e   = path.find_last_not_of('/');
+            const string::size_type p   = e == string::npos ?
+                string::npos : path.rfind('/', e);
+            results[i] = r.fattr;
+            if (e == string::npos) {
+                results[i].filename = "/";
+            } else {
+                results[i].filename.assign(path, p + 1, e - p);
+            }
+        }
+        start = end;
+    }
+    return 0;
+}
+
+int
+KfsClientImpl::GetContentSummary(const char* pathname, int64_t& dirCount,
+    int64_t& fileCount, int64_t& byteCount)
+{
+    QCStMutexLocker l(mMutex);
+
+    if (! pathname || ! *pathname) {
+        return -EINVAL;
+    }
+    string path;
+    if (pathname[0] != '/') {
+        path.assign(mCwd.data(), mCwd.length());
+        path.append("/", 1);
+    }
+    path.append(pathname);
+    GetContentSummaryOp op(0, ROOTFID, path.c_str());
+    DoMetaOpWithRetry(&op);
+    if (op.status < 0) {
+        return GetOpStatus(op);
+    }
+    dirCount  = op.dirCount;
+    fileCount = op.fileCount;
+    byteCount = op.byteCount;
+    return 0;
+}
+
 int
 KfsClientImpl::GetNumChunks(const char *pathname)
 {
@@ -323,6 +323,26 @@ public:
         bool computeFilesize = true, bool updateClientCache = true,
         bool fileIdAndTypeOnly = false);
 
+    ///
+    /// Read the next page of a directory's contents and attributes.
+    /// Unlike the above, the memory use is bounded by the page size, and
+    /// the client's attribute cache is not updated.
+    /// @param[in] pathname  The full pathname such as /.../dir
+    /// @param[in,out] cursor  Empty to start from the first entry; on
+    ///     return the position to continue from with the next call.
+    /// @param[out] result  The page's entries and their attributes.
+    /// @param[out] hasMoreEntries  Set if more entries remain.
+    /// @param[in] maxEntries  Max page entries; <= 0 -- use default.
+    /// @param[in] approxFilesize  When set, the sizes of the files being
+    ///     written are estimated by the meta server, instead of querying
+    ///     chunk servers.
+    /// @retval 0 if readdirplus is successful; -errno otherwise
+    ///
+    int ReaddirPlus(const char* pathname, string& cursor,
+        vector<KfsFileAttr>& result, bool& hasMoreEntries,
+        int maxEntries = 0, bool computeFilesize = true,
+        bool approxFilesize = false);
+
     ///
     /// Read a directory's contents and retrieve the attributes
     /// @retval 0 if readdirplus is successful; -errno otherwise
@@ -347,6 +367,35 @@ public:
     int Stat(const char* pathname, KfsFileAttr& result, bool computeFilesize = true);
     int Stat(int fd, KfsFileAttr& result);
 
+    ///
+    /// Stat a list of files with as few meta server round trips as possible.
+    /// @param[in] pathnames The list of pathnames
+    /// @param[out] results  The attributes, one per pathname
+    /// @param[out] statuses 0 if stat was successful; -errno otherwise, one
+    /// per pathname
+    /// @param[in] computeFilesize  When set, for files, the size of
+    /// file is computed and the value is returned in result.st_size
+    /// @retval 0 if the batch was processed; -errno otherwise
+    ///
+    int StatBatch(const vector<string>& pathnames,
+        vector<KfsFileAttr>& results, vector<int>& statuses,
+        bool computeFilesize = true);
+
+    ///
+    /// Get the directory and file count, and the sum of the file sizes of
+    /// the subtree rooted at the specified directory, with a single meta
+    /// server round trip. The meta server maintains these with every update,
+    /// if directory sizes update is enabled, otherwise -ENOSYS is returned.
+    /// For a file, the counts are 0 and 1, and the file size is returned.
+    /// @param[in] pathname The full pathname
+    /// @param[out] dirCount The number of sub directories
+    /// @param[out] fileCount The number of files
+    /// @param[out] byteCount The sum of the file sizes
+    /// @retval 0 on success; -errno otherwise
+    ///
+    int GetContentSummary(const char* pathname, int64_t& dirCount,
+        int64_t& fileCount, int64_t& byteCount);
+
     ///
     /// Return the # of chunks in the file specified by the fully qualified pathname.
     /// -1 if there is an error.
@@ -794,6 +843,7 @@ private:
     kfsSeq_t                       mCreateId;
     bool                           mUseOsUserAndGroupFlag;
     bool                           mInitLookupRootFlag;
+    bool                           mRmdirsFastFlag;
     UserNames                      mUserNames;
     GroupNames                     mGroupNames;
     UserIds                        mUserIds;
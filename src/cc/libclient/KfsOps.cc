@@ -35,11 +35,13 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "kfsio/checksum.h"
 #include "kfsio/DelegationToken.h"
 #include "common/RequestParser.h"
 #include "common/kfserrno.h"
+#include "common/IntToString.h"
 #include "utils.h"
 
 namespace KFS
@@ -238,6 +240,17 @@ RmdirOp::Request(ostream &os)
     "\r\n";
 }
 
+void
+RmdirsOp::Request(ostream &os)
+{
+    os <<
+        "RMDIRS \r\n"          << ReqHeaders(*this) <<
+        "Parent File-handle: " << parentFid         << "\r\n"
+        "Pathname: "           << pathname          << "\r\n"
+        "Directory: "          << dirname           << "\r\n"
+    "\r\n";
+}
+
 void
 RenameOp::Request(ostream &os)
 {
@@ -312,11 +325,19 @@ ReaddirPlusOp::Request(ostream &os)
     ;
     if (fileIdAndTypeOnlyFlag) {
         os << "FidT-only: 1\r\n";
+    } else if (approxFileSizeFlag) {
+        os << "Approx-size: 1\r\n";
     } else if (omitLastChunkInfoFlag) {
         os << "Omit-lci: 1\r\n";
     }
+    if (0 < maxRespSize) {
+        os << "Max-resp-size: " << maxRespSize << "\r\n";
+    }
     if (! fnameStart.empty()) {
         os << "Fname-start: " << fnameStart << "\r\n";
+        if (resumeFlag) {
+            os << "Fname-resume: 1\r\n";
+        }
     }
     os << "\r\n";
 }
@@ -359,6 +380,37 @@ LookupPathOp::Request(ostream &os)
     "\r\n";
 }
 
+void
+GetContentSummaryOp::Request(ostream &os)
+{
+    os <<
+        "GET_CONTENT_SUMMARY\r\n" << ReqHeaders(*this) <<
+        "Root File-handle: "      << rootFid           << "\r\n"
+        "Pathname: "              << filename          << "\r\n"
+    "\r\n";
+}
+
+void
+LookupBatchOp::Request(ostream &os)
+{
+    content.clear();
+    for (int i = 0; i < numEntries; i++) {
+        AppendDecIntToString(content, dirFids ? dirFids[i] : kfsFileId_t(-1));
+        content += ' ';
+        AppendDecIntToString(content, names[i].size());
+        content += ' ';
+        content += names[i];
+        content += '\n';
+    }
+    AttachContentBuf(content.data(), content.size(), false);
+    contentLength = content.size();
+    os <<
+        "LOOKUP_BATCH\r\n" << ReqHeaders(*this) <<
+        "Num-entries: "    << numEntries        << "\r\n"
+        "Content-length: " << contentLength     << "\r\n"
+    "\r\n";
+}
+
 void
 GetAllocOp::Request(ostream &os)
 {
@@ -1006,6 +1058,61 @@ LookupPathOp::ParseResponseHeaderSelf(const Properties &prop)
     ParseFileAttribute(prop, fattr, userName, groupName);
 }
 
+void
+GetContentSummaryOp::ParseResponseHeaderSelf(const Properties &prop)
+{
+    fid       = prop.getValue("File-handle", kfsFileId_t(-1));
+    dirFlag   = prop.getValue("Type", string()) == "dir";
+    dirCount  = prop.getValue("Dir-count",  int64_t(-1));
+    fileCount = prop.getValue("File-count", int64_t(-1));
+    byteCount = prop.getValue("Byte-count", chunkOff_t(-1));
+}
+
+void
+LookupBatchOp::ParseResponseHeaderSelf(const Properties &prop)
+{
+    euser  = prop.getValue("EUserId",  euser);
+    egroup = prop.getValue("EGroupId", kKfsGroupNone);
+    if (0 <= status && prop.getValue("Num-entries", -1) != numEntries) {
+        status    = -EINVAL;
+        statusMsg = "invalid batch lookup response entries count";
+    }
+}
+
+int
+LookupBatchOp::ParseResults()
+{
+    results.clear();
+    if (numEntries <= 0) {
+        return 0;
+    }
+    if (! contentBuf) {
+        return -EINVAL;
+    }
+    results.resize(numEntries);
+    const char        kSeparator = ':';
+    const char*       ptr        = contentBuf;
+    const char* const end        = ptr + contentLength;
+    Properties        prop;
+    for (Results::iterator it = results.begin(); it != results.end(); ++it) {
+        const char* const next = ptr < end ? strstr(ptr, "\r\n\r\n") : 0;
+        if (! next || end <= next) {
+            results.clear();
+            return -EINVAL;
+        }
+        prop.clear();
+        prop.loadProperties(ptr, next - ptr + 2, kSeparator);
+        it->status = prop.getValue("Status", -1);
+        if (it->status < 0) {
+            it->status = -KfsToSysErrno(-it->status);
+        } else if (it->status == 0) {
+            ParseFileAttribute(prop, it->fattr, it->userName, it->groupName);
+        }
+        ptr = next + 4;
+    }
+    return 0;
+}
+
 static inline bool
 ParseChunkServerAccess(
     KfsOp&                    inOp,
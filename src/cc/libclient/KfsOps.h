@@ -366,6 +366,23 @@ struct RmdirOp : public KfsOp {
     }
 };
 
+// Remove directory along with its content on the meta server.
+struct RmdirsOp : public KfsOp {
+    kfsFileId_t parentFid; // input parent file-id
+    const char* dirname;
+    const char* pathname; // input: full pathname
+    RmdirsOp(kfsSeq_t s, kfsFileId_t p, const char* d, const char* pn)
+        : KfsOp(CMD_RMDIR, s), parentFid(p), dirname(d), pathname(pn)
+        {}
+    void Request(ostream& os);
+    // default parsing of OK/Cseq/Status/Content-length will suffice.
+
+    virtual ostream& ShowSelf(ostream& os) const {
+        os << "rmdirs: " << dirname << " (parentfid = " << parentFid << ")";
+        return os;
+    }
+};
+
 struct RenameOp : public KfsOp {
     kfsFileId_t parentFid; // input parent file-id
     const char *oldname;  // old file name/dir
@@ -475,8 +492,11 @@ struct ReaddirPlusOp : public KfsOp {
     bool        getLastChunkInfoOnlyIfSizeUnknown;
     bool        omitLastChunkInfoFlag;
     bool        fileIdAndTypeOnlyFlag;
+    bool        approxFileSizeFlag; // meta server estimates unknown sizes
+    bool        resumeFlag;         // resume if fname start was removed
     bool        hasMoreEntriesFlag;
     int         numEntries; // # of entries in the directory
+    int         maxRespSize; // response size limit, if > 0
     string      fnameStart;
     ReaddirPlusOp(kfsSeq_t s, kfsFileId_t f, bool cif, bool olcif, bool fidtof)
         : KfsOp(CMD_READDIRPLUS, s),
@@ -484,8 +504,11 @@ struct ReaddirPlusOp : public KfsOp {
           getLastChunkInfoOnlyIfSizeUnknown(cif),
           omitLastChunkInfoFlag(olcif),
           fileIdAndTypeOnlyFlag(fidtof),
+          approxFileSizeFlag(false),
+          resumeFlag(false),
           hasMoreEntriesFlag(false),
           numEntries(0),
+          maxRespSize(0),
           fnameStart()
         {}
     void Request(ostream& os);
@@ -567,6 +590,79 @@ struct LookupPathOp : public KfsOp {
     }
 };
 
+/// Get the subtree directory and file count, and the sum of the file sizes.
+struct GetContentSummaryOp : public KfsOp {
+    kfsFileId_t rootFid;   // fid of the root dir
+    const char* filename;  // path relative to root
+    kfsFileId_t fid;       // result
+    bool        dirFlag;   // result
+    int64_t     dirCount;  // result
+    int64_t     fileCount; // result
+    chunkOff_t  byteCount; // result
+    GetContentSummaryOp(kfsSeq_t s, kfsFileId_t r, const char* f)
+        : KfsOp(CMD_GETDIRSUMMARY, s),
+          rootFid(r),
+          filename(f),
+          fid(-1),
+          dirFlag(false),
+          dirCount(-1),
+          fileCount(-1),
+          byteCount(-1)
+        {}
+    void Request(ostream& os);
+    virtual void ParseResponseHeaderSelf(const Properties& prop);
+
+    virtual ostream& ShowSelf(ostream& os) const {
+        os << "get_content_summary: " << filename <<
+            " (rootFid = " << rootFid << ")";
+        return os;
+    }
+};
+
+/// Look up a batch of paths, or directory id and name pairs, with a single
+/// meta server round trip.
+struct LookupBatchOp : public KfsOp {
+    struct Result
+    {
+        Result()
+            : status(-EIO),
+              fattr(),
+              userName(),
+              groupName()
+            {}
+        int      status;
+        FileAttr fattr;
+        string   userName;
+        string   groupName;
+    };
+    typedef vector<Result> Results;
+
+    const string*      names;    // absolute paths, or names relative to dirs
+    const kfsFileId_t* dirFids;  // if null, names must be absolute paths
+    int                numEntries;
+    kfsUid_t           euser;    // result -- effective user
+    kfsGid_t           egroup;   // result -- effective group
+    Results            results;  // result -- ParseResults()
+    string             content;
+    LookupBatchOp(kfsSeq_t s, const string* n, const kfsFileId_t* d, int cnt)
+        : KfsOp(CMD_LOOKUP, s),
+          names(n),
+          dirFids(d),
+          numEntries(cnt),
+          euser(kKfsUserNone),
+          egroup(kKfsGroupNone),
+          results(),
+          content()
+        {}
+    void Request(ostream& os);
+    virtual void ParseResponseHeaderSelf(const Properties& prop);
+    int ParseResults();
+    virtual ostream& ShowSelf(ostream& os) const {
+        os << "lookup_batch: entries: " << numEntries;
+        return os;
+    }
+};
+
 /// Coalesce blocks from src->dst by appending the blocks of src to
 /// dst.  If the op is successful, src will end up with 0 blocks.
 struct CoalesceBlocksOp: public KfsOp {
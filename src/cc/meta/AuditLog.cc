@@ -29,12 +29,41 @@
 #include "AuditLog.h"
 #include "MetaRequest.h"
 #include "kfsio/IOBuffer.h"
+#include "kfsio/Counter.h"
+#include "kfsio/Globals.h"
 #include "common/BufferedLogWriter.h"
 #include "common/kfserrno.h"
 #include "common/IntToString.h"
+#include "common/MsgLogger.h"
+#include "common/Properties.h"
+#include "common/kfsatomic.h"
+#include "common/time.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/qcstutils.h"
+#include "qcdio/qcdebug.h"
+#include "qcdio/QCUtils.h"
+
+#include <zlib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
 
 namespace KFS
 {
+using std::string;
+using std::vector;
+using std::min;
+using std::max;
+using libkfsio::globals;
 
 class AuditLogWriter : public BufferedLogWriter::Writer
 {
@@ -121,10 +150,641 @@ GetAuditMsgWriter()
     return sAuditMsgWriter;
 }
 
+// Binary audit log writer. The request processing threads copy compact fixed
+// size records into per thread single producer single consumer ring buffers,
+// without acquiring any locks. The writer thread drains the ring buffers,
+// formats and optionally compresses the records, and writes the resulting
+// blocks into the log file, rotating the file when it reaches the configured
+// size. The ring buffer is sized to hold the records produced at the max.
+// expected rate over the flush interval, and the producer wakes up the writer
+// when the ring buffer becomes half full. The records are dropped when the
+// ring buffer is full, the dropped records are counted, and reported in the
+// meta server stats and in the message log.
+class AuditLogBinaryWriter : public QCRunnable
+{
+public:
+    AuditLogBinaryWriter()
+        : QCRunnable(),
+          mMutex(),
+          mCond(),
+          mThread(),
+          mEnabledFlag(false),
+          mRunFlag(false),
+          mRingsPtr(0),
+          mRingSize(8 << 10),
+          mMaxRecordRate(64 << 10),
+          mWakeupFlag(false),
+          mFileName(),
+          mCompressionLevel(Z_BEST_SPEED),
+          mBlockSize(256 << 10),
+          mFlushInterval(1000 * 1000),
+          mMaxLogFileSize(-1),
+          mMaxLogFiles(-1),
+          mFd(-1),
+          mFileSize(0),
+          mLastFlushTime(0),
+          mRecordCount(0),
+          mDroppedCounter("Audit Log Dropped Records"),
+          mReportedDroppedCount(0),
+          mRawBuf(),
+          mBlockBuf()
+        { globals().counterManager.AddCounter(&mDroppedCounter); }
+    ~AuditLogBinaryWriter()
+    {
+        AuditLogBinaryWriter::Stop();
+        globals().counterManager.RemoveCounter(&mDroppedCounter);
+    }
+    bool IsEnabled() const
+        { return mEnabledFlag; }
+    void Log(
+        const MetaRequest& inOp)
+    {
+        if (! mEnabledFlag) {
+            return;
+        }
+        Ring* const theRingPtr = GetRing();
+        const int   theCount   = theRingPtr ? theRingPtr->Put(inOp) : -1;
+        if (theCount < 0) {
+            mDroppedCounter.Update(1);
+        } else if (theCount == theRingPtr->GetHighWaterMark()) {
+            Wakeup();
+        }
+    }
+    void SetParameters(
+        const Properties& inProps,
+        const string&     inPrefix)
+    {
+        QCStMutexLocker theLocker(mMutex);
+        mFileName = inProps.getValue(inPrefix + "fileName", mFileName);
+        mCompressionLevel = max(0, min(Z_BEST_COMPRESSION, inProps.getValue(
+            inPrefix + "compressionLevel", mCompressionLevel)));
+        mBlockSize = max(4 << 10, min(64 << 20, inProps.getValue(
+            inPrefix + "blockSize", mBlockSize)));
+        mFlushInterval = max(int64_t(1000), (int64_t)(inProps.getValue(
+            inPrefix + "flushIntervalSec", mFlushInterval * 1e-6) * 1e6));
+        mMaxLogFileSize = (int64_t)inProps.getValue(
+            inPrefix + "maxLogFileSize", (double)mMaxLogFileSize);
+        mMaxLogFiles = inProps.getValue(
+            inPrefix + "maxLogFiles", mMaxLogFiles);
+        mRingSize = max(64, inProps.getValue(
+            inPrefix + "threadBufferSize", mRingSize));
+        mMaxRecordRate = max(0, inProps.getValue(
+            inPrefix + "maxRecordRate", mMaxRecordRate));
+        if (mFileName.empty()) {
+            mEnabledFlag = false;
+            return;
+        }
+        if (mFd >= 0) {
+            // Re-open the file with the next flush, in case the file name
+            // has changed.
+            mCond.Notify();
+        }
+        if (! mThread.IsStarted()) {
+            mRunFlag = true;
+            const int kStackSize = 64 << 10;
+            mThread.Start(this, kStackSize, "AuditLog");
+        }
+        mEnabledFlag = true;
+    }
+    void Stop()
+    {
+        QCStMutexLocker theLocker(mMutex);
+        mEnabledFlag = false;
+        if (! mRunFlag) {
+            return;
+        }
+        mRunFlag = false;
+        mCond.Notify();
+        {
+            QCStMutexUnlocker theUnlocker(mMutex);
+            mThread.Join();
+        }
+    }
+    void PrepareToFork()
+        { mMutex.Lock(); }
+    void ForkDone()
+        { mMutex.Unlock(); }
+    void ChildAtFork()
+    {
+        mEnabledFlag = false;
+        mRunFlag     = false;
+        if (mFd >= 0) {
+            close(mFd);
+            mFd = -1;
+        }
+    }
+    virtual void Run()
+    {
+        QCStMutexLocker theLocker(mMutex);
+        mLastFlushTime = microseconds();
+        string theFileName;
+        while (mRunFlag) {
+            if (! mWakeupFlag) {
+                mCond.Wait(mMutex, QCMutex::Time(mFlushInterval) * 1000 / 4);
+            }
+            mWakeupFlag = false;
+            Drain();
+            ReportDropped();
+            const int64_t theNow = microseconds();
+            if (mRawBuf.empty() || (mRunFlag &&
+                    (int)mRawBuf.size() < mBlockSize &&
+                    theNow < mLastFlushTime + mFlushInterval &&
+                    theFileName == mFileName)) {
+                continue;
+            }
+            mLastFlushTime = theNow;
+            Flush(theFileName);
+        }
+        Drain();
+        ReportDropped();
+        Flush(theFileName);
+        if (mFd >= 0) {
+            close(mFd);
+            mFd = -1;
+        }
+    }
+private:
+    enum { kMaxOpNameLen = 64 };
+    enum { kMaxIpLen     = 63 };
+
+    struct Record
+    {
+        int64_t  mTime;
+        int64_t  mDuration;
+        int64_t  mSeq;
+        int64_t  mFid;
+        int32_t  mStatus;
+        int32_t  mOp;
+        kfsUid_t mAuthUid;
+        kfsUid_t mEUser;
+        kfsGid_t mEGroup;
+        uint8_t  mIpLen;
+        char     mIp[kMaxIpLen];
+    };
+    class Ring
+    {
+    public:
+        Ring(
+            int   inSize,
+            Ring* inNextPtr)
+            : mHead(0),
+              mTail(0),
+              mMask(0),
+              mRecordsPtr(0),
+              mNextPtr(inNextPtr)
+        {
+            int theSize = 1;
+            while (theSize < inSize) {
+                theSize <<= 1;
+            }
+            mMask       = theSize - 1;
+            mRecordsPtr = new Record[theSize];
+        }
+        // Returns the number of records in the buffer, including the one just
+        // added, or -1 if the buffer is full.
+        int Put(
+            const MetaRequest& inOp)
+        {
+            const int64_t theHead  = mHead;
+            const int64_t theCount =
+                theHead - SyncAddAndFetch(mTail, int64_t(0));
+            if (mMask < theCount) {
+                return -1;
+            }
+            Record& theRec = mRecordsPtr[theHead & mMask];
+            const int64_t theNow = microseconds();
+            theRec.mTime     = 0 < inOp.recvTime ? inOp.recvTime : theNow;
+            theRec.mDuration = theNow - theRec.mTime;
+            theRec.mSeq      = inOp.opSeqno;
+            theRec.mFid      = GetFid(inOp);
+            theRec.mStatus   = inOp.status;
+            theRec.mOp       = inOp.op;
+            theRec.mAuthUid  = inOp.authUid;
+            theRec.mEUser    = inOp.euser;
+            theRec.mEGroup   = inOp.egroup;
+            theRec.mIpLen    = (uint8_t)min(
+                inOp.clientIp.size(), size_t(kMaxIpLen));
+            memcpy(theRec.mIp, inOp.clientIp.data(), theRec.mIpLen);
+            // Full barrier ensures that the record content is visible prior
+            // to the head update.
+            SyncAddAndFetch(mHead, int64_t(1));
+            return (int)(theCount + 1);
+        }
+        int GetHighWaterMark() const
+            { return (int)((mMask + 1) / 2); }
+        template<typename T>
+        int Get(
+            T& inFunc)
+        {
+            const int64_t theHead = SyncAddAndFetch(mHead, int64_t(0));
+            const int64_t theTail = mTail;
+            for (int64_t i = theTail; i < theHead; i++) {
+                inFunc(mRecordsPtr[i & mMask]);
+            }
+            if (theTail < theHead) {
+                SyncAddAndFetch(mTail, theHead - theTail);
+            }
+            return (int)(theHead - theTail);
+        }
+        Ring* GetNext() const
+            { return mNextPtr; }
+    private:
+        volatile int64_t mHead;
+        volatile int64_t mTail;
+        int64_t          mMask;
+        Record*          mRecordsPtr;
+        Ring* const      mNextPtr;
+    private:
+        Ring(
+            const Ring& inRing);
+        Ring& operator=(
+            const Ring& inRing);
+    };
+    class Encoder
+    {
+    public:
+        Encoder(
+            vector<char>& inBuf)
+            : mBuf(inBuf)
+            {}
+        void operator()(
+            const Record& inRec)
+        {
+            const char* const theNamePtr = GetOpName(inRec.mOp);
+            const size_t      theNameLen = min(
+                strlen(theNamePtr), size_t(kMaxOpNameLen));
+            const size_t      theLen     =
+                AuditLog::kBinaryRecordFixedSize + theNameLen + inRec.mIpLen;
+            const size_t      thePos     = mBuf.size();
+            mBuf.resize(thePos + 2 + theLen);
+            char* thePtr = &mBuf[thePos];
+            Write(thePtr, (uint16_t)theLen);
+            Write(thePtr, inRec.mTime);
+            Write(thePtr, inRec.mDuration);
+            Write(thePtr, inRec.mSeq);
+            Write(thePtr, inRec.mFid);
+            Write(thePtr, (int32_t)(inRec.mStatus < 0 ?
+                -SysToKfsErrno(-inRec.mStatus) : inRec.mStatus));
+            Write(thePtr, (uint32_t)inRec.mAuthUid);
+            Write(thePtr, (uint32_t)inRec.mEUser);
+            Write(thePtr, (uint32_t)inRec.mEGroup);
+            Write(thePtr, (uint8_t)theNameLen);
+            memcpy(thePtr, theNamePtr, theNameLen);
+            thePtr += theNameLen;
+            Write(thePtr, inRec.mIpLen);
+            memcpy(thePtr, inRec.mIp, inRec.mIpLen);
+            thePtr += inRec.mIpLen;
+            QCASSERT(&mBuf[0] + mBuf.size() == thePtr);
+        }
+    private:
+        vector<char>& mBuf;
+    };
+
+    QCMutex          mMutex;
+    QCCondVar        mCond;
+    QCThread         mThread;
+    volatile bool    mEnabledFlag;
+    bool             mRunFlag;
+    Ring*            mRingsPtr;
+    int              mRingSize;
+    int              mMaxRecordRate;
+    bool             mWakeupFlag;
+    string           mFileName;
+    int              mCompressionLevel;
+    int              mBlockSize;
+    int64_t          mFlushInterval;
+    int64_t          mMaxLogFileSize;
+    int              mMaxLogFiles;
+    int              mFd;
+    int64_t          mFileSize;
+    int64_t          mLastFlushTime;
+    int64_t          mRecordCount;
+    Counter          mDroppedCounter;
+    int64_t          mReportedDroppedCount;
+    vector<char>     mRawBuf;
+    vector<char>     mBlockBuf;
+
+    Ring* GetRing()
+    {
+        static __thread Ring* sRingPtr = 0;
+        if (! sRingPtr) {
+            QCStMutexLocker theLocker(mMutex);
+            if (! mRunFlag) {
+                return 0;
+            }
+            // Size the buffer to hold the records produced at the max.
+            // expected rate over the flush interval. The flush interval
+            // change has no effect on the existing buffers.
+            const int kMaxRingSize = 4 << 20;
+            const int theSize      = (int)min(int64_t(kMaxRingSize), max(
+                int64_t(mRingSize),
+                mMaxRecordRate * mFlushInterval / (1000 * 1000)
+            ));
+            mRingsPtr = new Ring(theSize, mRingsPtr);
+            sRingPtr  = mRingsPtr;
+        }
+        return sRingPtr;
+    }
+    void Wakeup()
+    {
+        // Invoked once the ring buffer becomes half full, i.e. at most once
+        // per half of the buffer records, thus the mutex acquisition cost
+        // is amortized.
+        QCStMutexLocker theLocker(mMutex);
+        if (! mWakeupFlag) {
+            mWakeupFlag = true;
+            mCond.Notify();
+        }
+    }
+    void ReportDropped()
+    {
+        const int64_t theDroppedCount = mDroppedCounter.GetValue();
+        if (mReportedDroppedCount == theDroppedCount) {
+            return;
+        }
+        KFS_LOG_STREAM_ERROR <<
+            "audit log: dropped records: " <<
+                (theDroppedCount - mReportedDroppedCount) <<
+            " total: " << theDroppedCount <<
+        KFS_LOG_EOM;
+        mReportedDroppedCount = theDroppedCount;
+    }
+    void Drain()
+    {
+        Encoder theEncoder(mRawBuf);
+        for (Ring* thePtr = mRingsPtr; thePtr; thePtr = thePtr->GetNext()) {
+            mRecordCount += thePtr->Get(theEncoder);
+        }
+    }
+    void Flush(
+        string& ioFileName)
+    {
+        if (ioFileName != mFileName && 0 <= mFd) {
+            close(mFd);
+            mFd = -1;
+        }
+        if (mRawBuf.empty()) {
+            return;
+        }
+        ioFileName = mFileName;
+        const int     theLevel     = mCompressionLevel;
+        const int64_t theMaxSize   = mMaxLogFileSize;
+        const int     theMaxFiles  = mMaxLogFiles;
+        const int64_t theRecCount  = mRecordCount;
+        mRecordCount = 0;
+        vector<char> theRawBuf;
+        theRawBuf.swap(mRawBuf);
+        // Compression and disk io are performed without holding the mutex,
+        // in order not to block the new threads ring buffer registration.
+        QCStMutexUnlocker theUnlocker(mMutex);
+        if (! MakeBlock(theRawBuf, theLevel, theRecCount) ||
+                ! Write(ioFileName, theMaxSize, theMaxFiles)) {
+            KFS_LOG_STREAM_ERROR <<
+                "audit log: " << ioFileName <<
+                " dropped records: " << theRecCount <<
+            KFS_LOG_EOM;
+        }
+        theRawBuf.clear();
+        theUnlocker.Lock();
+        if (mRawBuf.empty()) {
+            theRawBuf.swap(mRawBuf); // Re-use buffer.
+        }
+    }
+    bool MakeBlock(
+        const vector<char>& inRawBuf,
+        int                 inLevel,
+        int64_t             inRecCount)
+    {
+        const uLong theRawLen = (uLong)inRawBuf.size();
+        uLongf      theLen    = theRawLen;
+        uint32_t    theFlags  = 0;
+        mBlockBuf.resize(AuditLog::kBinaryBlockHeaderSize +
+            (0 < inLevel ? compressBound(theRawLen) : theRawLen));
+        char* const thePayloadPtr =
+            &mBlockBuf[0] + AuditLog::kBinaryBlockHeaderSize;
+        if (0 < inLevel) {
+            theLen = mBlockBuf.size() - AuditLog::kBinaryBlockHeaderSize;
+            const int theStatus = compress2(
+                reinterpret_cast<Bytef*>(thePayloadPtr),
+                &theLen,
+                reinterpret_cast<const Bytef*>(&inRawBuf[0]),
+                theRawLen,
+                inLevel
+            );
+            if (theStatus != Z_OK) {
+                KFS_LOG_STREAM_ERROR <<
+                    "audit log: compression failure: " << theStatus <<
+                KFS_LOG_EOM;
+                return false;
+            }
+            if (theLen < theRawLen) {
+                theFlags |= AuditLog::kBinaryFlagCompressed;
+            }
+        }
+        if ((theFlags & AuditLog::kBinaryFlagCompressed) == 0) {
+            theLen = theRawLen;
+            memcpy(thePayloadPtr, &inRawBuf[0], theLen);
+        }
+        mBlockBuf.resize(AuditLog::kBinaryBlockHeaderSize + theLen);
+        char* thePtr = &mBlockBuf[0];
+        Write(thePtr, (uint32_t)AuditLog::kBinaryMagic);
+        Write(thePtr, theFlags);
+        Write(thePtr, (uint32_t)inRecCount);
+        Write(thePtr, (uint32_t)theRawLen);
+        Write(thePtr, (uint32_t)theLen);
+        Write(thePtr, (uint32_t)crc32(crc32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(thePayloadPtr), (uInt)theLen));
+        QCASSERT(thePayloadPtr == thePtr);
+        return true;
+    }
+    bool Write(
+        const string& inFileName,
+        int64_t       inMaxSize,
+        int           inMaxFiles)
+    {
+        if (0 <= mFd && 0 < inMaxSize && inMaxSize <= mFileSize) {
+            close(mFd);
+            mFd = -1;
+            Rotate(inFileName, inMaxFiles);
+        }
+        if (mFd < 0) {
+            mFd = open(inFileName.c_str(),
+                O_WRONLY | O_CREAT | O_APPEND, 0644);
+            struct stat theStat = {0};
+            if (mFd < 0 || fstat(mFd, &theStat)) {
+                const int theErr = errno;
+                KFS_LOG_STREAM_ERROR <<
+                    "audit log: " << inFileName << ": " <<
+                        QCUtils::SysError(theErr) <<
+                KFS_LOG_EOM;
+                if (0 <= mFd) {
+                    close(mFd);
+                    mFd = -1;
+                }
+                return false;
+            }
+            mFileSize = theStat.st_size;
+        }
+        const char*       thePtr    = &mBlockBuf[0];
+        const char* const theEndPtr = thePtr + mBlockBuf.size();
+        while (thePtr < theEndPtr) {
+            const ssize_t theNWr = write(mFd, thePtr, theEndPtr - thePtr);
+            if (theNWr < 0) {
+                const int theErr = errno;
+                if (theErr == EINTR) {
+                    continue;
+                }
+                KFS_LOG_STREAM_ERROR <<
+                    "audit log: " << inFileName << ": " <<
+                        QCUtils::SysError(theErr) <<
+                KFS_LOG_EOM;
+                close(mFd);
+                mFd = -1;
+                return false;
+            }
+            thePtr    += theNWr;
+            mFileSize += theNWr;
+        }
+        return true;
+    }
+    void Rotate(
+        const string& inFileName,
+        int           inMaxFiles)
+    {
+        if (inMaxFiles <= 0) {
+            string theName = inFileName;
+            AppendDecIntToString(theName += ".", microseconds());
+            Rename(inFileName, theName);
+            return;
+        }
+        for (int i = inMaxFiles - 1; 0 < i; i--) {
+            string theFrom = inFileName;
+            string theTo   = inFileName;
+            AppendDecIntToString(theFrom += ".", i);
+            AppendDecIntToString(theTo   += ".", i + 1);
+            Rename(theFrom, theTo);
+        }
+        Rename(inFileName, inFileName + ".1");
+    }
+    static void Rename(
+        const string& inFrom,
+        const string& inTo)
+    {
+        if (rename(inFrom.c_str(), inTo.c_str()) && errno != ENOENT) {
+            const int theErr = errno;
+            KFS_LOG_STREAM_ERROR <<
+                "audit log: rename " << inFrom << " to " << inTo << ": " <<
+                    QCUtils::SysError(theErr) <<
+            KFS_LOG_EOM;
+        }
+    }
+    template<typename T>
+    static void Write(
+        char*& ioPtr,
+        T      inVal)
+    {
+        char* const theStartPtr = ioPtr;
+        ioPtr += sizeof(inVal);
+        char*       thePtr      = ioPtr;
+        while (theStartPtr <= --thePtr) {
+            *thePtr = (char)(inVal & 0xFF);
+            inVal >>= 8;
+        }
+    }
+    static const char* GetOpName(
+        int inOp)
+    {
+        static const char* const kOpNames[] = {
+#define KfsMakeMetaOpName(name) #name,
+            KfsForEachMetaOpId(KfsMakeMetaOpName)
+#undef KfsMakeMetaOpName
+            "UNKNOWN"
+        };
+        return kOpNames[(0 <= inOp && inOp < META_NUM_OPS_COUNT) ?
+            inOp : META_NUM_OPS_COUNT];
+    }
+    static fid_t GetFid(
+        const MetaRequest& inOp)
+    {
+        switch (inOp.op) {
+            case META_LOOKUP:
+                return static_cast<const MetaLookup&>(inOp).dir;
+            case META_LOOKUP_PATH:
+                return static_cast<const MetaLookupPath&>(inOp).root;
+            case META_GET_CONTENT_SUMMARY:
+                return static_cast<const MetaGetContentSummary&>(inOp).fid;
+            case META_CREATE: {
+                const MetaCreate& theOp = static_cast<const MetaCreate&>(inOp);
+                return (0 <= theOp.fid ? theOp.fid : theOp.dir);
+            }
+            case META_MKDIR: {
+                const MetaMkdir& theOp = static_cast<const MetaMkdir&>(inOp);
+                return (0 <= theOp.fid ? theOp.fid : theOp.dir);
+            }
+            case META_REMOVE:
+                return static_cast<const MetaRemove&>(inOp).dir;
+            case META_RMDIR:
+                return static_cast<const MetaRmdir&>(inOp).dir;
+            case META_RMDIRS:
+                return static_cast<const MetaRmdirs&>(inOp).dir;
+            case META_READDIR:
+                return static_cast<const MetaReaddir&>(inOp).dir;
+            case META_READDIRPLUS:
+                return static_cast<const MetaReaddirPlus&>(inOp).dir;
+            case META_GETALLOC:
+                return static_cast<const MetaGetalloc&>(inOp).fid;
+            case META_GETLAYOUT:
+                return static_cast<const MetaGetlayout&>(inOp).fid;
+            case META_ALLOCATE:
+                return static_cast<const MetaAllocate&>(inOp).fid;
+            case META_TRUNCATE:
+                return static_cast<const MetaTruncate&>(inOp).fid;
+            case META_RENAME:
+                return static_cast<const MetaRename&>(inOp).dir;
+            case META_SETMTIME:
+                return static_cast<const MetaSetMtime&>(inOp).fid;
+            case META_CHANGE_FILE_REPLICATION:
+                return static_cast<const MetaChangeFileReplication&>(inOp).fid;
+            case META_GETPATHNAME:
+                return static_cast<const MetaGetPathName&>(inOp).fid;
+            case META_CHMOD:
+                return static_cast<const MetaChmod&>(inOp).fid;
+            case META_CHOWN:
+                return static_cast<const MetaChown&>(inOp).fid;
+            default:
+                break;
+        }
+        return -1;
+    }
+private:
+    AuditLogBinaryWriter(
+        const AuditLogBinaryWriter&);
+    AuditLogBinaryWriter& operator=(
+        const AuditLogBinaryWriter&);
+};
+
+static AuditLogBinaryWriter&
+GetAuditBinaryWriter()
+{
+    static AuditLogBinaryWriter sAuditBinaryWriter;
+    return sAuditBinaryWriter;
+}
+
+/* static */ bool
+AuditLog::IsBinary()
+{
+    return GetAuditBinaryWriter().IsEnabled();
+}
+
 /* static */ void
 AuditLog::Log(
     const MetaRequest& inOp)
 {
+    AuditLogBinaryWriter& theBinaryWriter = GetAuditBinaryWriter();
+    if (theBinaryWriter.IsEnabled()) {
+        theBinaryWriter.Log(inOp);
+        return;
+    }
     AuditLogWriter theWriter(inOp);
     GetAuditMsgWriter().Append(
         inOp.status >= 0 ?
@@ -140,23 +800,28 @@ AuditLog::SetParameters(
 {
     GetAuditMsgWriter().SetParameters(inProps,
         "metaServer.auditLogWriter.");
+    GetAuditBinaryWriter().SetParameters(inProps,
+        "metaServer.auditLogBinary.");
 }
 
 /* static */ void
 AuditLog::Stop()
 {
     GetAuditMsgWriter().Stop();
+    GetAuditBinaryWriter().Stop();
 }
 
 /* static */ void
 AuditLog::PrepareToFork()
 {
     GetAuditMsgWriter().PrepareToFork();
+    GetAuditBinaryWriter().PrepareToFork();
 }
 
 /* static */ void
 AuditLog::ForkDone()
 {
+    GetAuditBinaryWriter().ForkDone();
     GetAuditMsgWriter().ForkDone();
 }
 
@@ -164,6 +829,7 @@ AuditLog::ForkDone()
 AuditLog::ChildAtFork()
 {
     GetAuditMsgWriter().ChildAtFork();
+    GetAuditBinaryWriter().ChildAtFork();
 }
 
 }
@@ -39,7 +39,29 @@ class Properties;
 class AuditLog
 {
 public:
+    // Binary audit log file format. The file consists of blocks. Each block
+    // starts with the fixed size header, followed by the block payload. All
+    // integers are in network (big endian) byte order.
+    // Block header:
+    //  magic (4), flags (4), record count (4), uncompressed payload size (4),
+    //  payload size (4), payload crc32 (4).
+    // The payload is zlib compressed if kBinaryFlagCompressed flag is set.
+    // Uncompressed payload is a sequence of records, each record is:
+    //  record length excluding the length field (2), request receive time in
+    //  microseconds (8), request processing time in microseconds (8),
+    //  client sequence number (8), file or directory id (8), status (4),
+    //  authenticated user id (4), effective user id (4), effective group id
+    //  (4), request name length (1), request name, client ip length (1),
+    //  client ip.
+    enum
+    {
+        kBinaryMagic           = 0x5146414C, // QFAL
+        kBinaryFlagCompressed  = 0x1,
+        kBinaryBlockHeaderSize = 6 * 4,
+        kBinaryRecordFixedSize = 4 * 8 + 4 * 4 + 1 + 1
+    };
     static void Log(const MetaRequest& inOp);
+    static bool IsBinary();
     static void SetParameters(const Properties& inProps);
     static void Stop();
     static void PrepareToFork();
@@ -28,9 +28,13 @@
 #ifndef CS_MAP_H
 #define CS_MAP_H
 
+#ifdef KFS_CSMAP_FLAT_TABLE
+#include "common/OpenAddressingHash.h"
+#else
 #include "qcdio/QCDLList.h"
 #include "common/LinearHash.h"
 #include "common/PoolAllocator.h"
+#endif
 #include "common/StdAllocator.h"
 #include "kfstypes.h"
 #include "meta.h"
@@ -43,17 +47,34 @@
 #include <string.h>
 #include <boost/static_assert.hpp>
 
+#include <algorithm>
+#include <map>
+
 namespace KFS
 {
 using std::vector;
+using std::map;
+using std::sort;
+using std::unique;
 
 // chunkid to server(s) map
+// With KFS_CSMAP_FLAT_TABLE defined the entries are allocated from the indexed
+// pool, the state lists are linked with 32 bit entry indexes, and the chunk id
+// lookup uses open addressing hash table, instead of linear hash with the
+// pointer linked lists. This reduces memory per chunk, but presently the random
+// lookups are slower than with the linear hash, therefore only csmapbench_flat
+// is built this way.
 class CSMap
 {
 public:
     class Entry;
 private:
+#ifdef KFS_CSMAP_FLAT_TABLE
+    class EntryAccessor;
+    typedef IndexedDLListOp<Entry, EntryAccessor> EList;
+#else
     typedef QCDLListOp<Entry, 0> EList;
+#endif
 public:
     typedef MetaRequest::Servers Servers;
 
@@ -70,6 +91,9 @@ public:
             kStateNoDestination      = 3,
             kStatePendingRecovery    = 4,
             kStateDelayedRecovery    = 5,
+            // Replication check candidate in the layout manager
+            // priority queue.
+            kStateQueuedReplication  = 6,
             kStateCount
         };
 
@@ -236,8 +260,13 @@ public:
         };
 
         IdxData mIdxData;
+#ifdef KFS_CSMAP_FLAT_TABLE
+        uint32_t mPrevIdx[1];
+        uint32_t mNextIdx[1];
+#else
         Entry*  mPrevPtr[1];
         Entry*  mNextPtr[1];
+#endif
 
         static Allocator& GetAllocator() {
             static Allocator alloc;
@@ -521,7 +550,11 @@ public:
             }
             return true;
         }
+#ifdef KFS_CSMAP_FLAT_TABLE
+        friend class IndexedDLListOp<Entry, EntryAccessor>;
+#else
         friend class QCDLListOp<Entry, 0>;
+#endif
         friend class CSMap;
     private:
         Entry(const Entry& entry);
@@ -533,6 +566,7 @@ public:
           mServers(),
           mPendingRemove(),
           mNullSlots(),
+          mHibernatedInfos(),
           mServerCount(0),
           mHibernatedCount(0),
           mRemoveServerScanPtr(0),
@@ -555,6 +589,13 @@ public:
     {
         mMap.SetDeleteObserver(0);
     }
+    static const char* GetTableType() {
+#ifdef KFS_CSMAP_FLAT_TABLE
+        return "open addressing";
+#else
+        return "linear hash";
+#endif
+    }
     bool SetDebugValidate(bool flag) {
         if (GetServerCount() > 0) {
             return (mDebugValidateFlag == flag);
@@ -617,6 +658,11 @@ public:
         }
         mServers[server->GetIndex()].reset();
         idx = server->GetIndex();
+        HibernatedInfo& info = mHibernatedInfos[idx];
+        info.mChunkCount   = server->GetChunkCount();
+        info.mRemovedCount = 0;
+        info.mValidFlag    = ! mDebugValidateFlag;
+        info.mStale.clear();
         server->SetIndex(-1, mDebugValidateFlag);
         Validate();
         return true;
@@ -630,18 +676,72 @@ public:
             return false;
         }
         assert(! mServers[idx] && mServerCount > 0);
+        mHibernatedInfos.erase(idx);
         mPendingRemove.push_back(idx);
         mServerCount--;
         // Start or restart full scan.
         RemoveServerScanFirst();
         return true;
     }
+    // Put the server back into the hibernated server slot, with all chunk
+    // entries that still reference the slot. The stale list returns the
+    // chunks that were deleted, or that changed while the server was
+    // hibernated. The list is sorted, and might contain chunks that no
+    // longer exist or no longer reference the slot. Not supported with debug
+    // validation, as the hosted chunk ids aren't tracked while hibernated.
+    bool RestoreHibernatedServer(const ChunkServerPtr& server, size_t idx,
+            vector<chunkId_t>& stale) {
+        if (! server || Validate(server) || ! CanRestoreHibernatedServer(idx)
+                || idx >= mServers.size() || mServers[idx]) {
+            return false;
+        }
+        HibernatedInfos::iterator const it = mHibernatedInfos.find(idx);
+        if (it->second.mChunkCount < it->second.mRemovedCount) {
+            return false;
+        }
+        Validate();
+        ClearHibernated(idx);
+        mServers[idx] = server;
+        server->SetIndex(idx, mDebugValidateFlag);
+        server->SetHosted(it->second.mChunkCount - it->second.mRemovedCount);
+        stale.swap(it->second.mStale);
+        mHibernatedInfos.erase(it);
+        sort(stale.begin(), stale.end());
+        stale.erase(unique(stale.begin(), stale.end()), stale.end());
+        Validate();
+        return true;
+    }
+    bool CanRestoreHibernatedServer(size_t idx) const {
+        if (mDebugValidateFlag || idx >= Entry::kMaxServers ||
+                ! IsHibernated(idx)) {
+            return false;
+        }
+        HibernatedInfos::const_iterator const it = mHibernatedInfos.find(idx);
+        return (it != mHibernatedInfos.end() && it->second.mValidFlag);
+    }
+    // Record the replicas on the hibernated servers as stale, for example
+    // when the chunk version changes. The entry keeps referencing the
+    // hibernated servers, in order to preserve the re-replication delay.
+    void SetHibernatedStale(const Entry& entry) const {
+        if (mHibernatedCount <= 0) {
+            return;
+        }
+        for (size_t i = 0, e = entry.ServerCount(); i < e; i++) {
+            const size_t idx = entry.IndexAt(i);
+            if (! mServers[idx] && IsHibernated(idx)) {
+                HibernatedStale(idx, entry.GetChunkId(), false);
+            }
+        }
+    }
     size_t GetServerCount() const {
         return mServerCount;
     }
     size_t GetHibernatedCount() const {
         return mHibernatedCount;
     }
+    bool HasStaleServers() const {
+        return (mRemoveServerScanPtr != 0);
+    }
     size_t ServerCount(const Entry& entry) const {
         if (mRemoveServerScanPtr) {
             return CleanupStaleServers(entry);
@@ -900,6 +1000,15 @@ public:
     size_t Size() const {
         return mMap.GetSize();
     }
+    // Hash table memory footprint, excluding the entries.
+    size_t GetTableByteCount() const {
+#ifdef KFS_CSMAP_FLAT_TABLE
+        return mMap.GetTableByteCount();
+#else
+        // Linear hash has one bucket pointer per entry.
+        return mMap.GetSize() * sizeof(void*);
+#endif
+    }
     void Clear() {
         mMap.Clear();
         RemoveServerCleanup(0);
@@ -1002,6 +1111,11 @@ private:
         KeyVal(const KeyVal& kv)
             : Entry(kv.GetKey(), kv.GetVal())
             {}
+#ifdef KFS_CSMAP_FLAT_TABLE
+        KeyVal(const Key& key, const Val& val, uint32_t idx)
+            : Entry(key, val)
+            { EList::Init(*this, idx); }
+#endif
         const Key& GetKey() const { return GetChunkId(); }
         const Val& GetVal() const { return *this; }
         Val& GetVal()             { return *this; }
@@ -1014,6 +1128,69 @@ public:
         Erasing(keyVal.GetVal());
     }
 private:
+#ifdef KFS_CSMAP_FLAT_TABLE
+    typedef IndexedPool<KeyVal> EntryPool;
+    class EntryAccessor
+    {
+    public:
+        // All maps share single entry pool, as the list operations are
+        // static.
+        static EntryPool& GetPool() {
+            static EntryPool sPool;
+            return sPool;
+        }
+        static Entry& Get(uint32_t idx) {
+            return *GetPool().Get(idx);
+        }
+    };
+    // List heads and iteration delimiters are allocated from the entry pool,
+    // in order to be addressable by the list indexes.
+    template<int TCount>
+    class PoolEntries
+    {
+    public:
+        PoolEntries() {
+            EntryPool& pool = EntryAccessor::GetPool();
+            for (int i = 0; i < TCount; i++) {
+                const uint32_t idx = pool.Allocate();
+                if (idx == EntryPool::kNullIndex) {
+                    panic("entry pool allocation failure", false);
+                }
+                mEntries[i] = new (pool.Get(idx)) KeyVal(0, Entry(), idx);
+            }
+        }
+        ~PoolEntries() {
+            EntryPool& pool = EntryAccessor::GetPool();
+            for (int i = TCount - 1; i >= 0; i--) {
+                // Removing from the list clears the index links, but keeps
+                // the entry's own index.
+                EList::Remove(*mEntries[i]);
+                const uint32_t idx = EList::GetIndex(*mEntries[i]);
+                mEntries[i]->~KeyVal();
+                pool.Deallocate(idx);
+            }
+        }
+        Entry& operator[](size_t i) const {
+            return *mEntries[i];
+        }
+    private:
+        KeyVal* mEntries[TCount];
+    private:
+        PoolEntries(const PoolEntries&);
+        PoolEntries& operator=(const PoolEntries&);
+    };
+    typedef OpenAddressingHash<
+        KeyVal,
+        EntryAccessor,
+        KeyCompare<chunkId_t>,
+        CSMap
+    > Map;
+public:
+    typedef Map::Allocator PAllocator;
+    const PAllocator& GetAllocator() const {
+        return mMap.GetAllocator();
+    }
+#else
     typedef LinearHash<
         KeyVal,
         KeyCompare<chunkId_t>,
@@ -1034,9 +1211,26 @@ public:
     const PAllocator& GetAllocator() const {
         return mMap.GetAllocator().GetAllocator();
     }
+#endif
 private:
     typedef vector<Entry::AllocIdx> SlotIndexes;
     typedef uint8_t                 HibernatedBits;
+    // Hibernated server slot state required to restore the slot with
+    // incremental chunk server hello.
+    struct HibernatedInfo
+    {
+        HibernatedInfo()
+            : mChunkCount(0),
+              mRemovedCount(0),
+              mValidFlag(false),
+              mStale()
+            {}
+        size_t            mChunkCount;
+        size_t            mRemovedCount;
+        bool              mValidFlag;
+        vector<chunkId_t> mStale;
+    };
+    typedef map<size_t, HibernatedInfo> HibernatedInfos;
     enum
     {
         kHibernatedBitShift = 3,
@@ -1047,6 +1241,7 @@ private:
     Servers        mServers;
     SlotIndexes    mPendingRemove;
     SlotIndexes    mNullSlots;
+    HibernatedInfos mHibernatedInfos;
     size_t         mServerCount;
     size_t         mHibernatedCount;
     Entry*         mRemoveServerScanPtr;
@@ -1056,8 +1251,13 @@ private:
     Entry*         mPrevPtr[Entry::kStateCount];
     Entry*         mNextPtr[Entry::kStateCount];
     size_t         mCounts[Entry::kStateCount];
+#ifdef KFS_CSMAP_FLAT_TABLE
+    PoolEntries<Entry::kStateCount + 1> mLists;
+    PoolEntries<Entry::kStateCount>     mNextEnd;
+#else
     Entry          mLists[Entry::kStateCount + 1];
     Entry          mNextEnd[Entry::kStateCount];
+#endif
     HibernatedBits mHibernatedIndexes[
         (Entry::kMaxServers + kHibernatedBitMask) /
         (1 << kHibernatedBitShift)];
@@ -1162,9 +1362,33 @@ private:
                 } else {
                     srv->RemoveHosted();
                 }
+            } else if (mHibernatedCount > 0 && IsHibernated(idx)) {
+                HibernatedStale(idx, entry.GetChunkId(), true);
             }
         }
     }
+    void HibernatedStale(size_t idx, chunkId_t chunkId,
+            bool removedFlag) const {
+        HibernatedInfos& infos = const_cast<CSMap*>(this)->mHibernatedInfos;
+        HibernatedInfos::iterator const it = infos.find(idx);
+        if (it == infos.end() || ! it->second.mValidFlag) {
+            return;
+        }
+        HibernatedInfo& info = it->second;
+        if (removedFlag) {
+            info.mRemovedCount++;
+        }
+        // Bound the memory use: restore isn't worth it if most of the
+        // replicas have changed.
+        if (info.mChunkCount <= info.mStale.size() ||
+                info.mChunkCount < info.mRemovedCount) {
+            info.mValidFlag = false;
+            vector<chunkId_t> tmp;
+            info.mStale.swap(tmp);
+            return;
+        }
+        info.mStale.push_back(chunkId);
+    }
     void AddHosted(const ChunkServerPtr& server, const Entry& entry) const {
         if (mDebugValidateFlag) {
             server->AddHosted(
@@ -1247,8 +1471,10 @@ private:
             i++;
         }
         ValidateServersNoScan(entry);
-        // Enqueue replication check if servers were removed.
-        if (prev != cnt && entry.GetState() == Entry::kStateNone) {
+        // Enqueue replication check if servers were removed. Re-check
+        // queued entry, as its replication priority might have changed.
+        if (prev != cnt && (entry.GetState() == Entry::kStateNone ||
+                entry.GetState() == Entry::kStateQueuedReplication)) {
             SetStateSelf(entry, Entry::kStateCheckReplication);
         }
         return ret;
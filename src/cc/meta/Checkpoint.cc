@@ -39,11 +39,23 @@
 #include "Logger.h"
 #include "util.h"
 #include "LayoutManager.h"
+#include "Restorer.h"
 #include "common/MdStream.h"
 #include "common/FdWriter.h"
+#include "common/MsgLogger.h"
+#include "common/time.h"
+#include "kfsio/Globals.h"
+#include "kfsio/ITimeout.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/QCUtils.h"
+#include "qcdio/qcstutils.h"
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <map>
+#include <deque>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -53,6 +65,11 @@ namespace KFS
 {
 using std::hex;
 using std::dec;
+using std::map;
+using std::deque;
+using std::ostringstream;
+using std::make_pair;
+using libkfsio::globalNetManager;
 
 // default values
 string CPDIR("./kfscp");        //!< directory for CP files
@@ -75,6 +92,601 @@ Checkpoint::write_leaves(ostream& os)
     return status;
 }
 
+// Checkpoint writer thread. The calling thread formats the leaves into
+// buffers, and the writer thread writes the buffers into the checkpoint
+// stream, and computes the checkpoint md5 in parallel with the leaves
+// formatting. The calling thread waits for the writer if the pending bytes
+// exceed the limit.
+class Checkpoint::Writer : public QCRunnable
+{
+public:
+    Writer(ostream& os, size_t maxPendingBytes)
+        : QCRunnable(),
+          mStream(os),
+          mMaxPendingBytes(maxPendingBytes),
+          mThread(),
+          mMutex(),
+          mCond(),
+          mSpaceCond(),
+          mQueue(),
+          mPendingBytes(0),
+          mFinishFlag(false)
+        {}
+    virtual ~Writer()
+        { Finish(); }
+    int Start()
+    {
+        const int kStackSize = 256 << 10;
+        const int err = mThread.TryToStart(
+            this, kStackSize, "CheckpointWriter");
+        if (err) {
+            KFS_LOG_STREAM_ERROR << QCUtils::SysError(
+                err, "failed to start checkpoint writer thread") <<
+            KFS_LOG_EOM;
+            return (err > 0 ? -err : (err == 0 ? -EINVAL : err));
+        }
+        return 0;
+    }
+    void Write(string& buf)
+    {
+        QCStMutexLocker locker(mMutex);
+        while (mMaxPendingBytes <= mPendingBytes) {
+            mSpaceCond.Wait(mMutex);
+        }
+        mPendingBytes += buf.size();
+        mQueue.push_back(string());
+        mQueue.back().swap(buf);
+        mCond.Notify();
+    }
+    void Finish()
+    {
+        if (! mThread.IsStarted()) {
+            return;
+        }
+        QCStMutexLocker locker(mMutex);
+        mFinishFlag = true;
+        mCond.Notify();
+        locker.Unlock();
+        mThread.Join();
+    }
+    virtual void Run()
+    {
+        QCStMutexLocker locker(mMutex);
+        for (; ;) {
+            while (mQueue.empty() && ! mFinishFlag) {
+                mCond.Wait(mMutex);
+            }
+            if (mQueue.empty()) {
+                break;
+            }
+            string buf;
+            buf.swap(mQueue.front());
+            mQueue.pop_front();
+            {
+                QCStMutexUnlocker unlocker(mMutex);
+                if (mStream) {
+                    mStream.write(buf.data(), buf.size());
+                }
+            }
+            mPendingBytes -= buf.size();
+            mSpaceCond.Notify();
+        }
+    }
+private:
+    typedef deque<string> Queue;
+
+    ostream&     mStream;
+    const size_t mMaxPendingBytes;
+    QCThread     mThread;
+    QCMutex      mMutex;
+    QCCondVar    mCond;
+    QCCondVar    mSpaceCond;
+    Queue        mQueue;
+    size_t       mPendingBytes;
+    bool         mFinishFlag;
+private:
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+};
+
+int
+Checkpoint::write_leaves_parallel(ostream& os)
+{
+    const size_t batchSize = max(size_t(64) << 10,
+        min(size_t(1) << 20, writebuffersize));
+    Writer writer(os, max(size_t(4) << 20, writebuffersize * 2));
+    int status = writer.Start();
+    if (status != 0) {
+        return status;
+    }
+    ostringstream batch;
+    batch << hex;
+    string   buf;
+    LeafIter li(metatree.firstLeaf(), 0);
+    Meta*    m = li.current();
+    for (int64_t count = 1; status == 0 && m; count++) {
+        status = m->checkpoint(batch);
+        li.next();
+        Node* const p = li.parent();
+        m = p ? li.current() : 0;
+        if (((count & 0x3F) == 0 || ! m) &&
+                batchSize <= (size_t)batch.tellp()) {
+            buf = batch.str();
+            batch.str(string());
+            writer.Write(buf);
+        }
+    }
+    buf = batch.str();
+    if (! buf.empty()) {
+        writer.Write(buf);
+    }
+    writer.Finish();
+    return status;
+}
+
+// Checkpoint merge. The restorer reads and parses the base checkpoint, in
+// parallel with the merge with the parser threads, and invokes the merger
+// with the base checkpoint leaves in key order. The merger skips the leaves
+// that the filter accepts, as the tree has the current version of these,
+// and interleaves the remaining leaves with the tree leaves. The writer
+// thread computes md5 and writes the merged leaves.
+class Checkpoint::Merger : public CheckpointLeafScanner
+{
+public:
+    Merger(
+        Writer&           writer,
+        CheckpointFilter& filter,
+        size_t            batchSize)
+        : CheckpointLeafScanner(),
+          mWriter(writer),
+          mFilter(filter),
+          mBatchSize(batchSize),
+          mBatch(),
+          mBuf(),
+          mIt(metatree.firstLeaf(), 0),
+          mLeaf(mIt.current()),
+          mLeafCount(0),
+          mBaseCount(0),
+          mSkipCount(0),
+          mStatus(0)
+        { mBatch << hex; }
+    virtual bool leaf(const Key& key, const string& entry)
+    {
+        if (mFilter.accept(key)) {
+            mSkipCount++;
+            return true;
+        }
+        if (! WriteLeaves(&key)) {
+            return false;
+        }
+        mBatch << entry << '\n';
+        if ((++mBaseCount & 0x3F) == 0) {
+            Flush(false);
+        }
+        return true;
+    }
+    int Finish()
+    {
+        WriteLeaves(0);
+        Flush(true);
+        return mStatus;
+    }
+    int GetStatus() const
+        { return mStatus; }
+    int64_t GetLeafCount() const
+        { return mLeafCount; }
+    int64_t GetBaseCount() const
+        { return mBaseCount; }
+    int64_t GetSkipCount() const
+        { return mSkipCount; }
+private:
+    Writer&           mWriter;
+    CheckpointFilter& mFilter;
+    const size_t      mBatchSize;
+    ostringstream     mBatch;
+    string            mBuf;
+    LeafIter          mIt;
+    Meta*             mLeaf;
+    int64_t           mLeafCount;
+    int64_t           mBaseCount;
+    int64_t           mSkipCount;
+    int               mStatus;
+
+    // Write the tree leaves with the keys less than or equal to the key, or
+    // all remaining leaves if key is null.
+    bool WriteLeaves(const Key* key)
+    {
+        while (mStatus == 0 && mLeaf &&
+                (! key || ! (*key < mIt.parent()->getkey(mIt.index())))) {
+            mStatus = mLeaf->checkpoint(mBatch);
+            mIt.next();
+            mLeaf = mIt.parent() ? mIt.current() : 0;
+            if ((++mLeafCount & 0x3F) == 0) {
+                Flush(false);
+            }
+        }
+        return (mStatus == 0);
+    }
+    void Flush(bool forceFlag)
+    {
+        if (! forceFlag && (size_t)mBatch.tellp() < mBatchSize) {
+            return;
+        }
+        mBuf = mBatch.str();
+        mBatch.str(string());
+        if (! mBuf.empty()) {
+            mWriter.Write(mBuf);
+        }
+    }
+private:
+    Merger(const Merger&);
+    Merger& operator=(const Merger&);
+};
+
+int
+Checkpoint::write_leaves_merge(ostream& os, const string& basecp,
+    CheckpointFilter& filter, int threads)
+{
+    const int64_t start = microseconds();
+    const size_t batchSize = max(size_t(64) << 10,
+        min(size_t(1) << 20, writebuffersize));
+    Writer writer(os, max(size_t(4) << 20, writebuffersize * 2));
+    int status = writer.Start();
+    if (status != 0) {
+        return status;
+    }
+    Merger   merger(writer, filter, batchSize);
+    Restorer restorer(threads);
+    if (! restorer.scan(basecp, merger)) {
+        status = merger.GetStatus();
+        if (status == 0) {
+            status = -EINVAL;
+        }
+    }
+    const int mergeStatus = merger.Finish();
+    if (status == 0) {
+        status = mergeStatus;
+    }
+    writer.Finish();
+    KFS_LOG_STREAM(status == 0 ?
+            MsgLogger::kLogLevelINFO :
+            MsgLogger::kLogLevelERROR) <<
+        "checkpoint merge: " << basecp <<
+        " status: "          << status <<
+        " tree leaves: "     << merger.GetLeafCount() <<
+        " base leaves: "     << merger.GetBaseCount() <<
+        " replaced: "        << merger.GetSkipCount() <<
+        " threads: "         << threads <<
+        " total: "           << (microseconds() - start) * 1e-6 << " sec." <<
+    KFS_LOG_EOM;
+    return status;
+}
+
+// In process checkpoint. The main thread walks the leaves in key order in
+// time slices, and formats the leaves into buffers that are written by the
+// writer thread, which also computes the checkpoint md5.
+// The leaf change observer saves the image of all leaves with the given key,
+// if the key is past the cursor -- the last written key, before the first
+// change to the leaves with this key. The walk emits the saved image instead
+// of the current leaves, thus the checkpoint represents the state at the
+// start of the walk. The leaves with the same key are always written in the
+// same slice, as the leaves order within the key can change with the inserts.
+class Checkpoint::Incremental :
+    public QCRunnable,
+    public ITimeout,
+    public LeafChangeObserver
+{
+public:
+    Incremental(
+        Checkpoint&   checkpoint,
+        MetaRequest&  doneOp,
+        int           fd,
+        const string& tmpName,
+        int64_t       sliceTimeUsec)
+        : QCRunnable(),
+          ITimeout(),
+          LeafChangeObserver(),
+          mCheckpoint(checkpoint),
+          mDoneOp(doneOp),
+          mFd(fd),
+          mTmpName(tmpName),
+          mSliceTimeUsec(max(int64_t(100), sliceTimeUsec)),
+          mBatchSize(max(size_t(64) << 10,
+            min(size_t(1) << 20, checkpoint.getWriteBufferSize()))),
+          mMaxPendingBytes(max(size_t(4) << 20,
+            checkpoint.getWriteBufferSize() * 2)),
+          mTrailer(),
+          mCursor(),
+          mImages(),
+          mStream(),
+          mImageStream(),
+          mLeavesDoneFlag(false),
+          mStartTime(microseconds()),
+          mWalkTime(0),
+          mMaxSliceTime(0),
+          mSliceCount(0),
+          mLeafCount(0),
+          mImageCount(0),
+          mMaxImageCount(0),
+          mThread(),
+          mMutex(),
+          mCond(),
+          mQueue(),
+          mPendingBytes(0),
+          mFinishFlag(false),
+          mDoneFlag(false),
+          mStatus(0)
+    {
+        mStream << hex;
+        mImageStream << hex;
+    }
+    virtual ~Incremental()
+    {
+        if (mThread.IsStarted()) {
+            QCStMutexLocker locker(mMutex);
+            mFinishFlag = true;
+            mCond.Notify();
+            locker.Unlock();
+            mThread.Join();
+        }
+    }
+    int Start(const string& header, const string& trailer)
+    {
+        mTrailer = trailer;
+        Enqueue(header, false);
+        const int kStackSize = 256 << 10;
+        const int err = mThread.TryToStart(
+            this, kStackSize, "CheckpointWriter");
+        if (err) {
+            KFS_LOG_STREAM_ERROR << QCUtils::SysError(
+                err, "failed to start checkpoint writer thread") <<
+            KFS_LOG_EOM;
+            return (err > 0 ? -err : (err == 0 ? -EINVAL : err));
+        }
+        metatree.setLeafChangeObserver(this);
+        SetTimeoutInterval(0);
+        globalNetManager().RegisterTimeoutHandler(this);
+        return 0;
+    }
+    virtual void leafChanging(const Key& key)
+    {
+        if (key <= mCursor) {
+            return; // Already written.
+        }
+        Images::iterator it = mImages.lower_bound(key);
+        if (it != mImages.end() && it->first == key) {
+            return; // Already saved.
+        }
+        it = mImages.insert(it, make_pair(key, string()));
+        mImageStream.str(string());
+        int       kp = 0;
+        Node*     n  = metatree.leafLowerBound(key, kp);
+        LeafIter  li(n, kp);
+        while ((n = li.parent()) && n->getkey(li.index()) == key) {
+            li.current()->checkpoint(mImageStream);
+            li.next();
+        }
+        it->second = mImageStream.str();
+        mImageCount++;
+        mMaxImageCount = max(mMaxImageCount, int64_t(mImages.size()));
+    }
+    virtual void Timeout()
+    {
+        if (mLeavesDoneFlag) {
+            QCStMutexLocker locker(mMutex);
+            if (! mDoneFlag) {
+                return;
+            }
+            locker.Unlock();
+            Done();
+            return;
+        }
+        {
+            QCStMutexLocker locker(mMutex);
+            if (mMaxPendingBytes <= mPendingBytes) {
+                // The writer thread wakes up the main thread.
+                return;
+            }
+        }
+        const int64_t start = microseconds();
+        Walk(start + mSliceTimeUsec);
+        const int64_t sliceTime = microseconds() - start;
+        mWalkTime += sliceTime;
+        mMaxSliceTime = max(mMaxSliceTime, sliceTime);
+        mSliceCount++;
+        if (! mLeavesDoneFlag) {
+            // Run next slice after processing pending network io.
+            globalNetManager().Wakeup();
+        }
+    }
+    virtual void Run()
+    {
+        FdWriter   fdw(mFd);
+        const bool kSyncFlag = false;
+        MdStreamT<FdWriter> os(&fdw, kSyncFlag, string(),
+            mCheckpoint.getWriteBufferSize());
+        QCStMutexLocker locker(mMutex);
+        for (; ;) {
+            while (mQueue.empty() && ! mFinishFlag) {
+                mCond.Wait(mMutex);
+            }
+            if (mQueue.empty()) {
+                break;
+            }
+            string buf;
+            buf.swap(mQueue.front());
+            mQueue.pop_front();
+            {
+                QCStMutexUnlocker unlocker(mMutex);
+                if (os) {
+                    os.write(buf.data(), buf.size());
+                }
+            }
+            const bool wakeupFlag = mMaxPendingBytes <= mPendingBytes;
+            mPendingBytes -= buf.size();
+            if (wakeupFlag && mPendingBytes < mMaxPendingBytes) {
+                globalNetManager().Wakeup();
+            }
+        }
+        QCStMutexUnlocker unlocker(mMutex);
+        int status = 0;
+        if (mLeavesDoneFlag) {
+            const string md = os.GetMd();
+            os << "checksum/" << md << '\n';
+            os.SetStream(0);
+            if ((status = fdw.GetError()) != 0) {
+                if (status > 0) {
+                    status = -status;
+                }
+            } else if (! os) {
+                status = -EIO;
+            }
+        } else {
+            os.SetStream(0);
+            status = -ECANCELED;
+        }
+        if (close(mFd) && status == 0) {
+            status = errno > 0 ? -errno : -EIO;
+        }
+        if (status == 0) {
+            status = mCheckpoint.commit_tmp(mTmpName);
+        } else {
+            unlink(mTmpName.c_str());
+        }
+        unlocker.Lock();
+        mStatus = status;
+        mDoneFlag = true;
+        globalNetManager().Wakeup();
+    }
+private:
+    typedef map<Key, string> Images;
+    typedef deque<string>    Queue;
+
+    Checkpoint&         mCheckpoint;
+    MetaRequest&        mDoneOp;
+    const int           mFd;
+    const string        mTmpName;
+    const int64_t       mSliceTimeUsec;
+    const size_t        mBatchSize;
+    const size_t        mMaxPendingBytes;
+    string              mTrailer;
+    Key                 mCursor; //!< last written key
+    Images              mImages; //!< saved images of keys past the cursor
+    ostringstream       mStream;
+    ostringstream       mImageStream;
+    bool                mLeavesDoneFlag;
+    int64_t             mStartTime;
+    int64_t             mWalkTime;
+    int64_t             mMaxSliceTime;
+    int64_t             mSliceCount;
+    int64_t             mLeafCount;
+    int64_t             mImageCount;
+    int64_t             mMaxImageCount;
+    QCThread            mThread;
+    QCMutex             mMutex;
+    QCCondVar           mCond;
+    Queue               mQueue;
+    size_t              mPendingBytes;
+    bool                mFinishFlag;
+    bool                mDoneFlag;
+    int                 mStatus;
+
+    size_t Enqueue(const string& buf, bool finishFlag)
+    {
+        QCStMutexLocker locker(mMutex);
+        mPendingBytes += buf.size();
+        mQueue.push_back(buf);
+        mFinishFlag = finishFlag;
+        mCond.Notify();
+        return mPendingBytes;
+    }
+    size_t Flush(bool finishFlag = false)
+    {
+        const size_t ret = Enqueue(mStream.str(), finishFlag);
+        mStream.str(string());
+        return ret;
+    }
+    void Walk(int64_t endTime)
+    {
+        int       kp = 0;
+        Node*     n  = metatree.leafLowerBound(mCursor, kp);
+        LeafIter  li(n, kp);
+        while ((n = li.parent()) && n->getkey(li.index()) == mCursor) {
+            li.next();
+        }
+        for (int64_t groups = 1; ; groups++) {
+            n = li.parent();
+            Meta* const leaf = n ? li.current() : 0;
+            Images::iterator const it = mImages.begin();
+            if (it != mImages.end() &&
+                    (! leaf || it->first <= n->getkey(li.index()))) {
+                mStream << it->second;
+                mCursor = it->first;
+                mImages.erase(it);
+                while ((n = li.parent()) && n->getkey(li.index()) == mCursor) {
+                    li.next();
+                }
+            } else if (! leaf) {
+                break;
+            } else {
+                mCursor = n->getkey(li.index());
+                do {
+                    li.current()->checkpoint(mStream);
+                    li.next();
+                    mLeafCount++;
+                } while ((n = li.parent()) && n->getkey(li.index()) == mCursor);
+            }
+            if ((groups & 0x3F) != 0) {
+                continue;
+            }
+            if (mBatchSize <= (size_t)mStream.tellp() &&
+                    mMaxPendingBytes <= Flush()) {
+                return;
+            }
+            if (endTime <= microseconds()) {
+                Flush();
+                return;
+            }
+        }
+        // All leaves are written, append the trailer captured at the start.
+        mLeavesDoneFlag = true;
+        metatree.setLeafChangeObserver(0);
+        mStream << mTrailer;
+        mStream << "time/" << DisplayIsoDateTime() << '\n';
+        Flush(true);
+    }
+    void Done()
+    {
+        mThread.Join();
+        globalNetManager().UnRegisterTimeoutHandler(this);
+        const int64_t now = microseconds();
+        KFS_LOG_STREAM(mStatus == 0 ?
+                MsgLogger::kLogLevelINFO :
+                MsgLogger::kLogLevelERROR) <<
+            "checkpoint: "   << mCheckpoint.name() <<
+            " status: "      << mStatus <<
+            " leaves: "      << mLeafCount <<
+            " saved images: " << mImageCount <<
+            " max: "         << mMaxImageCount <<
+            " slices: "      << mSliceCount <<
+            " walk: "        << mWalkTime * 1e-6 <<
+            " max slice: "   << mMaxSliceTime * 1e-6 <<
+            " total: "       << (now - mStartTime) * 1e-6 <<
+        KFS_LOG_EOM;
+        MetaRequest& op     = mDoneOp;
+        const int    status = mStatus;
+        mCheckpoint.incremental = 0;
+        mCheckpoint.cpcount++;
+        delete this;
+        op.status    = status;
+        op.suspended = false;
+        submit_request(&op);
+    }
+private:
+    Incremental(const Incremental&);
+    Incremental& operator=(const Incremental&);
+};
+
 /*
  * At system startup, take a CP if the file that corresponds to the
  * latest CP doesn't exist.
@@ -89,57 +701,110 @@ Checkpoint::initial_CP()
 }
 
 int
-Checkpoint::do_CP()
+Checkpoint::create_tmp(string& tmpname)
 {
-    if (oplog.name().empty()) {
-        return -EINVAL;
-    }
-    seq_t highest = oplog.checkpointed();
-    cpname = cpfile(highest);
     const char* const suffix = ".tmp.XXXXXX";
-    char* const tmpname = new char[cpname.length() + strlen(suffix) + 1];
-    memcpy(tmpname, cpname.c_str(), cpname.length());
-    strcpy(tmpname + cpname.length(), suffix);
-    int fd = mkstemp(tmpname);
-    int status = 0;
+    char* const name = new char[cpname.length() + strlen(suffix) + 1];
+    memcpy(name, cpname.c_str(), cpname.length());
+    strcpy(name + cpname.length(), suffix);
+    int fd = mkstemp(name);
     if (fd < 0) {
-        status = errno > 0 ? -errno : -EIO;
+        fd = errno > 0 ? -errno : -EIO;
     } else {
         close(fd);
-        fd = open(tmpname, O_WRONLY | (writesync ? O_SYNC : 0));
+        fd = open(name, O_WRONLY | (writesync ? O_SYNC : 0));
         if (fd < 0) {
-            status = errno > 0 ? -errno : -EIO;
-            unlink(tmpname);
+            fd = errno > 0 ? -errno : -EIO;
+            unlink(name);
         }
     }
+    tmpname = name;
+    delete [] name;
+    return fd;
+}
+
+void
+Checkpoint::write_header(ostream& os, seq_t highest)
+{
+    os << dec;
+    os << "checkpoint/" << highest << '\n';
+    os << "checksum/last-line\n";
+    os << "version/" << VERSION << '\n';
+    os << "filesysteminfo/fsid/" << metatree.GetFsId() << "/crtime/" <<
+        ShowTime(metatree.GetCreateTime()) << '\n';
+    os << "fid/" << fileID.getseed() << '\n';
+    os << "chunkId/" << chunkID.getseed() << '\n';
+    os << "chunkVersionInc/1\n";
+    os << "time/" << DisplayIsoDateTime() << '\n';
+    os << "setintbase/16\n" << hex;
+    os << "log/" << oplog.name() << "\n\n";
+}
+
+int
+Checkpoint::write_trailer(ostream& os)
+{
+    int status = gLayoutManager.WritePendingMakeStable(os);
+    if (status == 0 && os) {
+        status = gLayoutManager.WritePendingChunkVersionChange(os);
+    }
+    if (status == 0 && os) {
+        status = gNetDispatch.WriteCanceledTokens(os);
+    }
+    if (status == 0 && os) {
+        status = gLayoutManager.WritePendingObjStoreDelete(os);
+    }
+    return status;
+}
+
+int
+Checkpoint::commit_tmp(const string& tmpname)
+{
+    if (rename(tmpname.c_str(), cpname.c_str())) {
+        const int status = errno > 0 ? -errno : -EIO;
+        unlink(tmpname.c_str());
+        return status;
+    }
+    return link_latest(cpname, LASTCP);
+}
+
+int
+Checkpoint::do_CP()
+{
+    return write_CP(0, 0, 0);
+}
+
+int
+Checkpoint::merge_CP(const string& basecp, CheckpointFilter& filter,
+    int threads)
+{
+    return write_CP(&basecp, &filter, threads);
+}
+
+int
+Checkpoint::write_CP(const string* basecp, CheckpointFilter* filter,
+    int threads)
+{
+    if (oplog.name().empty()) {
+        return -EINVAL;
+    }
+    seq_t highest = oplog.checkpointed();
+    cpname = cpfile(highest);
+    string tmpname;
+    int    fd     = create_tmp(tmpname);
+    int    status = fd < 0 ? fd : 0;
     if (status == 0) {
         FdWriter fdw(fd);
         const bool kSyncFlag = false;
         MdStreamT<FdWriter> os(&fdw, kSyncFlag, string(), writebuffersize);
-        os << dec;
-        os << "checkpoint/" << highest << '\n';
-        os << "checksum/last-line\n";
-        os << "version/" << VERSION << '\n';
-        os << "filesysteminfo/fsid/" << metatree.GetFsId() << "/crtime/" <<
-            ShowTime(metatree.GetCreateTime()) << '\n';
-        os << "fid/" << fileID.getseed() << '\n';
-        os << "chunkId/" << chunkID.getseed() << '\n';
-        os << "chunkVersionInc/1\n";
-        os << "time/" << DisplayIsoDateTime() << '\n';
-        os << "setintbase/16\n" << hex;
-        os << "log/" << oplog.name() << "\n\n";
-        status = write_leaves(os);
-        if (status == 0 && os) {
-            status = gLayoutManager.WritePendingMakeStable(os);
-        }
-        if (status == 0 && os) {
-            status = gLayoutManager.WritePendingChunkVersionChange(os);
-        }
-        if (status == 0 && os) {
-            status = gNetDispatch.WriteCanceledTokens(os);
+        write_header(os, highest);
+        if (basecp) {
+            status = write_leaves_merge(os, *basecp, *filter, threads);
+        } else {
+            status = writethread ?
+                write_leaves_parallel(os) : write_leaves(os);
         }
         if (status == 0 && os) {
-            status = gLayoutManager.WritePendingObjStoreDelete(os);
+            status = write_trailer(os);
         }
         if (status == 0) {
             os << "time/" << DisplayIsoDateTime() << '\n';
@@ -158,22 +823,57 @@ Checkpoint::do_CP()
             if (close(fd)) {
                 status = errno > 0 ? -errno : -EIO;
             } else {
-                if (rename(tmpname, cpname.c_str())) {
-                    status = errno > 0 ? -errno : -EIO;
-                } else {
-                    fd = -1;
-                    status = link_latest(cpname, LASTCP);
-                }
+                fd = -1;
+                status = commit_tmp(tmpname);
             }
         } else {
             close(fd);
         }
     }
     if (status != 0 && fd >= 0) {
-        unlink(tmpname);
+        unlink(tmpname.c_str());
     }
     ++cpcount;
-    delete [] tmpname;
+    return status;
+}
+
+int
+Checkpoint::start_CP(MetaRequest& doneOp, int64_t sliceTimeUsec)
+{
+    if (incremental) {
+        return -EAGAIN;
+    }
+    if (oplog.name().empty()) {
+        return -EINVAL;
+    }
+    const seq_t highest = oplog.checkpointed();
+    cpname = cpfile(highest);
+    string tmpname;
+    const int fd = create_tmp(tmpname);
+    if (fd < 0) {
+        return fd;
+    }
+    ostringstream header;
+    write_header(header, highest);
+    ostringstream trailer;
+    trailer << hex;
+    int status = write_trailer(trailer);
+    if (status == 0 && ! trailer) {
+        status = -EIO;
+    }
+    if (status != 0) {
+        close(fd);
+        unlink(tmpname.c_str());
+        return status;
+    }
+    incremental = new Incremental(*this, doneOp, fd, tmpname, sliceTimeUsec);
+    if ((status = incremental->Start(header.str(), trailer.str())) != 0) {
+        // The writer thread owns the file descriptor only once started.
+        delete incremental;
+        incremental = 0;
+        close(fd);
+        unlink(tmpname.c_str());
+    }
     return status;
 }
 
@@ -34,6 +34,9 @@
 namespace KFS {
 using std::string;
 
+struct MetaRequest;
+class CheckpointFilter;
+
 /*!
  * \brief keeps track of checkpoint status
  *
@@ -49,6 +52,17 @@ using std::string;
  * file (created via a hardlink) that identifies the checkpoint that should be
  * used for restore purposes.
  *
+ * The checkpoint can be written either by a forked copy of the meta server
+ * process, or in process with start_CP(). The in process checkpoint walks the
+ * leaves in time slices on the main thread, and saves the images of the not
+ * yet written leaves before these are modified, therefore the checkpoint
+ * represents the meta data state at the time of start_CP() invocation. The
+ * md5 and disk writes are done by a separate thread.
+ * With the write thread flag set, do_CP() formats the leaves on the calling
+ * thread, while a separate thread computes md5 and writes to disk.
+ * The merge_CP() writes the tree leaves merged with the leaves of the base
+ * checkpoint that are not in the tree, therefore the tree can contain only
+ * the subset of the base checkpoint leaves that the log replay modified.
  */
 class Checkpoint
 {
@@ -60,7 +74,9 @@ public:
           mutations(0),
           cpcount(0),
           writesync(true),
-          writebuffersize(16 << 20)
+          writebuffersize(16 << 20),
+          writethread(false),
+          incremental(0)
         {}
     void setCPDir(const string& d)
         { cpdir = d; }
@@ -69,12 +85,25 @@ public:
     bool isCPNeeded() { return mutations != 0; }
     int initial_CP();  //!< schedule a checkpoint on startup if needed
     int do_CP();        //!< do the actual work
+    /*
+     * write checkpoint by merging the tree leaves with the base checkpoint
+     * leaves that the filter does not accept. The filter must accept all
+     * base checkpoint leaves that the tree has, or had before these were
+     * removed. The base checkpoint is parsed with the specified number of
+     * threads.
+     */
+    int merge_CP(const string& basecp, CheckpointFilter& filter, int threads);
+    //!< start in process checkpoint; doneOp is submitted on completion
+    int start_CP(MetaRequest& doneOp, int64_t sliceTimeUsec);
+    bool isCPRunning() const { return incremental != 0; }
     void note_mutation() { ++mutations; }
     void resetMutationCount() { mutations = 0; }
     bool getWriteSyncFlag() const { return writesync; }
     void setWriteSyncFlag(bool flag) { writesync = flag; }
     size_t getWriteBufferSize() const { return writebuffersize; }
     void setWriteBufferSize(size_t size) { writebuffersize = size; }
+    bool getWriteThreadFlag() const { return writethread; }
+    void setWriteThreadFlag(bool flag) { writethread = flag; }
 private:
     string  cpdir;       //!< dir for CP files
     string  cpname;      //!< name of CP file
@@ -82,10 +111,24 @@ private:
     int64_t cpcount;     //!< number of CP's since startup
     bool    writesync;
     size_t  writebuffersize;
+    bool    writethread; //!< format and write leaves in parallel in do_CP()
+    class Writer;
+    class Merger;
+    class Incremental;
+    friend class Incremental;
+    Incremental* incremental; //!< running in process checkpoint
 
     string cpfile(seq_t highest)    //!< generate the next file name
         { return makename(cpdir, "chkpt", highest); }
     int write_leaves(ostream& os);
+    int write_leaves_parallel(ostream& os);
+    int write_leaves_merge(ostream& os, const string& basecp,
+        CheckpointFilter& filter, int threads);
+    int write_CP(const string* basecp, CheckpointFilter* filter, int threads);
+    int create_tmp(string& tmpname);
+    void write_header(ostream& os, seq_t highest);
+    int write_trailer(ostream& os);
+    int commit_tmp(const string& tmpname);
 private:
     // No copy.
     Checkpoint(const Checkpoint&);
@@ -49,6 +49,7 @@ using std::make_pair;
 using std::find_if;
 using std::iter_swap;
 using std::sort;
+using std::find;
 using boost::bind;
 
 /*
@@ -71,6 +72,14 @@ using boost::bind;
  * for the initial chunk placement, unless using available space is forced by
  * the meta server configuration for initial chunk placement.
  *
+ * With the "placement choices" configured, the initial chunk placement samples
+ * the configured number of random servers from the rack's tier placement
+ * candidates index, and picks the one with the least "load", instead of
+ * building and scanning the rack candidates list. This makes allocation cost
+ * independent of the rack size, and avoids "herding" of the allocation bursts
+ * onto the servers that looked least loaded at the last load update. The
+ * candidates list is used if sampling fails to find an eligible server.
+ *
  * To minimize network transfers between the rack the re-replication and
  * re-balancing attempts to choose re-replication source and destination withing
  * the same rack. If not enough different racks available, put chunk replicas
@@ -100,12 +109,15 @@ public:
           mServerExcludes(),
           mCandidateRacks(),
           mCandidates(),
+          mSampled(),
+          mSampleRackPtr(0),
           mLoadAvgSum(0),
           mRackPos(0),
           mCandidatePos(0),
           mCurRackId(-1),
           mCandidatesInRacksCount(0),
           mMaxReplicationsPerNode(0),
+          mChoicesCount(0),
           mMaxSpaceUtilizationThreshold(0),
           mCurSTierMaxSpaceUtilizationThreshold(0),
           mForReplicationFlag(false),
@@ -128,8 +140,10 @@ public:
         mUsingRackExcludesFlag   = false;
         mUsingServerExcludesFlag = false;
         mLastAttemptFlag         = false;
+        mSampleRackPtr           = 0;
         mCandidateRacks.clear();
         mCandidates.clear();
+        mSampled.clear();
     }
     void clear()
     {
@@ -161,6 +175,8 @@ public:
             mLayoutManager.GetMaxSpaceUtilizationThreshold();
         mMaxReplicationsPerNode       =
             mLayoutManager.GetMaxConcurrentWriteReplicationsPerNode();
+        mChoicesCount                 = forReplicationFlag ? 0 :
+            mLayoutManager.GetPlacementChoicesCount();
         FindCandidatesSelf(rackIdToUse);
     }
     void FindCandidatesInRack(
@@ -196,6 +212,7 @@ public:
             mLayoutManager.GetMaxSpaceUtilizationThreshold());
         mMaxReplicationsPerNode       =
             mLayoutManager.GetMaxConcurrentWriteReplicationsPerNode();
+        mChoicesCount                 = 0;
         FindCandidatesSelf(rackIdToUse);
     }
 
@@ -237,6 +254,16 @@ public:
             mCandidatePos = 0;
             return GetNext(canIgnoreServerExcludesFlag); // Tail recursion.
         }
+        if (mSampleRackPtr) {
+            ChunkServer* const srv = Sample();
+            if (srv) {
+                return srv->shared_from_this();
+            }
+            // Fall back to the candidates list.
+            const RackInfo& rack = *mSampleRackPtr;
+            FindCandidateServers(
+                rack.getServers(), rack.getPossibleCandidatesCount(mCurSTier));
+        }
         if (mCandidatePos <= 0) {
             if (! canIgnoreServerExcludesFlag ||
                     ! mUsingRackExcludesFlag ||
@@ -325,7 +352,7 @@ public:
                     continue;
                 }
                 FindCandidateServers(*it);
-                if (mCandidates.empty()) {
+                if (! HasCandidates()) {
                     continue;
                 }
                 mCurRackId = rackId;
@@ -376,12 +403,12 @@ public:
             } else {
                 FindCandidateServers(rack);
             }
-            if (! mCandidates.empty()) {
+            if (HasCandidates()) {
                 mCurRackId = rack.id();
                 break;
             }
         }
-        return (! mCandidates.empty());
+        return HasCandidates();
     }
 
     bool ExcludeServer(
@@ -716,6 +743,11 @@ private:
             pair<int64_t, ChunkServer*>,
             StdAllocator<pair<int64_t, ChunkServer*> >
         > Candidates;
+    typedef vector<
+            const ChunkServer*,
+            StdAllocator<const ChunkServer*>
+        > Sampled;
+    typedef typename RackInfo::CandidatesIndex CandidatesIndex;
     typedef Servers Sources;
     enum { kSlaveScaleFracBits = LayoutManager::kSlaveScaleFracBits };
 
@@ -725,12 +757,15 @@ private:
     ServerExcludes   mServerExcludes;
     CandidateRacks   mCandidateRacks;
     Candidates       mCandidates;
+    Sampled          mSampled;
+    const RackInfo*  mSampleRackPtr;
     int64_t          mLoadAvgSum;
     size_t           mRackPos;
     size_t           mCandidatePos;
     RackId           mCurRackId;
     int64_t          mCandidatesInRacksCount;
     int              mMaxReplicationsPerNode;
+    int              mChoicesCount;
     double           mMaxSpaceUtilizationThreshold;
     double           mCurSTierMaxSpaceUtilizationThreshold;
     bool             mForReplicationFlag;
@@ -760,7 +795,7 @@ private:
                     mCandidateRacks.begin() + ri);
                 const RackInfo& rack = *(mCandidateRacks[mRackPos++].second);
                 FindCandidateServers(rack);
-                if (! mCandidates.empty()) {
+                if (HasCandidates()) {
                     mCurRackId = rack.id();
                     return;
                 }
@@ -817,13 +852,17 @@ private:
     }
     int64_t GetLoad(
         const ChunkServer& srv) const
+        { return GetLoad(srv, mSortCandidatesByLoadAvgFlag); }
+    int64_t GetLoad(
+        const ChunkServer& srv,
+        bool               loadAvgFlag) const
     {
         const int64_t kLoadAvgFloor = 1;
         if (mSortBySpaceUtilizationFlag) {
             return ((int64_t)(srv.GetStorageTierSpaceUtilization(mCurSTier) *
                 (int64_t(1) << (10 + kSlaveScaleFracBits))) + kLoadAvgFloor);
         }
-        if (mSortCandidatesByLoadAvgFlag) {
+        if (loadAvgFlag) {
             int64_t load = srv.GetLoadAvg();
             if (! srv.CanBeChunkMaster()) {
                 load = (load * mLayoutManager.GetSlavePlacementScale()
@@ -844,18 +883,70 @@ private:
                 srv.GetNumChunkReplications() < mMaxReplicationsPerNode)
         );
     }
+    bool HasCandidates() const
+        { return (mSampleRackPtr || ! mCandidates.empty()); }
+    bool IsSampled(
+        const ChunkServer& srv) const
+    {
+        return (! mSampled.empty() &&
+            find(mSampled.begin(), mSampled.end(), &srv) != mSampled.end());
+    }
     void FindCandidateServers(
         const RackInfo& rack)
     {
+        if (2 <= mChoicesCount &&
+                ! rack.getCandidatesIndex(mCurSTier).empty()) {
+            mLoadAvgSum    = 0;
+            mCandidatePos  = 0;
+            mCandidates.clear();
+            mSampleRackPtr = &rack;
+            return;
+        }
         FindCandidateServers(
             rack.getServers(), rack.getPossibleCandidatesCount(mCurSTier));
     }
+    // Pick the least loaded out of mChoicesCount randomly chosen eligible
+    // servers. The number of attempts is bounded, as the index might have
+    // mostly excluded or overloaded servers.
+    ChunkServer* Sample()
+    {
+        const CandidatesIndex& index = mSampleRackPtr->getCandidatesIndex(
+            mCurSTier);
+        const int64_t size = (int64_t)index.size();
+        if (size <= 0) {
+            return 0;
+        }
+        ChunkServer* ret     = 0;
+        int64_t      retLoad = 0;
+        int          choices = 0;
+        for (int i = 0, e = 4 * mChoicesCount;
+                i < e && choices < mChoicesCount;
+                i++) {
+            ChunkServer& srv = *index[size <= 1 ? 0 : Rand(size)];
+            if (! IsCandidateServer(srv) ||
+                    mServerExcludes.Find(&srv) ||
+                    IsSampled(srv)) {
+                continue;
+            }
+            choices++;
+            const int64_t load = GetLoad(srv, true);
+            if (! ret || load < retLoad) {
+                ret     = &srv;
+                retLoad = load;
+            }
+        }
+        if (ret) {
+            mSampled.push_back(ret);
+        }
+        return ret;
+    }
     void FindCandidateServers(
         const Sources& sources,
         int            candidatesCount)
     {
-        mLoadAvgSum   = 0;
-        mCandidatePos = 0;
+        mLoadAvgSum    = 0;
+        mCandidatePos  = 0;
+        mSampleRackPtr = 0;
         mCandidates.clear();
         int cnt = 0;
         for (typename Servers::const_iterator it = sources.begin();
@@ -866,7 +957,7 @@ private:
                 continue;
             }
             cnt++;
-            if (mServerExcludes.Find(&srv)) {
+            if (mServerExcludes.Find(&srv) || IsSampled(srv)) {
                 continue;
             }
             const int64_t load = GetLoad(srv);
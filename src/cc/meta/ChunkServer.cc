@@ -34,8 +34,14 @@
 #include "kfsio/DelegationToken.h"
 #include "kfsio/ChunkAccessToken.h"
 #include "kfsio/CryptoKeys.h"
+#include "kfsio/ITimeout.h"
+#include "kfsio/Counter.h"
 #include "common/MdStream.h"
+#include "common/time.h"
 #include "qcdio/QCUtils.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/qcstutils.h"
 #include "common/MsgLogger.h"
 #include "common/kfserrno.h"
 #include "common/RequestParser.h"
@@ -48,6 +54,7 @@
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <deque>
 
 namespace KFS
 {
@@ -60,10 +67,12 @@ using std::pair;
 using std::hex;
 using std::numeric_limits;
 using std::sort;
+using std::deque;
 using std::setprecision;
 using std::scientific;
 using std::fixed;
 using libkfsio::globalNetManager;
+using libkfsio::globals;
 using boost::bind;
 
 static inline time_t TimeNow()
@@ -124,6 +133,267 @@ private:
     HelloBufferQueueRunner& operator=(const HelloBufferQueueRunner&);
 };
 
+static bool ParseHelloChunkLists(
+    MetaHello& op, IOBuffer& buf, int contentLength, IOBuffer::IStream& ist);
+
+// Parses and sorts hello chunk lists in the worker threads, in order to
+// minimize the main thread time spent on the chunk server re-connects.
+// The hello content is moved into the job, and the job holds the chunk
+// server reference until the main thread processes the parse completion.
+// The content io buffers are released, and the hello buffer bytes are put
+// back by the main thread.
+// The parser is created by the first SetParameters() invocation, and destroyed
+// by Shutdown(), both invoked from the layout manager, in order to stop the
+// threads, and detach from the net manager and counter manager prior to the
+// static destructors.
+class ChunkServer::HelloParser : public QCRunnable, public ITimeout
+{
+public:
+    static void SetParameters(const Properties& props)
+    {
+        if (! sInstance) {
+            sInstance = new HelloParser();
+        }
+        sInstance->SetParametersSelf(props);
+    }
+    static void Shutdown()
+    {
+        delete sInstance;
+        sInstance = 0;
+    }
+    static bool Start(ChunkServer& srv, IOBuffer& buf, int contentLength)
+    {
+        return (sInstance &&
+            sInstance->StartSelf(srv, buf, contentLength));
+    }
+    static void UpdateParseStats(int64_t count, int64_t timeUsec)
+    {
+        if (! sInstance) {
+            return;
+        }
+        Counter& counter = sInstance->mParseCounter;
+        counter.Update(count);
+        counter.UpdateTime(timeUsec);
+    }
+    virtual void Run()
+    {
+        IOBuffer::IStream ist;
+        QCStMutexLocker locker(mMutex);
+        for (; ;) {
+            while (mQueue.empty() && ! mStopFlag) {
+                mCond.Wait(mMutex);
+            }
+            if (mStopFlag) {
+                break;
+            }
+            Job& job = *mQueue.front();
+            mQueue.pop_front();
+            {
+                QCStMutexUnlocker unlocker(mMutex);
+                Parse(job, ist);
+            }
+            const bool wakeupFlag = mDone.empty();
+            mDone.push_back(&job);
+            if (wakeupFlag) {
+                globalNetManager().Wakeup();
+            }
+        }
+    }
+    virtual void Timeout()
+    {
+        Queue done;
+        {
+            QCStMutexLocker locker(mMutex);
+            done.swap(mDone);
+        }
+        while (! done.empty()) {
+            Job* const job = done.front();
+            done.pop_front();
+            mInFlightCount--;
+            const int64_t now = microseconds();
+            mParseCounter.Update(job->mChunkCount);
+            mParseCounter.UpdateTime(job->mParseTime);
+            KFS_LOG_STREAM_INFO << job->mServer->GetPeerName() <<
+                " hello parsed:"
+                " chunks: "    << job->mChunkCount <<
+                " status: "    << (job->mOkFlag ? "ok" : "error") <<
+                " parse: "     << job->mParseTime << " usec."
+                " wait: "      << (now - job->mStartTime - job->mParseTime) <<
+                    " usec."
+                " in flight: " << mInFlightCount <<
+            KFS_LOG_EOM;
+            job->mBuf.Clear();
+            job->mServer->HelloParseDone(*job->mOp, job->mOkFlag);
+            delete job;
+        }
+        if (mInFlightCount <= 0 && mRegisteredFlag) {
+            mRegisteredFlag = false;
+            globalNetManager().UnRegisterTimeoutHandler(this);
+        }
+    }
+private:
+    struct Job
+    {
+        Job(const ChunkServerPtr& srv, MetaHello& op)
+            : mServer(srv),
+              mOp(&op),
+              mBuf(),
+              mContentLength(0),
+              mOkFlag(false),
+              mChunkCount(0),
+              mStartTime(microseconds()),
+              mParseTime(0)
+            {}
+        ChunkServerPtr const mServer;
+        MetaHello* const     mOp;
+        IOBuffer             mBuf;
+        int                  mContentLength;
+        bool                 mOkFlag;
+        int64_t              mChunkCount;
+        int64_t const        mStartTime;
+        int64_t              mParseTime;
+    private:
+        Job(const Job&);
+        Job& operator=(const Job&);
+    };
+    struct ChunkIdLess
+    {
+        bool operator()(
+            const MetaHello::ChunkInfo& lhs,
+            const MetaHello::ChunkInfo& rhs) const
+            { return (lhs.chunkId < rhs.chunkId); }
+    };
+    typedef deque<Job*> Queue;
+    enum { kMaxThreadCount = 64 };
+
+    QCMutex  mMutex;
+    QCCondVar mCond;
+    Queue    mQueue;
+    Queue    mDone;
+    bool     mStopFlag;
+    bool     mRegisteredFlag;
+    int      mThreadCount;
+    int      mStartedCount;
+    int      mMinContentLength;
+    int      mInFlightCount;
+    Counter  mParseCounter;
+    QCThread mThreads[kMaxThreadCount];
+
+    static HelloParser* sInstance;
+
+    HelloParser()
+        : QCRunnable(),
+          ITimeout(),
+          mMutex(),
+          mCond(),
+          mQueue(),
+          mDone(),
+          mStopFlag(false),
+          mRegisteredFlag(false),
+          mThreadCount(2),
+          mStartedCount(0),
+          mMinContentLength(256 << 10),
+          mInFlightCount(0),
+          mParseCounter("Hello Chunks Parsed")
+    {
+        globals().counterManager.AddCounter(&mParseCounter);
+    }
+    virtual ~HelloParser()
+    {
+        QCStMutexLocker locker(mMutex);
+        mStopFlag = true;
+        mCond.NotifyAll();
+        locker.Unlock();
+        for (int i = 0; i < mStartedCount; i++) {
+            mThreads[i].Join();
+        }
+        if (mRegisteredFlag) {
+            globalNetManager().UnRegisterTimeoutHandler(this);
+        }
+        globals().counterManager.RemoveCounter(&mParseCounter);
+        // Discard the jobs not processed by the main thread.
+        mQueue.insert(mQueue.end(), mDone.begin(), mDone.end());
+        mDone.clear();
+        while (! mQueue.empty()) {
+            Job* const job = mQueue.front();
+            mQueue.pop_front();
+            delete job->mOp;
+            delete job;
+        }
+    }
+    void SetParametersSelf(const Properties& props)
+    {
+        mThreadCount = min(int(kMaxThreadCount), max(0, props.getValue(
+            "metaServer.chunkServer.helloParseThreadCount",
+            mThreadCount)));
+        mMinContentLength = props.getValue(
+            "metaServer.chunkServer.helloParseMinContentLength",
+            mMinContentLength);
+    }
+    bool StartSelf(ChunkServer& srv, IOBuffer& buf, int contentLength)
+    {
+        if (mThreadCount <= 0 || contentLength < mMinContentLength ||
+                ! StartThreads()) {
+            return false;
+        }
+        Job& job = *(new Job(srv.shared_from_this(), *srv.mHelloOp));
+        job.mContentLength = job.mBuf.Move(&buf, contentLength);
+        srv.mHelloOp                = 0;
+        srv.mHelloParseInFlightFlag = true;
+        srv.mNetConnection->SetMaxReadAhead(0);
+        if (! mRegisteredFlag) {
+            mRegisteredFlag = true;
+            globalNetManager().RegisterTimeoutHandler(this);
+        }
+        mInFlightCount++;
+        QCStMutexLocker locker(mMutex);
+        mQueue.push_back(&job);
+        mCond.Notify();
+        return true;
+    }
+    bool StartThreads()
+    {
+        while (mStartedCount < mThreadCount) {
+            const int kStackSize = 256 << 10;
+            string name("HelloParser");
+            AppendDecIntToString(name, mStartedCount);
+            const int err = mThreads[mStartedCount].TryToStart(
+                this, kStackSize, name.c_str());
+            if (err) {
+                KFS_LOG_STREAM_ERROR << QCUtils::SysError(
+                    err, "failed to start hello parser thread") <<
+                KFS_LOG_EOM;
+                mThreadCount = mStartedCount;
+                break;
+            }
+            mStartedCount++;
+        }
+        return (0 < mStartedCount);
+    }
+    static void Parse(Job& job, IOBuffer::IStream& ist)
+    {
+        const int64_t start = microseconds();
+        MetaHello& op = *job.mOp;
+        job.mOkFlag = ParseHelloChunkLists(
+            op, job.mBuf, job.mContentLength, ist);
+        if (job.mOkFlag) {
+            // Sort by chunk id, in order to make main thread chunk server map
+            // updates cache friendly: the chunk ids are allocated sequentially,
+            // and the chunk entries are typically allocated in id order.
+            sort(op.chunks.begin(), op.chunks.end(), ChunkIdLess());
+        }
+        job.mChunkCount = (int64_t)(op.chunks.size() +
+            op.notStableAppendChunks.size() + op.notStableChunks.size() +
+            op.deletedChunks.size());
+        job.mParseTime = microseconds() - start;
+    }
+private:
+    HelloParser(const HelloParser&);
+    HelloParser& operator=(const HelloParser&);
+};
+
+ChunkServer::HelloParser* ChunkServer::HelloParser::sInstance = 0;
+
 static ostringstream&
 GetTmpOStringStream(bool secondFlag = false)
 {
@@ -258,6 +528,13 @@ void ChunkServer::SetParameters(const Properties& prop, int clientPort)
     sRestartCSOnInvalidClusterKeyFlag = prop.getValue(
         "metaServer.chunkServer.restartOnInvalidClusterKey",
         sRestartCSOnInvalidClusterKeyFlag ? 1 : 0) != 0;
+    HelloParser::SetParameters(prop);
+}
+
+/* static */ void
+ChunkServer::Shutdown()
+{
+    HelloParser::Shutdown();
 }
 
 static seq_t RandomSeqNo()
@@ -384,6 +661,8 @@ ChunkServer::ChunkServer(const NetConnectionPtr& conn, const string& peerName)
       mSessionExpirationTime(TimeNow() + kMaxSessionTimeoutSec),
       mReAuthSentFlag(false),
       mHelloOp(0),
+      mHelloParseInFlightFlag(false),
+      mHelloChunksParsedFlag(false),
       mSelfPtr(),
       mSrvLoadSampler(sSrvLoadSamplerSampleCount, 0, TimeNow()),
       mLoadAvg(0),
@@ -403,6 +682,7 @@ ChunkServer::ChunkServer(const NetConnectionPtr& conn, const string& peerName)
       mLostChunkDirs(),
       mChunkDirInfos(),
       mMd5Sum(),
+      mInventoryGeneration(0),
       mPeerName(peerName),
       mCryptoKeyValidFlag(false),
       mCryptoKeyId(),
@@ -424,6 +704,7 @@ ChunkServer::ChunkServer(const NetConnectionPtr& conn, const string& peerName)
     sChunkServerCount++;
     for (size_t i = 0; i < kKfsSTierCount; i++) {
         mCanBeCandidateServerFlags[i] = false;
+        mPlacementIdx[i]              = -1;
     }
     KFS_LOG_STREAM_INFO <<
         "new ChunkServer " << (const void*)this << " " <<
@@ -746,8 +1027,8 @@ ChunkServer::HandleRequest(int code, void *data)
 
     case EVENT_INACTIVITY_TIMEOUT:
         // Check heartbeat timeout.
-        if (mHelloDone || mLastHeartbeatSent + sHeartbeatTimeout >
-                TimeNow()) {
+        if (mHelloDone || mHelloParseInFlightFlag ||
+                mLastHeartbeatSent + sHeartbeatTimeout > TimeNow()) {
             break;
         }
         Error("hello timeout");
@@ -1078,6 +1359,111 @@ private:
 };
 const unsigned char* const HexChunkInfoParser::sC2HexTable = char2HexTable();
 
+static bool
+ParseHelloChunkLists(
+    MetaHello&         op,
+    IOBuffer&          buf,
+    int                contentLength,
+    IOBuffer::IStream& ist)
+{
+    istream& is = ist.Set(buf, contentLength);
+    HexChunkInfoParser hexParser(buf, op.noFidsFlag);
+    for (int j = 0; j < 4; ++j) {
+        MetaHello::ChunkInfos& chunks = j == 0 ?
+            op.chunks : (j == 1 ?
+            op.notStableAppendChunks : (j == 2 ?
+            op.notStableChunks :
+            op.deletedChunks));
+        int i = j == 0 ?
+            op.numChunks : (j == 1 ?
+            op.numNotStableAppendChunks : (j == 2 ?
+            op.numNotStableChunks :
+            op.numDeletedChunks));
+        if (op.contentIntBase == 16) {
+            const MetaHello::ChunkInfo* c;
+            while (i-- > 0 && (c = hexParser.Next())) {
+                chunks.push_back(*c);
+            }
+        } else {
+            MetaHello::ChunkInfo c;
+            if (op.noFidsFlag) {
+                while (i-- > 0) {
+                    if (! (is >> c.chunkId >> c.chunkVersion)) {
+                        break;
+                    }
+                    chunks.push_back(c);
+                }
+            } else {
+                fid_t allocFileId;
+                while (i-- > 0) {
+                    if (! (is >> allocFileId
+                            >> c.chunkId
+                            >> c.chunkVersion)) {
+                        break;
+                    }
+                    chunks.push_back(c);
+                }
+            }
+        }
+    }
+    ist.Reset();
+    return (
+        op.chunks.size() == size_t(max(0, op.numChunks)) &&
+        op.notStableAppendChunks.size() ==
+            size_t(max(0, op.numNotStableAppendChunks)) &&
+        op.notStableChunks.size() ==
+            size_t(max(0, op.numNotStableChunks)) &&
+        op.deletedChunks.size() ==
+            size_t(max(0, op.numDeletedChunks))
+    );
+}
+
+void
+ChunkServer::HelloChunkListsError(int contentLength)
+{
+    KFS_LOG_STREAM_ERROR << GetPeerName() <<
+        " invalid or short chunk list:"
+        " expected: " << mHelloOp->numChunks <<
+        "/"      << mHelloOp->numNotStableAppendChunks <<
+        "/"      << mHelloOp->numNotStableChunks <<
+        " got: " << mHelloOp->chunks.size() <<
+        "/"      <<
+            mHelloOp->notStableAppendChunks.size() <<
+        "/"      << mHelloOp->notStableChunks.size() <<
+        " last good chunk: " <<
+            (mHelloOp->chunks.empty() ? -1 :
+            mHelloOp->chunks.back().chunkId) <<
+        "/" << (mHelloOp->notStableAppendChunks.empty() ? -1 :
+            mHelloOp->notStableAppendChunks.back().chunkId) <<
+        "/" << (mHelloOp->notStableChunks.empty() ? -1 :
+            mHelloOp->notStableChunks.back().chunkId) <<
+        " content length: " << contentLength <<
+    KFS_LOG_EOM;
+}
+
+void
+ChunkServer::HelloParseDone(MetaHello& op, bool okFlag)
+{
+    assert(mHelloParseInFlightFlag && ! mHelloOp && ! mHelloDone);
+    mHelloParseInFlightFlag = false;
+    PutHelloBytes(&op);
+    if (mDown || ! mNetConnection) {
+        delete &op;
+        return;
+    }
+    mHelloOp = &op;
+    if (! okFlag) {
+        HelloChunkListsError(op.contentLength);
+        delete mHelloOp;
+        mHelloOp = 0;
+        Error("failed to parse hello message");
+        return;
+    }
+    // Resume hello processing with the chunk lists parsed.
+    mHelloChunksParsedFlag = true;
+    HandleRequest(EVENT_NET_READ, &mNetConnection->GetInBuffer());
+}
+
 int
 ChunkServer::DeclareHelloError(
     int         status,
@@ -1110,6 +1496,9 @@ ChunkServer::HandleHelloMsg(IOBuffer* iobuf, int msgLen)
 {
     assert(!mHelloDone);
 
+    if (mHelloParseInFlightFlag) {
+        return 1; // Wait for chunk lists parse completion.
+    }
     const bool hasHelloOpFlag = mHelloOp != 0;
     if (! hasHelloOpFlag) {
         MetaRequest * const op = mAuthenticateOp ? mAuthenticateOp :
@@ -1238,10 +1627,19 @@ ChunkServer::HandleHelloMsg(IOBuffer* iobuf, int msgLen)
                 mHelloOp->numChunks                = 0;
                 mHelloOp->numNotStableAppendChunks = 0;
                 mHelloOp->numNotStableChunks       = 0;
+                mHelloOp->numDeletedChunks         = 0;
+                mHelloOp->inventoryGeneration      = 0;
             } else {
                 return DeclareHelloError(-EINVAL, "file system id mismatch");
             }
         }
+        if (0 < mHelloOp->inventoryGeneration &&
+                ! gLayoutManager.CanAcceptHelloDelta(*mHelloOp)) {
+            // The chunk server resets its inventory generation on hello
+            // failure, and sends full chunk inventory with the next hello.
+            return DeclareHelloError(-EAGAIN,
+                "chunk inventory generation mismatch");
+        }
         if (mHelloOp->status == 0 &&
                 mHelloOp->contentLength > 0 &&
                 iobuf->BytesConsumable() <
@@ -1267,7 +1665,9 @@ ChunkServer::HandleHelloMsg(IOBuffer* iobuf, int msgLen)
         }
     }
     // make sure we have the chunk ids...
-    if (mHelloOp->contentLength > 0) {
+    if (mHelloChunksParsedFlag) {
+        mHelloChunksParsedFlag = false;
+    } else if (mHelloOp->contentLength > 0) {
         const int nAvail = iobuf->BytesConsumable();
         if (nAvail < mHelloOp->contentLength) {
             // need to wait for data...
@@ -1295,83 +1695,36 @@ ChunkServer::HandleHelloMsg(IOBuffer* iobuf, int msgLen)
                     contentLength <<
                 " bytes done" <<
             KFS_LOG_EOM;
-            PutHelloBytes(mHelloOp);
         }
         mHelloOp->chunks.clear();
         mHelloOp->notStableChunks.clear();
         mHelloOp->notStableAppendChunks.clear();
+        mHelloOp->deletedChunks.clear();
         if (mHelloOp->status == 0) {
-            const size_t numStable(max(0, mHelloOp->numChunks));
-            mHelloOp->chunks.reserve(mHelloOp->numChunks);
-            const size_t nonStableAppendNum(
+            mHelloOp->chunks.reserve(max(0, mHelloOp->numChunks));
+            mHelloOp->notStableAppendChunks.reserve(
                 max(0, mHelloOp->numNotStableAppendChunks));
-            mHelloOp->notStableAppendChunks.reserve(nonStableAppendNum);
-            const size_t nonStableNum(max(0, mHelloOp->numNotStableChunks));
-            mHelloOp->notStableChunks.reserve(nonStableNum);
-            // get the chunkids
-            istream& is = mIStream.Set(iobuf, contentLength);
-            HexChunkInfoParser hexParser(*iobuf, mHelloOp->noFidsFlag);
-            for (int j = 0; j < 3; ++j) {
-                MetaHello::ChunkInfos& chunks = j == 0 ?
-                    mHelloOp->chunks : (j == 1 ?
-                    mHelloOp->notStableAppendChunks :
-                    mHelloOp->notStableChunks);
-                int i = j == 0 ?
-                    mHelloOp->numChunks : (j == 1 ?
-                    mHelloOp->numNotStableAppendChunks :
-                    mHelloOp->numNotStableChunks);
-                if (mHelloOp->contentIntBase == 16) {
-                    const MetaHello::ChunkInfo* c;
-                    while (i-- > 0 && (c = hexParser.Next())) {
-                        chunks.push_back(*c);
-                    }
-                } else {
-                    MetaHello::ChunkInfo c;
-                    if (mHelloOp->noFidsFlag) {
-                        while (i-- > 0) {
-                            if (! (is >> c.chunkId >> c.chunkVersion)) {
-                                break;
-                            }
-                            chunks.push_back(c);
-                        }
-                    } else {
-                        fid_t allocFileId;
-                        while (i-- > 0) {
-                            if (! (is >> allocFileId
-                                    >> c.chunkId
-                                    >> c.chunkVersion)) {
-                                break;
-                            }
-                            chunks.push_back(c);
-                        }
-                    }
-                }
+            mHelloOp->notStableChunks.reserve(
+                max(0, mHelloOp->numNotStableChunks));
+            mHelloOp->deletedChunks.reserve(
+                max(0, mHelloOp->numDeletedChunks));
+            if (HelloParser::Start(*this, *iobuf, contentLength)) {
+                // The hello buffer bytes are put back on parse completion.
+                return 1;
             }
-            mIStream.Reset();
+            PutHelloBytes(mHelloOp);
+            const int64_t start = microseconds();
+            const bool    okFlag = ParseHelloChunkLists(
+                *mHelloOp, *iobuf, contentLength, mIStream);
             iobuf->Consume(contentLength);
-            if (mHelloOp->chunks.size() != numStable ||
-                    mHelloOp->notStableAppendChunks.size() !=
-                    nonStableAppendNum ||
-                    mHelloOp->notStableChunks.size() !=
-                    nonStableNum) {
-                KFS_LOG_STREAM_ERROR << GetPeerName() <<
-                    " invalid or short chunk list:"
-                    " expected: " << mHelloOp->numChunks <<
-                    "/"      << mHelloOp->numNotStableAppendChunks <<
-                    "/"      << mHelloOp->numNotStableChunks <<
-                    " got: " << mHelloOp->chunks.size() <<
-                    "/"      <<
-                        mHelloOp->notStableAppendChunks.size() <<
-                    "/"      << mHelloOp->notStableChunks.size() <<
-                    " last good chunk: " <<
-                        (mHelloOp->chunks.empty() ? -1 :
-                        mHelloOp->chunks.back().chunkId) <<
-                    "/" << (mHelloOp->notStableAppendChunks.empty() ? -1 :
-                        mHelloOp->notStableAppendChunks.back().chunkId) <<
-                    "/" << (mHelloOp->notStableChunks.empty() ? -1 :
-                        mHelloOp->notStableChunks.back().chunkId) <<
-                    " content length: " << contentLength <<
-                KFS_LOG_EOM;
+            HelloParser::UpdateParseStats((int64_t)(
+                mHelloOp->chunks.size() +
+                mHelloOp->notStableAppendChunks.size() +
+                mHelloOp->notStableChunks.size() +
+                mHelloOp->deletedChunks.size()),
+                microseconds() - start);
+            if (! okFlag) {
+                HelloChunkListsError(contentLength);
                 delete mHelloOp;
                 mHelloOp = 0;
                 return -1;
@@ -2245,6 +2598,13 @@ ChunkServer::FailDispatchedOps(const char* errMsg)
             it != reqs.end();
             ++it) {
         MetaChunkRequest* const op = it->second.first->second;
+        if (op->op == META_CHUNK_DELETE ||
+                op->op == META_CHUNK_STALENOTIFY ||
+                op->op == META_CHUNK_COALESCE_BLOCK) {
+            // The outcome is unknown, the chunk server might still have
+            // the chunks. Require full chunk inventory with the next hello.
+            mInventoryGeneration = 0;
+        }
         op->statusMsg = errMsg ? errMsg : "chunk server disconnect";
         op->status    = -EIO;
         op->resume();
@@ -115,6 +115,9 @@ private:
             mSet->Clear();
         }
     }
+    void SetHosted(size_t count) {
+        mChunkCount = count;
+    }
     void SetIndex(int idx, bool debugTrackChunkIdFlag) {
         mIndex = idx;
         if (debugTrackChunkIdFlag) {
@@ -670,6 +673,7 @@ public:
     int TimeSinceLastHeartbeat() const;
     void ForceDown();
     static void SetParameters(const Properties& prop, int clientPort);
+    static void Shutdown();
     void SetProperties(const Properties& props);
     int64_t Uptime() const { return mUptime; }
     bool ScheduleRestart(int64_t gracefulRestartTimeout, int64_t gracefulRestartAppendWithWidTimeout);
@@ -719,6 +723,13 @@ public:
     void SetCanBeCandidateServerFlag(bool flag) {
         mCanBeCandidateServerFlag = flag;
     }
+    // Position in the rack's tier placement candidates index, or -1.
+    int GetPlacementIndex(kfsSTier_t tier) const {
+        return mPlacementIdx[tier];
+    }
+    void SetPlacementIndex(kfsSTier_t tier, int idx) {
+        mPlacementIdx[tier] = idx;
+    }
     int64_t GetEvacuateCount() const {
         return mEvacuateCnt;
     }
@@ -800,6 +811,10 @@ public:
         { return mAuthUid; }
     const string& GetMd5Sum() const
         { return mMd5Sum; }
+    int64_t GetInventoryGeneration() const
+        { return mInventoryGeneration; }
+    void SetInventoryGeneration(int64_t generation)
+        { mInventoryGeneration = generation; }
     const int64_t GetOpenObjectCount() const
         { return mNumObjects; }
     const int64_t GetWritableObjectCount() const
@@ -985,6 +1000,8 @@ protected:
     time_t             mSessionExpirationTime;
     bool               mReAuthSentFlag;
     MetaHello*         mHelloOp;
+    bool               mHelloParseInFlightFlag;
+    bool               mHelloChunksParsedFlag;
     ChunkServerPtr     mSelfPtr;
     ValueSampler       mSrvLoadSampler;
     int64_t            mLoadAvg;
@@ -1004,6 +1021,7 @@ protected:
     LostChunkDirs      mLostChunkDirs;
     ChunkDirInfos      mChunkDirInfos;
     string             mMd5Sum;
+    int64_t            mInventoryGeneration;
     const string       mPeerName;
     bool               mCryptoKeyValidFlag;
     CryptoKeys::KeyId  mCryptoKeyId;
@@ -1013,6 +1031,7 @@ protected:
     MetaRequest*       mPendingResponseOpsHeadPtr;
     MetaRequest*       mPendingResponseOpsTailPtr;
     bool               mCanBeCandidateServerFlags[kKfsSTierCount];
+    int                mPlacementIdx[kKfsSTierCount];
     StorageTierInfo    mStorageTiersInfo[kKfsSTierCount];
     StorageTierInfo    mStorageTiersInfoDelta[kKfsSTierCount];
     ChunkServer*       mPrevPtr[kChunkSrvListsCount];
@@ -1030,6 +1049,8 @@ protected:
     static int              sEvacuateRateUpdateInterval;
     static size_t           sChunkDirsCount;
 
+    class HelloParser;
+    friend class HelloParser;
     friend class QCDLListOp<ChunkServer, 0>;
     friend class QCDLListOp<ChunkServer, 1>;
     typedef QCDLList<ChunkServer, 0> ChunkServersList;
@@ -1140,6 +1161,8 @@ protected:
     int DeclareHelloError(
         int         status,
         const char* statusMsg);
+    void HelloChunkListsError(int contentLength);
+    void HelloParseDone(MetaHello& op, bool okFlag);
     void ReleasePendingResponses(bool sendResponseFlag = false);
 };
 
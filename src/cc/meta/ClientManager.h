@@ -84,6 +84,10 @@ public:
     void PrepareCurrentThreadToFork();
     inline void PrepareToFork();
     inline void ForkDone();
+    inline bool IsSharedDispatchEnabled() const;
+    inline bool StartSharedDispatch();
+    inline void SharedDispatchDone();
+    inline void StartExclusiveDispatch();
 private:
     class Impl;
     Impl& mImpl;
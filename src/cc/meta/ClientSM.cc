@@ -147,6 +147,7 @@ ClientSM::ClientSM(
       mDelegationValidFlag(false),
       mLastReadLeft(0),
       mAuthenticateOp(0),
+      mLookupBatchOp(0),
       mAuthUid(kKfsUserNone),
       mAuthGid(kKfsGroupNone),
       mAuthEUid(kKfsUserNone),
@@ -180,6 +181,7 @@ ClientSM::ClientSM(
 ClientSM::~ClientSM()
 {
     delete mAuthenticateOp;
+    delete mLookupBatchOp;
     QCStMutexLocker locker(gNetDispatch.GetClientManagerMutex());
     ClientSMList::Remove(sClientSMPtr, *this);
     sClientCount--;
@@ -217,6 +219,7 @@ ClientSM::SendResponse(MetaRequest *op)
         mOstream.Set(mNetConnection->GetOutBuffer()),
         mNetConnection->GetOutBuffer());
     mOstream.Reset();
+    gNetDispatch.ResponseDone(*op);
     if (mRecursionCnt <= 0) {
         mNetConnection->StartFlush();
     }
@@ -260,7 +263,8 @@ ClientSM::HandleRequestSelf(int code, void *data)
         }
         assert(data == &iobuf);
         HandleAuthenticate(iobuf);
-        if (mAuthenticateOp) {
+        HandleLookupBatch(iobuf);
+        if (mAuthenticateOp || mLookupBatchOp) {
             break;
         }
         // Do not start new op if response does not get unloaded by
@@ -281,11 +285,11 @@ ClientSM::HandleRequestSelf(int code, void *data)
                 break;
             }
             HandleClientCmd(iobuf, cmdLen);
-            if (mAuthenticateOp) {
+            if (mAuthenticateOp || mLookupBatchOp) {
                 break;
             }
         }
-        if (overWriteBehindFlag || mAuthenticateOp) {
+        if (overWriteBehindFlag || mAuthenticateOp || mLookupBatchOp) {
             break;
         }
         if (! IsOverPendingOpsLimit() && ! mDisconnectFlag) {
@@ -311,7 +315,8 @@ ClientSM::HandleRequestSelf(int code, void *data)
     case EVENT_CMD_DONE: {
         assert(data && mPendingOpsCount > 0);
         MetaRequest* const op = reinterpret_cast<MetaRequest*>(data);
-        if (sAuditLoggingFlag && ! op->reqHeaders.IsEmpty()) {
+        if (sAuditLoggingFlag &&
+                (! op->reqHeaders.IsEmpty() || AuditLog::IsBinary())) {
             AuditLog::Log(*op);
         }
         const bool deleteOpFlag = op != mAuthenticateOp;
@@ -397,6 +402,7 @@ ClientSM::HandleRequestSelf(int code, void *data)
         if (! IsOverPendingOpsLimit() &&
                 mRecursionCnt <= 1 &&
                 ! mAuthenticateOp &&
+                ! mLookupBatchOp &&
                 (code == EVENT_CMD_DONE || ! mNetConnection->IsReadReady()) &&
                 mNetConnection->GetNumBytesToWrite() < sMaxWriteBehind) {
             if (mNetConnection->GetNumBytesToRead() > mLastReadLeft ||
@@ -477,6 +483,12 @@ ClientSM::HandleRequestSelf(int code, void *data)
                 mNetConnection->SetMaxReadAhead(0);
             }
         } else {
+            if (mLookupBatchOp) {
+                // Discard partially received request.
+                delete mLookupBatchOp;
+                mLookupBatchOp = 0;
+                mPendingOpsCount--;
+            }
             if (mPendingOpsCount > 0) {
                 mNetConnection.reset();
             } else {
@@ -521,6 +533,7 @@ ClientSM::HandleClientCmd(IOBuffer& iobuf, int cmdLen)
 {
     assert(! IsOverPendingOpsLimit() && mNetConnection);
     MetaRequest* op = 0;
+    const int64_t recvTime = microseconds();
     if (ParseCommand(iobuf, cmdLen, &op, mParseBuffer) != 0) {
         IOBuffer::IStream is(iobuf, cmdLen);
         char buf[128];
@@ -543,7 +556,8 @@ ClientSM::HandleClientCmd(IOBuffer& iobuf, int cmdLen)
         KFS_LOG_EOM;
     }
     // Command is ready to be pushed down.  So remove the cmd from the buffer.
-    if (sAuditLoggingFlag) {
+    if (sAuditLoggingFlag && ! AuditLog::IsBinary()) {
+        // Binary audit log does not include request headers.
         op->reqHeaders.Move(&iobuf, cmdLen);
     } else {
         iobuf.Consume(cmdLen);
@@ -555,6 +569,7 @@ ClientSM::HandleClientCmd(IOBuffer& iobuf, int cmdLen)
         " rd: "   << mNetConnection->GetNumBytesToRead() <<
         " wr: "   << mNetConnection->GetNumBytesToWrite() <<
     KFS_LOG_EOM;
+    op->recvTime            = recvTime;
     op->clientIp            = mClientIp;
     op->fromClientSMFlag    = true;
     op->clnt                = this;
@@ -630,13 +645,19 @@ ClientSM::HandleClientCmd(IOBuffer& iobuf, int cmdLen)
     if (op->dispatch(*this)) {
         return;
     }
-    if (mAuthUid == kKfsUserNone && mAuthContext.IsAuthRequired(*op)) {
-        op->status    = -EPERM;
-        op->statusMsg = "authentication required";
-        CmdDone(*op);
+    SubmitCmd(*op);
+}
+
+void
+ClientSM::SubmitCmd(MetaRequest& op)
+{
+    if (mAuthUid == kKfsUserNone && mAuthContext.IsAuthRequired(op)) {
+        op.status    = -EPERM;
+        op.statusMsg = "authentication required";
+        CmdDone(op);
         return;
     }
-    ClientManager::SubmitRequest(mClientThread, *op);
+    ClientManager::SubmitRequest(mClientThread, op);
 }
 
 void
@@ -658,6 +679,15 @@ ClientSM::Handle(MetaAuthenticate& op)
     return true;
 }
 
+bool
+ClientSM::Handle(MetaLookupBatch& op)
+{
+    assert(! mLookupBatchOp);
+    mLookupBatchOp = &op;
+    HandleLookupBatch(mNetConnection->GetInBuffer());
+    return true;
+}
+
 bool
 ClientSM::Handle(MetaDelegate& op)
 {
@@ -890,6 +920,33 @@ ClientSM::HandleAuthenticate(IOBuffer& iobuf)
     return;
 }
 
+void
+ClientSM::HandleLookupBatch(IOBuffer& iobuf)
+{
+    if (! mLookupBatchOp) {
+        return;
+    }
+    const int rem = mLookupBatchOp->Read(iobuf);
+    if (0 < rem) {
+        if (mDisconnectFlag) {
+            // Discard partially received request.
+            delete mLookupBatchOp;
+            mLookupBatchOp = 0;
+            mPendingOpsCount--;
+            return;
+        }
+        mNetConnection->SetMaxReadAhead(rem + sMaxReadAhead);
+        return;
+    }
+    MetaLookupBatch& op = *mLookupBatchOp;
+    mLookupBatchOp = 0;
+    if (op.status != 0) {
+        CmdDone(op);
+        return;
+    }
+    SubmitCmd(op);
+}
+
 /* virtual */ bool
 ClientSM::Verify(
     string&       ioFilterAuthName,
@@ -53,6 +53,7 @@ struct MetaRequest;
 struct MetaAuthenticate;
 struct MetaDelegate;
 struct MetaLookup;
+struct MetaLookupBatch;
 struct MetaDelegateCancel;
 
 class ClientSM :
@@ -101,6 +102,7 @@ public:
     bool Handle(MetaAuthenticate& op);
     bool Handle(MetaDelegate& op);
     bool Handle(MetaLookup& op);
+    bool Handle(MetaLookupBatch& op);
     bool Handle(MetaDelegateCancel& op);
     bool Handle(MetaAllocate& op);
 private:
@@ -117,6 +119,7 @@ private:
     bool                               mDelegationValidFlag:1;
     int                                mLastReadLeft;
     MetaAuthenticate*                  mAuthenticateOp;
+    MetaLookupBatch*                   mLookupBatchOp;
     kfsUid_t                           mAuthUid;
     kfsGid_t                           mAuthGid;
     kfsUid_t                           mAuthEUid;
@@ -149,6 +152,8 @@ private:
     bool IsOverPendingOpsLimit() const
         { return (mPendingOpsCount >= sMaxPendingOps); }
     void HandleAuthenticate(IOBuffer& iobuf);
+    void HandleLookupBatch(IOBuffer& iobuf);
+    void SubmitCmd(MetaRequest& op);
     void HandleDelegation(MetaDelegate& op);
     void CloseConnection(const char* msg = 0);
 
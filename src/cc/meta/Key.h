@@ -65,10 +65,23 @@ public:
         { return ! (*this > test); }
     bool operator >= (const Key &test) const
         { return ! (*this < test); }
+    uint64_t getHi() const { return hi; }
+    uint64_t getLo() const { return lo; }
+    uint64_t getLoMask() const { return ~uint64_t(0); }
+    //!< return the type and the first data item passed to the constructor
+    MetaType getType() const
+        { return (MetaType)(((hi >> 62) << 4) | (lo & 3)); }
+    KeyData getData1() const
+        { return (KeyData)(((hi << 2) | (lo >> 62)) + (uint64_t(1) << 63)); }
 private:
     uint64_t hi;
     uint64_t lo;
+    Key(uint64_t h, uint64_t l)
+        : hi(h),
+          lo(l)
+        {}
     friend class PartialMatch;
+    template<int> friend class NodeT;
 };
 
 class PartialMatch
@@ -98,6 +111,11 @@ public:
         { return ! (*this > test); }
     bool operator >= (const Key &test) const
         { return ! (*this < test); }
+    uint64_t getHi() const { return key.hi; }
+    uint64_t getLo() const { return (key.lo & mask); }
+    uint64_t getLoMask() const { return mask; }
+    MetaType getType() const { return key.getType(); }
+    KeyData getData1() const { return key.getData1(); }
 };
 
 inline bool operator < (const Key &l, const PartialMatch &r) {
@@ -37,6 +37,9 @@
 #include "kfsio/IOBufferWriter.h"
 #include "qcdio/QCIoBufferPool.h"
 #include "qcdio/QCUtils.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/qcstutils.h"
 #include "common/MsgLogger.h"
 #include "common/Properties.h"
 #include "common/time.h"
@@ -44,6 +47,7 @@
 #include "common/RequestParser.h"
 #include "common/StdAllocator.h"
 #include "common/rusage.h"
+#include "common/IntToString.h"
 
 #include <algorithm>
 #include <functional>
@@ -55,6 +59,9 @@
 #include <boost/mem_fn.hpp>
 #include <boost/bind.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace KFS {
 
 using std::for_each;
@@ -1400,6 +1407,18 @@ LayoutManager::Rand(int64_t interval)
     return (int64_t)(mRandom.Rand() % interval);
 }
 
+// GetChunkToServerMapping() can be invoked by the client threads concurrently,
+// see MetaGetalloc::IsSharedReadOnly().
+static PrngIsaac64&
+GetThreadRandom()
+{
+    static __thread PrngIsaac64* sRandom = 0;
+    if (! sRandom) {
+        sRandom = new PrngIsaac64();
+    }
+    return *sRandom;
+}
+
 LayoutManager::ChunkPlacement::ChunkPlacement()
     : Super(gLayoutManager)
 {
@@ -1436,6 +1455,8 @@ LayoutManager::LayoutManager() :
     mLeaseCleaner(ChunkLeases::kLeaseTimerResolutionSec * 1000),
     mChunkReplicator(5 * 1000),
     mCheckpoint(5 * 1000),
+    mDumpsterReclaimer(60 * 1000),
+    mDumpsterReclaimMaxEntries(4 << 10),
     mMinChunkserversToExitRecovery(1),
     mChunkServers(),
     mMastersCount(0),
@@ -1450,6 +1471,7 @@ LayoutManager::LayoutManager() :
     mMaxAppendersPerChunk(4 << 10),
     mReservationOvercommitFactor(1.0),
     mServerDownReplicationDelay(2 * 60),
+    mHelloDeltaFlag(true),
     mMaxDownServersHistorySize(4 << 10),
     mChunkServersProps(),
     mCSToRestartCount(0),
@@ -1476,6 +1498,7 @@ LayoutManager::LayoutManager() :
     mFullReplicationCheckInterval(
         int64_t(7) * 24 * 60 * 60 * kSecs2MicroSecs),
     mCheckAllChunksInProgressFlag(false),
+    mReplicationQueues(),
     mConcurrentWritesPerNodeWatermark(10),
     mMaxSpaceUtilizationThreshold(0.95),
     mUseFsTotalSpaceFlag(true),
@@ -1518,10 +1541,17 @@ LayoutManager::LayoutManager() :
     mForceDelayedRecoveryUpdateFlag(false),
     mSortCandidatesBySpaceUtilizationFlag(false),
     mSortCandidatesByLoadAvgFlag(false),
+    mPlacementChoicesCount(0),
     mMaxFsckFiles(128 << 10),
     mFsckAbandonedFileTimeout(int64_t(1000) * kSecs2MicroSecs),
     mMaxFsckTime(int64_t(19) * 60 * kSecs2MicroSecs),
     mFullFsckFlag(true),
+    mInProcessFsckFlag(false),
+    mInProcessChunkMapDumpFlag(false),
+    mInProcessScanSliceTime(5000),
+    mInProcessScanProgressInterval(int64_t(30) * kSecs2MicroSecs),
+    mFsckScan(0),
+    mChunkMapDumpScan(0),
     mMTimeUpdateResolution(kSecs2MicroSecs),
     mMaxPendingRecoveryMsgLogInfo(1 << 10),
     mAllowLocalPlacementFlag(true),
@@ -1634,6 +1664,7 @@ LayoutManager::LayoutManager() :
     mTotalReplicationStats   = new Counter("Total Num Replications");
     mFailedReplicationStats  = new Counter("Num Failed Replications");
     mStaleChunkCount         = new Counter("Num Stale Chunks");
+    mHelloMergeStats         = new Counter("Hello Chunks Merged");
     // how much to be done before we are done
     globals().counterManager.AddCounter(mReplicationTodoStats);
     // how many chunks are "endangered"
@@ -1642,6 +1673,17 @@ LayoutManager::LayoutManager() :
     globals().counterManager.AddCounter(mTotalReplicationStats);
     globals().counterManager.AddCounter(mFailedReplicationStats);
     globals().counterManager.AddCounter(mStaleChunkCount);
+    globals().counterManager.AddCounter(mHelloMergeStats);
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        // Backlog by the number of replicas or chunks that can be lost.
+        string name("Num Replications Queued Redundancy ");
+        AppendDecIntToString(name, i);
+        if (i + 1 == kReplicationPriorityCount) {
+            name += "+";
+        }
+        mReplicationQueueStats[i] = new Counter(name.c_str());
+        globals().counterManager.AddCounter(mReplicationQueueStats[i]);
+    }
     for (size_t i = 0; i < kKfsSTierCount; i++) {
         mTierSpaceUtilizationThreshold[i]   = 2.;
         mTiersMaxWritesPerDriveThreshold[i] = mMinWritesPerDrive;
@@ -1657,11 +1699,17 @@ LayoutManager::~LayoutManager()
     globals().counterManager.RemoveCounter(mTotalReplicationStats);
     globals().counterManager.RemoveCounter(mFailedReplicationStats);
     globals().counterManager.RemoveCounter(mStaleChunkCount);
+    globals().counterManager.RemoveCounter(mHelloMergeStats);
     delete mReplicationTodoStats;
     delete mOngoingReplicationStats;
     delete mTotalReplicationStats;
     delete mFailedReplicationStats;
     delete mStaleChunkCount;
+    delete mHelloMergeStats;
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        globals().counterManager.RemoveCounter(mReplicationQueueStats[i]);
+        delete mReplicationQueueStats[i];
+    }
     if (mCleanupScheduledFlag) {
         globalNetManager().UnRegisterTimeoutHandler(this);
     }
@@ -1849,6 +1897,12 @@ LayoutManager::SetParameters(const Properties& props, int clientPort)
         "metaServer.replicationCheckInterval",
         mChunkReplicator.GetTimeoutInterval() * 1e-3) * 1e3));
 
+    mDumpsterReclaimer.SetTimeoutInterval((int)(props.getValue(
+        "metaServer.dumpsterReclaimInterval",
+        mDumpsterReclaimer.GetTimeoutInterval() * 1e-3) * 1e3));
+    mDumpsterReclaimMaxEntries = max(1, props.getValue(
+        "metaServer.dumpsterReclaimMaxEntries",
+        mDumpsterReclaimMaxEntries));
     mCheckpoint.GetOp().SetParameters(props);
 
     mCSCountersUpdateInterval = props.getValue(
@@ -1867,6 +1921,9 @@ LayoutManager::SetParameters(const Properties& props, int clientPort)
     mServerDownReplicationDelay = (int)props.getValue(
         "metaServer.serverDownReplicationDelay",
          double(mServerDownReplicationDelay));
+    mHelloDeltaFlag = props.getValue(
+        "metaServer.chunkServer.helloDeltaEnabled",
+        mHelloDeltaFlag ? 1 : 0) != 0;
     mMaxDownServersHistorySize = props.getValue(
         "metaServer.maxDownServersHistorySize",
          mMaxDownServersHistorySize);
@@ -1904,6 +1961,9 @@ LayoutManager::SetParameters(const Properties& props, int clientPort)
     mSortCandidatesByLoadAvgFlag = props.getValue(
         "metaServer.sortCandidatesByLoadAvg",
         mSortCandidatesByLoadAvgFlag ? 1 : 0) != 0;
+    mPlacementChoicesCount = props.getValue(
+        "metaServer.placementChoices",
+        mPlacementChoicesCount);
 
     mMaxFsckFiles = props.getValue(
         "metaServer.maxFsckChunks",
@@ -1917,6 +1977,18 @@ LayoutManager::SetParameters(const Properties& props, int clientPort)
     mFullFsckFlag = props.getValue(
         "metaServer.fullFsck",
         mFullFsckFlag ? 1 : 0) != 0;
+    mInProcessFsckFlag = props.getValue(
+        "metaServer.fsck.inProcess",
+        mInProcessFsckFlag ? 1 : 0) != 0;
+    mInProcessChunkMapDumpFlag = props.getValue(
+        "metaServer.chunkMapDump.inProcess",
+        mInProcessChunkMapDumpFlag ? 1 : 0) != 0;
+    mInProcessScanSliceTime = max(int64_t(100), props.getValue(
+        "metaServer.inProcessScanSliceTimeUsec",
+        mInProcessScanSliceTime));
+    mInProcessScanProgressInterval = (int64_t)(props.getValue(
+        "metaServer.inProcessScanProgressInterval",
+        mInProcessScanProgressInterval * 1e-6) * 1e6);
 
     mMTimeUpdateResolution = (int64_t)(props.getValue(
         "metaServer.MTimeUpdateResolution",
@@ -2075,6 +2147,7 @@ LayoutManager::SetParameters(const Properties& props, int clientPort)
     MetaFsck::SetParameters(props);
     SetRequestParameters(props);
     CSMapUnitTest(props);
+    ReplicationPriorityUnitTest(props);
     mChunkToServerMap.SetDebugValidate(props.getValue(
         "metaServer.chunkToServerMap.debugValidate", 0) != 0);
     mAllowChunkServerRetireFlag = props.getValue(
@@ -2378,6 +2451,30 @@ LayoutManager::Validate(MetaHello& r) const
     return false;
 }
 
+/*!
+ * \brief Check if incremental chunk server hello can be accepted: the chunk
+ *  server must be hibernated, or still connected, with the chunk inventory
+ *  generation that matches the one presented by the hello.
+ */
+bool
+LayoutManager::CanAcceptHelloDelta(const MetaHello& r)
+{
+    if (! mHelloDeltaFlag || r.inventoryGeneration <= 0) {
+        return false;
+    }
+    const HibernatingServerInfo_t* const hs = FindHibernatingServer(r.location);
+    if (hs && hs->IsHibernated()) {
+        return (hs->inventoryGeneration == r.inventoryGeneration &&
+            TimeNow() < hs->sleepEndTime &&
+            mChunkToServerMap.CanRestoreHibernatedServer(hs->csmapIdx));
+    }
+    // Reconnect before the existing connection is declared down. The
+    // existing server is put into hibernation when the hello is processed.
+    Servers::const_iterator const it = FindServer(r.location);
+    return (it != mChunkServers.end() &&
+        (*it)->GetInventoryGeneration() == r.inventoryGeneration);
+}
+
 bool
 LayoutManager::Validate(MetaCreate& createOp) const
 {
@@ -2468,6 +2565,7 @@ LayoutManager::Shutdown()
     mCSDirCountersResponse.Clear();
     mPingResponse.Clear();
     mUserAndGroup.Shutdown();
+    ChunkServer::Shutdown();
     mClientAuthContext.Clear();
     mCSAuthContext.Clear();
 }
@@ -2935,7 +3033,34 @@ LayoutManager::AddNewServer(MetaHello *r)
     // Add server first, then add chunks, otherwise if/when the server goes
     // down in the process of adding chunks, taking out server from chunk
     // info will not work in ServerDown().
-    if ( ! mChunkToServerMap.AddServer(r->server)) {
+    // With incremental hello the chunk server reports only the chunks that
+    // changed since its previous hello, and the hibernated server slot with
+    // all unchanged chunks is restored.
+    const bool        deltaFlag = 0 < r->inventoryGeneration;
+    vector<chunkId_t> hibernatedStale;
+    if (deltaFlag) {
+        HibernatedServerInfos::iterator const hsi = find_if(
+            mHibernatingServers.begin(), mHibernatingServers.end(),
+            bind(&HibernatingServerInfo_t::location, _1) == srvId
+        );
+        if (! mHelloDeltaFlag ||
+                hsi == mHibernatingServers.end() ||
+                ! hsi->IsHibernated() ||
+                hsi->inventoryGeneration != r->inventoryGeneration ||
+                ! mChunkToServerMap.RestoreHibernatedServer(
+                    r->server, hsi->csmapIdx, hibernatedStale)) {
+            KFS_LOG_STREAM_ERROR <<
+                "failed to add server: " << srvId <<
+                " unable to restore hibernated server"
+                " inventory generation: " << r->inventoryGeneration <<
+                " hibernated: " << (hsi != mHibernatingServers.end() &&
+                    hsi->IsHibernated()) <<
+            KFS_LOG_EOM;
+            srv.ForceDown();
+            return;
+        }
+        mHibernatingServers.erase(hsi);
+    } else if ( ! mChunkToServerMap.AddServer(r->server)) {
         KFS_LOG_STREAM_WARN <<
             "failed to add server: " << srvId <<
             " no slots available "
@@ -2947,7 +3072,9 @@ LayoutManager::AddNewServer(MetaHello *r)
     }
     mChunkServers.insert(existing, r->server);
 
-    const uint64_t allocSpace = r->chunks.size() * CHUNKSIZE;
+    // The chunk count is non 0 only if the hibernated server was restored.
+    const uint64_t allocSpace =
+        (srv.GetChunkCount() + r->chunks.size()) * CHUNKSIZE;
     srv.SetSpace(r->totalSpace, r->usedSpace, allocSpace);
     RackId rackId;
     if (mUseCSRackAssignmentFlag && 0 <= r->rackId) {
@@ -3017,8 +3144,53 @@ LayoutManager::AddNewServer(MetaHello *r)
     if (! mChunkServersProps.empty() && ! srv.IsDown()) {
         srv.SetProperties(mChunkServersProps);
     }
+    // The stable chunk list is sorted by chunk id if it was parsed by the
+    // hello parser thread, thus the chunk map lookups are mostly sequential.
+    const int64_t mergeStart = microseconds();
     int maxLogInfoCnt = 32;
     ChunkIdQueue staleChunkIds;
+    if (deltaFlag) {
+        // Remove the replicas that the chunk server reports as deleted or
+        // changed. The loops below add the changed replicas back in the same
+        // way as with the full hello.
+        vector<bool> reported(hibernatedStale.size(), false);
+        for (int i = 0; i < 4 && ! srv.IsDown(); i++) {
+            const MetaHello::ChunkInfos& chunks = i == 0 ?
+                r->deletedChunks : (i == 1 ?
+                r->chunks : (i == 2 ?
+                r->notStableAppendChunks :
+                r->notStableChunks));
+            for (MetaHello::ChunkInfos::const_iterator it = chunks.begin();
+                    it != chunks.end();
+                    ++it) {
+                vector<chunkId_t>::const_iterator const si = lower_bound(
+                    hibernatedStale.begin(), hibernatedStale.end(),
+                    it->chunkId);
+                if (si != hibernatedStale.end() && *si == it->chunkId) {
+                    reported[si - hibernatedStale.begin()] = true;
+                }
+                CSMap::Entry* const cmi = mChunkToServerMap.Find(it->chunkId);
+                if (cmi && cmi->Remove(mChunkToServerMap, r->server) &&
+                        i == 0) {
+                    CheckReplication(*cmi);
+                }
+            }
+        }
+        // Replicas that were deleted or changed while the server was
+        // hibernated, and that the chunk server did not report, are stale.
+        for (size_t i = 0; i < hibernatedStale.size(); i++) {
+            if (reported[i]) {
+                continue;
+            }
+            const chunkId_t     chunkId = hibernatedStale[i];
+            CSMap::Entry* const cmi     = mChunkToServerMap.Find(chunkId);
+            if (cmi && cmi->Remove(mChunkToServerMap, r->server)) {
+                CheckReplication(*cmi);
+            }
+            staleChunkIds.PushBack(chunkId);
+            mStaleChunkCount->Update(1);
+        }
+    }
     for (MetaHello::ChunkInfos::const_iterator it = r->chunks.begin();
             it != r->chunks.end() && ! srv.IsDown();
             ++it) {
@@ -3140,6 +3312,11 @@ LayoutManager::AddNewServer(MetaHello *r)
             // MakeChunkStableDone will process pending recovery.
         }
     }
+    const int64_t mergeTime = microseconds() - mergeStart;
+    mHelloMergeStats->Update((int64_t)(r->chunks.size() +
+        r->notStableAppendChunks.size() + r->notStableChunks.size() +
+        r->deletedChunks.size()));
+    mHelloMergeStats->UpdateTime(mergeTime);
     const size_t staleCnt = staleChunkIds.GetSize();
     if (! staleChunkIds.IsEmpty() && ! srv.IsDown()) {
         srv.NotifyStaleChunks(staleChunkIds);
@@ -3179,18 +3356,28 @@ LayoutManager::AddNewServer(MetaHello *r)
         }
     }
     UpdateReplicationsThreshold();
+    if (mHelloDeltaFlag) {
+        // Positive random number, hello with generation 0 is full hello.
+        const int64_t generation = (int64_t)(mRandom.Rand() >> 1) | 1;
+        srv.SetInventoryGeneration(generation);
+        r->newInventoryGeneration = generation;
+    }
     KFS_LOG_STREAM_INFO <<
         msg << " chunk server: " << r->peerName << "/" <<
             srv.GetServerLocation() <<
         (srv.CanBeChunkMaster() ? " master" : " slave") <<
         " rack: "            << r->rackId << " => " << rackId <<
-        " chunks: stable: "  << r->chunks.size() <<
+        " chunks: "          << (deltaFlag ? "delta" : "full") <<
+        " hosted: "          << srv.GetChunkCount() <<
+        " stable: "          << r->chunks.size() <<
         " not stable: "      << r->notStableChunks.size() <<
         " append: "          << r->notStableAppendChunks.size() <<
+        " deleted: "         << r->deletedChunks.size() <<
         " +wid: "            << r->numAppendsWithWid <<
         " writes: "          << srv.GetNumChunkWrites() <<
         " +wid: "            << srv.GetNumAppendsWithWid() <<
         " stale: "           << staleCnt <<
+        " merge: "           << mergeTime << " usec." <<
         " masters: "         << mMastersCount <<
         " slaves: "          << mSlavesCount <<
         " total: "           << mChunkServers.size() <<
@@ -3530,14 +3717,14 @@ public:
 // Dump out the chunk block map to a file.  The output can be used in emulation
 // modes where we setup the block map and experiment.
 //
-void
-LayoutManager::DumpChunkToServerMap(const string& dirToUse)
+bool
+LayoutManager::WriteNetworkDef(const string& dirToUse)
 {
     //
     // to make offline rebalancing/re-replication easier, dump out where the
     // servers are and how much space each has.
     //
-    string fn = dirToUse + "/network.def";
+    const string fn = dirToUse + "/network.def";
     ofstream ofs(fn.c_str(), ofstream::out | ofstream::trunc);
     if (ofs) {
         for_each(mChunkServers.begin(), mChunkServers.end(),
@@ -3546,11 +3733,19 @@ LayoutManager::DumpChunkToServerMap(const string& dirToUse)
     }
     if (! ofs) {
         unlink(fn.c_str());
-        return;
+        return false;
     }
+    return true;
+}
 
-    fn = dirToUse + "/chunkmap.txt";
-    ofs.open(fn.c_str(), ofstream::out | ofstream::trunc);
+void
+LayoutManager::DumpChunkToServerMap(const string& dirToUse)
+{
+    if (! WriteNetworkDef(dirToUse)) {
+        return;
+    }
+    const string fn = dirToUse + "/chunkmap.txt";
+    ofstream ofs(fn.c_str(), ofstream::out | ofstream::trunc);
     if (ofs) {
         DumpChunkToServerMap(ofs);
         ofs.close();
@@ -3855,6 +4050,8 @@ public:
         : mLayoutManager(layoutManager),
           mPlacement(),
           mStartTime(microseconds()),
+          mSliceStartTime(mStartTime),
+          mWalkTime(0),
           mMaxToReportFileCount(maxFilesToReport),
           mPath(),
           mDepth(0),
@@ -3912,6 +4109,30 @@ public:
             mDirCount++;
             return true;
         }
+        return Check(&de, fa);
+    }
+    // Meta tree leaf walk entry point. The path is obtained from the parent
+    // pointers, only for the files that are reported.
+    bool operator()(const MetaFattr& fa)
+    {
+        if (mStopFlag) {
+            return false;
+        }
+        if (fa.type == KFS_DIR) {
+            if (fa.parent) {
+                size_t depth = 0;
+                for (const MetaFattr* p = fa.parent; p->parent; p = p->parent) {
+                    depth++;
+                }
+                mMaxDirDepth = max(mMaxDirDepth, depth);
+                mDirCount++;
+            }
+            return true;
+        }
+        return Check(0, fa);
+    }
+    bool Check(const MetaDentry* de, const MetaFattr& fa)
+    {
         const chunkOff_t fsize = metatree.getFileSize(fa);
         mMaxFileSize     = max(mMaxFileSize, fsize);
         mTotalFilesSize += fsize;
@@ -3937,7 +4158,7 @@ public:
     }
     void Report(
         Status            status,
-        const MetaDentry& de,
+        const MetaDentry* de,
         const MetaFattr&  fa)
     {
         mFileCounts[status]++;
@@ -3960,7 +4181,11 @@ public:
             fa.chunkcount()) <<
         " " << DisplayIsoDateTime(fa.mtime) <<
         " ";
-        DisplayPath(os) << "/" << de.getName() << "\n";
+        if (de) {
+            de->showName(DisplayPath(os) << "/") << "\n";
+        } else {
+            os << metatree.getPathname(&fa) << "\n";
+        }
     }
     void OverReplicated()       { mOverReplicatedCount++; }
     void UnderReplicated()      { mUnderReplicatedCount++; }
@@ -3976,6 +4201,16 @@ public:
     }
     ChunkPlacement& GetPlacement() { return mPlacement; }
     int64_t StartTime() const      { return mStartTime; }
+    void StartSlice(int64_t walkTime)
+    {
+        mSliceStartTime = microseconds();
+        mWalkTime       = walkTime;
+    }
+    bool IsRunTimeExceeded(int64_t maxRunTime) const
+    {
+        return (mSliceStartTime + maxRunTime - mWalkTime <
+            microseconds());
+    }
     int64_t GetFileCount() const   { return mFileCount; }
     int64_t ItemsCount() const
         { return (mTotalChunkCount + (int64_t)mFileCount); }
@@ -4099,6 +4334,8 @@ private:
     ostream*       mOs[kStateCount];
     size_t         mFileCounts[kStateCount];
     const int64_t  mStartTime;
+    int64_t        mSliceStartTime;
+    int64_t        mWalkTime;
     const int64_t  mMaxToReportFileCount;
     Path           mPath;
     size_t         mDepth;
@@ -4132,7 +4369,7 @@ private:
         for (Path::const_iterator it = mPath.begin();
                 it != mPath.end();
                 ++it) {
-            os << "/" << (*it)->getName();
+            (*it)->showName(os << "/");
         }
         return os;
     }
@@ -4144,7 +4381,7 @@ private:
 void
 LayoutManager::CheckFile(
     FilesChecker&     fsck,
-    const MetaDentry& de,
+    const MetaDentry* de,
     const MetaFattr&  fa)
 {
     const int64_t         kScanCheckMask    = ((int64_t(1) << 16) - 1);
@@ -4193,8 +4430,7 @@ LayoutManager::CheckFile(
             }
             fsck.Chunk();
             if ((fsck.ItemsCount() & kScanCheckMask) == 0 &&
-                    fsck.StartTime() + mMaxFsckTime <
-                    microseconds()) {
+                    fsck.IsRunTimeExceeded(mMaxFsckTime)) {
                 stopFlag = true;
                 break;
             }
@@ -4278,7 +4514,7 @@ LayoutManager::CheckFile(
         fsck.Report(status, de, fa);
     } else if (chunkBlockCount <= 0) {
         stopFlag = (fsck.ItemsCount() & kScanCheckMask) == 0 &&
-            fsck.StartTime() + mMaxFsckTime < microseconds();
+            fsck.IsRunTimeExceeded(mMaxFsckTime);
     }
     if (stopFlag) {
         ostringstream os;
@@ -4288,6 +4524,482 @@ LayoutManager::CheckFile(
     }
 }
 
+void
+LayoutManager::DumpChunkToServerMap(ostream& os)
+{
+    mChunkToServerMap.First();
+    StTmp<Servers> serversTmp(mServersTmp);
+    for (const CSMap::Entry* p; (p = mChunkToServerMap.Next()); ) {
+        DumpChunkToServerMap(os, *p, serversTmp.Get());
+    }
+}
+
+void
+LayoutManager::DumpChunkToServerMap(
+    ostream& os, const CSMap::Entry& entry, Servers& cs)
+{
+    mChunkToServerMap.GetServers(entry, cs);
+    os << entry.GetChunkId() <<
+        " " << entry.GetFileId() <<
+        " " << cs.size();
+    for (Servers::const_iterator it = cs.begin();
+            it != cs.end();
+            ++it) {
+        os <<
+            " " << (*it)->GetServerLocation() <<
+            " " << (*it)->GetRack();
+    }
+    os << "\n";
+}
+
+// Leaf scan output writer thread. The main thread formats the output in time
+// slices, and the writer thread writes it into the files, in order not to
+// block the event loop on the file io. The scan stops walking while the
+// pending bytes exceed the limit, the writer wakes up the net manager once
+// the pending bytes drop below the limit, and once all output is written.
+class LeafScanWriter : public QCRunnable
+{
+public:
+    typedef vector<int> Fds;
+
+    LeafScanWriter(const Fds& fds, size_t maxPendingBytes)
+        : QCRunnable(),
+          mFds(fds),
+          mOffsets(fds.size(), 0),
+          mMaxPendingBytes(maxPendingBytes),
+          mThread(),
+          mMutex(),
+          mCond(),
+          mQueue(),
+          mPendingBytes(0),
+          mError(0),
+          mFinishFlag(false),
+          mDoneFlag(false)
+        {}
+    virtual ~LeafScanWriter()
+    {
+        Finish();
+        mThread.Join();
+    }
+    int Start()
+    {
+        const int kStackSize = 64 << 10;
+        const int err = mThread.TryToStart(
+            this, kStackSize, "LeafScanWriter");
+        if (err) {
+            KFS_LOG_STREAM_ERROR << QCUtils::SysError(
+                err, "failed to start leaf scan writer thread") <<
+            KFS_LOG_EOM;
+            return (err > 0 ? -err : (err == 0 ? -EINVAL : err));
+        }
+        return 0;
+    }
+    void Write(int idx, string& buf)
+    {
+        QCStMutexLocker locker(mMutex);
+        mPendingBytes += buf.size();
+        mQueue.push_back(Entry(idx, string()));
+        mQueue.back().second.swap(buf);
+        mCond.Notify();
+    }
+    bool IsFull() const
+    {
+        QCStMutexLocker locker(mMutex);
+        return (mMaxPendingBytes <= mPendingBytes);
+    }
+    //!< write the queued output and exit, does not wait
+    void Finish()
+    {
+        QCStMutexLocker locker(mMutex);
+        mFinishFlag = true;
+        mCond.Notify();
+    }
+    bool IsDone() const
+    {
+        QCStMutexLocker locker(mMutex);
+        return mDoneFlag;
+    }
+    int GetError() const
+    {
+        QCStMutexLocker locker(mMutex);
+        return mError;
+    }
+    virtual void Run()
+    {
+        QCStMutexLocker locker(mMutex);
+        for (; ;) {
+            while (mQueue.empty() && ! mFinishFlag) {
+                mCond.Wait(mMutex);
+            }
+            if (mQueue.empty()) {
+                break;
+            }
+            Entry entry;
+            entry.first = mQueue.front().first;
+            entry.second.swap(mQueue.front().second);
+            mQueue.pop_front();
+            if (mError == 0) {
+                QCStMutexUnlocker unlocker(mMutex);
+                const int err = WriteSelf(entry.first, entry.second);
+                unlocker.Lock();
+                if (err != 0 && mError == 0) {
+                    mError = err;
+                }
+            }
+            const bool wakeupFlag = mMaxPendingBytes <= mPendingBytes;
+            mPendingBytes -= entry.second.size();
+            if (wakeupFlag && mPendingBytes < mMaxPendingBytes) {
+                globalNetManager().Wakeup();
+            }
+        }
+        mDoneFlag = true;
+        globalNetManager().Wakeup();
+    }
+private:
+    typedef vector<off_t>       Offsets;
+    typedef pair<int, string>   Entry;
+    typedef deque<Entry>        Queue;
+
+    const Fds       mFds;
+    Offsets         mOffsets;
+    const size_t    mMaxPendingBytes;
+    QCThread        mThread;
+    mutable QCMutex mMutex;
+    QCCondVar       mCond;
+    Queue           mQueue;
+    size_t          mPendingBytes;
+    int             mError;
+    bool            mFinishFlag;
+    bool            mDoneFlag;
+
+    int WriteSelf(int idx, const string& buf)
+    {
+        const char*       ptr = buf.data();
+        const char* const end = ptr + buf.size();
+        while (ptr < end) {
+            const ssize_t nwr = pwrite(mFds[idx], ptr, end - ptr,
+                mOffsets[idx]);
+            if (nwr < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                const int err = errno;
+                KFS_LOG_STREAM_ERROR << QCUtils::SysError(
+                    err, "leaf scan write error") <<
+                KFS_LOG_EOM;
+                return (err > 0 ? -err : -EIO);
+            }
+            ptr += nwr;
+            mOffsets[idx] += nwr;
+        }
+        return 0;
+    }
+private:
+    LeafScanWriter(const LeafScanWriter&);
+    LeafScanWriter& operator=(const LeafScanWriter&);
+};
+
+// Walks the meta tree leaves of the given type in key order in time slices,
+// between the event loop iterations. Only the key of the last visited leaf is
+// retained between the slices, therefore the tree modifications do not affect
+// the walk. Unlike the forked copy, the walk does not represent the state at
+// a point in time: the leaves inserted behind the cursor are not visited, and
+// the leaves deleted before the cursor reaches them are not reported.
+// The output is formatted into one stream per file descriptor, and handed to
+// the writer thread after each slice.
+class LayoutManager::LeafScan : public ITimeout
+{
+public:
+    typedef LeafScanWriter::Fds Fds;
+
+    LeafScan(
+        const char*  name,
+        MetaType     type,
+        MetaRequest& doneOp,
+        int64_t      sliceTime,
+        int64_t      progressInterval,
+        int64_t      totalCount,
+        const Fds&   fds)
+        : ITimeout(),
+          mName(name),
+          mType(type),
+          mDoneOp(doneOp),
+          mSliceTime(sliceTime),
+          mProgressInterval(progressInterval),
+          mTotalCount(totalCount),
+          mStreamCount((int)fds.size()),
+          mStreams(new ostringstream[fds.size()]),
+          mStreamPtrs(new ostream*[fds.size() + 1]),
+          mWriter(fds, size_t(4) << 20),
+          mBuf(),
+          mCursor(),
+          mCursorFlag(false),
+          mWalkDoneFlag(false),
+          mStatus(0),
+          mStartTime(microseconds()),
+          mNextProgressTime(mStartTime + progressInterval),
+          mWalkTime(0),
+          mMaxSliceTime(0),
+          mSliceCount(0),
+          mCount(0)
+    {
+        for (int i = 0; i < mStreamCount; i++) {
+            mStreamPtrs[i] = mStreams + i;
+        }
+        mStreamPtrs[mStreamCount] = 0;
+    }
+    virtual ~LeafScan()
+    {
+        globalNetManager().UnRegisterTimeoutHandler(this);
+        delete [] mStreamPtrs;
+        delete [] mStreams;
+    }
+    int Start()
+    {
+        const int status = mWriter.Start();
+        if (status != 0) {
+            return status;
+        }
+        KFS_LOG_STREAM_INFO << mName << ": starting" <<
+            " total: " << mTotalCount <<
+        KFS_LOG_EOM;
+        SetTimeoutInterval(0);
+        globalNetManager().RegisterTimeoutHandler(this);
+        return 0;
+    }
+    virtual void Timeout()
+    {
+        if (mWalkDoneFlag) {
+            if (mWriter.IsDone()) {
+                Complete();
+            }
+            return; // The writer wakes up the net manager when done.
+        }
+        if (mWriter.IsFull()) {
+            return; // The writer wakes up the net manager.
+        }
+        const int64_t start = microseconds();
+        StartSlice(mWalkTime);
+        // Stop on the write error, the status is set on completion.
+        const bool    doneFlag  =
+            mWriter.GetError() != 0 || Walk(start + mSliceTime);
+        if (doneFlag) {
+            mStatus = Done();
+        }
+        Flush();
+        const int64_t now       = microseconds();
+        const int64_t sliceTime = now - start;
+        mWalkTime += sliceTime;
+        mMaxSliceTime = max(mMaxSliceTime, sliceTime);
+        mSliceCount++;
+        if (doneFlag) {
+            mWalkDoneFlag = true;
+            mWriter.Finish();
+            return;
+        }
+        if (mNextProgressTime <= now) {
+            mNextProgressTime = now + mProgressInterval;
+            KFS_LOG_STREAM_INFO << mName << ": progress:" <<
+                " visited: " << mCount <<
+                " of: "      << mTotalCount <<
+                " "          << (mCount * 1e2 /
+                    max(mTotalCount, int64_t(1))) << "%" <<
+                " slices: "  << mSliceCount <<
+                " walk: "    << mWalkTime * 1e-6 <<
+                " elapsed: " << (now - mStartTime) * 1e-6 <<
+            KFS_LOG_EOM;
+        }
+        // Run next slice after processing pending network io.
+        globalNetManager().Wakeup();
+    }
+protected:
+    ostream** GetStreams()
+        { return mStreamPtrs; }
+    //!< return false to stop the walk
+    virtual bool Process(Meta& leaf) = 0;
+    //!< invoked once the walk is complete, returns the completion status
+    virtual int Done() = 0;
+    //!< invoked once the output is written, returns the completion status
+    virtual int Close(int status)
+        { return status; }
+    virtual void StartSlice(int64_t /* walkTime */) {}
+private:
+    const char* const    mName;
+    const MetaType       mType;
+    MetaRequest&         mDoneOp;
+    const int64_t        mSliceTime;
+    const int64_t        mProgressInterval;
+    const int64_t        mTotalCount;
+    const int            mStreamCount;
+    ostringstream* const mStreams;
+    ostream** const      mStreamPtrs;
+    LeafScanWriter       mWriter;
+    string               mBuf;
+    Key                  mCursor; //!< key of the last visited leaf
+    bool                 mCursorFlag;
+    bool                 mWalkDoneFlag;
+    int                  mStatus;
+    const int64_t        mStartTime;
+    int64_t              mNextProgressTime;
+    int64_t              mWalkTime;
+    int64_t              mMaxSliceTime;
+    int64_t              mSliceCount;
+    int64_t              mCount;
+
+    bool Walk(int64_t endTime)
+    {
+        // The keys of file attribute and chunk info leaves are unique, and
+        // the keys of the leaves of different types never match, therefore
+        // only one leaf with the cursor key has to be skipped.
+        int      kp = 0;
+        Node*    n  = metatree.leafLowerBound(mCursor, kp);
+        LeafIter li(n, kp);
+        if (mCursorFlag && (n = li.parent()) &&
+                n->getkey(li.index()) == mCursor) {
+            li.next();
+        }
+        for (int64_t cnt = 1; (n = li.parent()); li.next(), cnt++) {
+            Meta* const leaf = li.current();
+            mCursor     = n->getkey(li.index());
+            mCursorFlag = true;
+            if (leaf->metaType() == mType) {
+                mCount++;
+                if (! Process(*leaf)) {
+                    return true;
+                }
+            }
+            if ((cnt & 0xF) == 0 && endTime <= microseconds()) {
+                return false;
+            }
+        }
+        return true;
+    }
+    void Flush()
+    {
+        for (int i = 0; i < mStreamCount; i++) {
+            if (mStreams[i].tellp() <= 0) {
+                continue;
+            }
+            mBuf = mStreams[i].str();
+            mStreams[i].str(string());
+            mWriter.Write(i, mBuf);
+        }
+    }
+    void Complete()
+    {
+        int status = mWriter.GetError();
+        if (status == 0) {
+            status = mStatus;
+        }
+        MetaRequest& op = mDoneOp;
+        op.status = Close(status);
+        KFS_LOG_STREAM(op.status == 0 ?
+                MsgLogger::kLogLevelINFO :
+                MsgLogger::kLogLevelERROR) <<
+            mName << ": done"
+            " status: "    << op.status <<
+            " visited: "   << mCount <<
+            " slices: "    << mSliceCount <<
+            " walk: "      << mWalkTime * 1e-6 <<
+            " max slice: " << mMaxSliceTime * 1e-6 <<
+            " total: "     << (microseconds() - mStartTime) * 1e-6 <<
+        KFS_LOG_EOM;
+        delete this;
+        op.suspended = false;
+        submit_request(&op);
+    }
+private:
+    LeafScan(const LeafScan&);
+    LeafScan& operator=(const LeafScan&);
+};
+
+class LayoutManager::ChunkMapDumpScan : public LayoutManager::LeafScan
+{
+public:
+    ChunkMapDumpScan(
+        LayoutManager& layoutManager,
+        MetaRequest&   doneOp,
+        const string&  fileName,
+        int            fd)
+        : LeafScan("chunk map dump", KFS_CHUNKINFO, doneOp,
+            layoutManager.mInProcessScanSliceTime,
+            layoutManager.mInProcessScanProgressInterval,
+            (int64_t)layoutManager.mChunkToServerMap.Size(),
+            Fds(1, fd)),
+          mLayoutManager(layoutManager),
+          mFileName(fileName),
+          mFd(fd),
+          mServers()
+        {}
+    virtual ~ChunkMapDumpScan()
+    {
+        if (0 <= mFd) {
+            close(mFd);
+        }
+    }
+protected:
+    virtual bool Process(Meta& leaf)
+    {
+        mLayoutManager.DumpChunkToServerMap(*(GetStreams()[0]),
+            CSMap::Entry::GetCsEntry(*refine<MetaChunkInfo>(&leaf)),
+            mServers);
+        return true;
+    }
+    virtual int Done()
+        { return 0; }
+    virtual int Close(int status)
+    {
+        // Reset the pointer once the output is written, in order not to
+        // start the next dump into the same file.
+        mLayoutManager.mChunkMapDumpScan = 0;
+        if (close(mFd) != 0 && status == 0) {
+            status = errno > 0 ? -errno : -EIO;
+        }
+        mFd = -1;
+        if (status != 0) {
+            unlink(mFileName.c_str());
+        }
+        return status;
+    }
+private:
+    LayoutManager& mLayoutManager;
+    const string   mFileName;
+    int            mFd;
+    Servers        mServers;
+};
+
+int
+LayoutManager::StartDumpChunkToServerMap(
+    MetaRequest& doneOp, const string& dirToUse)
+{
+    if (mChunkMapDumpScan) {
+        return -EAGAIN;
+    }
+    if (! WriteNetworkDef(dirToUse)) {
+        return -EIO;
+    }
+    const string fileName = dirToUse + "/chunkmap.txt";
+    const int    fd       = open(fileName.c_str(),
+        O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        const int err = errno;
+        KFS_LOG_STREAM_ERROR << fileName << ": " <<
+            QCUtils::SysError(err) <<
+        KFS_LOG_EOM;
+        return (err > 0 ? -err : -EIO);
+    }
+    ChunkMapDumpScan* const scan = new ChunkMapDumpScan(
+        *this, doneOp, fileName, fd);
+    const int status = scan->Start();
+    if (status != 0) {
+        delete scan;
+        unlink(fileName.c_str());
+        return status;
+    }
+    mChunkMapDumpScan = scan;
+    return 0;
+}
+
 int
 LayoutManager::FsckStreamCount(bool reportAbandonedFilesFlag) const
 {
@@ -4307,26 +5019,62 @@ LayoutManager::Fsck(ostream** os, bool reportAbandonedFilesFlag)
     }
 }
 
-void
-LayoutManager::DumpChunkToServerMap(ostream& os)
+// The run time limit applies to the sum of the time slices.
+class LayoutManager::FsckScan : public LayoutManager::LeafScan
 {
-    mChunkToServerMap.First();
-    StTmp<Servers> serversTmp(mServersTmp);
-    for (const CSMap::Entry* p; (p = mChunkToServerMap.Next()); ) {
-        Servers& cs = serversTmp.Get();
-        mChunkToServerMap.GetServers(*p, cs);
-        os << p->GetChunkId() <<
-            " " << p->GetFileId() <<
-            " " << cs.size();
-        for (Servers::const_iterator it = cs.begin();
-                it != cs.end();
-                ++it) {
-            os <<
-                " " << (*it)->GetServerLocation() <<
-                " " << (*it)->GetRack();
-        }
-        os << "\n";
+public:
+    FsckScan(
+        LayoutManager& layoutManager,
+        MetaRequest&   doneOp,
+        const Fds&     fds)
+        : LeafScan("fsck", KFS_FATTR, doneOp,
+            layoutManager.mInProcessScanSliceTime,
+            layoutManager.mInProcessScanProgressInterval,
+            GetNumFiles() + GetNumDirs(),
+            fds),
+          mLayoutManager(layoutManager),
+          mChecker(layoutManager, layoutManager.mMaxFsckFiles, GetStreams())
+        {}
+protected:
+    virtual bool Process(Meta& leaf)
+        { return mChecker(*refine<MetaFattr>(&leaf)); }
+    virtual int Done()
+    {
+        mChecker.Report(mLayoutManager.mChunkToServerMap.Size());
+        return 0;
+    }
+    virtual int Close(int status)
+    {
+        mLayoutManager.mFsckScan = 0;
+        return status;
+    }
+    virtual void StartSlice(int64_t walkTime)
+        { mChecker.StartSlice(walkTime); }
+private:
+    LayoutManager& mLayoutManager;
+    FilesChecker   mChecker;
+};
+
+int
+LayoutManager::StartFsck(
+    MetaRequest& doneOp, const vector<int>& fds,
+    bool reportAbandonedFilesFlag)
+{
+    if (! mFullFsckFlag ||
+            (int)fds.size() != FsckStreamCount(reportAbandonedFilesFlag)) {
+        return -EINVAL;
+    }
+    if (mFsckScan) {
+        return -EAGAIN;
+    }
+    FsckScan* const scan = new FsckScan(*this, doneOp, fds);
+    const int status = scan->Start();
+    if (status != 0) {
+        delete scan;
+        return status;
     }
+    mFsckScan = scan;
+    return 0;
 }
 
 void
@@ -4381,6 +5129,7 @@ LayoutManager::ServerDown(const ChunkServerPtr& server)
         const bool   wasHibernatedFlag = hsi.IsHibernated();
         const size_t prevIdx           = hsi.csmapIdx;
         if (mChunkToServerMap.SetHibernated(server, hsi.csmapIdx)) {
+            hsi.inventoryGeneration = server->GetInventoryGeneration();
             if (! wasHibernatedFlag) {
                 reason = "Hibernated";
             } else {
@@ -4435,8 +5184,9 @@ LayoutManager::ServerDown(const ChunkServerPtr& server)
                 HibernatingServerInfo_t());
             HibernatingServerInfo_t& hsi =
                 mHibernatingServers.back();
-            hsi.location     = loc;
-            hsi.sleepEndTime = TimeNow() + replicationDelay;
+            hsi.location            = loc;
+            hsi.sleepEndTime        = TimeNow() + replicationDelay;
+            hsi.inventoryGeneration = server->GetInventoryGeneration();
             if (! mChunkToServerMap.SetHibernated(
                     server, hsi.csmapIdx)) {
                 panic("failed to initiate hibernation");
@@ -4639,8 +5389,9 @@ LayoutManager::UpdateSrvLoadAvg(ChunkServer& srv, int64_t delta,
         srv.IsResponsiveServer() &&
         ! srv.IsRetiring() &&
         ! srv.IsRestartScheduled();
-    int candidateTiersCount = 0;
-    int racksCandidatesDelta[kKfsSTierCount];
+    int                 candidateTiersCount = 0;
+    int                 racksCandidatesDelta[kKfsSTierCount];
+    RackInfos::iterator candidatesRackIter  = mRacks.end();
     for (size_t i = 0; i < kKfsSTierCount; i++) {
         const bool flag = isPossibleCandidate &&
             srv.GetDeviceCount(i) > 0 &&
@@ -4656,6 +5407,14 @@ LayoutManager::UpdateSrvLoadAvg(ChunkServer& srv, int64_t delta,
             continue;
         }
         srv.SetCanBeCandidateServerFlag(i, flag);
+        if (candidatesRackIter == mRacks.end()) {
+            candidatesRackIter = FindRack(srv.GetRack());
+        }
+        if (candidatesRackIter != mRacks.end()) {
+            // The index has raw pointers, never add server that is down.
+            candidatesRackIter->updateCandidatesIndex(
+                srv, i, flag && ! srv.IsDown());
+        }
         if (flag) {
             mTierCandidatesCount[i]++;
         } else if (mTierCandidatesCount[i] > 0) {
@@ -5253,6 +6012,8 @@ LayoutManager::ReplayBeginChangeChunkVersion(
     const CSMap::Entry* const cs = mChunkToServerMap.Find(chunkId);
     if (! cs) {
         err = "no such chunk";
+        // Replay lookup by the log chunk id, see kfstree.h chunkNotFound().
+        metatree.chunkNotFound(chunkId);
     }
     const seq_t vers = err ? -1 : cs->GetChunkInfo()->chunkVersion;
     if (! err && vers >= chunkVersion) {
@@ -5556,6 +6317,9 @@ LayoutManager::GetChunkWriteLease(MetaAllocate* r, bool& isNewLease)
     }
     isNewLease = true;
     assert(r->chunkVersion == r->initialChunkVersion);
+    // The hibernated replicas do not participate in the version change,
+    // ensure that incremental hello does not add these back.
+    mChunkToServerMap.SetHibernatedStale(*ci);
     // When issuing a new lease, increment the version, skipping over
     // the failed version increment attemtps.
     r->chunkVersion += IncrementChunkVersionRollBack(r->chunkId);
@@ -6698,7 +7462,8 @@ LayoutManager::InvalidateAllChunkReplicas(
     if (mci->offset != offset) {
         return false;
     }
-    mci->chunkVersion += IncrementChunkVersionRollBack(chunkId);
+    metatree.modify(mci)->chunkVersion +=
+        IncrementChunkVersionRollBack(chunkId);
     chunkVersion = mci->chunkVersion;
     StTmp<Servers> serversTmp(mServers3Tmp);
     Servers&       c = serversTmp.Get();
@@ -6796,9 +7561,10 @@ LayoutManager::GetChunkToServerMapping(MetaChunkInfo& chunkInfo,
         loadAvgSum += (*it)->GetLoadAvg() + kLoadAvgFloor;
     }
     *orderReplicasFlag = true;
+    PrngIsaac64& random = GetThreadRandom();
     for (size_t i = c.size(); i >= 2; ) {
         assert(loadAvgSum > 0);
-        int64_t rnd = Rand(loadAvgSum);
+        int64_t rnd = (int64_t)(random.Rand() % loadAvgSum);
         size_t  ri  = i--;
         int64_t load;
         do {
@@ -6984,8 +7750,10 @@ LayoutManager::Ping(IOBuffer& buf, bool wormModeFlag)
         "Total space= "         << pinger.totalSpace << "\t"
         "Used space= "          << pinger.usedSpace << "\t"
         "Replications= "        << mNumOngoingReplications << "\t"
-        "Replications check= "  << mChunkToServerMap.GetCount(
-            CSMap::Entry::kStateCheckReplication) << "\t"
+        "Replications check= "  << (mChunkToServerMap.GetCount(
+            CSMap::Entry::kStateCheckReplication) +
+            mChunkToServerMap.GetCount(
+                CSMap::Entry::kStateQueuedReplication)) << "\t"
         "Pending recovery= "    << mChunkToServerMap.GetCount(
             CSMap::Entry::kStatePendingRecovery) << "\t"
         "Repl check timeouts= " << mReplicationCheckTimeouts << "\t"
@@ -7013,6 +7781,16 @@ LayoutManager::Ping(IOBuffer& buf, bool wormModeFlag)
             MetaNode::getPoolAllocator<MetaDentry>().GetItemSize() << "\t"
         "Dentry nodes storage= "  <<
             MetaNode::getPoolAllocator<MetaDentry>().GetStorageSize() << "\t"
+        "Dentry names= "      <<
+            MetaDentry::getNameStats().count << "\t"
+        "Dentry name bytes= "  <<
+            MetaDentry::getNameStats().bytes << "\t"
+        "Dentry name storage= "  <<
+            MetaDentry::getNameStats().storageBytes << "\t"
+        "Dentry large names= "  <<
+            MetaDentry::getNameStats().largeCount << "\t"
+        "Dentry name string bytes= "  <<
+            MetaDentry::getNameStats().stringBytes << "\t"
         "Fattr nodes= "      <<
             MetaNode::getPoolAllocator<MetaFattr>().GetInUseCount() << "\t"
         "Fattr node size= "  <<
@@ -7070,6 +7848,12 @@ LayoutManager::Ping(IOBuffer& buf, bool wormModeFlag)
             (mObjStoreFilesDeleteQueue.IsEmpty() ? time_t(0) :
                 TimeNow() - mObjStoreFilesDeleteQueue.Front()->mTime)
     ;
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        mWOstream << "\t"
+            "Replication queue redundancy " << i <<
+            (i + 1 == kReplicationPriorityCount ? "+" : "") << "= " <<
+            mReplicationQueues[i].size();
+    }
     mWOstream.flush();
     mWOstream.Reset();
     mPingResponse.Move(&tmpbuf);
@@ -7113,6 +7897,14 @@ LayoutManager::ExpiredLeaseCleanup(chunkId_t chunkId)
     );
 }
 
+void
+LayoutManager::DumpsterReclaim()
+{
+    if (metatree.reclaimDumpster(mDumpsterReclaimMaxEntries)) {
+        mDumpsterReclaimer.ScheduleNext();
+    }
+}
+
 void
 LayoutManager::LeaseCleanup()
 {
@@ -7593,7 +8385,7 @@ LayoutManager::MakeChunkStableInit(
             MetaFattr* const fa  = entry.GetFattr();
             const int64_t    now = microseconds();
             if (fa->mtime + mMTimeUpdateResolution < now) {
-                fa->mtime = now;
+                metatree.modify(fa)->mtime = now;
                 submit_request(new MetaSetMtime(fid, fa->mtime));
             }
         }
@@ -8175,15 +8967,17 @@ LayoutManager::MakeChunkStableDone(const MetaChunkMakeStable* req)
     }
     MetaFattr* const fa     = pinfo->GetFattr();
     const fid_t      fileId = pinfo->GetFileId();
-    if (updateMTimeFlag || mChunkToServerMap.GetState(*pinfo) !=
-            CSMap::Entry::kStateCheckReplication) {
+    if (updateMTimeFlag || (mChunkToServerMap.GetState(*pinfo) !=
+                CSMap::Entry::kStateCheckReplication &&
+            mChunkToServerMap.GetState(*pinfo) !=
+                CSMap::Entry::kStateQueuedReplication)) {
         if (fa->IsStriped()) {
             updateSizeFlag = false;
         }
         if (updateMTimeFlag) {
             const int64_t now = microseconds();
             if (fa->mtime + mMTimeUpdateResolution < now) {
-                fa->mtime = now;
+                metatree.modify(fa)->mtime = now;
                 submit_request(
                     new MetaSetMtime(fileId, fa->mtime));
             }
@@ -8249,6 +9043,8 @@ LayoutManager::ReplayPendingMakeStable(
     MsgLogger::LogLevel logLevel = MsgLogger::kLogLevelDEBUG;
     if (! ci) {
         res = "no such chunk";
+        // Replay lookup by the log chunk id, see kfstree.h chunkNotFound().
+        metatree.chunkNotFound(chunkId);
     } else if ((curChunkVersion = ci->GetChunkInfo()->chunkVersion) !=
             chunkVersion) {
         res      = "chunk version mismatch";
@@ -9202,6 +9998,11 @@ LayoutManager::HandoutChunkReplicationWork()
     StTmp<ChunkPlacement> placementTmp(mChunkPlacementTmp);
     bool nextRunLowPriorityFlag = false;
     mChunkToServerMap.First(CSMap::Entry::kStateCheckReplication);
+    // Order the replication check candidates by the remaining redundancy,
+    // spend at most half of the run time doing so. The remaining candidates
+    // are handled after the queues in the list order.
+    CompactReplicationQueues();
+    QueueReplicationCandidates(now + (endTime - now) / 2);
     for (; ; loopCount++) {
         if (--pass <= 0) {
             now  = microseconds();
@@ -9226,8 +10027,10 @@ LayoutManager::HandoutChunkReplicationWork()
                      " timeouts: "   <<
                         mReplicationCheckTimeouts <<
                      " candidates: " <<
+                        (mChunkToServerMap.GetCount(
+                            CSMap::Entry::kStateCheckReplication) +
                         mChunkToServerMap.GetCount(
-                    CSMap::Entry::kStateCheckReplication) <<
+                            CSMap::Entry::kStateQueuedReplication)) <<
                      " initiated: "  << count <<
                      " done: "       << doneCount <<
                      " loop: "       << loopCount <<
@@ -9248,8 +10051,11 @@ LayoutManager::HandoutChunkReplicationWork()
             }
             break;
         }
-        CSMap::Entry* cur = mChunkToServerMap.Next(
-            CSMap::Entry::kStateCheckReplication);
+        CSMap::Entry* cur = NextQueuedReplication();
+        if (! cur) {
+            cur = mChunkToServerMap.Next(
+                CSMap::Entry::kStateCheckReplication);
+        }
         if (! cur) {
             // See if all chunks check was requested.
             if (! (cur = mChunkToServerMap.Next(
@@ -9331,6 +10137,151 @@ LayoutManager::HandoutChunkReplicationWork()
     return timedOutFlag;
 }
 
+/// Return replication priority of a replicated chunk: the remaining
+/// redundancy, i.e. the number of replicas that can still be lost before the
+/// chunk becomes unavailable. Lower value means higher priority.
+int
+LayoutManager::GetReplicationPriority(int replicas, int numReplicas)
+{
+    const int kLowest = kReplicationPriorityCount - 1;
+    if (replicas <= 0 || numReplicas <= replicas) {
+        // Nothing left to replicate from, or not under replicated.
+        return kLowest;
+    }
+    return min(replicas - 1, kLowest);
+}
+
+/// Return recovery priority of a chunk of a file with recovery: the remaining
+/// recovery margin, i.e. the number of chunks in the chunk block that can still
+/// be lost before the data becomes unavailable.
+int
+LayoutManager::GetRecoveryPriority(int numRecoveryStripes, int lost)
+{
+    const int kLowest = kReplicationPriorityCount - 1;
+    const int margin  = numRecoveryStripes - lost;
+    if (margin < 0) {
+        // Not recoverable, let the higher priority candidates go first.
+        return kLowest;
+    }
+    return min(margin, kLowest);
+}
+
+/// Return replication priority by the remaining redundancy.
+int
+LayoutManager::GetReplicationPriority(const CSMap::Entry& entry)
+{
+    const int              kLowest  = kReplicationPriorityCount - 1;
+    const MetaFattr* const fa       = entry.GetFattr();
+    const int              replicas =
+        (int)mChunkToServerMap.ServerCount(entry);
+    if (fa->IsStriped() && fa->HasRecovery()) {
+        StTmp<vector<MetaChunkInfo*> > cinfoTmp(mChunkInfosTmp);
+        vector<MetaChunkInfo*>&        cblk   = cinfoTmp.Get();
+        chunkOff_t                     start  = -1;
+        MetaFattr*                     mfa    = 0;
+        MetaChunkInfo*                 mci    = 0;
+        chunkOff_t                     offset = entry.GetChunkInfo()->offset;
+        cblk.reserve(fa->numStripes + fa->numRecoveryStripes);
+        if (metatree.getalloc(fa->id(), offset,
+                    mfa, mci, &cblk, &start) != 0 || mfa != fa) {
+            return kLowest;
+        }
+        int lost = 0;
+        for (vector<MetaChunkInfo*>::const_iterator it = cblk.begin();
+                it != cblk.end();
+                ++it) {
+            if (! mChunkToServerMap.HasServers(GetCsEntry(**it))) {
+                lost++;
+            }
+        }
+        return GetRecoveryPriority((int)fa->numRecoveryStripes, lost);
+    }
+    return GetReplicationPriority(replicas, (int)fa->numReplicas);
+}
+
+/// Move replication check candidates into the priority queues.
+/// Return true if the replication check list is exhausted.
+bool
+LayoutManager::QueueReplicationCandidates(int64_t endTime)
+{
+    const int     kCheckTime = 32;
+    int           pass       = kCheckTime;
+    CSMap::Entry* entry;
+    while ((entry = mChunkToServerMap.Next(
+            CSMap::Entry::kStateCheckReplication))) {
+        const int priority = GetReplicationPriority(*entry);
+        mChunkToServerMap.SetState(*entry,
+            CSMap::Entry::kStateQueuedReplication);
+        mReplicationQueues[priority].push_back(entry->GetChunkId());
+        if (--pass <= 0) {
+            pass = kCheckTime;
+            if (endTime <= microseconds()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/// Return the highest priority queued replication candidate, and move it
+/// into the replication check list.
+CSMap::Entry*
+LayoutManager::NextQueuedReplication()
+{
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        ReplicationQueue& queue = mReplicationQueues[i];
+        while (! queue.empty()) {
+            CSMap::Entry* const entry = mChunkToServerMap.Find(queue.front());
+            queue.pop_front();
+            if (entry && mChunkToServerMap.GetState(*entry) ==
+                    CSMap::Entry::kStateQueuedReplication) {
+                mChunkToServerMap.SetState(*entry,
+                    CSMap::Entry::kStateCheckReplication);
+                return entry;
+            }
+        }
+    }
+    return 0;
+}
+
+/// Discard the ids of the chunks that are no longer queued, when these
+/// dominate the queues.
+void
+LayoutManager::CompactReplicationQueues()
+{
+    size_t total = 0;
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        total += mReplicationQueues[i].size();
+    }
+    const size_t queued = mChunkToServerMap.GetCount(
+        CSMap::Entry::kStateQueuedReplication);
+    if (total <= queued + max(queued, size_t(64) << 10)) {
+        return;
+    }
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        ReplicationQueue&          queue = mReplicationQueues[i];
+        ReplicationQueue::iterator out   = queue.begin();
+        for (ReplicationQueue::const_iterator it = queue.begin();
+                it != queue.end();
+                ++it) {
+            const CSMap::Entry* const entry = mChunkToServerMap.Find(*it);
+            if (entry && mChunkToServerMap.GetState(*entry) ==
+                    CSMap::Entry::kStateQueuedReplication) {
+                *out++ = *it;
+            }
+        }
+        queue.erase(out, queue.end());
+    }
+}
+
+void
+LayoutManager::UpdateReplicationQueueStats()
+{
+    for (int i = 0; i < kReplicationPriorityCount; i++) {
+        mReplicationQueueStats[i]->Set(mReplicationQueues[i].size());
+    }
+}
+
 void LayoutManager::Timeout()
 {
     ScheduleCleanup(mMaxServerCleanupScan);
@@ -9414,8 +10365,12 @@ LayoutManager::ChunkReplicationChecker()
         mLastRebalanceRunTime = now;
         RebalanceServers();
     }
-    mReplicationTodoStats->Set(mChunkToServerMap.GetCount(
-        CSMap::Entry::kStateCheckReplication));
+    mReplicationTodoStats->Set(
+        mChunkToServerMap.GetCount(
+            CSMap::Entry::kStateCheckReplication) +
+        mChunkToServerMap.GetCount(
+            CSMap::Entry::kStateQueuedReplication));
+    UpdateReplicationQueueStats();
     ScheduleCleanup(mMaxServerCleanupScan);
 }
 
@@ -9472,6 +10427,8 @@ LayoutManager::ChunkReplicationDone(MetaChunkReplicate* req)
     // schedule chunk replication scheduler to run.
     if ((((int64_t)mChunkToServerMap.GetCount(
                 CSMap::Entry::kStateCheckReplication) > 0 ||
+            (int64_t)mChunkToServerMap.GetCount(
+                CSMap::Entry::kStateQueuedReplication) > 0 ||
             (int64_t)mChunkToServerMap.GetCount(
                 CSMap::Entry::kStateNoDestination) >
             (int64_t)mChunkServers.size() *
@@ -10923,6 +11880,68 @@ LayoutManager::CSMapUnitTest(const Properties& props)
     KFS_LOG_EOM;
 }
 
+void
+LayoutManager::ReplicationPriorityUnitTest(const Properties& props)
+{
+    const char* const kUniteTestPropName =
+        "metaServer.replicationPriority.unittest";
+    const int unitTestPropVal = props.getValue(kUniteTestPropName, 0);
+    if (unitTestPropVal == 0) {
+        return;
+    }
+    KFS_LOG_STREAM_WARN << "running replication priority unit test: " <<
+        kUniteTestPropName << " = " << unitTestPropVal <<
+    KFS_LOG_EOM;
+
+    const int kLowest = kReplicationPriorityCount - 1;
+    // The last replica goes first regardless of the replication factor.
+    if (GetReplicationPriority(1, 3) != 0 ||
+            GetReplicationPriority(1, 2) != 0 ||
+            GetReplicationPriority(1, 6) != 0) {
+        panic("last replica is not the highest priority");
+    }
+    // 3-way chunk down to the last replica goes ahead of 6-way chunk that
+    // still has 3 replicas.
+    if (GetReplicationPriority(1, 3) >= GetReplicationPriority(3, 6)) {
+        panic("6-way chunk with 3 replicas ahead of the last replica");
+    }
+    // 2-way chunk with one replica, no redundancy, goes ahead of 3-way chunk
+    // with 2 replicas.
+    if (GetReplicationPriority(1, 2) >= GetReplicationPriority(2, 3)) {
+        panic("3-way chunk with 2 replicas ahead of the last replica");
+    }
+    // Same remaining redundancy, same priority.
+    if (GetReplicationPriority(2, 3) != GetReplicationPriority(2, 6)) {
+        panic("priority depends on the replication factor");
+    }
+    for (int numReplicas = 1; numReplicas < 16; numReplicas++) {
+        if (GetReplicationPriority(0, numReplicas) != kLowest ||
+                GetReplicationPriority(numReplicas, numReplicas) !=
+                    kLowest ||
+                GetReplicationPriority(numReplicas + 1, numReplicas) !=
+                    kLowest) {
+            panic("no replicas or not under replicated chunk priority");
+        }
+        for (int replicas = 2; replicas < numReplicas; replicas++) {
+            if (GetReplicationPriority(replicas, numReplicas) <
+                    GetReplicationPriority(replicas - 1, numReplicas)) {
+                panic("fewer replicas lower priority");
+            }
+        }
+    }
+    // Recovery margin and the remaining replica redundancy are ordered the
+    // same way.
+    if (GetRecoveryPriority(3, 3) != GetReplicationPriority(1, 3) ||
+            GetRecoveryPriority(3, 2) != GetReplicationPriority(2, 3) ||
+            GetRecoveryPriority(3, 4) != kLowest ||
+            GetRecoveryPriority(3, 0) != kLowest) {
+        panic("recovery priority mismatch");
+    }
+
+    KFS_LOG_STREAM_WARN << "passed replication priority unit test" <<
+    KFS_LOG_EOM;
+}
+
 bool
 LayoutManager::AddReplica(CSMap::Entry& ci, const ChunkServerPtr& s)
 {
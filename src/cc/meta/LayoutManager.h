@@ -631,6 +631,7 @@ public:
     typedef ChunkServer::StorageTierInfo StorageTierInfo;
     typedef double                       RackWeight;
     typedef CSMap::Servers               Servers;
+    typedef vector<ChunkServer*>         CandidatesIndex;
 
     RackInfo()
         : mRackId(-1),
@@ -668,6 +669,35 @@ public:
         if (iter != mServers.end()) {
             mServers.erase(iter);
         }
+        for (size_t i = 0; i < kKfsSTierCount; i++) {
+            updateCandidatesIndex(*server, i, false);
+        }
+    }
+    // Servers that can be used for placement in a given tier, for constant
+    // time random sampling. The servers are added and removed with swap with
+    // the last element, the server keeps its position in the index.
+    const CandidatesIndex& getCandidatesIndex(kfsSTier_t tier) const {
+        return mTierCandidates[tier];
+    }
+    void updateCandidatesIndex(ChunkServer& server, kfsSTier_t tier,
+            bool flag) {
+        CandidatesIndex& index  = mTierCandidates[tier];
+        const int        idx    = server.GetPlacementIndex(tier);
+        const bool       inFlag = 0 <= idx && (size_t)idx < index.size() &&
+            index[idx] == &server;
+        if (flag == inFlag) {
+            return;
+        }
+        if (flag) {
+            server.SetPlacementIndex(tier, (int)index.size());
+            index.push_back(&server);
+            return;
+        }
+        ChunkServer* const last = index.back();
+        index[idx] = last;
+        last->SetPlacementIndex(tier, idx);
+        index.pop_back();
+        server.SetPlacementIndex(tier, -1);
     }
     const Servers& getServers() const {
         return mServers;
@@ -716,6 +746,7 @@ private:
     Servers         mServers;
     int             mTierCandidateCount[kKfsSTierCount];
     StorageTierInfo mStorageTierInfo[kKfsSTierCount];
+    CandidatesIndex mTierCandidates[kKfsSTierCount];
 };
 
 typedef map<
@@ -742,7 +773,8 @@ struct HibernatingServerInfo_t
     HibernatingServerInfo_t()
         : location(),
           sleepEndTime(),
-          csmapIdx(~size_t(0))
+          csmapIdx(~size_t(0)),
+          inventoryGeneration(0)
           {}
     bool IsHibernated() const { return (csmapIdx != ~size_t(0)) ; }
     // the server we put in hibernation
@@ -751,6 +783,9 @@ struct HibernatingServerInfo_t
     time_t sleepEndTime;
     // CSMap server index to remove hibernated server.
     size_t csmapIdx;
+    // Chunk inventory generation that incremental hello must present in
+    // order to restore the hibernated server.
+    int64_t inventoryGeneration;
 };
 typedef vector<
     HibernatingServerInfo_t,
@@ -1179,6 +1214,21 @@ public:
     int  FsckStreamCount(bool reportAbandonedFilesFlag) const;
     void Fsck(ostream** os, bool reportAbandonedFilesFlag);
 
+    /// In process, time sliced variants of the above. The meta tree leaves
+    /// are walked between the event loop iterations, while the requests
+    /// are processed. The output is written by a writer thread. The doneOp
+    /// is submitted on completion with the status set. Return -EAGAIN if
+    /// the same kind of walk is in progress.
+    /// Fsck writes one output stream into each file descriptor, the caller
+    /// owns the descriptors.
+    int StartDumpChunkToServerMap(MetaRequest& doneOp, const string& dir);
+    int StartFsck(MetaRequest& doneOp, const vector<int>& fds,
+        bool reportAbandonedFilesFlag);
+    bool IsInProcessChunkMapDump() const
+        { return mInProcessChunkMapDumpFlag; }
+    bool IsInProcessFsck() const
+        { return (mFullFsckFlag && mInProcessFsckFlag); }
+
     /// For monitoring purposes, dump out state of all the
     /// connected chunk servers.
     void Ping(IOBuffer& buf, bool wormModeFlag);
@@ -1190,6 +1240,12 @@ public:
     /// and remove out dead leases.
     void LeaseCleanup();
 
+    /// Delete a portion of the directory trees moved into the dumpster
+    /// by rmdirs, and re-schedule if more work remains.
+    void DumpsterReclaim();
+    void ScheduleDumpsterReclaim()
+        { mDumpsterReclaimer.ScheduleNext(); }
+
     /// Periodically, re-check the replication level of all chunks
     /// the system; this call initiates the checking work, which
     /// gets done over time.
@@ -1300,6 +1356,7 @@ public:
     void Done(MetaChunkVersChange& req);
     virtual void Timeout();
     bool Validate(MetaHello& r) const;
+    bool CanAcceptHelloDelta(const MetaHello& r);
     void UpdateDelayedRecovery(const MetaFattr& fa, bool forceUpdateFlag = false);
     bool HasWriteAppendLease(chunkId_t chunkId) const;
     void ScheduleRestartChunkServers();
@@ -1320,6 +1377,14 @@ public:
         { return mReadDirLimit; }
     void ChangeIoBufPending(int64_t delta)
         { SyncAddAndFetch(mIoBufPending, delta); }
+    /// Returns true if read only requests can be handled concurrently by the
+    /// client threads. The user and group remap "last entry" cache, and the
+    /// chunk server map stale entries cleanup modify the state on lookup.
+    bool IsSharedReadOnlyAllowed() const
+    {
+        return (mHostUserGroupRemap.empty() &&
+            ! mChunkToServerMap.HasStaleServers());
+    }
     bool IsCandidateServer(
         const ChunkServer& c,
         kfsSTier_t         tier                         = kKfsSTierUndef,
@@ -1335,6 +1400,8 @@ public:
         { return mSortCandidatesBySpaceUtilizationFlag; }
     bool GetSortCandidatesByLoadAvgFlag() const
         { return mSortCandidatesByLoadAvgFlag; }
+    int GetPlacementChoicesCount() const
+        { return mPlacementChoicesCount; }
     bool GetUseFsTotalSpaceFlag() const
         { return mUseFsTotalSpaceFlag; }
     int64_t GetSlavePlacementScale();
@@ -1919,6 +1986,9 @@ protected:
     > StripedFilesAllocationsInFlight;
 
     class FilesChecker;
+    class LeafScan;
+    class FsckScan;
+    class ChunkMapDumpScan;
 
     /// A counter to track the # of ongoing chunk replications
     int mNumOngoingReplications;
@@ -1960,6 +2030,9 @@ protected:
     /// sufficient copies of each chunk.
     PeriodicOp<MetaChunkReplicationCheck> mChunkReplicator;
     PeriodicOp<MetaCheckpoint> mCheckpoint;
+    /// Incrementally delete directory sub trees in the dumpster.
+    PeriodicOp<MetaDumpsterReclaim> mDumpsterReclaimer;
+    int                             mDumpsterReclaimMaxEntries;
 
     uint32_t mMinChunkserversToExitRecovery;
 
@@ -2013,6 +2086,8 @@ protected:
     Counter *mFailedReplicationStats;
     /// Track the # of stale chunks we have seen so far
     Counter *mStaleChunkCount;
+    /// Track chunk server hello inventory merge count and time.
+    Counter *mHelloMergeStats;
     size_t mMastersCount;
     size_t mSlavesCount;
     bool   mAssignMasterByIpFlag;
@@ -2027,6 +2102,7 @@ protected:
     double mReservationOvercommitFactor;
     // Delay replication when connection breaks.
     int    mServerDownReplicationDelay;
+    bool   mHelloDeltaFlag;
     uint64_t mMaxDownServersHistorySize;
     // Chunk server properties broadcasted to all chunk servers.
     Properties mChunkServersProps;
@@ -2064,6 +2140,16 @@ protected:
     int64_t mFullReplicationCheckInterval;
     bool    mCheckAllChunksInProgressFlag;
 
+    /// Replication check candidates ordered by the remaining redundancy:
+    /// the number of replicas, or for RS files the number of chunks in the
+    /// chunk block, that can be lost before the data becomes unavailable.
+    /// The queues might contain ids of the chunks that are no longer in
+    /// queued replication state, these are discarded by NextQueuedReplication.
+    enum { kReplicationPriorityCount = 4 };
+    typedef deque<chunkId_t> ReplicationQueue;
+    ReplicationQueue mReplicationQueues[kReplicationPriorityCount];
+    Counter*         mReplicationQueueStats[kReplicationPriorityCount];
+
     ///
     /// When placing chunks, we see the space available on the node as well as
     /// we take our estimate of the # of writes on
@@ -2120,10 +2206,17 @@ protected:
     bool    mForceDelayedRecoveryUpdateFlag;
     bool    mSortCandidatesBySpaceUtilizationFlag;
     bool    mSortCandidatesByLoadAvgFlag;
+    int     mPlacementChoicesCount;
     int64_t mMaxFsckFiles;
     int64_t mFsckAbandonedFileTimeout;
     int64_t mMaxFsckTime;
     bool    mFullFsckFlag;
+    bool    mInProcessFsckFlag;
+    bool    mInProcessChunkMapDumpFlag;
+    int64_t mInProcessScanSliceTime;
+    int64_t mInProcessScanProgressInterval;
+    LeafScan* mFsckScan;
+    LeafScan* mChunkMapDumpScan;
     int64_t mMTimeUpdateResolution;
     int64_t mMaxPendingRecoveryMsgLogInfo;
     bool    mAllowLocalPlacementFlag;
@@ -2324,6 +2417,13 @@ protected:
     /// From the candidates, handout work to nodes.  If any chunks are
     /// over-replicated/chunk is deleted from system, add them to delset.
     bool HandoutChunkReplicationWork();
+    int GetReplicationPriority(const CSMap::Entry& entry);
+    static int GetReplicationPriority(int replicas, int numReplicas);
+    static int GetRecoveryPriority(int numRecoveryStripes, int lost);
+    bool QueueReplicationCandidates(int64_t endTime);
+    CSMap::Entry* NextQueuedReplication();
+    void CompactReplicationQueues();
+    void UpdateReplicationQueueStats();
 
     /// There are more replicas of a chunk than the requested amount.  So,
     /// delete the extra replicas and reclaim space.  When deleting the addtional
@@ -2399,13 +2499,17 @@ protected:
     HibernatingServerInfo_t* FindHibernatingServer(
         const ServerLocation& loc);
     void CSMapUnitTest(const Properties& props);
+    void ReplicationPriorityUnitTest(const Properties& props);
     int64_t GetMaxCSUptime() const;
     bool ReadRebalancePlan(size_t nread);
     void Fsck(ostream &os, bool reportAbandonedFilesFlag);
     void CheckFile(
         FilesChecker&     fsck,
-        const MetaDentry& de,
+        const MetaDentry* de,
         const MetaFattr&  fa);
+    bool WriteNetworkDef(const string& dir);
+    void DumpChunkToServerMap(ostream& os, const CSMap::Entry& entry,
+        Servers& servers);
     template<typename T, typename OT> void LoadIdRemap(
         istream& fs, T OT::* map);
     void SetUserAndGroupSelf(const MetaRequest& req,
@@ -29,11 +29,20 @@
 #include "util.h"
 #include "Replay.h"
 #include "common/MsgLogger.h"
+#include "common/Properties.h"
 #include "kfsio/Globals.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/QCUtils.h"
+#include "qcdio/qcstutils.h"
 #include "NetDispatch.h"
 
 #include <iomanip>
 
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
 namespace KFS
 {
 using std::hex;
@@ -48,27 +57,277 @@ string LASTLOG(LOGDIR + "/last");
 
 Logger oplog(LOGDIR);
 
+// The log writer thread writes and syncs the log records batches, accumulated
+// by the main thread. Only one batch is in flight at a time: while the batch is
+// being written, the main thread accumulates the next one, therefore the batch
+// size adapts to the disk write and sync latency ("group commit").
+// The requests with log records in the batch are handed back to the main
+// thread event loop (Timeout() below) once the batch is on disk, and
+// dispatched to their senders from there.
+class Logger::Writer : public QCRunnable, public ITimeout
+{
+public:
+    Writer(
+        Logger& logger)
+        : QCRunnable(),
+          ITimeout(),
+          mLogger(logger),
+          mMutex(),
+          mWorkCond(),
+          mDoneCond(),
+          mThread(),
+          mFd(-1),
+          mSyncFlag(true),
+          mStopFlag(false),
+          mBusyFlag(false),
+          mError(0),
+          mBuf(),
+          mReqs(),
+          mDoneReqs(),
+          mLastSeq(-1),
+          mDoneSeq(-1),
+          mDoneFlag(false)
+        {}
+    virtual ~Writer()
+        { Writer::Stop(); }
+    bool Start()
+    {
+        if (mThread.IsStarted()) {
+            return true;
+        }
+        mStopFlag = false;
+        const int kStackSize = 64 << 10;
+        const int err = mThread.TryToStart(this, kStackSize, "LogWriter");
+        if (err) {
+            KFS_LOG_STREAM_ERROR << QCUtils::SysError(
+                err, "failed to start log writer thread") <<
+            KFS_LOG_EOM;
+            return false;
+        }
+        globalNetManager().RegisterTimeoutHandler(this);
+        return true;
+    }
+    void Stop()
+    {
+        if (! mThread.IsStarted()) {
+            return;
+        }
+        QCStMutexLocker locker(mMutex);
+        mStopFlag = true;
+        mWorkCond.Notify();
+        locker.Unlock();
+        mThread.Join();
+        globalNetManager().UnRegisterTimeoutHandler(this);
+    }
+    bool Submit(
+        int       fd,
+        bool      syncFlag,
+        string&   buf,
+        Requests& reqs,
+        seq_t     lastSeq)
+    {
+        QCStMutexLocker locker(mMutex);
+        if (mBusyFlag) {
+            return false;
+        }
+        mFd       = fd;
+        mSyncFlag = syncFlag;
+        mLastSeq  = lastSeq;
+        mBuf.swap(buf);
+        mReqs.swap(reqs);
+        mBusyFlag = true;
+        mWorkCond.Notify();
+        return true;
+    }
+    bool GetDone(
+        Requests& reqs,
+        seq_t&    lastSeq,
+        int&      err)
+    {
+        QCStMutexLocker locker(mMutex);
+        if (! mDoneFlag) {
+            return false;
+        }
+        reqs.insert(reqs.end(), mDoneReqs.begin(), mDoneReqs.end());
+        mDoneReqs.clear();
+        lastSeq   = mDoneSeq;
+        err       = mError;
+        mDoneFlag = false;
+        return true;
+    }
+    bool IsBusy()
+    {
+        QCStMutexLocker locker(mMutex);
+        return mBusyFlag;
+    }
+    void WaitIdle()
+    {
+        QCStMutexLocker locker(mMutex);
+        while (mBusyFlag) {
+            mDoneCond.Wait(mMutex);
+        }
+    }
+    virtual void Run()
+    {
+        QCStMutexLocker locker(mMutex);
+        for (; ;) {
+            while (! mBusyFlag && ! mStopFlag) {
+                mWorkCond.Wait(mMutex);
+            }
+            if (! mBusyFlag) {
+                break;
+            }
+            // The buffer and requests are not accessed by the main thread
+            // while the writer is busy.
+            const int  fd       = mFd;
+            const bool syncFlag = mSyncFlag;
+            int        err;
+            {
+                QCStMutexUnlocker unlocker(mMutex);
+                err = Write(fd, mBuf);
+                if (err == 0 && syncFlag) {
+                    err = Sync(fd);
+                }
+            }
+            mBuf.clear();
+            mDoneReqs.insert(mDoneReqs.end(), mReqs.begin(), mReqs.end());
+            mReqs.clear();
+            mDoneSeq  = mLastSeq;
+            mDoneFlag = true;
+            if (mError == 0) {
+                mError = err;
+            }
+            mBusyFlag = false;
+            mDoneCond.NotifyAll();
+            QCStMutexUnlocker unlocker(mMutex);
+            globalNetManager().Wakeup();
+        }
+    }
+    virtual void Timeout()
+        { mLogger.commitDone(); }
+    static int Write(
+        int           fd,
+        const string& buf)
+    {
+        const char*       ptr = buf.data();
+        const char* const end = ptr + buf.size();
+        while (ptr < end) {
+            const ssize_t nwr = ::write(fd, ptr, end - ptr);
+            if (nwr < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return (errno > 0 ? errno : EIO);
+            }
+            ptr += nwr;
+        }
+        return 0;
+    }
+    static int Sync(
+        int fd)
+    {
+#ifdef KFS_OS_NAME_LINUX
+        if (fdatasync(fd)) {
+#else
+        if (fsync(fd)) {
+#endif
+            return (errno > 0 ? errno : EIO);
+        }
+        return 0;
+    }
+private:
+    Logger&   mLogger;
+    QCMutex   mMutex;
+    QCCondVar mWorkCond;
+    QCCondVar mDoneCond;
+    QCThread  mThread;
+    int       mFd;
+    bool      mSyncFlag;
+    bool      mStopFlag;
+    bool      mBusyFlag;
+    int       mError;
+    string    mBuf;
+    Requests  mReqs;
+    Requests  mDoneReqs;
+    seq_t     mLastSeq;
+    seq_t     mDoneSeq;
+    bool      mDoneFlag;
+private:
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+};
+
+Logger::Logger(string d)
+    : logdir(d),
+      lognum(-1),
+      logname(),
+      logfd(-1),
+      logbuf(),
+      md(),
+      logstream(md),
+      nextseq(0),
+      committed(0),
+      incp(0),
+      groupcommit(false),
+      logsync(true),
+      logerror(0),
+      pending(),
+      done(),
+      writer(0)
+{}
+
+Logger::~Logger()
+{
+    delete writer;
+    logstream.flush();
+    writeLog();
+    closeLog();
+}
+
+void
+Logger::setParameters(const Properties& props)
+{
+    // The group commit can only be turned on or off at startup, the log sync
+    // can be changed at any time.
+    if (! writer) {
+        groupcommit = props.getValue(
+            "metaServer.log.groupCommit", groupcommit ? 1 : 0) != 0;
+    }
+    logsync = props.getValue(
+        "metaServer.log.sync", logsync ? 1 : 0) != 0;
+}
+
 void
 Logger::dispatch(MetaRequest *r)
 {
-    r->seqno = ++nextseq;
+    r->seqno   = ++nextseq;
+    r->logTime = microseconds();
     if (r->mutation && r->status == 0) {
         if (log(r) < 0) {
             panic("Logger::dispatch", true);
         }
         cp.note_mutation();
+        if (writer) {
+            // Reply after the log record is on disk.
+            pending.push_back(r);
+            if (pending.size() == 1) {
+                globalNetManager().Wakeup();
+            }
+            return;
+        }
     }
     gNetDispatch.Dispatch(r);
 }
 
 /*!
  * \brief log the request and flush the result to the fs buffer.
+ * With group commit the log record is written by the log writer thread.
 */
 int
 Logger::log(MetaRequest *r)
 {
     const int res = r->log(logstream);
-    if (res >= 0) {
+    if (res >= 0 && ! writer) {
         flushResult(r);
     }
     return res;
@@ -86,12 +345,149 @@ Logger::flushLog()
     seq_t last = nextseq;
 
     logstream.flush();
+    writeLog();
     if (fail()) {
         panic("Logger::flushLog", true);
     }
     committed = last;
 }
 
+/*!
+ * \brief write log records buffered in memory into the log file
+ * \return      0 if successful, negative on I/O error
+ */
+int
+Logger::writeLog()
+{
+    const string buf = logbuf.str();
+    if (buf.empty()) {
+        return 0;
+    }
+    logbuf.str(string());
+    if (logfd < 0) {
+        return -EIO;
+    }
+    const int err = Writer::Write(logfd, buf);
+    if (err != 0 && logerror == 0) {
+        logerror = err;
+    }
+    return (err == 0 ? 0 : -err);
+}
+
+/*!
+ * \brief close current log file
+ * \return      0 if successful, negative on I/O error
+ */
+int
+Logger::closeLog()
+{
+    if (logfd < 0) {
+        return 0;
+    }
+    int err = 0;
+    if (groupcommit && logsync) {
+        err = Writer::Sync(logfd);
+    }
+    if (close(logfd) && err == 0) {
+        err = errno > 0 ? errno : EIO;
+    }
+    logfd = -1;
+    if (err != 0 && logerror == 0) {
+        logerror = err;
+    }
+    return (err == 0 ? 0 : -err);
+}
+
+/*!
+ * \brief hand off the pending log records to the log writer thread,
+ * if it isn't busy writing the previous batch.
+ */
+void
+Logger::submitPending()
+{
+    if (pending.empty() || ! writer || writer->IsBusy()) {
+        return;
+    }
+    logstream.flush();
+    if (md.fail()) {
+        panic("Logger::submitPending", true);
+    }
+    string buf = logbuf.str();
+    logbuf.str(string());
+    if (! writer->Submit(logfd, logsync, buf, pending, nextseq)) {
+        panic("Logger::submitPending, log writer is busy", false);
+    }
+}
+
+/*!
+ * \brief get the requests with the log records written by the log writer.
+ */
+void
+Logger::getCommitted()
+{
+    seq_t last = -1;
+    int   err  = 0;
+    if (! writer || ! writer->GetDone(done, last, err)) {
+        return;
+    }
+    if (err != 0) {
+        logerror = err;
+        panic("Logger::getCommitted " + QCUtils::SysError(err), false);
+    }
+    committed = last;
+}
+
+/*!
+ * \brief wait for all pending log records to be written to disk.
+ * The requests are dispatched later by commitDone().
+ */
+void
+Logger::waitCommitted()
+{
+    if (! writer) {
+        return;
+    }
+    for (; ;) {
+        writer->WaitIdle();
+        getCommitted();
+        if (pending.empty()) {
+            break;
+        }
+        submitPending();
+    }
+}
+
+/*!
+ * \brief dispatch requests with log records written by the log writer, and
+ * start writing the next batch, if any.
+ */
+void
+Logger::commitDone()
+{
+    getCommitted();
+    Requests reqs;
+    reqs.swap(done);
+    for (Requests::const_iterator it = reqs.begin(); it != reqs.end(); ++it) {
+        gNetDispatch.Dispatch(*it);
+    }
+    submitPending();
+}
+
+/*!
+ * \brief write all pending log records, and stop log writer thread.
+ */
+void
+Logger::shutdown()
+{
+    if (! writer) {
+        return;
+    }
+    waitCommitted();
+    commitDone();
+    delete writer;
+    writer = 0;
+}
+
 /*!
  * \brief set the log filename/log # to seqno
  * \param[in] seqno the next log sequence number (lognum)
@@ -126,23 +522,28 @@ Logger::startLog(int seqno, bool appendFlag /* = false */,
             " int base: " << logAppendIntBase <<
             " file: "     << logname <<
         KFS_LOG_EOM;
-        logf.open(logname.c_str(), ofstream::app | ofstream::binary);
-        md.SetStream(&logf);
+        if ((logfd = open(logname.c_str(),
+                O_WRONLY | O_CREAT | O_APPEND, 0666)) < 0) {
+            logerror = errno > 0 ? errno : EIO;
+        }
+        md.SetStream(&logbuf);
         md.SetWriteTrough(false);
         switch (logAppendIntBase) {
             case 10: logstream << dec; break;
             case 16: logstream << hex; break;
             default:
                 panic("invalid int base parameter", false);
-                logf.close();
+                closeLog();
                 return -EINVAL;
         }
-        return (fail() ? -EIO : 0);
+        return (startWriter() ? 0 : -EIO);
+    }
+    if ((logfd = open(logname.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+        logerror = errno > 0 ? errno : EIO;
     }
-    logf.open(logname.c_str(),
-        ofstream::out | ofstream::binary | ofstream::trunc);
     md.SetWriteTrough(false);
-    md.Reset(&logf);
+    md.Reset(&logbuf);
     logstream <<
         "version/" << VERSION << "\n"
         "checksum/last-line\n"
@@ -151,7 +552,34 @@ Logger::startLog(int seqno, bool appendFlag /* = false */,
     logstream << "time/" << DisplayIsoDateTime() << '\n';
     logstream << hex;
     logstream.flush();
-    return (fail() ? -EIO : 0);
+    writeLog();
+    return (startWriter() ? 0 : -EIO);
+}
+
+/*!
+ * \brief start log writer thread if group commit is enabled
+ * \return      false on I/O error or if the thread fails to start
+ */
+bool
+Logger::startWriter()
+{
+    if (fail()) {
+        return false;
+    }
+    if (! groupcommit || writer) {
+        return true;
+    }
+    writer = new Writer(*this);
+    if (! writer->Start()) {
+        delete writer;
+        writer = 0;
+        return false;
+    }
+    KFS_LOG_STREAM_INFO <<
+        "log writer started:"
+        " sync: " << logsync <<
+    KFS_LOG_EOM;
+    return true;
 }
 
 /*!
@@ -160,6 +588,8 @@ Logger::startLog(int seqno, bool appendFlag /* = false */,
 int
 Logger::finishLog()
 {
+    // Ensure that all log records are on disk before closing the log file.
+    waitCommitted();
     // if there has been no update to the log since the last roll, don't
     // roll the file over; otherwise, we'll have a file every N mins
     if (incp == committed) {
@@ -168,9 +598,10 @@ Logger::finishLog()
     logstream << "time/" << DisplayIsoDateTime() << '\n';
     logstream.flush();
     const string checksum = md.GetMd();
-    logf << "checksum/" << checksum << '\n';
-    logf.close();
-    if (fail()) {
+    // Checksum line is not included into the checksum: write it "around" md.
+    logbuf << "checksum/" << checksum << '\n';
+    writeLog();
+    if (closeLog() != 0 || logerror != 0 || md.fail()) {
         panic("Logger::finishLog, close", true);
     }
     if (link_latest(logname, LASTLOG)) {
@@ -278,4 +709,10 @@ logger_init(int rotateIntervalSec)
     LogRotater::Instance().Start();
 }
 
+void
+logger_shutdown()
+{
+    oplog.shutdown();
+}
+
 } // namespace KFS.
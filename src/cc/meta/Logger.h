@@ -28,6 +28,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "kfstypes.h"
 #include "MetaRequest.h"
@@ -41,6 +42,9 @@ namespace KFS
 using std::string;
 using std::ostringstream;
 using std::ofstream;
+using std::vector;
+
+class Properties;
 
 /*!
  * \brief Class for logging metadata updates
@@ -51,28 +55,18 @@ using std::ofstream;
  *  the log rollover occurs, after we close the log file, we create a link from
  *  "LAST" to the recently closed log file.  This is used by the log compactor
  *  to determine the set of files that can be compacted.
+ *  - optional "group commit" mode: log records are accumulated in memory, and
+ *  written and synced to disk by the log writer thread in batches. The
+ *  requests are dispatched to the sender only after the batch that contains
+ *  the corresponding log records is on disk.
  */
 
 class Logger
 {
 public:
     static const int VERSION = 1;
-    Logger(string d)
-        : logdir(d),
-          lognum(-1),
-          logname(),
-          logf(),
-          md(),
-          logstream(md),
-          nextseq(0),
-          committed(0),
-          incp(0)
-        {}
-    ~Logger()
-    {
-        logstream.flush();
-        logf.close();
-    }
+    Logger(string d);
+    ~Logger();
     void setLogDir(const string &d)
     {
         logdir = d;
@@ -110,25 +104,47 @@ public:
         incp = committed = nextseq = last;
     }
     MdStream& getMdStream() { return md; }
+    //!< set group commit and log sync parameters
+    void setParameters(const Properties& props);
+    //!< write pending log records, and stop log writer thread
+    void shutdown();
+    //!< dispatch requests with log records written by the log writer
+    void commitDone();
 private:
+    class Writer;
+    typedef vector<MetaRequest*> Requests;
+
     string   logdir;      //!< directory where logs are kept
     int      lognum;      //!< for generating log file names
     string   logname;     //!< name of current log file
-    ofstream logf;        //!< the current log file
+    int      logfd;       //!< the current log file
+    ostringstream logbuf; //!< log records not yet written to the log file
     MdStream md;
     ostream& logstream;
     seq_t    nextseq;     //!< next request sequence no.
     seq_t    committed;   //!< highest request known to be on disk
     seq_t    incp;        //!< highest request in a checkpoint
+    bool     groupcommit; //!< use log writer thread
+    bool     logsync;     //!< sync log file after each write
+    int      logerror;    //!< log file write or sync error
+    Requests pending;     //!< requests waiting for their log records write
+    Requests done;        //!< requests with log records on disk
+    Writer*  writer;      //!< log writer thread, group commit mode only
     string genfile(int n) //!< generate a log file name
     {
         ostringstream f(ostringstream::out);
         f << n;
         return logdir + "/log." + f.str();
     }
-    bool fail() const { return (logf.fail() || md.fail()); }
+    bool fail() const { return (logfd < 0 || logerror != 0 || md.fail()); }
     void flushLog();
     void flushResult(MetaRequest *r);
+    int  writeLog();
+    int  closeLog();
+    bool startWriter();
+    void submitPending();
+    void getCommitted();
+    void waitCommitted();
 private:
     // No copy.
     Logger(const Logger&);
@@ -141,6 +157,7 @@ extern Logger oplog;
 extern void logger_setup_paths(const string& logdir);
 extern void logger_init(int rotateIntervalSec);
 extern void logger_set_rotate_interval(int rotateIntervalSec);
+extern void logger_shutdown();
 
 }
 #endif // !defined(KFS_LOGGER_H)
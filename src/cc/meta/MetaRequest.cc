@@ -76,10 +76,16 @@ static bool    gWormMode = false;
 static string  gChunkmapDumpDir(".");
 static const char* const ftypes[] = { "empty", "file", "dir" };
 
+// Read only requests can be handled by the client threads concurrently, see
+// submit_request_shared(), therefore the temporary objects are per thread.
 static ostringstream&
 GetTmpOStringStream()
 {
-    static ostringstream ret;
+    static __thread ostringstream* sTmpOStringStream = 0;
+    if (! sTmpOStringStream) {
+        sTmpOStringStream = new ostringstream();
+    }
+    ostringstream& ret = *sTmpOStringStream;
     ret.str(string());
     resetOStream(ret);
     return ret;
@@ -532,16 +538,54 @@ CheckIfIoBuffersAvailable()
     }
 }
 
+class AlwaysReadyCond
+{
+public:
+    bool operator() (MetaRequest& /* req */)
+        { return true; }
+};
+
+static AlwaysReadyCond&
+GetAlwaysReadyCond()
+{
+    static AlwaysReadyCond sAlwaysReadyCond;
+    return sAlwaysReadyCond;
+}
+
+// Rmdirs requests with the sub tree permission check in progress are re-
+// submitted from the net manager loop, in order to let other requests through
+// between the check time slices.
+typedef RequestWaitQueue<AlwaysReadyCond> RmdirsWaitQueue;
+static RmdirsWaitQueue sRmdirsWaitQueue(
+    globalNetManager(), GetAlwaysReadyCond());
+static int sRmdirsCheckMaxEntries = 4 << 10;
+
 void
 SetRequestParameters(const Properties& props)
 {
     sBuffersWaitQueue.SetParameters(props, "metaServer.buffersWaitQueue.");
+    sRmdirsWaitQueue.SetParameters(props, "metaServer.rmdirsWaitQueue.");
+    sRmdirsCheckMaxEntries = max(2, props.getValue(
+        "metaServer.rmdirsCheckMaxEntries", sRmdirsCheckMaxEntries));
 }
 
+// Set while the request handle() is invoked by submit_request_shared().
+static __thread bool sSharedReadOnlyHandleFlag = false;
+
 static bool
 HasEnoughIoBuffersForResponse(MetaRequest& req)
 {
-    return (! sBuffersWaitQueue.SuspendIfNeeded(req));
+    // The shared read only requests are checked prior to the submission by
+    // HasEnoughIoBuffersForSharedResponse() with the dispatch mutex held.
+    return (sSharedReadOnlyHandleFlag ||
+        ! sBuffersWaitQueue.SuspendIfNeeded(req));
+}
+
+static bool
+HasEnoughIoBuffersForSharedResponse(const MetaRequest& req)
+{
+    return (! sBuffersWaitQueue.HasPendingRequests() &&
+        gLayoutManager.HasEnoughFreeBuffers(const_cast<MetaRequest*>(&req)));
 }
 
 class ResponseWOStream : private IOBuffer::WOStream
@@ -558,7 +602,22 @@ public:
     void Reset()
         { IOBuffer::WOStream::Reset(); }
 };
-static ResponseWOStream sWOStream;
+
+static ResponseWOStream&
+GetResponseWOStream()
+{
+    static __thread ResponseWOStream* sWOStream = 0;
+    if (! sWOStream) {
+        sWOStream = new ResponseWOStream();
+    }
+    return *sWOStream;
+}
+
+/* virtual */ bool
+MetaLookup::IsSharedReadOnly() const
+{
+    return gLayoutManager.IsSharedReadOnlyAllowed();
+}
 
 /* virtual */ void
 MetaLookup::handle()
@@ -577,6 +636,14 @@ MetaLookup::dispatch(ClientSM& sm)
     return sm.Handle(*this);
 }
 
+/* virtual */ bool
+MetaLookupPath::IsSharedReadOnly() const
+{
+    // Path to fid cache lookup updates the cache.
+    return (gLayoutManager.IsSharedReadOnlyAllowed() &&
+        ! metatree.isPathToFidCacheEnabled());
+}
+
 /* virtual */ void
 MetaLookupPath::handle()
 {
@@ -588,6 +655,139 @@ MetaLookupPath::handle()
     }
 }
 
+/* virtual */ bool
+MetaGetContentSummary::IsSharedReadOnly() const
+{
+    return (gLayoutManager.IsSharedReadOnlyAllowed() &&
+        ! metatree.isPathToFidCacheEnabled());
+}
+
+/* virtual */ void
+MetaGetContentSummary::handle()
+{
+    SetEUserAndEGroup(*this);
+    MetaFattr* fa = 0;
+    if ((status = metatree.lookupPath(
+            root, path, euser, egroup, fa)) != 0) {
+        return;
+    }
+    fid     = fa->id();
+    dirFlag = fa->type == KFS_DIR;
+    if (! dirFlag) {
+        dirCount  = 0;
+        fileCount = 1;
+        byteCount = metatree.getFileSize(*fa);
+        return;
+    }
+    if (! metatree.getUpdatePathSpaceUsageFlag()) {
+        status    = -ENOSYS;
+        statusMsg = "directory sizes update is not enabled";
+        return;
+    }
+    dirCount  = fa->dirCount();
+    fileCount = fa->fileCount();
+    byteCount = fa->filesize;
+}
+
+/* virtual */ bool
+MetaLookupBatch::IsSharedReadOnly() const
+{
+    return (gLayoutManager.IsSharedReadOnlyAllowed() &&
+        ! metatree.isPathToFidCacheEnabled() &&
+        HasEnoughIoBuffersForSharedResponse(*this));
+}
+
+/* virtual */ void
+MetaLookupBatch::handle()
+{
+    if (status != 0) {
+        return;
+    }
+    if (! HasEnoughIoBuffersForResponse(*this)) {
+        return;
+    }
+    SetEUserAndEGroup(*this);
+    const UserAndGroupNames* const ugn = GetUserAndGroupNames(*this);
+    ostream&                       os  = GetResponseWOStream().Set(resp);
+    MFattr                         fattr;
+    for (Entries::const_iterator it = entries.begin();
+            it != entries.end() && os;
+            ++it) {
+        MetaFattr* fa = 0;
+        const int  res = metatree.lookupPath(
+            it->dir, it->path, euser, egroup, fa);
+        os << "Status: " << (res >= 0 ? res : -SysToKfsErrno(-res)) << "\r\n";
+        if (res == 0) {
+            FattrReply(fa, fattr);
+            FattrReply(os, fattr, ugn);
+        }
+        os << "\r\n";
+    }
+    os.flush();
+    GetResponseWOStream().Reset();
+    if (! os) {
+        resp.Clear();
+        status    = -ENOMEM;
+        statusMsg = "response exceeds max. size";
+    }
+    entries.clear();
+}
+
+/* virtual */ bool
+MetaLookupBatch::dispatch(ClientSM& sm)
+{
+    return sm.Handle(*this);
+}
+
+int
+MetaLookupBatch::Read(IOBuffer& iobuf)
+{
+    if (! contentBuf && contentBufPos <= 0 && 0 < contentLength) {
+        contentBuf = new char[contentLength];
+    }
+    const int rem = iobuf.CopyOut(
+        contentBuf + contentBufPos, contentLength - contentBufPos);
+    contentBufPos += iobuf.Consume(rem);
+    const int ret = contentLength - contentBufPos;
+    if (ret <= 0) {
+        ParseContent();
+        delete [] contentBuf;
+        contentBuf = 0;
+    }
+    return ret;
+}
+
+void
+MetaLookupBatch::ParseContent()
+{
+    entries.clear();
+    entries.reserve(numEntries);
+    const char*       ptr = contentBuf;
+    const char* const end = ptr + contentLength;
+    for (int i = 0; i < numEntries; i++) {
+        fid_t  dir = -1;
+        size_t len = 0;
+        if (! DecIntParser::Parse(ptr, end - ptr, dir) ||
+                ! DecIntParser::Parse(ptr, end - ptr, len) ||
+                end <= ptr || *ptr++ != ' ' ||
+                len <= 0 || MAX_PATH_NAME_LENGTH < len ||
+                (size_t)(end - ptr) <= len || ptr[len] != '\n' ||
+                (dir < 0 && *ptr != '/')) {
+            entries.clear();
+            status    = -EINVAL;
+            statusMsg = "invalid batch lookup entry";
+            return;
+        }
+        entries.push_back(Entry(dir, string(ptr, len)));
+        ptr += len + 1;
+    }
+    if (ptr != end) {
+        entries.clear();
+        status    = -EINVAL;
+        statusMsg = "batch lookup entries count mismatch";
+    }
+}
+
 template<typename T> inline static bool
 CheckUserAndGroup(T& req)
 {
@@ -833,8 +1033,9 @@ MetaCreate::handle()
     );
     if (status == 0) {
         if (minSTier < kKfsSTierMax) {
-            fa->minSTier = minSTier;
-            fa->maxSTier = maxSTier;
+            MetaFattr* const mfa = metatree.modify(fa);
+            mfa->minSTier = minSTier;
+            mfa->maxSTier = maxSTier;
         } else {
             minSTier = fa->minSTier;
             maxSTier = fa->maxSTier;
@@ -936,20 +1137,62 @@ MetaRmdir::handle()
     status = metatree.rmdir(dir, name, pathname, euser, egroup, mtime);
 }
 
+/* virtual */ void
+MetaRmdirs::handle()
+{
+    if (gWormMode) {
+        // deletes are disabled in WORM mode
+        statusMsg = "worm mode";
+        status    = -EPERM;
+        return;
+    }
+    todumpster = -1;
+    SetEUserAndEGroup(*this);
+    if ((status = LookupAbsPath(dir, name, euser, egroup)) != 0) {
+        return;
+    }
+    if (euser != kKfsUserRoot && ! check) {
+        check = new RmdirsCheck(sRmdirsCheckMaxEntries);
+    }
+    mtime = microseconds();
+    status = metatree.rmdirs(dir, name, pathname, todumpster,
+        euser, egroup, mtime, check);
+    if (status == -EAGAIN) {
+        // Sub tree permission check is not complete, continue with the next
+        // time slice.
+        status = 0;
+        sRmdirsWaitQueue.Add(this);
+        sRmdirsWaitQueue.Wakeup();
+        return;
+    }
+    if (status == 0) {
+        gLayoutManager.ScheduleDumpsterReclaim();
+    }
+}
+
+MetaRmdirs::~MetaRmdirs()
+{
+    delete check;
+}
+
 static vector<MetaDentry*>&
 GetReadDirTmpVec()
 {
-    static vector<MetaDentry*> sReaddirRes;
-    sReaddirRes.clear();
-    sReaddirRes.reserve(1024);
-    return sReaddirRes;
+    static __thread vector<MetaDentry*>* sReaddirRes = 0;
+    if (! sReaddirRes) {
+        sReaddirRes = new vector<MetaDentry*>();
+    }
+    sReaddirRes->clear();
+    sReaddirRes->reserve(1024);
+    return *sReaddirRes;
 }
 
 inline const MetaFattr*
 GetDirAttr(fid_t dir, const vector<MetaDentry*>& v)
 {
-    const MetaFattr* fa = v.empty() ? 0 : (v.front()->getName() == ".." ?
-        v.back()->getFattr() : v.front()->getFattr());
+    const MetaFattr* fa = v.empty() ? 0 :
+        (v.front()->compareName("..", 2) == 0 ?
+            v.back()->getFattr() : v.front()->getFattr());
     if (fa && fa->id() != dir) {
         fa = fa->parent;
         if (fa && fa->id() != dir) {
@@ -959,6 +1202,13 @@ GetDirAttr(fid_t dir, const vector<MetaDentry*>& v)
     return (fa ? fa : metatree.getFattr(dir));
 }
 
+/* virtual */ bool
+MetaReaddir::IsSharedReadOnly() const
+{
+    return (gLayoutManager.IsSharedReadOnlyAllowed() &&
+        HasEnoughIoBuffersForSharedResponse(*this));
+}
+
 /* virtual */ void
 MetaReaddir::handle()
 {
@@ -1011,12 +1261,12 @@ MetaReaddir::handle()
     for (it = v.begin();
             it != v.end() && writer.GetSize() <= maxSize;
             ++it) {
-        const string& name = (*it)->getName();
+        const MetaDentry& entry = **it;
         // Supress "/" dentry for "/".
-        if (dir == ROOTFID && name == "/") {
+        if (dir == ROOTFID && entry.compareName("/", 1) == 0) {
             continue;
         }
-        writer.Write(name);
+        writer.Write(entry.getNamePtr(), entry.getNameLen());
         writer.Write("\n", 1);
         ++numEntries;
     }
@@ -1469,6 +1719,13 @@ MetaReaddirPlus::~MetaReaddirPlus()
     }
 }
 
+/* virtual */ bool
+MetaReaddirPlus::IsSharedReadOnly() const
+{
+    return (gLayoutManager.IsSharedReadOnlyAllowed() &&
+        HasEnoughIoBuffersForSharedResponse(*this));
+}
+
 /* virtual */ void
 MetaReaddirPlus::handle()
 {
@@ -1491,7 +1748,7 @@ MetaReaddirPlus::handle()
             metatree.readdir(dir, res,
                 maxEntries, &hasMoreEntriesFlag) :
             metatree.readdir(dir, fnameStart, res,
-                maxEntries, hasMoreEntriesFlag)
+                maxEntries, hasMoreEntriesFlag, resumeFlag)
             ) != 0) {
         if (status == -ENOENT) {
             MetaFattr * const fa = metatree.getFattr(dir);
@@ -1515,6 +1772,14 @@ MetaReaddirPlus::handle()
         return;
     }
     maxRespSize = max(0, gLayoutManager.GetMaxResponseSize());
+    if (0 <= numEntries && 0 < respSizeLimit && respSizeLimit < maxRespSize) {
+        // Paginated listing: the client sets smaller response size in
+        // order to bound its memory use, and the response latency.
+        maxRespSize = respSizeLimit;
+    }
+    if (approxFileSizeFlag) {
+        omitLastChunkInfoFlag = true;
+    }
     const int    extSize = IOBufferData::GetDefaultBufferSize() +
         int(MAX_FILE_NAME_LENGTH);
     const size_t maxSize =
@@ -1543,13 +1808,24 @@ MetaReaddirPlus::handle()
             continue;
         }
         // Supress "/" dentry for "/".
-        const string& name = entry->getName();
-        if (fa->id() == ROOTFID && name == "/") {
+        if (fa->id() == ROOTFID && entry->compareName("/", 1) == 0) {
             continue;
         }
-        responseSize += name.length() + (fa->type == KFS_DIR ?
+        const size_t nameLen = entry->getNameLen();
+        responseSize += nameLen + (fa->type == KFS_DIR ?
             avgDirExtraSize : avgFileExtraSize);
-        dentries.push_back(DEntry(*fa, name));
+        dentries.push_back(DEntry(*fa, entry->getNamePtr(), nameLen));
+        if (approxFileSizeFlag && fa->type == KFS_FILE && fa->filesize < 0 &&
+                ! fa->IsStriped() && ! noAttrsFlag) {
+            // The size of the file being written is not known. Use the last
+            // chunk start position as the size lower bound estimate, instead
+            // of letting the client query chunk servers.
+            MetaChunkInfo* lastChunk = 0;
+            MetaFattr*     cfa       = 0;
+            dentries.back().filesize =
+                (metatree.getLastChunkInfo(fa->id(), cfa, lastChunk) == 0 &&
+                    lastChunk) ? lastChunk->offset : chunkOff_t(0);
+        }
         if (omitLastChunkInfoFlag || fileIdAndTypeOnlyFlag ||
                 noAttrsFlag || fa->type == KFS_DIR || fa->IsStriped() ||
                 (getLastChunkInfoOnlyIfSizeUnknown &&
@@ -1609,6 +1885,12 @@ MetaReaddirPlus::handle()
 /*!
  * \brief Get the allocation information for a specific chunk in a file.
  */
+/* virtual */ bool
+MetaGetalloc::IsSharedReadOnly() const
+{
+    return (gLayoutManager.IsSharedReadOnlyAllowed() && ! objectStoreFlag);
+}
+
 /* virtual */ void
 MetaGetalloc::handle()
 {
@@ -1699,6 +1981,13 @@ MetaGetalloc::handle()
  * \brief Get the allocation information for a file.  Determine
  * how many chunks there and where they are located.
  */
+/* virtual */ bool
+MetaGetlayout::IsSharedReadOnly() const
+{
+    return (gLayoutManager.IsSharedReadOnlyAllowed() &&
+        HasEnoughIoBuffersForSharedResponse(*this));
+}
+
 /* virtual */ void
 MetaGetlayout::handle()
 {
@@ -1755,7 +2044,7 @@ MetaGetlayout::handle()
     if ((hasMoreChunksFlag = maxResCnt > 0 && maxResCnt < numChunks)) {
         numChunks = maxResCnt;
     }
-    ostream&        os     = sWOStream.Set(resp);
+    ostream&        os     = GetResponseWOStream().Set(resp);
     const char*     prefix = "";
     Servers         c;
     ChunkLayoutInfo l;
@@ -1790,7 +2079,7 @@ MetaGetlayout::handle()
         status    = -ENOMEM;
         statusMsg = "response exceeds max. size";
     }
-    sWOStream.Reset();
+    GetResponseWOStream().Reset();
 }
 
 /* virtual */ bool
@@ -2413,8 +2702,8 @@ MetaSetMtime::handle()
         status = -EACCES;
         return;
     }
-    fa->mtime = mtime;
-    fid       = fa->id();
+    metatree.modify(fa)->mtime = mtime;
+    fid = fa->id();
 }
 
 /* virtual */ void
@@ -2614,6 +2903,13 @@ MetaLeaseCleanup::handle()
     status = 0;
 }
 
+/* virtual */ void
+MetaDumpsterReclaim::handle()
+{
+    gLayoutManager.DumpsterReclaim();
+    status = 0;
+}
+
 class PrintChunkServerLocations {
     ostream &os;
 public:
@@ -2624,6 +2920,13 @@ public:
     }
 };
 
+/* virtual */ bool
+MetaGetPathName::IsSharedReadOnly() const
+{
+    // Chunk id lookup updates chunk server map "last lookup" cache.
+    return (gLayoutManager.IsSharedReadOnlyAllowed() && 0 <= fid);
+}
+
 /* virtual */ void
 MetaGetPathName::handle()
 {
@@ -2691,7 +2994,7 @@ MetaChmod::handle()
         return;
     }
     status = 0;
-    fa->mode = mode;
+    metatree.modify(fa)->mode = mode;
 }
 
 /* virtual */ void
@@ -2724,11 +3027,12 @@ MetaChown::handle()
         }
     }
     status = 0;
+    MetaFattr* const mfa = metatree.modify(fa);
     if (user != kKfsUserNone) {
-        fa->user = user;
+        mfa->user = user;
     }
     if (group != kKfsGroupNone) {
-        fa->group = group;
+        mfa->group = group;
     }
 }
 
@@ -2892,10 +3196,10 @@ MetaUpServers::handle()
     if (! HasMetaServerStatsAccess(*this)) {
         return;
     }
-    ostream& os = sWOStream.Set(resp);
+    ostream& os = GetResponseWOStream().Set(resp);
     gLayoutManager.UpServers(os);
     os.flush();
-    sWOStream.Reset();
+    GetResponseWOStream().Reset();
     if (! os) {
         resp.Clear();
         status    = -ENOMEM;
@@ -2967,9 +3271,30 @@ MetaDumpChunkToServerMap::handle()
         pid = -1;
         return; // Child finished.
     }
+    if (inProcessRunningFlag) {
+        inProcessRunningFlag = false;
+        if (status != 0) {
+            statusMsg = "chunk map write failure";
+        }
+        return; // In process dump finished.
+    }
     if (! HasMetaServerAdminAccess(*this)) {
         return;
     }
+    if (gLayoutManager.IsInProcessChunkMapDump()) {
+        status = gLayoutManager.StartDumpChunkToServerMap(
+            *this, gChunkmapDumpDir);
+        if (status != 0) {
+            statusMsg = status == -EAGAIN ?
+                "chunk map dump in progress" :
+                "failed to start chunk map dump";
+            return;
+        }
+        chunkmapFile         = gChunkmapDumpDir + "/chunkmap.txt";
+        inProcessRunningFlag = true;
+        suspended            = true;
+        return;
+    }
     if (gChildProcessTracker.GetProcessCount() > 0) {
         statusMsg = "another child process running";
         status    = -EAGAIN;
@@ -3015,12 +3340,13 @@ MetaFsck::handle()
 {
     suspended = false;
     resp.Clear();
-    if (pid > 0) {
+    if (pid > 0 || inProcessRunningFlag) {
         if (! HasEnoughIoBuffersForResponse(*this)) {
             return;
         }
-        // Child finished.
-        pid = -1;
+        // Child or in process fsck finished.
+        pid                  = -1;
+        inProcessRunningFlag = false;
         if (status == 0) {
             int maxReadSize = min(
                 gLayoutManager.GetMaxResponseSize(),
@@ -3058,7 +3384,7 @@ MetaFsck::handle()
                     if (st.st_size > maxReadSize &&
                             maxReadSize == nRead) {
                         ostream& os =
-                            sWOStream.Set(resp);
+                            GetResponseWOStream().Set(resp);
                         os  <<
                             "\nWARNING: output"
                             " truncated to " <<
@@ -3071,7 +3397,7 @@ MetaFsck::handle()
                                 "buffers";
                             status    = -ENOMEM;
                         }
-                        sWOStream.Reset();
+                        GetResponseWOStream().Reset();
                         break;
                     }
                     if (nRead < st.st_size) {
@@ -3085,12 +3411,7 @@ MetaFsck::handle()
         } else if (status > 0) {
             status = -status;
         }
-        for (Fds::const_iterator it = fd.begin();
-                it != fd.end();
-                ++it) {
-            close(*it);
-        }
-        fd.clear();
+        CloseFds();
         if (status != 0) {
             status = status < 0 ? status : -EIO;
             if (statusMsg.empty()) {
@@ -3103,11 +3424,6 @@ MetaFsck::handle()
     if (! HasMetaServerAdminAccess(*this)) {
         return;
     }
-    if (gChildProcessTracker.GetProcessCount() > 0) {
-        statusMsg = "another child process running";
-        status    = -EAGAIN;
-        return;
-    }
     const int cnt = gLayoutManager.FsckStreamCount(
         reportAbandonedFilesFlag);
     if (cnt <= 0) {
@@ -3115,28 +3431,34 @@ MetaFsck::handle()
         status    = -EINVAL;
         return;
     }
-    const char* const    suffix    = ".XXXXXX";
-    const size_t         suffixLen = strlen(suffix);
-    StBufferT<char, 128> buf;
-    vector<string>       names;
-    names.reserve(cnt);
-    fd.reserve(cnt);
-    for (int i = 0; i < cnt; i++) {
-        char* const ptr = buf.Resize(sTmpName.length() + suffixLen + 1);
-        memcpy(ptr, sTmpName.data(), sTmpName.size());
-        strcpy(ptr + sTmpName.size(), suffix);
-        const int tfd = mkstemp(ptr);
-        if (tfd < 0) {
-            status    = errno > 0 ? -errno : -EINVAL;
-            statusMsg = "failed to create temporary file";
-            while (--i >= 0) {
-                close(fd[i]);
-                unlink(names[i].c_str());
-            }
+    const bool inProcessFlag = gLayoutManager.IsInProcessFsck();
+    if (! inProcessFlag && gChildProcessTracker.GetProcessCount() > 0) {
+        statusMsg = "another child process running";
+        status    = -EAGAIN;
+        return;
+    }
+    vector<string> names;
+    if ((status = CreateTmpFiles(cnt, names)) != 0) {
+        return;
+    }
+    if (inProcessFlag) {
+        // The in process fsck writes into the temporary files with the
+        // writer thread, and the output is read the same way as the child
+        // process output.
+        for (int i = 0; i < cnt; i++) {
+            unlink(names[i].c_str());
+        }
+        status = gLayoutManager.StartFsck(
+            *this, fd, reportAbandonedFilesFlag);
+        if (status != 0) {
+            statusMsg = status == -EAGAIN ?
+                "fsck in progress" : "failed to start fsck";
+            CloseFds();
             return;
         }
-        fd.push_back(tfd);
-        names.push_back(string(ptr));
+        inProcessRunningFlag = true;
+        suspended            = true;
+        return;
     }
     if ((pid = DoFork((int)(gLayoutManager.GetMaxFsckTime() /
                     (1000 * 1000)))) == 0) {
@@ -3182,9 +3504,9 @@ MetaFsck::handle()
         status    = errno > 0 ? -errno : -EINVAL;
         statusMsg = "fork failure";
         for (int i = 0; i < cnt; i++) {
-            close(fd[i]);
             unlink(names[i].c_str());
         }
+        CloseFds();
         return;
     }
     KFS_LOG_STREAM_INFO << "fsck pid: " << pid <<
@@ -3193,6 +3515,45 @@ MetaFsck::handle()
     gChildProcessTracker.Track(pid, this);
 }
 
+int
+MetaFsck::CreateTmpFiles(int cnt, vector<string>& names)
+{
+    const char* const    suffix    = ".XXXXXX";
+    const size_t         suffixLen = strlen(suffix);
+    StBufferT<char, 128> buf;
+    names.reserve(cnt);
+    fd.reserve(cnt);
+    for (int i = 0; i < cnt; i++) {
+        char* const ptr = buf.Resize(sTmpName.length() + suffixLen + 1);
+        memcpy(ptr, sTmpName.data(), sTmpName.size());
+        strcpy(ptr + sTmpName.size(), suffix);
+        const int tfd = mkstemp(ptr);
+        if (tfd < 0) {
+            const int err = errno > 0 ? -errno : -EINVAL;
+            statusMsg = "failed to create temporary file";
+            while (--i >= 0) {
+                unlink(names[i].c_str());
+            }
+            CloseFds();
+            return err;
+        }
+        fd.push_back(tfd);
+        names.push_back(string(ptr));
+    }
+    return 0;
+}
+
+void
+MetaFsck::CloseFds()
+{
+    for (Fds::const_iterator it = fd.begin();
+            it != fd.end();
+            ++it) {
+        close(*it);
+    }
+    fd.clear();
+}
+
 void
 MetaFsck::SetParameters(const Properties& props)
 {
@@ -3224,6 +3585,7 @@ MetaStats::handle()
     ostringstream& os = GetTmpOStringStream();
     status = 0;
     globals().counterManager.Show(os);
+    gNetDispatch.GetClientSchedulerStats(os);
     stats = os.str();
 }
 
@@ -3240,7 +3602,7 @@ MetaOpenFiles::handle()
     WriteInfo openForWrite;
     gLayoutManager.GetOpenFiles(openForRead, openForWrite);
     status = 0;
-    ostream& os = sWOStream.Set(resp);
+    ostream& os = GetResponseWOStream().Set(resp);
     for (ReadInfo::const_iterator it = openForRead.begin();
             it != openForRead.end();
             ++it) {
@@ -3279,7 +3641,7 @@ MetaOpenFiles::handle()
         openForReadCnt  = openForRead.size();
         openForWriteCnt = openForWrite.size();
     }
-    sWOStream.Reset();
+    GetResponseWOStream().Reset();
 }
 
 /* virtual */ void
@@ -3328,7 +3690,11 @@ MetaGetRequestCounters::handle()
         return;
     }
     status = 0;
-    gNetDispatch.GetStatsCsv(resp);
+    if (latencyHistogramsFlag) {
+        gNetDispatch.GetLatencyHistogramsCsv(resp);
+    } else {
+        gNetDispatch.GetStatsCsv(resp);
+    }
     userCpuMicroSec   = gNetDispatch.GetUserCpuMicroSec();
     systemCpuMicroSec = gNetDispatch.GetSystemCpuMicroSec();
 }
@@ -3337,13 +3703,14 @@ MetaGetRequestCounters::handle()
 MetaCheckpoint::handle()
 {
     suspended = false;
-    if (pid > 0) {
-        // Child finished.
+    if (pid > 0 || inProcessRunningFlag) {
+        // Child or in process checkpoint finished.
         KFS_LOG_STREAM(status == 0 ?
                 MsgLogger::kLogLevelINFO :
                 MsgLogger::kLogLevelERROR) <<
             "checkpoint: "    << lastCheckpointId <<
             " pid: "          << pid <<
+            " in process: "   << inProcessRunningFlag <<
             " done; status: " << status <<
             " failures: "     << failedCount <<
         KFS_LOG_EOM;
@@ -3359,8 +3726,9 @@ MetaCheckpoint::handle()
         if (failedCount > maxFailedCount) {
             panic("checkpoint failures", false);
         }
-        runningCheckpointId = -1;
-        pid = -1;
+        runningCheckpointId  = -1;
+        pid                  = -1;
+        inProcessRunningFlag = false;
         return;
     }
     status = 0;
@@ -3419,6 +3787,31 @@ MetaCheckpoint::handle()
         return;
     }
     runningCheckpointId = oplog.checkpointed();
+    if (inProcessFlag) {
+        // The in process checkpoint does not use dir sizes re-computation, as
+        // the sizes are maintained incrementally. The checkpoint represents
+        // the current meta data state, the subsequent changes are in the new
+        // log segment.
+        cp.setWriteSyncFlag(checkpointWriteSyncFlag);
+        cp.setWriteBufferSize(checkpointWriteBufferSize);
+        status = cp.start_CP(*this, inProcessSliceTimeUsec);
+        KFS_LOG_STREAM(status == 0 ?
+                MsgLogger::kLogLevelINFO :
+                MsgLogger::kLogLevelERROR) <<
+            "checkpoint: " << lastCheckpointId <<
+            " in process start status: " << status <<
+        KFS_LOG_EOM;
+        if (status != 0) {
+            if (lockFd >= 0) {
+                close(lockFd);
+            }
+            runningCheckpointId = -1;
+            return;
+        }
+        inProcessRunningFlag = true;
+        suspended            = true;
+        return;
+    }
     // DoFork() / PrepareCurrentThreadToFork() releases and re-acquires the
     // global mutex by waiting on condition with this mutex, but must ensure
     // that no other RPC gets processed. If checkpoint mutation count isn't
@@ -3479,6 +3872,12 @@ MetaCheckpoint::SetParameters(const Properties& props)
     checkpointWriteBufferSize = props.getValue(
         "metaServer.checkpoint.writeBufferSize",
         checkpointWriteBufferSize);
+    inProcessFlag = props.getValue(
+        "metaServer.checkpoint.inProcess",
+        inProcessFlag ? 1 : 0) != 0;
+    inProcessSliceTimeUsec = props.getValue(
+        "metaServer.checkpoint.inProcessSliceTimeUsec",
+        inProcessSliceTimeUsec);
 }
 
 /*!
@@ -3500,6 +3899,7 @@ submit_request(MetaRequest *r)
         r->processTime = start - r->processTime;
     }
     r->handle();
+    r->handleTime += microseconds() - start;
     if (r->suspended) {
         r->processTime = microseconds() - r->processTime;
     } else {
@@ -3507,6 +3907,52 @@ submit_request(MetaRequest *r)
     }
 }
 
+/*!
+ * \brief Start shared read only request processing. Invoked by the client
+ * threads with the dispatch mutex held.
+ * \return true if the request should be handled by submit_request_shared(),
+ * otherwise the request must be submitted with submit_request()
+ */
+bool
+submit_request_shared_start(MetaRequest* r)
+{
+    if (r->submitCount != 0 || ! r->IsSharedReadOnly()) {
+        return false;
+    }
+    const int64_t start = microseconds();
+    r->submitCount++;
+    r->submitTime  = start;
+    r->processTime = start;
+    return true;
+}
+
+/*!
+ * \brief Handle read only request. Can be invoked without holding the dispatch
+ * mutex, provided that no meta server state modifications are in flight.
+ */
+void
+submit_request_shared(MetaRequest* r)
+{
+    const int64_t start = microseconds();
+    sSharedReadOnlyHandleFlag = true;
+    r->handle();
+    sSharedReadOnlyHandleFlag = false;
+    r->handleTime += microseconds() - start;
+}
+
+/*!
+ * \brief Complete shared read only request processing. Invoked with the dispatch
+ * mutex held.
+ */
+void
+submit_request_shared_done(MetaRequest* r)
+{
+    if (r->suspended) {
+        panic("invalid suspended shared read only request", false);
+    }
+    oplog.dispatch(r);
+}
+
 /*!
  * \brief print out the leaf nodes for debugging
  */
@@ -3615,6 +4061,18 @@ MetaRmdir::log(ostream &file) const
     return file.fail() ? -EIO : 0;
 }
 
+/*!
+ * \brief log a directory tree deletion
+ */
+int
+MetaRmdirs::log(ostream &file) const
+{
+    file << "rmdirs/dir/" << dir << "/name/" << name <<
+        "/todumpster/" << todumpster <<
+        "/mtime/" << ShowTime(mtime) << '\n';
+    return file.fail() ? -EIO : 0;
+}
+
 /*!
  * \brief log directory read (nop)
  */
@@ -4112,6 +4570,37 @@ MetaLookupPath::response(ostream &os)
     FattrReply(os, fattr, GetUserAndGroupNames(*this)) << "\r\n";
 }
 
+void
+MetaGetContentSummary::response(ostream& os)
+{
+    if (! OkHeader(this, os)) {
+        return;
+    }
+    os <<
+        "File-handle: " << fid       << "\r\n"
+        "Type: "        << (dirFlag ? "dir" : "file") << "\r\n"
+        "Dir-count: "   << dirCount  << "\r\n"
+        "File-count: "  << fileCount << "\r\n"
+        "Byte-count: "  << byteCount << "\r\n"
+    "\r\n";
+}
+
+void
+MetaLookupBatch::response(ostream& os, IOBuffer& buf)
+{
+    if (! OkHeader(this, os)) {
+        return;
+    }
+    os <<
+        "EUserId: "        << euser  << "\r\n"
+        "EGroupId: "       << egroup << "\r\n"
+        "Num-entries: "    << numEntries << "\r\n"
+        "Content-length: " << resp.BytesConsumable() << "\r\n"
+    "\r\n";
+    os.flush();
+    buf.Move(&resp);
+}
+
 void
 MetaCreate::response(ostream &os)
 {
@@ -4170,6 +4659,12 @@ MetaRmdir::response(ostream &os)
     PutHeader(this, os) << "\r\n";
 }
 
+void
+MetaRmdirs::response(ostream &os)
+{
+    PutHeader(this, os) << "\r\n";
+}
+
 void
 MetaReaddir::response(ostream& os, IOBuffer& buf)
 {
@@ -4625,6 +5120,9 @@ MetaHello::response(ostream &os)
             os << "Delete-all-chunks: " << metaFileSystemId << "\r\n";
         }
     }
+    if (0 < newInventoryGeneration) {
+        os << "Inventory-generation: " << newInventoryGeneration << "\r\n";
+    }
     os << "\r\n";
 }
 
@@ -146,7 +146,11 @@ using std::less;
     f(DELEGATE_CANCEL) \
     f(SET_FILE_SYSTEM_INFO) \
     f(FORCE_CHUNK_REPLICATION) \
-    f(CLEAR_OBJ_STORE_DELETE)
+    f(CLEAR_OBJ_STORE_DELETE) \
+    f(LOOKUP_BATCH) \
+    f(RMDIRS) \
+    f(GET_CONTENT_SUMMARY) \
+    f(DUMPSTER_RECLAIM) /* Internally generated */
 
 enum MetaOp {
 #define KfsMakeMetaOpEnumEntry(name) META_##name,
@@ -158,6 +162,7 @@ enum MetaOp {
 
 class ChunkServer;
 class ClientSM;
+struct RmdirsCheck;
 typedef boost::shared_ptr<ChunkServer> ChunkServerPtr;
 typedef DynamicArray<chunkId_t, 8> ChunkIdQueue;
 
@@ -191,6 +196,10 @@ struct MetaRequest {
     int             submitCount;     //!< for time tracking.
     int64_t         submitTime;      //!< to time requests, optional.
     int64_t         processTime;     //!< same as previous
+    int64_t         recvTime;        //!< request receive time, 0 if internal
+    int64_t         handleTime;      //!< time spent in handle()
+    int64_t         logTime;         //!< log queue entry time
+    int64_t         doneTime;        //!< completion dispatch time
     string          statusMsg;       //!< optional human readable status message
     seq_t           opSeqno;         //!< command sequence # sent by the client
     seq_t           seqno;           //!< sequence no. in log
@@ -216,6 +225,10 @@ struct MetaRequest {
           submitCount(0),
           submitTime(0),
           processTime(0),
+          recvTime(0),
+          handleTime(0),
+          logTime(0),
+          doneTime(0),
           statusMsg(),
           opSeqno(opSeq),
           seqno(0),
@@ -237,6 +250,10 @@ struct MetaRequest {
         { MetaRequest::Init(); }
     virtual ~MetaRequest();
     virtual void handle();
+    //!< Returns true if handle() only reads the meta server state, and can
+    //!< run concurrently with other such requests without holding the
+    //!< dispatch mutex. Invoked with the dispatch mutex held.
+    virtual bool IsSharedReadOnly() const { return false; }
     //!< when an op finishes execution, we send a response back to
     //!< the client.  This function should generate the appropriate
     //!< response to be sent back as per the KFS protocol.
@@ -309,6 +326,9 @@ inline static ostream& operator<<(ostream& os, const MetaRequest::Display& disp)
 { return disp.Show(os); }
 
 void submit_request(MetaRequest *r);
+bool submit_request_shared_start(MetaRequest* r);
+void submit_request_shared(MetaRequest* r);
+void submit_request_shared_done(MetaRequest* r);
 
 /*!
  * \brief look up a file name
@@ -328,6 +348,7 @@ struct MetaLookup: public MetaRequest {
           fattr()
         {}
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual int log(ostream& file) const;
     virtual void response(ostream& os);
     virtual bool dispatch(ClientSM& sm);
@@ -373,6 +394,7 @@ struct MetaLookupPath: public MetaRequest {
           fattr()
         {}
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual int log(ostream& file) const;
     virtual void response(ostream& os);
     virtual ostream& ShowSelf(ostream& os) const
@@ -396,6 +418,122 @@ struct MetaLookupPath: public MetaRequest {
     }
 };
 
+/*!
+ * \brief return the subtree directory and file count, and the sum of the
+ * file sizes. The directory aggregates are maintained by the tree with every
+ * update, if directory sizes update is enabled, therefore the cost does not
+ * depend on the subtree size.
+ */
+struct MetaGetContentSummary: public MetaRequest {
+    fid_t      root;      //!< fid of starting directory
+    string     path;      //!< path to look up
+    fid_t      fid;       //!< result: file or directory fid
+    bool       dirFlag;   //!< result: directory
+    int64_t    dirCount;  //!< result: sub directories count
+    int64_t    fileCount; //!< result: files count
+    chunkOff_t byteCount; //!< result: sum of the files sizes
+    MetaGetContentSummary()
+        : MetaRequest(META_GET_CONTENT_SUMMARY, false),
+          root(-1),
+          path(),
+          fid(-1),
+          dirFlag(false),
+          dirCount(0),
+          fileCount(0),
+          byteCount(0)
+        {}
+    virtual void handle();
+    virtual bool IsSharedReadOnly() const;
+    virtual int log(ostream& /* file */) const { return 0; }
+    virtual void response(ostream& os);
+    virtual ostream& ShowSelf(ostream& os) const
+    {
+        return os <<
+            "content summary:"
+            " path: " << path <<
+            " root: " << root
+        ;
+    }
+    bool Validate()
+    {
+        return (root >= 0 && ! path.empty());
+    }
+    template<typename T> static T& ParserDef(T& parser)
+    {
+        return MetaRequest::ParserDef(parser)
+        .Def("Root File-handle", &MetaGetContentSummary::root, fid_t(-1))
+        .Def("Pathname",         &MetaGetContentSummary::path           )
+        ;
+    }
+};
+
+/*!
+ * \brief look up a batch of paths, or directory fid and name pairs.
+ * The request content consists of the "<dir fid> <path length> <path>\n"
+ * entries. Absolute path entries ignore the directory fid. The response
+ * content has a status followed by attributes for each entry, every entry
+ * terminated by an empty line.
+ */
+struct MetaLookupBatch: public MetaRequest {
+    struct Entry
+    {
+        Entry(fid_t d = -1, const string& p = string())
+            : dir(d),
+              path(p)
+            {}
+        fid_t  dir;
+        string path;
+    };
+    typedef vector<Entry> Entries;
+
+    int      numEntries;
+    int      contentLength;
+    char*    contentBuf;
+    int      contentBufPos;
+    Entries  entries;
+    IOBuffer resp;
+    MetaLookupBatch()
+        : MetaRequest(META_LOOKUP_BATCH, false),
+          numEntries(0),
+          contentLength(0),
+          contentBuf(0),
+          contentBufPos(0),
+          entries(),
+          resp()
+        {}
+    virtual ~MetaLookupBatch()
+        { delete [] contentBuf; }
+    virtual void handle();
+    virtual bool IsSharedReadOnly() const;
+    virtual bool dispatch(ClientSM& sm);
+    virtual int log(ostream& /* file */) const { return 0; }
+    virtual void response(ostream& os, IOBuffer& buf);
+    virtual ostream& ShowSelf(ostream& os) const
+    {
+        return os <<
+            "lookup batch:"
+            " entries: " << numEntries <<
+            " length: "  << contentLength
+        ;
+    }
+    bool Validate()
+    {
+        return (0 < numEntries && numEntries <= MAX_LOOKUP_BATCH_ENTRIES &&
+            0 < contentLength &&
+            contentLength <= MAX_LOOKUP_BATCH_CONTENT_LENGTH);
+    }
+    int Read(IOBuffer& iobuf);
+    template<typename T> static T& ParserDef(T& parser)
+    {
+        return MetaRequest::ParserDef(parser)
+        .Def("Num-entries",    &MetaLookupBatch::numEntries,    int(0))
+        .Def("Content-length", &MetaLookupBatch::contentLength, int(0))
+        ;
+    }
+private:
+    void ParseContent();
+};
+
 /*!
  * \brief create a file
  */
@@ -636,6 +774,55 @@ struct MetaRmdir: public MetaRequest {
     }
 };
 
+/*!
+ * \brief remove directory with all its content. The directory is atomically
+ * moved into the dumpster, and its content is removed incrementally by
+ * dumpster reclaim.
+ */
+struct MetaRmdirs: public MetaRequest {
+    fid_t   dir;        //!< parent directory fid
+    string  name;       //!< name to remove
+    string  pathname;   //!< full pathname to remove
+    fid_t   todumpster; //!< moved to dumpster
+    int64_t mtime;
+    RmdirsCheck* check; //!< incremental sub tree permission check state
+    MetaRmdirs()
+        : MetaRequest(META_RMDIRS, true),
+          dir(-1),
+          name(),
+          pathname(),
+          todumpster(-1),
+          mtime(),
+          check(0)
+        {}
+    ~MetaRmdirs();
+    virtual void handle();
+    virtual int log(ostream &file) const;
+    virtual void response(ostream &os);
+    virtual ostream& ShowSelf(ostream& os) const
+    {
+        return os <<
+            "rmdirs:"
+            " path: "       << pathname <<
+            " name: "       << name <<
+            " parent: "     << dir <<
+            " todumpster: " << todumpster
+        ;
+    }
+    bool Validate()
+    {
+        return (dir >= 0 && ! name.empty());
+    }
+    template<typename T> static T& ParserDef(T& parser)
+    {
+        return MetaRequest::ParserDef(parser)
+        .Def("Parent File-handle", &MetaRmdirs::dir, fid_t(-1))
+        .Def("Directory",          &MetaRmdirs::name          )
+        .Def("Pathname",           &MetaRmdirs::pathname      )
+        ;
+    }
+};
+
 /*!
  * \brief read directory contents
  */
@@ -654,6 +841,7 @@ struct MetaReaddir: public MetaRequest {
           fnameStart()
         {}
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual int log(ostream& file) const;
     virtual void response(ostream& os, IOBuffer& buf);
     virtual ostream& ShowSelf(ostream& os) const
@@ -722,6 +910,10 @@ struct MetaReaddirPlus: public MetaRequest {
             : MFattr(fa),
               name(n)
             {}
+        DEntry(const MFattr& fa, const char* n, size_t len)
+            : MFattr(fa),
+              name(n, len)
+            {}
         string name;
     };
     typedef vector<DEntry,          StdAllocator<DEntry>          > DEntries;
@@ -730,11 +922,14 @@ struct MetaReaddirPlus: public MetaRequest {
     fid_t    dir;        //!< directory to read
     int      numEntries; //!< max number of entres to return
     int      maxRespSize;
+    int      respSizeLimit; //!< client response size limit, if > 0
     bool     getLastChunkInfoOnlyIfSizeUnknown;
     bool     omitLastChunkInfoFlag;
     bool     fileIdAndTypeOnlyFlag;
     bool     hasMoreEntriesFlag;
     bool     noAttrsFlag;
+    bool     approxFileSizeFlag; //!< estimate unknown sizes, omit last chunk
+    bool     resumeFlag; //!< resume past fname start if it was removed
     int64_t  ioBufPending;
     string   fnameStart;
     DEntries dentries;
@@ -745,11 +940,14 @@ struct MetaReaddirPlus: public MetaRequest {
           dir(-1),
           numEntries(-1),
           maxRespSize(-1),
+          respSizeLimit(0),
           getLastChunkInfoOnlyIfSizeUnknown(false),
           omitLastChunkInfoFlag(false),
           fileIdAndTypeOnlyFlag(false),
           hasMoreEntriesFlag(false),
           noAttrsFlag(false),
+          approxFileSizeFlag(false),
+          resumeFlag(false),
           ioBufPending(0),
           fnameStart(),
           dentries(),
@@ -757,6 +955,7 @@ struct MetaReaddirPlus: public MetaRequest {
         {}
     ~MetaReaddirPlus();
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual int log(ostream &file) const;
     virtual void response(ostream& os, IOBuffer& buf);
     virtual ostream& ShowSelf(ostream& os) const
@@ -779,6 +978,10 @@ struct MetaReaddirPlus: public MetaRequest {
             &MetaReaddirPlus::omitLastChunkInfoFlag, false)
         .Def("FidT-only",
             &MetaReaddirPlus::fileIdAndTypeOnlyFlag, false)
+        .Def("Approx-size",
+            &MetaReaddirPlus::approxFileSizeFlag, false)
+        .Def("Fname-resume",          &MetaReaddirPlus::resumeFlag,  false)
+        .Def("Max-resp-size",         &MetaReaddirPlus::respSizeLimit, 0)
         ;
     }
 };
@@ -807,6 +1010,7 @@ struct MetaGetalloc: public MetaRequest {
           replicasOrderedFlag(false)
         {}
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual int log(ostream &file) const;
     virtual void response(ostream &os);
     virtual ostream& ShowSelf(ostream& os) const
@@ -861,6 +1065,7 @@ struct MetaGetlayout: public MetaRequest {
           resp()
         {}
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual int log(ostream &file) const;
     virtual void response(ostream &os, IOBuffer& buf);
     virtual ostream& ShowSelf(ostream& os) const
@@ -1410,12 +1615,16 @@ struct MetaHello : public MetaRequest, public ServerLocation {
     ChunkInfos         chunks;                   //!< Chunks  hosted on this server
     ChunkInfos         notStableChunks;
     ChunkInfos         notStableAppendChunks;
+    ChunkInfos         deletedChunks;            //!< Chunks deleted since the last hello, with incremental hello
+    int                numDeletedChunks;
     int                bytesReceived;
     bool               staleChunksHexFormatFlag;
     bool               deleteAllChunksFlag;
     int64_t            fileSystemId;
     int64_t            metaFileSystemId;
     bool               noFidsFlag;
+    int64_t            inventoryGeneration;      //!< If positive, the stable chunk list only has chunks changed since the last hello
+    int64_t            newInventoryGeneration;
 
     MetaHello()
         : MetaRequest(META_HELLO, false),
@@ -1442,12 +1651,16 @@ struct MetaHello : public MetaRequest, public ServerLocation {
           chunks(),
           notStableChunks(),
           notStableAppendChunks(),
+          deletedChunks(),
+          numDeletedChunks(0),
           bytesReceived(0),
           staleChunksHexFormatFlag(false),
           deleteAllChunksFlag(false),
           fileSystemId(-1),
           metaFileSystemId(-1),
-          noFidsFlag(false)
+          noFidsFlag(false),
+          inventoryGeneration(0),
+          newInventoryGeneration(0)
         {}
     virtual void handle();
     virtual int log(ostream &file) const;
@@ -1484,6 +1697,8 @@ struct MetaHello : public MetaRequest, public ServerLocation {
         .Def("CKey",                         &MetaHello::cryptoKey)
         .Def("FsId",                         &MetaHello::fileSystemId,        int64_t(-1))
         .Def("NoFids",                       &MetaHello::noFidsFlag,                false)
+        .Def("Num-deleted-chunks",           &MetaHello::numDeletedChunks,         int(0))
+        .Def("Inventory-generation",         &MetaHello::inventoryGeneration,  int64_t(0))
         ;
     }
 };
@@ -1517,6 +1732,7 @@ struct MetaGetPathName: public MetaRequest {
           result()
         {}
     virtual void handle();
+    virtual bool IsSharedReadOnly() const;
     virtual void response(ostream &os);
     virtual int log(ostream& /* file */) const { return 0; }
     virtual ostream& ShowSelf(ostream& os) const
@@ -2235,10 +2451,12 @@ struct MetaRecomputeDirsize: public MetaRequest {
 struct MetaDumpChunkToServerMap: public MetaRequest {
     string chunkmapFile; //!< file to which the chunk map was written to
     int    pid;
+    bool   inProcessRunningFlag;
     MetaDumpChunkToServerMap()
         : MetaRequest(META_DUMP_CHUNKTOSERVERMAP, false),
           chunkmapFile(),
-          pid(-1)
+          pid(-1),
+          inProcessRunningFlag(false)
         {}
     virtual void handle();
     virtual int log(ostream &file) const;
@@ -2326,8 +2544,11 @@ struct MetaFsck: public MetaRequest {
           reportAbandonedFilesFlag(true),
           pid(-1),
           fd(),
-          resp()
+          resp(),
+          inProcessRunningFlag(false)
         {}
+    virtual ~MetaFsck()
+        { CloseFds(); }
     virtual void handle();
     virtual int log(ostream &file) const;
     virtual void response(ostream &os, IOBuffer& buf);
@@ -2353,8 +2574,12 @@ private:
     int           pid;
     Fds           fd;
     IOBuffer      resp;
+    bool          inProcessRunningFlag;
     static string sTmpName;
     static int    sMaxFsckResponseSize;
+
+    int CreateTmpFiles(int cnt, vector<string>& names);
+    void CloseFds();
 };
 
 /*!
@@ -2499,8 +2724,10 @@ private:
 };
 
 struct MetaGetRequestCounters : public MetaRequest {
+    bool latencyHistogramsFlag;
     MetaGetRequestCounters()
         : MetaRequest(META_GET_REQUEST_COUNTERS, false),
+          latencyHistogramsFlag(false),
           resp(),
           userCpuMicroSec(0),
           systemCpuMicroSec(0)
@@ -2513,7 +2740,8 @@ struct MetaGetRequestCounters : public MetaRequest {
     virtual void response(ostream &os, IOBuffer& buf);
     virtual ostream& ShowSelf(ostream& os) const
     {
-        return os << "get request counters ";
+        return os << "get request counters " <<
+            (latencyHistogramsFlag ? "latency histograms" : "");
     }
     bool Validate()
     {
@@ -2522,6 +2750,7 @@ struct MetaGetRequestCounters : public MetaRequest {
     template<typename T> static T& ParserDef(T& parser)
     {
         return MetaRequest::ParserDef(parser)
+        .Def("Latency-histograms", &MetaGetRequestCounters::latencyHistogramsFlag)
         ;
     }
 private:
@@ -2542,6 +2771,9 @@ struct MetaCheckpoint : public MetaRequest {
           checkpointWriteTimeoutSec(60 * 60),
           checkpointWriteSyncFlag(true),
           checkpointWriteBufferSize(16 << 20),
+          inProcessFlag(false),
+          inProcessRunningFlag(false),
+          inProcessSliceTimeUsec(5000),
           lastCheckpointId(-1),
           runningCheckpointId(-1),
           lastRun(0)
@@ -2567,6 +2799,9 @@ private:
     int    checkpointWriteTimeoutSec;
     bool   checkpointWriteSyncFlag;
     size_t checkpointWriteBufferSize;
+    bool   inProcessFlag;
+    bool   inProcessRunningFlag;
+    int64_t inProcessSliceTimeUsec;
     seq_t  lastCheckpointId;
     seq_t  runningCheckpointId;
     time_t lastRun;
@@ -3103,6 +3338,23 @@ struct MetaLeaseCleanup: public MetaRequest {
     }
 };
 
+/*!
+ * \brief An internally generated op to incrementally remove directories
+ * moved into the dumpster by rmdirs thru the main event processing loop.
+ */
+struct MetaDumpsterReclaim: public MetaRequest {
+    MetaDumpsterReclaim(seq_t s, KfsCallbackObj *c)
+        : MetaRequest(META_DUMPSTER_RECLAIM, false, s)
+            { clnt = c; }
+
+    virtual void handle();
+    virtual int log(ostream& /* file */) const { return 0; }
+    virtual ostream& ShowSelf(ostream& os) const
+    {
+        return os << "dumpster reclaim";
+    }
+};
+
 /*!
  * \brief An internally generated op to check that the degree
  * of replication for each chunk is satisfactory.  This op goes
@@ -12,10 +12,13 @@ static const MetaRequestHandler& MakeMetaRequestHandler()
     return sHandler
     .MakeParser<MetaLookup               >("LOOKUP")
     .MakeParser<MetaLookupPath           >("LOOKUP_PATH")
+    .MakeParser<MetaLookupBatch          >("LOOKUP_BATCH")
+    .MakeParser<MetaGetContentSummary    >("GET_CONTENT_SUMMARY")
     .MakeParser<MetaCreate               >("CREATE")
     .MakeParser<MetaMkdir                >("MKDIR")
     .MakeParser<MetaRemove               >("REMOVE")
     .MakeParser<MetaRmdir                >("RMDIR")
+    .MakeParser<MetaRmdirs               >("RMDIRS")
     .MakeParser<MetaReaddir              >("READDIR")
     .MakeParser<MetaReaddirPlus          >("READDIRPLUS")
     .MakeParser<MetaGetalloc             >("GETALLOC")
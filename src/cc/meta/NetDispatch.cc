@@ -44,6 +44,7 @@
 #include "common/time.h"
 #include "common/rusage.h"
 #include "common/StdAllocator.h"
+#include "common/kfsatomic.h"
 #include "qcdio/QCThread.h"
 #include "qcdio/QCUtils.h"
 #include "qcdio/qcstutils.h"
@@ -52,11 +53,21 @@
 #include <algorithm>
 #include <vector>
 #include <set>
+#include <map>
+#include <deque>
+#include <sstream>
+#include <limits>
 
 namespace KFS
 {
 using std::max;
+using std::min;
 using std::vector;
+using std::map;
+using std::deque;
+using std::istream;
+using std::istringstream;
+using std::numeric_limits;
 
 using KFS::libkfsio::globalNetManager;
 using KFS::libkfsio::globals;
@@ -583,6 +594,8 @@ private:
         AddCounter("Get layout", META_GETLAYOUT);
         AddCounter("Lookup", META_LOOKUP);
         AddCounter("Lookup Path", META_LOOKUP_PATH);
+        AddCounter("Lookup Batch", META_LOOKUP_BATCH);
+        AddCounter("Get Content Summary", META_GET_CONTENT_SUMMARY);
         AddCounter("Allocate", META_ALLOCATE);
         AddCounter("Truncate", META_TRUNCATE);
         AddCounter("Create", META_CREATE);
@@ -591,6 +604,7 @@ private:
         AddCounter("Set Mtime", META_SETMTIME);
         AddCounter("Mkdir", META_MKDIR);
         AddCounter("Rmdir", META_RMDIR);
+        AddCounter("Rmdirs", META_RMDIRS);
         AddCounter("Change File Replication", META_CHANGE_FILE_REPLICATION);
         AddCounter("Lease Acquire", META_LEASE_ACQUIRE);
         AddCounter("Lease Renew", META_LEASE_RENEW);
@@ -610,6 +624,111 @@ private:
     }
 }* MetaOpCounters::sInstance(MetaOpCounters::MakeInstance());
 
+// Fixed bucket log-linear latency histogram: each power of two interval is
+// split into kSubBuckets buckets, with relative error < 1 / kSubBuckets.
+// Updates are lock free, and can be performed by any thread.
+class LatencyHistogram
+{
+public:
+    enum
+    {
+        kSubBucketBits = 2,
+        kSubBuckets    = 1 << kSubBucketBits,
+        kMaxValueBits  = 36, // ~19 hours in microseconds
+        kBucketCount   = (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets
+    };
+    LatencyHistogram()
+        : mCount(0),
+          mTotal(0)
+    {
+        for (int i = 0; i < kBucketCount; i++) {
+            mBuckets[i] = 0;
+        }
+    }
+    void Update(
+        int64_t inTimeUsec)
+    {
+        const int64_t theTime = max(int64_t(0), inTimeUsec);
+        SyncAddAndFetch(mBuckets[GetBucketIdx(theTime)], int64_t(1));
+        SyncAddAndFetch(mCount, int64_t(1));
+        SyncAddAndFetch(mTotal, theTime);
+    }
+    int64_t GetCount() const
+        { return mCount; }
+    int64_t GetTotal() const
+        { return mTotal; }
+    int64_t GetBucket(
+        int inIdx) const
+        { return mBuckets[inIdx]; }
+    // Return bucket upper bound of the specified percentile.
+    int64_t GetPercentile(
+        double inPercentile) const
+    {
+        const int64_t theCount = mCount;
+        if (theCount <= 0) {
+            return 0;
+        }
+        const int64_t theRank = max(int64_t(1),
+            (int64_t)(theCount * inPercentile / 100. + .5));
+        int64_t theSum = 0;
+        for (int i = 0; i < kBucketCount; i++) {
+            if (theRank <= (theSum += mBuckets[i])) {
+                return GetBucketUpperBound(i);
+            }
+        }
+        return GetBucketUpperBound(kBucketCount - 1);
+    }
+    int64_t GetMax() const
+    {
+        for (int i = kBucketCount - 1; i >= 0; i--) {
+            if (0 < mBuckets[i]) {
+                return GetBucketUpperBound(i);
+            }
+        }
+        return 0;
+    }
+    static int GetBucketIdx(
+        int64_t inTimeUsec)
+    {
+        if (inTimeUsec < kSubBuckets) {
+            return (int)inTimeUsec;
+        }
+        if ((int64_t(1) << kMaxValueBits) <= inTimeUsec) {
+            return kBucketCount - 1;
+        }
+        int theMsb = kSubBucketBits;
+        while ((inTimeUsec >> (theMsb + 1)) != 0) {
+            theMsb++;
+        }
+        return ((theMsb - kSubBucketBits + 1) * kSubBuckets +
+            (int)((inTimeUsec >> (theMsb - kSubBucketBits)) &
+                (kSubBuckets - 1)));
+    }
+    static int64_t GetBucketLowerBound(
+        int inIdx)
+    {
+        if (inIdx < kSubBuckets) {
+            return inIdx;
+        }
+        const int theShift = inIdx / kSubBuckets - 1;
+        return ((int64_t)(kSubBuckets + inIdx % kSubBuckets) << theShift);
+    }
+    static int64_t GetBucketUpperBound(
+        int inIdx)
+    {
+        return (inIdx + 1 < kBucketCount ?
+            GetBucketLowerBound(inIdx + 1) - 1 :
+            numeric_limits<int64_t>::max());
+    }
+private:
+    volatile int64_t mCount;
+    volatile int64_t mTotal;
+    volatile int64_t mBuckets[kBucketCount];
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+};
+
 static class RequestStatsGatherer
 {
 public:
@@ -628,6 +747,14 @@ public:
         const int64_t reqTimeUsec     = timeNowUsec - op.submitTime;
         const int64_t reqProcTimeUsec = timeNowUsec - op.processTime;
         MetaOpCounters::Update(op.op, reqProcTimeUsec);
+        const int idx = GetReqIdx(op);
+        if (0 < op.recvTime) {
+            UpdateHistogram(idx, kPhaseWait, op.submitTime - op.recvTime);
+        }
+        UpdateHistogram(idx, kPhaseHandle, op.handleTime);
+        if (0 < op.logTime) {
+            UpdateHistogram(idx, kPhaseLog, timeNowUsec - op.logTime);
+        }
         if (reqProcTimeUsec > mOpTimeWarningThresholdMicroSec) {
             KFS_LOG_STREAM_INFO <<
                 "Time spent processing: " << op.Show() <<
@@ -636,12 +763,6 @@ public:
                 " was submitted: " << op.submitCount <<
             KFS_LOG_EOM;
         }
-        const int idx =
-            ((op.op < 0 || op.op >= META_NUM_OPS_COUNT) ?
-                (int)kOtherReqId :
-            ((op.op == META_ALLOCATE &&
-                ! static_cast<const MetaAllocate&>(op).logFlag) ?
-                (int)kReqTypeAllocNoLog : (int)op.op + 1));
         const int64_t reqTime     = reqTimeUsec > 0 ? reqTimeUsec : 0;
         const int64_t reqProcTime =
             reqProcTimeUsec > 0 ? reqProcTimeUsec : 0;
@@ -745,6 +866,55 @@ public:
         GetStatsCsv(mWOStream.Set(buf));
         mWOStream.Reset();
     }
+    void ResponseDone(
+        const MetaRequest& op)
+    {
+        if (0 < op.doneTime) {
+            UpdateHistogram(GetReqIdx(op), kPhaseSend,
+                microseconds() - op.doneTime);
+        }
+    }
+    void GetLatencyHistogramsCsv(
+        ostream& os)
+    {
+        // Times are in microseconds, percentiles and buckets columns are
+        // bucket upper bounds.
+        const char* kDelim = ",";
+        os << "Name,Phase,Count,Time-total,P50,P90,P99,P99.9,Max";
+        for (int i = 0; i < LatencyHistogram::kBucketCount; i++) {
+            os << kDelim << "Le-" << LatencyHistogram::GetBucketUpperBound(i);
+        }
+        os << "\n";
+        for (int i = 0; i < kHistogramReqTypesCnt; i++) {
+            for (int k = 0; k < kPhaseCount; k++) {
+                const LatencyHistogram& histogram = mHistograms[i][k];
+                if (histogram.GetCount() <= 0) {
+                    continue;
+                }
+                os <<
+                    GetRowName(i) <<
+                    kDelim << GetPhaseName(k) <<
+                    kDelim << histogram.GetCount() <<
+                    kDelim << histogram.GetTotal() <<
+                    kDelim << histogram.GetPercentile(50) <<
+                    kDelim << histogram.GetPercentile(90) <<
+                    kDelim << histogram.GetPercentile(99) <<
+                    kDelim << histogram.GetPercentile(99.9) <<
+                    kDelim << histogram.GetMax()
+                ;
+                for (int b = 0; b < LatencyHistogram::kBucketCount; b++) {
+                    os << kDelim << histogram.GetBucket(b);
+                }
+                os << "\n";
+            }
+        }
+    }
+    void GetLatencyHistogramsCsv(
+        IOBuffer& buf)
+    {
+        GetLatencyHistogramsCsv(mWOStream.Set(buf));
+        mWOStream.Reset();
+    }
     int64_t GetUserCpuMicroSec() const
         { return mUserCpuMicroSec; }
     int64_t GetSystemCpuMicroSec() const
@@ -758,6 +928,20 @@ private:
         kCpuSys            = kCpuUser + 1,
         kReqTypesCnt       = kCpuSys + 1
     };
+    enum
+    {
+        kHistogramReqTypesCnt = kReqTypeAllocNoLog + 1
+    };
+    // Request latency phases: wait in the queue prior to handle(), handle(),
+    // log commit, and response dispatch to the client connection.
+    enum
+    {
+        kPhaseWait   = 0,
+        kPhaseHandle = 1,
+        kPhaseLog    = 2,
+        kPhaseSend   = 3,
+        kPhaseCount  = 4
+    };
     struct Counter {
         Counter()
             : mCnt(0),
@@ -776,8 +960,39 @@ private:
     int64_t            mUserCpuMicroSec;
     int64_t            mSystemCpuMicroSec;
     Counter            mRequest[kReqTypesCnt];
+    LatencyHistogram   mHistograms[kHistogramReqTypesCnt][kPhaseCount];
     IOBuffer::WOStream mWOStream;
 
+    static int GetReqIdx(
+        const MetaRequest& op)
+    {
+        return ((op.op < 0 || op.op >= META_NUM_OPS_COUNT) ?
+                (int)kOtherReqId :
+            ((op.op == META_ALLOCATE &&
+                ! static_cast<const MetaAllocate&>(op).logFlag) ?
+                (int)kReqTypeAllocNoLog : (int)op.op + 1));
+    }
+    void UpdateHistogram(
+        int     idx,
+        int     phase,
+        int64_t timeUsec)
+    {
+        mHistograms[0  ][phase].Update(timeUsec);
+        mHistograms[idx][phase].Update(timeUsec);
+    }
+    static const char* GetPhaseName(
+        int phase)
+    {
+        static const char* const kNames[kPhaseCount] =
+        {
+            "WAIT",
+            "HANDLE",
+            "LOG",
+            "SEND"
+        };
+        return ((phase < 0 || phase >= kPhaseCount) ? "" : kNames[phase]);
+    }
+
     static const char* GetRowName(
         int idx)
     {
@@ -796,6 +1011,387 @@ private:
     }
 } sReqStatsGatherer;
 
+// Fair share client request admission control. Client requests are queued
+// per principal: authenticated user id, or client ip address for connections
+// without authentication. Each client thread dispatches its queues in deficit
+// round robin order, with principal's weight as the quantum, and no more than
+// max batch size requests per dispatch, in order to bound the dispatch mutex
+// hold time, and let the main thread and other client threads to proceed.
+// The optional per principal token bucket rate limit defers the requests
+// exceeding the limit to the subsequent dispatch(es).
+// The principal table, and the queue instances are accessed with the dispatch
+// mutex held.
+static class ClientScheduler
+{
+public:
+    class Principal
+    {
+    public:
+        Principal()
+            : mWeight(1),
+              mRate(0),
+              mBurst(0),
+              mTokens(0),
+              mRefillTime(0),
+              mLastUseTime(0),
+              mParamsUpdateCount(0),
+              mQueuedCount(0),
+              mMaxQueuedCount(0),
+              mDispatchedCount(0),
+              mThrottledCount(0),
+              mTotalWaitUsec(0),
+              mMaxWaitUsec(0)
+            {}
+        bool Admit(int64_t now)
+        {
+            if (mRate <= 0) {
+                return true;
+            }
+            if (mTokens < 1) {
+                mTokens = min(mBurst,
+                    mTokens + (now - mRefillTime) * mRate * 1e-6);
+                mRefillTime = now;
+                if (mTokens < 1) {
+                    mThrottledCount++;
+                    return false;
+                }
+            }
+            mTokens -= 1;
+            return true;
+        }
+        // Returns the time when the next token becomes available.
+        int64_t GetAdmitTime() const
+        {
+            if (mRate <= 0 || 1 <= mTokens) {
+                return mRefillTime;
+            }
+            return (mRefillTime + (int64_t)((1 - mTokens) * 1e6 / mRate) + 1);
+        }
+        void Queued(int64_t now)
+        {
+            mLastUseTime = now;
+            if (mMaxQueuedCount < ++mQueuedCount) {
+                mMaxQueuedCount = mQueuedCount;
+            }
+        }
+        void Dispatched(const MetaRequest& op, int64_t now)
+        {
+            assert(0 < mQueuedCount);
+            mQueuedCount--;
+            mDispatchedCount++;
+            mLastUseTime = now;
+            if (op.recvTime <= 0) {
+                return;
+            }
+            const int64_t wait = max(int64_t(0), now - op.recvTime);
+            mTotalWaitUsec += wait;
+            if (mMaxWaitUsec < wait) {
+                mMaxWaitUsec = wait;
+            }
+        }
+        int GetWeight() const
+            { return mWeight; }
+    private:
+        int      mWeight;
+        double   mRate;
+        double   mBurst;
+        double   mTokens;
+        int64_t  mRefillTime;
+        int64_t  mLastUseTime;
+        uint64_t mParamsUpdateCount;
+        int64_t  mQueuedCount;
+        int64_t  mMaxQueuedCount;
+        int64_t  mDispatchedCount;
+        int64_t  mThrottledCount;
+        int64_t  mTotalWaitUsec;
+        int64_t  mMaxWaitUsec;
+        friend class ClientScheduler;
+    };
+    class Queue
+    {
+    public:
+        Queue()
+            : mFlows(),
+              mActive()
+            {}
+        ~Queue()
+            { assert(mActive.empty()); }
+        bool IsEmpty() const
+            { return mActive.empty(); }
+        void Add(ClientScheduler& scheduler, MetaRequest* head, int64_t now)
+        {
+            while (head) {
+                MetaRequest& op = *head;
+                head = op.next;
+                op.next = 0;
+                Principal& principal = scheduler.Get(op, now);
+                principal.Queued(now);
+                Flow& flow = mFlows[&principal];
+                if (flow.mTail) {
+                    flow.mTail->next = &op;
+                } else {
+                    flow.mHead      = &op;
+                    flow.mPrincipal = &principal;
+                    mActive.push_back(&flow);
+                }
+                flow.mTail = &op;
+            }
+        }
+        // Returns the list of the requests to dispatch. The "more" flag is
+        // set if the max batch size limit was reached, and more requests can
+        // be dispatched without waiting for the rate limit. Otherwise the
+        // next time is set to the earliest time when the rate limit admits
+        // a queued request, or to -1 if no requests are deferred.
+        MetaRequest* Next(int maxBatchSize, bool drainFlag, int64_t now,
+            bool& moreFlag, int64_t& nextTime)
+        {
+            MetaRequest* head   = 0;
+            MetaRequest* tail   = 0;
+            int          count  = 0;
+            size_t       noProg = 0;
+            moreFlag = false;
+            nextTime = -1;
+            while (! mActive.empty() && noProg < mActive.size()) {
+                if (! drainFlag && maxBatchSize <= count) {
+                    moreFlag = true;
+                    break;
+                }
+                Flow&      flow      = *mActive.front();
+                Principal& principal = *flow.mPrincipal;
+                if (flow.mDeficit <= 0) {
+                    flow.mDeficit += principal.GetWeight();
+                }
+                bool progressFlag = false;
+                while (flow.mHead && (drainFlag ||
+                        (0 < flow.mDeficit && count < maxBatchSize &&
+                        principal.Admit(now)))) {
+                    MetaRequest& op = *flow.mHead;
+                    if (! (flow.mHead = op.next)) {
+                        flow.mTail = 0;
+                    }
+                    op.next = 0;
+                    if (tail) {
+                        tail->next = &op;
+                    } else {
+                        head = &op;
+                    }
+                    tail = &op;
+                    flow.mDeficit--;
+                    count++;
+                    progressFlag = true;
+                    principal.Dispatched(op, now);
+                }
+                noProg = progressFlag ? 0 : noProg + 1;
+                if (flow.mHead && 0 < flow.mDeficit && count < maxBatchSize) {
+                    // Deferred by the rate limit.
+                    const int64_t admitTime = principal.GetAdmitTime();
+                    if (nextTime < 0 || admitTime < nextTime) {
+                        nextTime = admitTime;
+                    }
+                }
+                mActive.pop_front();
+                if (flow.mHead) {
+                    if (0 < flow.mDeficit && count >= maxBatchSize) {
+                        // Resume with the remaining quantum.
+                        mActive.push_front(&flow);
+                    } else {
+                        mActive.push_back(&flow);
+                    }
+                } else {
+                    mFlows.erase(&principal);
+                }
+            }
+            return head;
+        }
+    private:
+        struct Flow
+        {
+            Flow()
+                : mPrincipal(0),
+                  mHead(0),
+                  mTail(0),
+                  mDeficit(0)
+                {}
+            Principal*   mPrincipal;
+            MetaRequest* mHead;
+            MetaRequest* mTail;
+            int          mDeficit;
+        };
+        typedef map<const Principal*, Flow> Flows;
+        typedef deque<Flow*>                Active;
+
+        Flows  mFlows;
+        Active mActive;
+    private:
+        Queue(const Queue&);
+        Queue& operator=(const Queue&);
+    };
+
+    ClientScheduler()
+        : mEnabledFlag(false),
+          mMaxBatchSize(256),
+          mDefaultWeight(1),
+          mDefaultRate(0),
+          mBurstSec(1),
+          mIdleTimeUsec(int64_t(300) * 1000 * 1000),
+          mUserWeights(),
+          mUserRates(),
+          mParamsUpdateCount(1),
+          mNextCleanupTime(0),
+          mPrincipals()
+        {}
+    void SetParameters(const Properties& props)
+    {
+        mEnabledFlag = props.getValue(
+            "metaServer.clientScheduler.enabled",
+            mEnabledFlag ? 1 : 0) != 0;
+        mMaxBatchSize = max(1, props.getValue(
+            "metaServer.clientScheduler.maxBatchSize",
+            mMaxBatchSize));
+        mDefaultWeight = max(1, props.getValue(
+            "metaServer.clientScheduler.weight",
+            mDefaultWeight));
+        mDefaultRate = max(0., props.getValue(
+            "metaServer.clientScheduler.maxOpsPerSec",
+            mDefaultRate));
+        mBurstSec = max(1e-3, props.getValue(
+            "metaServer.clientScheduler.burstSec",
+            mBurstSec));
+        mIdleTimeUsec = max(int64_t(1), props.getValue(
+            "metaServer.clientScheduler.principalIdleTimeSec",
+            mIdleTimeUsec / (1000 * 1000))) * 1000 * 1000;
+        mUserWeights.clear();
+        {
+            istringstream is(props.getValue(
+                "metaServer.clientScheduler.userWeights", ""));
+            Load(is, mUserWeights);
+        }
+        mUserRates.clear();
+        {
+            istringstream is(props.getValue(
+                "metaServer.clientScheduler.userMaxOpsPerSec", ""));
+            Load(is, mUserRates);
+        }
+        mParamsUpdateCount++;
+    }
+    bool IsEnabled() const
+        { return mEnabledFlag; }
+    int GetMaxBatchSize() const
+        { return mMaxBatchSize; }
+    Principal& Get(const MetaRequest& op, int64_t now)
+    {
+        Key key;
+        key.mUid = op.authUid;
+        if (key.mUid == kKfsUserNone) {
+            key.mIp = op.clientIp;
+        }
+        Principal& principal = mPrincipals[key];
+        if (principal.mParamsUpdateCount != mParamsUpdateCount) {
+            principal.mParamsUpdateCount = mParamsUpdateCount;
+            principal.mWeight = max(1, (int)Find(
+                mUserWeights, key.mUid, mDefaultWeight));
+            principal.mRate   = Find(mUserRates, key.mUid, mDefaultRate);
+            principal.mBurst  = max(1., principal.mRate * mBurstSec);
+            if (principal.mRefillTime <= 0) {
+                principal.mTokens     = principal.mBurst;
+                principal.mRefillTime = now;
+            }
+            principal.mTokens = min(principal.mTokens, principal.mBurst);
+        }
+        return principal;
+    }
+    void Cleanup(int64_t now)
+    {
+        if (now < mNextCleanupTime) {
+            return;
+        }
+        mNextCleanupTime = now + min(mIdleTimeUsec, int64_t(10) * 1000 * 1000);
+        const int64_t minTime = now - mIdleTimeUsec;
+        for (Principals::iterator it = mPrincipals.begin();
+                it != mPrincipals.end(); ) {
+            if (it->second.mQueuedCount <= 0 &&
+                    it->second.mLastUseTime < minTime) {
+                mPrincipals.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+    void Show(ostream& os) const
+    {
+        // queue depth, max queue depth, dispatched, throttled,
+        // average and max queue wait time in seconds.
+        for (Principals::const_iterator it = mPrincipals.begin();
+                it != mPrincipals.end();
+                ++it) {
+            const Principal& p = it->second;
+            os << "Client scheduler ";
+            if (it->first.mUid == kKfsUserNone) {
+                os << "ip " << it->first.mIp;
+            } else {
+                os << "uid " << it->first.mUid;
+            }
+            os << ": " <<
+                p.mQueuedCount     << "," <<
+                p.mMaxQueuedCount  << "," <<
+                p.mDispatchedCount << "," <<
+                p.mThrottledCount  << "," <<
+                (p.mDispatchedCount <= 0 ? 0. :
+                    p.mTotalWaitUsec * 1e-6 / p.mDispatchedCount) << "," <<
+                p.mMaxWaitUsec * 1e-6 <<
+            "\r\n";
+        }
+    }
+private:
+    struct Key
+    {
+        Key()
+            : mUid(kKfsUserNone),
+              mIp()
+            {}
+        bool operator<(const Key& rhs) const
+        {
+            return (mUid < rhs.mUid || (mUid == rhs.mUid && mIp < rhs.mIp));
+        }
+        kfsUid_t mUid;
+        string   mIp;
+    };
+    typedef map<Key, Principal> Principals;
+    typedef map<kfsUid_t, double> UserParams;
+
+    bool       mEnabledFlag;
+    int        mMaxBatchSize;
+    int        mDefaultWeight;
+    double     mDefaultRate;
+    double     mBurstSec;
+    int64_t    mIdleTimeUsec;
+    UserParams mUserWeights;
+    UserParams mUserRates;
+    uint64_t   mParamsUpdateCount;
+    int64_t    mNextCleanupTime;
+    Principals mPrincipals;
+
+    static void Load(istream& is, UserParams& params)
+    {
+        // White space separated list of user id and value pairs.
+        kfsUid_t uid = kKfsUserNone;
+        double   val = -1;
+        while ((is >> uid >> val)) {
+            if (uid != kKfsUserNone && 0 <= val) {
+                params[uid] = val;
+            }
+        }
+    }
+    static double Find(const UserParams& params, kfsUid_t uid, double def)
+    {
+        if (uid == kKfsUserNone) {
+            return def;
+        }
+        UserParams::const_iterator const it = params.find(uid);
+        return (it == params.end() ? def : it->second);
+    }
+} sClientScheduler;
+
 
 void NetDispatch::SetParameters(const Properties& props)
 {
@@ -821,6 +1417,7 @@ void NetDispatch::SetParameters(const Properties& props)
         globalNetManager().GetMaxAcceptsPerRead()));
 
     sReqStatsGatherer.SetParameters(props);
+    sClientScheduler.SetParameters(props);
     mClientManager.SetParameters(props);
 
     string errMsg;
@@ -844,6 +1441,21 @@ void NetDispatch::GetStatsCsv(IOBuffer& buf)
     sReqStatsGatherer.GetStatsCsv(buf);
 }
 
+void NetDispatch::GetLatencyHistogramsCsv(IOBuffer& buf)
+{
+    sReqStatsGatherer.GetLatencyHistogramsCsv(buf);
+}
+
+void NetDispatch::GetClientSchedulerStats(ostream& os)
+{
+    sClientScheduler.Show(os);
+}
+
+void NetDispatch::ResponseDone(const MetaRequest& r)
+{
+    sReqStatsGatherer.ResponseDone(r);
+}
+
 int64_t NetDispatch::GetUserCpuMicroSec() const
 {
     return sReqStatsGatherer.GetUserCpuMicroSec();
@@ -908,6 +1520,9 @@ NetDispatch::Dispatch(MetaRequest *r)
     // Reset count for requests like replication check, where the same
     // request reused.
     r->submitCount = 0;
+    r->handleTime  = 0;
+    r->logTime     = 0;
+    r->doneTime    = microseconds();
     // The Client will send out a response and destroy r.
     if (r->clnt) {
         r->clnt->HandleEvent(EVENT_CMD_DONE, r);
@@ -937,7 +1552,11 @@ public:
           mForkDoneCond(),
           mForkDoneCount(0),
           mPrepareToForkFlag(false),
-          mPrepareToForkCnt(0)
+          mPrepareToForkCnt(0),
+          mSharedDispatchDoneCond(),
+          mSharedDispatchCount(0),
+          mExclusiveDispatchWaitCount(0),
+          mSharedDispatchFlag(true)
         {};
     virtual ~Impl();
     bool Bind(const ServerLocation& location, bool ipV6OnlyFlag);
@@ -982,10 +1601,60 @@ public:
         // Resume threads after fork(s) completes and the lock gets released.
         mForkDoneCond.NotifyAll();
     }
+    // Read only requests are handled by the client threads with the dispatch
+    // mutex released. The shared dispatch count tracks such threads. All other
+    // request processing, including the main thread event loop, waits for the
+    // shared dispatch count to drop to 0 prior to proceeding. While exclusive
+    // dispatch is pending, the read only requests are handled with the mutex
+    // held in order to prevent exclusive dispatch starvation.
+    bool IsSharedDispatchEnabled() const
+        { return (mSharedDispatchFlag && gNetDispatch.GetMutex()); }
+    inline bool StartSharedDispatch()
+    {
+        QCMutex* const mutex = gNetDispatch.GetMutex();
+        if (! mutex) {
+            return false;
+        }
+        assert(mutex->IsOwned());
+        if (0 < mExclusiveDispatchWaitCount) {
+            return false;
+        }
+        mSharedDispatchCount++;
+        return true;
+    }
+    inline void SharedDispatchDone()
+    {
+        assert(gNetDispatch.GetMutex() &&
+            gNetDispatch.GetMutex()->IsOwned() &&
+            0 < mSharedDispatchCount);
+        if (--mSharedDispatchCount <= 0 && 0 < mExclusiveDispatchWaitCount) {
+            mSharedDispatchDoneCond.NotifyAll();
+        }
+    }
+    inline void StartExclusiveDispatch()
+    {
+        QCMutex* const mutex = gNetDispatch.GetMutex();
+        if (! mutex) {
+            return;
+        }
+        assert(mutex->IsOwned());
+        while (0 < mSharedDispatchCount) {
+            mExclusiveDispatchWaitCount++;
+            while (0 < mSharedDispatchCount) {
+                mSharedDispatchDoneCond.Wait(*mutex);
+            }
+            mExclusiveDispatchWaitCount--;
+            // The mutex was released, check for pending fork.
+            PrepareToFork();
+        }
+    }
     void SetParameters(const Properties& params)
     {
         mMaxClientCount = min(mMaxClientSocketCount, params.getValue(
             "metaServer.maxClientCount", mMaxClientCount));
+        mSharedDispatchFlag = params.getValue(
+            "metaServer.clientThreadSharedReadOnly",
+            mSharedDispatchFlag ? 1 : 0) != 0;
     }
     void SetMaxClientSockets(int count)
         { mMaxClientSocketCount = count; }
@@ -1006,6 +1675,10 @@ private:
     uint64_t                     mForkDoneCount;
     volatile bool                mPrepareToForkFlag;
     volatile int                 mPrepareToForkCnt;
+    QCCondVar                    mSharedDispatchDoneCond;
+    int                          mSharedDispatchCount;
+    int                          mExclusiveDispatchWaitCount;
+    bool                         mSharedDispatchFlag;
 };
 
 void
@@ -1050,10 +1723,59 @@ NetDispatch::ForkDone()
     mClientManager.ForkDone();
 }
 
+inline bool
+ClientManager::IsSharedDispatchEnabled() const
+{
+    return mImpl.IsSharedDispatchEnabled();
+}
+
+inline bool
+NetDispatch::IsSharedDispatchEnabled() const
+{
+    return mClientManager.IsSharedDispatchEnabled();
+}
+
+inline bool
+ClientManager::StartSharedDispatch()
+{
+    return mImpl.StartSharedDispatch();
+}
+
+inline bool
+NetDispatch::StartSharedDispatch()
+{
+    return mClientManager.StartSharedDispatch();
+}
+
+inline void
+ClientManager::SharedDispatchDone()
+{
+    mImpl.SharedDispatchDone();
+}
+
+inline void
+NetDispatch::SharedDispatchDone()
+{
+    mClientManager.SharedDispatchDone();
+}
+
+inline void
+ClientManager::StartExclusiveDispatch()
+{
+    mImpl.StartExclusiveDispatch();
+}
+
+inline void
+NetDispatch::StartExclusiveDispatch()
+{
+    mClientManager.StartExclusiveDispatch();
+}
+
 /* virtual */ void
 MainThreadPrepareToFork::DispatchStart()
 {
     mClientManager.PrepareToFork();
+    mClientManager.StartExclusiveDispatch();
 }
 
 /* virtual */ void
@@ -1093,6 +1815,7 @@ public:
           mCliTail(0),
           mReqPendingHead(0),
           mReqPendingTail(0),
+          mSchedulerQueue(),
           mFlushQueue(8 << 10),
           mAuthContext(),
           mAuthCtxUpdateCount(gLayoutManager.GetAuthCtxUpdateCount() - 1)
@@ -1154,13 +1877,60 @@ public:
             mAuthContext.SetUserAndGroup(gLayoutManager.GetUserAndGroup());
         }
         assert(! mReqPendingHead && ! mReqPendingTail);
-        // Dispatch requests.
+        if (sClientScheduler.IsEnabled() || ! mSchedulerQueue.IsEmpty()) {
+            // Drain the queue on shutdown, or if the scheduler was turned
+            // off.
+            const bool    drainFlag =
+                ! sClientScheduler.IsEnabled() || ! mNetManager.IsRunning();
+            const int64_t now       = microseconds();
+            bool          moreFlag  = false;
+            int64_t       nextTime  = -1;
+            mSchedulerQueue.Add(sClientScheduler, nextReq, now);
+            nextReq = mSchedulerQueue.Next(sClientScheduler.GetMaxBatchSize(),
+                drainFlag, now, moreFlag, nextTime);
+            sClientScheduler.Cleanup(now);
+            if (moreFlag) {
+                // Dispatch the remaining requests on the next event loop
+                // iteration, after releasing the dispatch mutex.
+                mNetManager.Wakeup();
+            } else if (0 <= nextTime) {
+                // Re-dispatch the requests deferred by the rate limit when
+                // the next token becomes available, instead of waiting for
+                // the net manager poll timeout.
+                mNetManager.SetNextPollTimeoutMs((int)min(int64_t(1000),
+                    (nextTime - now + 999) / 1000));
+            }
+        }
+        // Dispatch requests. Each run of consecutive read only requests is
+        // handled concurrently with other client threads, prior to the next
+        // request, in order to preserve the request execution order.
+        const bool   sharedFlag = gNetDispatch.IsSharedDispatchEnabled();
+        MetaRequest* sharedHead = 0;
+        MetaRequest* sharedTail = 0;
         while (nextReq) {
             MetaRequest& op = *nextReq;
             nextReq = op.next;
             op.next = 0;
+            if (sharedFlag && submit_request_shared_start(&op)) {
+                if (sharedTail) {
+                    sharedTail->next = &op;
+                } else {
+                    sharedHead = &op;
+                }
+                sharedTail = &op;
+                continue;
+            }
+            if (sharedHead) {
+                DispatchShared(sharedHead);
+                sharedHead = 0;
+                sharedTail = 0;
+            }
+            gNetDispatch.StartExclusiveDispatch();
             submit_request(&op);
         }
+        if (sharedHead) {
+            DispatchShared(sharedHead);
+        }
         gNetDispatch.ForkDone();
         dispatchLocker.Unlock();
 
@@ -1305,6 +2075,7 @@ private:
     ClientSM*          mCliTail;
     MetaRequest*       mReqPendingHead;
     MetaRequest*       mReqPendingTail;
+    ClientScheduler::Queue mSchedulerQueue;
     FlushQueue         mFlushQueue;
     AuthContext        mAuthContext;
     uint64_t           mAuthCtxUpdateCount;
@@ -1314,6 +2085,28 @@ private:
     {
         return static_cast<ClientSM*>(op.clnt)->GetConnection();
     }
+    void DispatchShared(MetaRequest* head)
+    {
+        if (gNetDispatch.StartSharedDispatch()) {
+            QCStMutexUnlocker dispatchUnlocker(gNetDispatch.GetMutex());
+            for (MetaRequest* op = head; op; op = op->next) {
+                submit_request_shared(op);
+            }
+            dispatchUnlocker.Lock();
+            gNetDispatch.SharedDispatchDone();
+            gNetDispatch.PrepareToFork();
+        } else {
+            for (MetaRequest* op = head; op; op = op->next) {
+                submit_request_shared(op);
+            }
+        }
+        while (head) {
+            MetaRequest& op = *head;
+            head = op.next;
+            op.next = 0;
+            submit_request_shared_done(&op);
+        }
+    }
 private:
     ClientThread(const ClientThread&);
     ClientThread& operator=(const ClientThread&);
@@ -62,6 +62,10 @@ public:
     void SetParameters(const Properties& props);
     void GetStatsCsv(ostream& os);
     void GetStatsCsv(IOBuffer& buf);
+    void GetLatencyHistogramsCsv(IOBuffer& buf);
+    void GetClientSchedulerStats(ostream& os);
+    //!< Response for the completed request was queued for transmission.
+    void ResponseDone(const MetaRequest& r);
     int64_t GetUserCpuMicroSec() const;
     int64_t GetSystemCpuMicroSec() const;
     QCMutex* GetMutex() const { return mMutex; }
@@ -72,6 +76,10 @@ public:
     void PrepareCurrentThreadToFork();
     inline void PrepareToFork();
     inline void ForkDone();
+    inline bool IsSharedDispatchEnabled() const;
+    inline bool StartSharedDispatch();
+    inline void SharedDispatchDone();
+    inline void StartExclusiveDispatch();
     bool CancelToken(const DelegationToken& token);
     bool CancelToken(
         int64_t inExpiration, int64_t inIssued, kfsUid_t inUid,
@@ -380,6 +380,31 @@ replay_rmdir(DETokenizer& c)
     return (ok && status == 0);
 }
 
+/*!
+ * \brief replay rmdirs
+ * format: rmdirs/dir/<parentID>/name/<name>/todumpster/<ID>
+ */
+static bool
+replay_rmdirs(DETokenizer& c)
+{
+    fid_t parent;
+    string myname;
+    int status = 0;
+    bool ok = pop_parent(parent, c);
+    ok = pop_name(myname, "name", c, ok);
+    fid_t todumpster = -1;
+    ok = pop_fid(todumpster, "todumpster", c, ok);
+    if (ok) {
+        int64_t mtime;
+        if (! pop_time(mtime, "mtime", c, ok)) {
+            mtime = sLogSegmentTimeUsec;
+        }
+        status = metatree.rmdirs(parent, myname, "", todumpster,
+            kKfsUserRoot, kKfsGroupRoot, mtime);
+    }
+    return (ok && status == 0);
+}
+
 /*!
  * \brief replay rename
  * format: rename/dir/<parentID>/old/<oldname>/new/<newpath>
@@ -965,6 +990,7 @@ get_entry_map()
     e.add_parser("mkdir",                   &replay_mkdir);
     e.add_parser("remove",                  &replay_remove);
     e.add_parser("rmdir",                   &replay_rmdir);
+    e.add_parser("rmdirs",                  &replay_rmdirs);
     e.add_parser("rename",                  &replay_rename);
     e.add_parser("allocate",                &replay_allocate);
     e.add_parser("truncate",                &replay_truncate);
@@ -1016,6 +1042,15 @@ Replay::playlog(bool& lastEntryChecksumFlag)
     int status = 0;
     while (tokenizer.next(&mds)) {
         if (! entrymap.parse(tokenizer)) {
+            if (ignoreErrorsFlag) {
+                errorCount++;
+                KFS_LOG_STREAM_DEBUG <<
+                    "ignoring error " << path <<
+                    ":" << tokenizer.getEntryCount() <<
+                    ":" << tokenizer.getEntry() <<
+                KFS_LOG_EOM;
+                continue;
+            }
             KFS_LOG_STREAM_FATAL <<
                 "error " << path <<
                 ":" << tokenizer.getEntryCount() <<
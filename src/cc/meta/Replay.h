@@ -43,7 +43,9 @@ public:
           lastLogNum(-1),
           lastLogIntBase(-1),
           appendToLastLogFlag(false),
-          rollSeeds(0)
+          rollSeeds(0),
+          ignoreErrorsFlag(false),
+          errorCount(0)
         {}
     ~Replay()
         {}
@@ -64,6 +66,9 @@ public:
     int getLastLogIntBase() const { return lastLogIntBase; }
     inline void setRollSeeds(int64_t roll);
     int64_t getRollSeeds() const { return rollSeeds; }
+    //!< continue past the log entries that fail to replay, and count these
+    void setIgnoreErrorsFlag(bool flag) { ignoreErrorsFlag = flag; }
+    int64_t getErrorCount() const { return errorCount; }
 private:
     ifstream file;   //!< the log file being replayed
     string   path;   //!< path name for log file
@@ -72,6 +77,8 @@ private:
     int      lastLogIntBase;
     bool     appendToLastLogFlag;
     int64_t  rollSeeds;
+    bool     ignoreErrorsFlag;
+    int64_t  errorCount;
 
     int playLogs(int lastlog, bool includeLastLogFlag);
     int playlog(bool& lastEntryChecksumFlag);
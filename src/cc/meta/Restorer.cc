@@ -40,12 +40,24 @@
 #include "NetDispatch.h"
 #include "common/MdStream.h"
 #include "common/MsgLogger.h"
+#include "common/RequestParser.h"
+#include "common/time.h"
 #include "qcdio/QCUtils.h"
+#include "qcdio/QCThread.h"
+#include "qcdio/QCMutex.h"
+#include "qcdio/qcstutils.h"
+
+#include <deque>
+#include <vector>
+#include <algorithm>
 
 namespace KFS
 {
 using std::cerr;
 using std::string;
+using std::deque;
+using std::vector;
+using std::max;
 
 static int16_t minReplicasPerFile = 0;
 
@@ -124,24 +136,78 @@ restore_chunkVersionInc(DETokenizer& c)
     return (! c.empty() && c.toNumber() >= 1);
 }
 
+// The file attribute the chunks are currently being restored for. The
+// chunks of a file follow its attribute in the checkpoint.
+static MetaFattr* sCurrFa = 0;
+static bool       sBulkLoadLeavesFlag = false;
+
+/*
+ * The entries that follow the tree leaves in the checkpoint might need to
+ * search the tree, complete the bulk load before processing these.
+ */
+static void
+restore_end_of_leaves()
+{
+    if (sBulkLoadLeavesFlag && metatree.isBulkLoading()) {
+        metatree.bulkLoadFinish();
+    }
+}
+
+/*
+ * Insert restored item into the tree. The checkpoint is written in the tree
+ * key order, therefore the tree is normally bulk loaded. Should an item
+ * be out of order, complete the bulk load, and use regular insert for the
+ * remaining items.
+ */
 static bool
-restore_dentry(DETokenizer& c)
+restore_insert(Meta* m)
+{
+    if (metatree.isBulkLoading()) {
+        if (metatree.bulkLoadAppend(m) == 0) {
+            sBulkLoadLeavesFlag = true;
+            return true;
+        }
+        KFS_LOG_STREAM_WARN <<
+            "checkpoint entry out of key order:"
+            " type: " << m->metaType() <<
+            " switching from bulk load to insert" <<
+        KFS_LOG_EOM;
+        metatree.bulkLoadFinish();
+        sCurrFa = 0;
+    }
+    return (metatree.insert(m) == 0);
+}
+
+static bool
+parse_dentry(DETokenizer& c, string& name, fid_t& id, fid_t& parent)
 {
-    string name;
-    fid_t id, parent;
     c.pop_front();
     bool ok = pop_name(name, "name", c, true);
     ok = pop_fid(id, "id", c, ok);
     ok = pop_fid(parent, "parent", c, ok);
-    if (!ok)
-        return false;
+    return ok;
+}
 
+static bool
+apply_dentry(const string& name, fid_t id, fid_t parent)
+{
     MetaDentry* const d = MetaDentry::create(parent, name, id, 0);
-    return (metatree.insert(d) == 0);
+    return restore_insert(d);
+}
+
+static bool
+restore_dentry(DETokenizer& c)
+{
+    string name;
+    fid_t id, parent;
+    if (! parse_dentry(c, name, id, parent))
+        return false;
+
+    return apply_dentry(name, id, parent);
 }
 
 static bool
-restore_striped_file_params(DETokenizer& c, MetaFattr& f)
+restore_striped_file_params(DETokenizer& c, MFattr& f)
 {
     chunkOff_t t = 0, n = 0, nr = 0, ss = 0;
     if (! pop_offset(t, "striperType", c, true)) {
@@ -160,8 +226,12 @@ restore_striped_file_params(DETokenizer& c, MetaFattr& f)
     );
 }
 
+/*
+ * Parse file attributes entry. Does not modify the tree, or any other global
+ * state, and can be invoked concurrently by the parallel checkpoint loader.
+ */
 static bool
-restore_fattr(DETokenizer& c)
+parse_fattr(DETokenizer& c, MFattr& f)
 {
     FileType type;
     fid_t fid;
@@ -191,76 +261,76 @@ restore_fattr(DETokenizer& c)
     // reason for it being estimate: if a CP is in progress while the
     // metatree is updated, we have cases where the chunkcount is off by 1
     // and the checkpoint contains the newly added chunk.
-    MetaFattr* const f = MetaFattr::create(type, fid, mtime, ctime, crtime,
+    f = MFattr(type, fid, mtime, ctime, crtime,
         0, numReplicas, kKfsUserNone, kKfsGroupNone, kKfsModeUndef);
     if (type != KFS_DIR) {
-        f->filesize = gotfilesize ? filesize : chunkOff_t(-1);
-        if (! restore_striped_file_params(c, *f)) {
-            f->destroy();
+        f.filesize = gotfilesize ? filesize : chunkOff_t(-1);
+        if (! restore_striped_file_params(c, f)) {
             return false;
         }
     }
-    int64_t n = f->user;
+    int64_t n = f.user;
     const bool gotperms = ! c.empty();
     if (gotperms) {
         if (! pop_num(n, "user", c, true)) {
-            f->destroy();
             return false;
         }
-        f->user = (kfsUid_t)n;
-        n = f->group;
+        f.user = (kfsUid_t)n;
+        n = f.group;
         if (! pop_num(n, "group", c, true)) {
-            f->destroy();
             return false;
         }
-        f->group = (kfsGid_t)n;
-        n = f->mode;
+        f.group = (kfsGid_t)n;
+        n = f.mode;
         if (! pop_num(n, "mode", c, true)) {
-            f->destroy();
             return false;
         }
-        f->mode = (kfsMode_t)n;
+        f.mode = (kfsMode_t)n;
         if ((type == KFS_FILE || type == KFS_DIR) && ! c.empty() &&
                 pop_num(n, "minTier", c, ok)) {
-            f->minSTier = (kfsSTier_t)n;
+            f.minSTier = (kfsSTier_t)n;
             if (! pop_num(n, "maxTier", c, ok)) {
-                f->destroy();
                 return false;
             }
-            f->maxSTier = (kfsSTier_t)n;
-            if (f->maxSTier < f->minSTier ||
-                    f->minSTier < kKfsSTierMin || f->minSTier > kKfsSTierMax ||
-                    f->maxSTier < kKfsSTierMin || f->maxSTier > kKfsSTierMax) {
-                f->destroy();
+            f.maxSTier = (kfsSTier_t)n;
+            if (f.maxSTier < f.minSTier ||
+                    f.minSTier < kKfsSTierMin || f.minSTier > kKfsSTierMax ||
+                    f.maxSTier < kKfsSTierMin || f.maxSTier > kKfsSTierMax) {
                 return false;
             }
         }
         if (! c.empty()) {
             if (! pop_num(n, "nextChunkOffset", c, ok) ||
                     n < 0 || n % CHUNKSIZE != 0) {
-                f->destroy();
                 return false;
             }
             if (0 == numReplicas) {
-                f->nextChunkOffset() = (chunkOff_t)n;
+                f.nextChunkOffset() = (chunkOff_t)n;
             }
         }
     } else {
-        f->user  = gLayoutManager.GetDefaultLoadUser();
-        f->group = gLayoutManager.GetDefaultLoadGroup();
-        f->mode  = type == KFS_DIR ?
+        f.user  = gLayoutManager.GetDefaultLoadUser();
+        f.group = gLayoutManager.GetDefaultLoadGroup();
+        f.mode  = type == KFS_DIR ?
             gLayoutManager.GetDefaultLoadDirMode() :
             gLayoutManager.GetDefaultLoadFileMode();
     }
-    if (f->user == kKfsUserNone || f->group == kKfsGroupNone ||
-            f->mode == kKfsModeUndef) {
-        f->destroy();
-        return false;
-    }
-    if (metatree.insert(f) != 0) {
+    return (f.user != kKfsUserNone && f.group != kKfsGroupNone &&
+        f.mode != kKfsModeUndef);
+}
+
+static bool
+apply_fattr(const MFattr& attr)
+{
+    MetaFattr* const f = MetaFattr::create(attr.type, attr.id(),
+        attr.mtime, attr.ctime, attr.crtime, 0, attr.numReplicas,
+        attr.user, attr.group, attr.mode);
+    static_cast<MFattr&>(*f) = attr;
+    if (! restore_insert(f)) {
         return false;
     }
-    if (type == KFS_DIR) {
+    sCurrFa = f;
+    if (attr.type == KFS_DIR) {
         UpdateNumDirs(1);
     } else {
         UpdateNumFiles(1);
@@ -269,32 +339,42 @@ restore_fattr(DETokenizer& c)
 }
 
 static bool
-restore_chunkinfo(DETokenizer& c)
+restore_fattr(DETokenizer& c)
 {
-    fid_t fid;
-    chunkId_t cid;
-    chunkOff_t offset;
-    seq_t chunkVersion;
+    MFattr attr;
+    return (parse_fattr(c, attr) && apply_fattr(attr));
+}
 
+static bool
+parse_chunkinfo(DETokenizer& c, fid_t& fid, chunkId_t& cid,
+    chunkOff_t& offset, seq_t& chunkVersion)
+{
     c.pop_front();
     bool ok = pop_fid(fid, "fid", c, true);
     ok = pop_fid(cid, "chunkid", c, ok);
     ok = pop_offset(offset, "offset", c, ok);
     ok = pop_fid(chunkVersion, "chunkVersion", c, ok);
-    if (!ok) {
-        return false;
-    }
+    return ok;
+}
 
+static bool
+apply_chunkinfo(fid_t fid, chunkId_t cid, chunkOff_t offset,
+    seq_t chunkVersion)
+{
     // The chunks of a file are stored next to each other in the tree and
     // are written out contigously.  Use this property when restoring the
     // chunkinfo: stash the fileattr for the the file we are currently
     // working on; as long as this doesn't change, we avoid tree lookups.
-    static MetaFattr* sCurrFa = 0;
+    // With bulk load the tree is not searchable, and the attribute must
+    // precede the file's chunks.
     MetaFattr* fa = sCurrFa;
-    if (! fa || fa->id() != fid) {
+    if ((! fa || fa->id() != fid) && ! metatree.isBulkLoading()) {
         fa = metatree.getFattr(fid);
         sCurrFa = fa;
     }
+    if (fa && fa->id() != fid) {
+        fa = 0;
+    }
     if (! fa) {
         return false;
     }
@@ -305,7 +385,7 @@ restore_chunkinfo(DETokenizer& c)
     if (! ch || ! newEntryFlag) {
         return false;
     }
-    if (metatree.insert(ch) != 0) {
+    if (! restore_insert(ch)) {
         return false;
     }
     if (boundary >= fa->nextChunkOffset()) {
@@ -316,6 +396,18 @@ restore_chunkinfo(DETokenizer& c)
     return true;
 }
 
+static bool
+restore_chunkinfo(DETokenizer& c)
+{
+    fid_t fid;
+    chunkId_t cid;
+    chunkOff_t offset;
+    seq_t chunkVersion;
+
+    return (parse_chunkinfo(c, fid, cid, offset, chunkVersion) &&
+        apply_chunkinfo(fid, cid, offset, chunkVersion));
+}
+
 static bool
 restore_makestable(DETokenizer& c)
 {
@@ -326,6 +418,7 @@ restore_makestable(DETokenizer& c)
     uint32_t   checksum;
     bool       hasChecksum;
 
+    restore_end_of_leaves();
     c.pop_front();
     bool ok = pop_fid(chunkId, "chunkId", c, true);
     ok = pop_fid(chunkVersion, "chunkVersion", c, ok);
@@ -350,6 +443,7 @@ restore_beginchunkversionchange(DETokenizer& c)
     chunkId_t chunkId;
     seq_t     chunkVersion;
 
+    restore_end_of_leaves();
     c.pop_front();
     bool ok = pop_fid(fid,          "file",         c, true);
     ok = pop_fid     (chunkId,      "chunkId",      c, ok);
@@ -439,6 +533,7 @@ restore_filesystem_info(DETokenizer& c)
 static bool
 restore_objstore_delete(DETokenizer& c)
 {
+    restore_end_of_leaves();
     const bool osdFlag = c.front() == DETokenizer::Token("osd", 3);
     c.pop_front();
     if (c.empty()) {
@@ -460,6 +555,209 @@ restore_objstore_delete(DETokenizer& c)
         chunkId, osdFlag ? last : chunkOff_t(0), last);
 }
 
+static CheckpointScanner* sScanner = 0;
+
+static bool
+scan_dentry(DETokenizer& c)
+{
+    string name;
+    fid_t id, parent;
+    return (parse_dentry(c, name, id, parent) &&
+        sScanner->dentry(name, id, parent));
+}
+
+static bool
+scan_fattr(DETokenizer& c)
+{
+    MFattr attr;
+    return (parse_fattr(c, attr) && sScanner->fattr(attr));
+}
+
+static bool
+scan_skip(DETokenizer& /* c */)
+{
+    return true;
+}
+
+/*
+ * The scan entry map does not modify the meta tree or the layout manager
+ * state. The chunk and the checkpoint trailer entries are ignored.
+ */
+static DiskEntry&
+get_scan_entry_map()
+{
+    static bool initied = false;
+    static DiskEntry e;
+    if (initied) {
+        return e;
+    }
+    e.add_parser("setintbase",              &restore_setintbase);
+    e.add_parser("checkpoint",              &checkpoint_seq);
+    e.add_parser("version",                 &checkpoint_version);
+    e.add_parser("fid",                     &checkpoint_fid);
+    e.add_parser("chunkId",                 &checkpoint_chunkId);
+    e.add_parser("time",                    &checkpoint_time);
+    e.add_parser("log",                     &checkpoint_log);
+    e.add_parser("chunkVersionInc",         &restore_chunkVersionInc);
+    e.add_parser("dentry",                  &scan_dentry);
+    e.add_parser("fattr",                   &scan_fattr);
+    e.add_parser("chunkinfo",               &scan_skip);
+    e.add_parser("mkstable",                &scan_skip);
+    e.add_parser("beginchunkversionchange", &scan_skip);
+    e.add_parser("checksum",                &restore_checksum);
+    e.add_parser("delegatecancel",          &scan_skip);
+    e.add_parser("filesysteminfo",          &scan_skip);
+    e.add_parser("osx",                     &scan_skip);
+    e.add_parser("osd",                     &scan_skip);
+    initied = true;
+    return e;
+}
+
+static CheckpointFilter*      sFilter      = 0;
+static CheckpointLeafScanner* sLeafScanner = 0;
+
+inline static Key
+dentry_key(fid_t parent, const string& name)
+{
+    return Key(KFS_DENTRY, parent, MetaDentry::nameHash(name));
+}
+
+inline static Key
+chunkinfo_key(fid_t fid, chunkOff_t offset)
+{
+    return Key(KFS_CHUNKINFO, fid, chunkStartOffset(offset));
+}
+
+static bool
+filter_dentry(DETokenizer& c)
+{
+    string name;
+    fid_t id, parent;
+    return (parse_dentry(c, name, id, parent) &&
+        (! sFilter->accept(dentry_key(parent, name)) ||
+            apply_dentry(name, id, parent)));
+}
+
+static bool
+filter_fattr(DETokenizer& c)
+{
+    MFattr attr;
+    return (parse_fattr(c, attr) &&
+        (! sFilter->accept(Key(KFS_FATTR, attr.id())) ||
+            apply_fattr(attr)));
+}
+
+static bool
+filter_chunkinfo(DETokenizer& c)
+{
+    fid_t fid;
+    chunkId_t cid;
+    chunkOff_t offset;
+    seq_t chunkVersion;
+
+    return (parse_chunkinfo(c, fid, cid, offset, chunkVersion) &&
+        (! sFilter->accept(chunkinfo_key(fid, offset), cid) ||
+            apply_chunkinfo(fid, cid, offset, chunkVersion)));
+}
+
+static bool
+leaf_scan_dentry(DETokenizer& c)
+{
+    const string entry = c.getEntry();
+    string name;
+    fid_t id, parent;
+    return (parse_dentry(c, name, id, parent) &&
+        sLeafScanner->leaf(dentry_key(parent, name), entry));
+}
+
+static bool
+leaf_scan_fattr(DETokenizer& c)
+{
+    const string entry = c.getEntry();
+    FileType type;
+    fid_t fid;
+    bool ok = pop_type(type, "fattr", c, true);
+    ok = pop_fid(fid, "id", c, ok);
+    return (ok && sLeafScanner->leaf(Key(KFS_FATTR, fid), entry));
+}
+
+static bool
+leaf_scan_chunkinfo(DETokenizer& c)
+{
+    const string entry = c.getEntry();
+    fid_t fid;
+    chunkId_t cid;
+    chunkOff_t offset;
+    seq_t chunkVersion;
+
+    return (parse_chunkinfo(c, fid, cid, offset, chunkVersion) &&
+        sLeafScanner->leaf(chunkinfo_key(fid, offset), entry));
+}
+
+/*
+ * The leaf scan entry map only verifies the checkpoint version and checksum.
+ * All entries other than the tree leaves are ignored.
+ */
+static DiskEntry&
+get_leaf_scan_entry_map()
+{
+    static bool initied = false;
+    static DiskEntry e;
+    if (initied) {
+        return e;
+    }
+    e.add_parser("setintbase",              &restore_setintbase);
+    e.add_parser("checkpoint",              &scan_skip);
+    e.add_parser("version",                 &checkpoint_version);
+    e.add_parser("fid",                     &scan_skip);
+    e.add_parser("chunkId",                 &scan_skip);
+    e.add_parser("time",                    &scan_skip);
+    e.add_parser("log",                     &scan_skip);
+    e.add_parser("chunkVersionInc",         &scan_skip);
+    e.add_parser("dentry",                  &leaf_scan_dentry);
+    e.add_parser("fattr",                   &leaf_scan_fattr);
+    e.add_parser("chunkinfo",               &leaf_scan_chunkinfo);
+    e.add_parser("mkstable",                &scan_skip);
+    e.add_parser("beginchunkversionchange", &scan_skip);
+    e.add_parser("checksum",                &restore_checksum);
+    e.add_parser("delegatecancel",          &scan_skip);
+    e.add_parser("filesysteminfo",          &scan_skip);
+    e.add_parser("osx",                     &scan_skip);
+    e.add_parser("osd",                     &scan_skip);
+    initied = true;
+    return e;
+}
+
+static DiskEntry&
+get_filter_entry_map()
+{
+    static bool initied = false;
+    static DiskEntry e;
+    if (initied) {
+        return e;
+    }
+    e.add_parser("setintbase",              &restore_setintbase);
+    e.add_parser("checkpoint",              &checkpoint_seq);
+    e.add_parser("version",                 &checkpoint_version);
+    e.add_parser("fid",                     &checkpoint_fid);
+    e.add_parser("chunkId",                 &checkpoint_chunkId);
+    e.add_parser("time",                    &checkpoint_time);
+    e.add_parser("log",                     &checkpoint_log);
+    e.add_parser("chunkVersionInc",         &restore_chunkVersionInc);
+    e.add_parser("dentry",                  &filter_dentry);
+    e.add_parser("fattr",                   &filter_fattr);
+    e.add_parser("chunkinfo",               &filter_chunkinfo);
+    e.add_parser("mkstable",                &restore_makestable);
+    e.add_parser("beginchunkversionchange", &restore_beginchunkversionchange);
+    e.add_parser("checksum",                &restore_checksum);
+    e.add_parser("delegatecancel",          &restore_delegate_cancel);
+    e.add_parser("filesysteminfo",          &restore_filesystem_info);
+    e.add_parser("osx",                     &restore_objstore_delete);
+    e.add_parser("osd",                     &restore_objstore_delete);
+    initied = true;
+    return e;
+}
+
 static DiskEntry&
 get_entry_map()
 {
@@ -500,6 +798,605 @@ lookupFattr(fid_t dir, const string& name)
     return 0;
 }
 
+/*!
+ * \brief parallel checkpoint loader
+ *
+ * The checkpoint is split into sections at the entry boundaries. The
+ * sections are read and added to the checksum sequentially, and then parsed
+ * by the worker threads into the file attributes, directory entries, and
+ * chunk info records. The main thread applies the parsed sections to the
+ * tree in the checkpoint order, therefore the tree insertion order, the
+ * chunk to file attribute association, and all other entries' semantics
+ * remain the same as with the single threaded load.
+ *
+ * The first section is loaded by the main thread before starting the
+ * workers, in order to process the checkpoint header, and the integer base in
+ * particular, the same way as the single threaded load does. Entries other
+ * than dentry, fattr, and chunkinfo are passed "as is" to the main thread,
+ * and processed with the same parsers as the single threaded load uses.
+ * With the filter or the leaf scanner, the workers also compute the leaf
+ * keys, and, for the leaf scanner, keep the leaf entries text.
+ */
+class CheckpointLoader : public QCRunnable
+{
+public:
+    CheckpointLoader(
+        const string&          name,
+        int                    fd,
+        int                    threadCount,
+        size_t                 sectionSize,
+        DiskEntry&             entryMap,
+        MdStream&              mds,
+        CheckpointScanner*     scanner     = 0,
+        CheckpointFilter*      filter      = 0,
+        CheckpointLeafScanner* leafScanner = 0)
+        : QCRunnable(),
+          mName(name),
+          mFd(fd),
+          mThreadCount(max(1, threadCount)),
+          mSectionSize(max(sectionSize, size_t(2) * kMaxEntrySize)),
+          mMaxPending((size_t)mThreadCount * 2 + 2),
+          mEntryMap(entryMap),
+          mMds(mds),
+          mScanner(scanner),
+          mFilter(filter),
+          mLeafScanner(leafScanner),
+          mMutex(),
+          mReadMutex(),
+          mDoneCond(),
+          mSpaceCond(),
+          mThreads(0),
+          mSections(),
+          mCarry(),
+          mMdTail(),
+          mIntBase(10),
+          mEntryCount(0),
+          mUpdateChecksumFlag(true),
+          mReadEofFlag(false),
+          mEofFlag(false),
+          mStopFlag(false),
+          mReadTime(0),
+          mParseTime(0),
+          mApplyTime(0),
+          mWaitTime(0)
+        {}
+    ~CheckpointLoader()
+    {
+        Stop();
+        delete [] mThreads;
+        for (Sections::iterator it = mSections.begin();
+                it != mSections.end();
+                ++it) {
+            delete *it;
+        }
+    }
+    bool Load();
+    virtual void Run();
+private:
+    enum { kMaxEntrySize = 512 << 10 };
+    struct Entry
+    {
+        enum Type
+        {
+            kTypeDentry,
+            kTypeFattr,
+            kTypeChunkInfo,
+            kTypeOther
+        };
+        Entry(
+            Type type = kTypeOther)
+            : mType(type),
+              mId(-1),
+              mParent(-1),
+              mOffset(-1),
+              mVersion(-1),
+              mAttr(),
+              mText(),
+              mKey(),
+              mEntry()
+            {}
+        Type       mType;
+        fid_t      mId;      // dentry id, or chunk file id
+        fid_t      mParent;  // dentry parent, or chunk id
+        chunkOff_t mOffset;
+        seq_t      mVersion;
+        MFattr     mAttr;
+        string     mText;    // dentry name, or other entries text
+        Key        mKey;     // leaf key, with filter or leaf scanner only
+        string     mEntry;   // leaf entry text, with leaf scanner only
+    };
+    typedef vector<Entry> Entries;
+    struct Section
+    {
+        Section()
+            : mData(),
+              mEntries(),
+              mEntryCount(0),
+              mErrorEntry(),
+              mStatus(0),
+              mDoneFlag(false)
+            {}
+        string  mData;
+        Entries mEntries;
+        size_t  mEntryCount;
+        string  mErrorEntry;
+        int     mStatus;
+        bool    mDoneFlag;
+    };
+    typedef deque<Section*> Sections;
+
+    const string           mName;
+    const int              mFd;
+    const int              mThreadCount;
+    const size_t           mSectionSize;
+    const size_t           mMaxPending;
+    DiskEntry&             mEntryMap;
+    MdStream&              mMds;
+    CheckpointScanner*     mScanner;
+    CheckpointFilter*      mFilter;
+    CheckpointLeafScanner* mLeafScanner;
+    QCMutex                mMutex;
+    QCMutex                mReadMutex;
+    QCCondVar              mDoneCond;
+    QCCondVar              mSpaceCond;
+    QCThread*              mThreads;
+    Sections               mSections;
+    string                 mCarry;
+    string                 mMdTail;
+    int                    mIntBase;
+    size_t                 mEntryCount;
+    bool                   mUpdateChecksumFlag;
+    bool                   mReadEofFlag;
+    bool                   mEofFlag;
+    bool                   mStopFlag;
+    int64_t                mReadTime;
+    int64_t                mParseTime;
+    int64_t                mApplyTime;
+    int64_t                mWaitTime;
+
+    int Read(Section& section, bool updateChecksumFlag);
+    void UpdateChecksum(const string& data);
+    void Parse(Section& section);
+    bool Apply(Section& section);
+    bool ApplyLeaf(const Entry& entry);
+    bool ApplyOther(const string& text, size_t& entryCount);
+    bool LoadFirst();
+    void Stop()
+    {
+        if (! mThreads) {
+            return;
+        }
+        QCStMutexLocker locker(mMutex);
+        mStopFlag = true;
+        mSpaceCond.NotifyAll();
+        locker.Unlock();
+        for (int i = 0; i < mThreadCount; i++) {
+            if (mThreads[i].IsStarted()) {
+                mThreads[i].Join();
+            }
+        }
+    }
+    bool Error(const Section& section, size_t entry, const char* msg)
+    {
+        KFS_LOG_STREAM_FATAL <<
+            mName << ":" << (mEntryCount + entry) << ":" <<
+            (msg ? msg : "") << section.mErrorEntry <<
+        KFS_LOG_EOM;
+        return false;
+    }
+private:
+    CheckpointLoader(const CheckpointLoader&);
+    CheckpointLoader& operator=(const CheckpointLoader&);
+};
+
+/*
+ * Read next section. The section ends at the entry boundary, unless it is the
+ * last section.
+ * Return 0 on success, 1 on eof, and negative error code on failure.
+ */
+int
+CheckpointLoader::Read(Section& section, bool updateChecksumFlag)
+{
+    if (mReadEofFlag && mCarry.empty()) {
+        return 1;
+    }
+    const int64_t start = microseconds();
+    string& data = section.mData;
+    data.swap(mCarry);
+    mCarry.clear();
+    size_t pos = 0;
+    while (! mReadEofFlag) {
+        const size_t size = data.size();
+        data.resize(size + mSectionSize);
+        const ssize_t nrd = read(mFd, &data[size], mSectionSize);
+        if (nrd < 0) {
+            const int err = errno;
+            data.resize(size);
+            KFS_LOG_STREAM_FATAL <<
+                mName << ": " << QCUtils::SysError(err) <<
+            KFS_LOG_EOM;
+            mReadEofFlag = true;
+            return (err > 0 ? -err : -EIO);
+        }
+        data.resize(size + nrd);
+        mReadEofFlag = nrd == 0;
+        if (! mReadEofFlag) {
+            pos = data.rfind('\n');
+            if (pos == string::npos) {
+                if (size_t(kMaxEntrySize) <= data.size()) {
+                    KFS_LOG_STREAM_FATAL <<
+                        mName << ": entry exceeds max size: " <<
+                        kMaxEntrySize <<
+                    KFS_LOG_EOM;
+                    mReadEofFlag = true;
+                    return -EINVAL;
+                }
+                continue;
+            }
+            mCarry.assign(data, pos + 1, string::npos);
+            data.resize(pos + 1);
+        }
+        break;
+    }
+    if (updateChecksumFlag) {
+        UpdateChecksum(data);
+    }
+    mReadTime += microseconds() - start;
+    return (data.empty() ? 1 : 0);
+}
+
+/*
+ * The last (non empty) line is the checksum, and must not be included into
+ * the checksum. As the last line position is known only at the end of file,
+ * defer adding the last line of each section to the checksum until the next
+ * section is read.
+ */
+void
+CheckpointLoader::UpdateChecksum(const string& data)
+{
+    size_t end = data.size();
+    while (0 < end && data[end - 1] == '\n') {
+        end--;
+    }
+    if (end <= 0) {
+        mMdTail += data;
+        return;
+    }
+    const size_t pos   = data.rfind('\n', end - 1);
+    const size_t start = pos == string::npos ? 0 : pos + 1;
+    if (! mMdTail.empty()) {
+        mMds.write(mMdTail.data(), mMdTail.size());
+    }
+    mMds.write(data.data(), start);
+    mMdTail.assign(data, start, string::npos);
+}
+
+void
+CheckpointLoader::Parse(Section& section)
+{
+    BufferInputStream is(section.mData.data(), section.mData.size());
+    DETokenizer       tokenizer(is);
+    const DETokenizer::Token kDentry("dentry");
+    const DETokenizer::Token kFattr("fattr");
+    const DETokenizer::Token kChunkInfo("chunkinfo");
+    const DETokenizer::Token kSetIntBase("setintbase");
+    Entries& entries = section.mEntries;
+    entries.reserve(section.mData.size() / 96);
+    tokenizer.setIntBase(mIntBase);
+    const bool keyFlag = mFilter || mLeafScanner;
+    bool ok = true;
+    while (tokenizer.next()) {
+        if (tokenizer.empty()) {
+            continue;
+        }
+        const DETokenizer::Token& key = tokenizer.front();
+        if (key == kDentry) {
+            entries.push_back(Entry(Entry::kTypeDentry));
+            Entry& e = entries.back();
+            if (mLeafScanner) {
+                e.mEntry = tokenizer.getEntry();
+            }
+            ok = parse_dentry(tokenizer, e.mText, e.mId, e.mParent);
+            if (ok && keyFlag) {
+                e.mKey = dentry_key(e.mParent, e.mText);
+            }
+        } else if (key == kFattr) {
+            entries.push_back(Entry(Entry::kTypeFattr));
+            Entry& e = entries.back();
+            if (mLeafScanner) {
+                e.mEntry = tokenizer.getEntry();
+            }
+            ok = parse_fattr(tokenizer, e.mAttr);
+            if (ok && keyFlag) {
+                e.mKey = Key(KFS_FATTR, e.mAttr.id());
+            }
+        } else if (key == kChunkInfo) {
+            entries.push_back(Entry(Entry::kTypeChunkInfo));
+            Entry& e = entries.back();
+            if (mLeafScanner) {
+                e.mEntry = tokenizer.getEntry();
+            }
+            ok = parse_chunkinfo(tokenizer,
+                e.mId, e.mParent, e.mOffset, e.mVersion);
+            if (ok && keyFlag) {
+                e.mKey = chunkinfo_key(e.mId, e.mOffset);
+            }
+        } else if (key == kSetIntBase) {
+            // Changing integer base past the header isn't supported, as
+            // the subsequent sections might be already parsed.
+            ok = false;
+        } else {
+            if (entries.empty() ||
+                    entries.back().mType != Entry::kTypeOther) {
+                entries.push_back(Entry(Entry::kTypeOther));
+            }
+            string& text = entries.back().mText;
+            text += tokenizer.getEntry();
+            text += '\n';
+        }
+        if (! ok) {
+            section.mErrorEntry = tokenizer.getEntry();
+            break;
+        }
+    }
+    section.mEntryCount = tokenizer.getEntryCount();
+    if (ok && ! is.eof()) {
+        section.mErrorEntry = tokenizer.getEntry();
+        ok = false;
+    }
+    section.mStatus = ok ? 0 : -EINVAL;
+}
+
+void
+CheckpointLoader::Run()
+{
+    for (; ;) {
+        QCStMutexLocker readLocker(mReadMutex);
+        QCStMutexLocker locker(mMutex);
+        while (! mStopFlag && ! mEofFlag && mMaxPending <= mSections.size()) {
+            mSpaceCond.Wait(mMutex);
+        }
+        if (mStopFlag || mEofFlag) {
+            break;
+        }
+        Section* const section = new Section();
+        int            status;
+        {
+            QCStMutexUnlocker unlocker(mMutex);
+            status = Read(*section, mUpdateChecksumFlag);
+        }
+        if (status != 0) {
+            if (status < 0) {
+                section->mStatus   = status;
+                section->mDoneFlag = true;
+                mSections.push_back(section);
+            } else {
+                delete section;
+            }
+            mEofFlag = true;
+            mDoneCond.Notify();
+            break;
+        }
+        mSections.push_back(section);
+        locker.Unlock();
+        readLocker.Unlock();
+
+        const int64_t start = microseconds();
+        Parse(*section);
+        const int64_t end = microseconds();
+
+        QCStMutexLocker doneLocker(mMutex);
+        mParseTime += end - start;
+        section->mDoneFlag = true;
+        if (section == mSections.front()) {
+            mDoneCond.Notify();
+        }
+    }
+}
+
+bool
+CheckpointLoader::ApplyOther(const string& text, size_t& entryCount)
+{
+    BufferInputStream is(text.data(), text.size());
+    DETokenizer       tokenizer(is);
+    tokenizer.setIntBase(mIntBase);
+    while (tokenizer.next()) {
+        if (! restoreChecksum.empty()) {
+            KFS_LOG_STREAM_FATAL <<
+                mName << ": entry after checksum" <<
+            KFS_LOG_EOM;
+            return false;
+        }
+        if (! mEntryMap.parse(tokenizer)) {
+            KFS_LOG_STREAM_FATAL <<
+                mName << ":" << (entryCount + tokenizer.getEntryCount()) <<
+                ":" << tokenizer.getEntry() <<
+            KFS_LOG_EOM;
+            return false;
+        }
+    }
+    entryCount += tokenizer.getEntryCount();
+    return true;
+}
+
+bool
+CheckpointLoader::Apply(Section& section)
+{
+    if (section.mStatus != 0) {
+        if (section.mErrorEntry.empty()) {
+            return false;
+        }
+        return Error(section, section.mEntryCount, "");
+    }
+    // Other entries are not counted individually, use the count of the
+    // leaf entries and other entries lines to report the error position.
+    size_t count = mEntryCount;
+    for (Entries::const_iterator it = section.mEntries.begin();
+            it != section.mEntries.end();
+            ++it) {
+        if (! restoreChecksum.empty()) {
+            KFS_LOG_STREAM_FATAL <<
+                mName << ": entry after checksum" <<
+            KFS_LOG_EOM;
+            return false;
+        }
+        if (it->mType == Entry::kTypeOther) {
+            if (! ApplyOther(it->mText, count)) {
+                return false;
+            }
+            continue;
+        }
+        count++;
+        if (! ApplyLeaf(*it)) {
+            KFS_LOG_STREAM_FATAL <<
+                mName << ":" << count << ": failed to restore" <<
+                (it->mType == Entry::kTypeDentry ? " dentry: " :
+                    (it->mType == Entry::kTypeFattr ? " fattr: " :
+                    " chunkinfo: ")) <<
+                (it->mType == Entry::kTypeFattr ?
+                    it->mAttr.id() : it->mId) <<
+            KFS_LOG_EOM;
+            return false;
+        }
+    }
+    mEntryCount += section.mEntryCount;
+    return true;
+}
+
+bool
+CheckpointLoader::ApplyLeaf(const Entry& entry)
+{
+    if (mLeafScanner) {
+        return mLeafScanner->leaf(entry.mKey, entry.mEntry);
+    }
+    switch (entry.mType) {
+        case Entry::kTypeDentry:
+            if (mScanner) {
+                return mScanner->dentry(entry.mText, entry.mId, entry.mParent);
+            }
+            return ((mFilter && ! mFilter->accept(entry.mKey)) ||
+                apply_dentry(entry.mText, entry.mId, entry.mParent));
+        case Entry::kTypeFattr:
+            if (mScanner) {
+                return mScanner->fattr(entry.mAttr);
+            }
+            return ((mFilter && ! mFilter->accept(entry.mKey)) ||
+                apply_fattr(entry.mAttr));
+        case Entry::kTypeChunkInfo:
+            return (mScanner ||
+                (mFilter && ! mFilter->accept(entry.mKey, entry.mParent)) ||
+                apply_chunkinfo(
+                    entry.mId, entry.mParent, entry.mOffset, entry.mVersion));
+        default:
+            break;
+    }
+    return false;
+}
+
+/*
+ * Load the first section, and the checkpoint header in particular, on the
+ * main thread with the single threaded loader entry map.
+ */
+bool
+CheckpointLoader::LoadFirst()
+{
+    Section section;
+    const int status = Read(section, false);
+    if (status != 0) {
+        return (0 < status);
+    }
+    BufferInputStream is(section.mData.data(), section.mData.size());
+    DETokenizer       tokenizer(is);
+    while (tokenizer.next(&mMds)) {
+        if (! mEntryMap.parse(tokenizer)) {
+            KFS_LOG_STREAM_FATAL <<
+                mName << ":" << tokenizer.getEntryCount() <<
+                ":" << tokenizer.getEntry() <<
+            KFS_LOG_EOM;
+            return false;
+        }
+        if (! restoreChecksum.empty()) {
+            if (tokenizer.next()) {
+                KFS_LOG_STREAM_FATAL <<
+                    mName << ": entry after checksum" <<
+                KFS_LOG_EOM;
+                return false;
+            }
+            break;
+        }
+    }
+    if (restoreChecksum.empty() && ! is.eof()) {
+        KFS_LOG_STREAM_FATAL <<
+            "error " << mName << ":" << tokenizer.getEntryCount() <<
+            ":" << tokenizer.getEntry() <<
+        KFS_LOG_EOM;
+        return false;
+    }
+    mIntBase            = tokenizer.getIntBase();
+    mEntryCount         = tokenizer.getEntryCount();
+    mUpdateChecksumFlag = restoreChecksum.empty();
+    return true;
+}
+
+bool
+CheckpointLoader::Load()
+{
+    const int64_t start = microseconds();
+    if (! LoadFirst()) {
+        return false;
+    }
+    mApplyTime += microseconds() - start;
+    mThreads = new QCThread[mThreadCount];
+    const int kStackSize = 256 << 10;
+    for (int i = 0; i < mThreadCount; i++) {
+        const int err = mThreads[i].TryToStart(
+            this, kStackSize, "CPLoader");
+        if (err) {
+            KFS_LOG_STREAM_FATAL << QCUtils::SysError(
+                err, "failed to start checkpoint loader thread") <<
+            KFS_LOG_EOM;
+            return false;
+        }
+    }
+    bool ok = true;
+    for (; ;) {
+        const int64_t waitStart = microseconds();
+        QCStMutexLocker locker(mMutex);
+        while (mSections.empty() ?
+                ! mEofFlag : ! mSections.front()->mDoneFlag) {
+            mDoneCond.Wait(mMutex);
+        }
+        if (mSections.empty()) {
+            break;
+        }
+        Section* const section = mSections.front();
+        mSections.pop_front();
+        mSpaceCond.Notify();
+        locker.Unlock();
+        const int64_t applyStart = microseconds();
+        mWaitTime += applyStart - waitStart;
+        ok = Apply(*section);
+        delete section;
+        mApplyTime += microseconds() - applyStart;
+        if (! ok) {
+            break;
+        }
+    }
+    Stop();
+    const int64_t end = microseconds();
+    KFS_LOG_STREAM_INFO <<
+        "checkpoint load: " << mName <<
+        " entries: "        << mEntryCount <<
+        " threads: "        << mThreadCount <<
+        " read: "           << (mReadTime  * 1e-6) <<
+        " parse: "          << (mParseTime * 1e-6) <<
+        " build: "          << (mApplyTime * 1e-6) <<
+        " wait: "           << (mWaitTime  * 1e-6) <<
+        " total: "          << ((end - start) * 1e-6) << " sec." <<
+    KFS_LOG_EOM;
+    return ok;
+}
+
 /*!
  * \brief rebuild metadata tree from CP file cpname
  * \param[in] cpname    the CP file
@@ -510,6 +1407,32 @@ lookupFattr(fid_t dir, const string& name)
  */
 bool
 Restorer::rebuild(const string cpname, int16_t minReplicas)
+{
+    minReplicasPerFile = minReplicas;
+    return build(cpname, get_entry_map());
+}
+
+/*!
+ * \brief rebuild metadata tree from the subset of CP file cpname leaves
+ * \param[in] cpname    the CP file
+ * \param[in] filter    selects the leaves to restore
+ * \return      true if successful
+ */
+bool
+Restorer::rebuild(const string& cpname, CheckpointFilter& filter)
+{
+    // The leaves that the filter does not accept might be written into a
+    // new checkpoint as is, do not change the replication of the accepted
+    // leaves either.
+    minReplicasPerFile = 0;
+    sFilter = &filter;
+    const bool is_ok = build(cpname, get_filter_entry_map());
+    sFilter = 0;
+    return is_ok;
+}
+
+bool
+Restorer::build(const string& cpname, DiskEntry& entrymap)
 {
     if (metatree.getFattr(ROOTFID)) {
         KFS_LOG_STREAM_FATAL <<
@@ -517,7 +1440,70 @@ Restorer::rebuild(const string cpname, int16_t minReplicas)
         KFS_LOG_EOM;
         return false;
     }
-    minReplicasPerFile = minReplicas;
+    // Use insert if the tree isn't empty, the entries then might not be
+    // in order with the existing items.
+    metatree.bulkLoadStart();
+    bool is_ok = load(cpname, entrymap, 0, sFilter);
+    if (metatree.isBulkLoading()) {
+        const int64_t start = microseconds();
+        metatree.bulkLoadFinish();
+        KFS_LOG_STREAM_INFO <<
+            "checkpoint tree build: " << ((microseconds() - start) * 1e-6) <<
+            " sec. height: " << metatree.height() <<
+        KFS_LOG_EOM;
+    }
+    const MetaFattr* fa;
+    if (is_ok && ! (
+            (fa = metatree.getFattr(ROOTFID)) &&
+            lookupFattr(ROOTFID, "/") == fa &&
+            lookupFattr(ROOTFID, ".") == fa &&
+            lookupFattr(ROOTFID, "..") == fa)) {
+        KFS_LOG_STREAM_FATAL <<
+            cpname <<
+            ": invalid or missing root directory" <<
+        KFS_LOG_EOM;
+        is_ok = false;
+    }
+    return is_ok;
+}
+
+/*!
+ * \brief scan CP file cpname without building the metadata tree
+ * \param[in] cpname    the CP file
+ * \param[in] scanner   receives directory entries and file attributes
+ * \return      true if successful
+ */
+bool
+Restorer::scan(const string& cpname, CheckpointScanner& scanner)
+{
+    minReplicasPerFile = 0;
+    sScanner = &scanner;
+    const bool is_ok = load(cpname, get_scan_entry_map(), &scanner);
+    sScanner = 0;
+    return is_ok;
+}
+
+/*!
+ * \brief scan CP file cpname tree leaves without building the metadata tree
+ * \param[in] cpname    the CP file
+ * \param[in] scanner   receives the tree leaves keys and entries
+ * \return      true if successful
+ */
+bool
+Restorer::scan(const string& cpname, CheckpointLeafScanner& scanner)
+{
+    minReplicasPerFile = 0;
+    sLeafScanner = &scanner;
+    const bool is_ok = load(cpname, get_leaf_scan_entry_map(), 0, 0, &scanner);
+    sLeafScanner = 0;
+    return is_ok;
+}
+
+bool
+Restorer::load(const string& cpname, DiskEntry& entrymap,
+    CheckpointScanner* scanner, CheckpointFilter* filter,
+    CheckpointLeafScanner* leafScanner)
+{
     file.open(cpname.c_str(), ofstream::binary | ofstream::in);
     if (file.fail()) {
         const int err = errno;
@@ -527,40 +1513,62 @@ Restorer::rebuild(const string cpname, int16_t minReplicas)
         return false;
     }
 
-    DiskEntry& entrymap = get_entry_map();
-        DETokenizer tokenizer(file);
-
     restoreChecksum.clear();
     lastLineChecksumFlag = false;
     MdStream mds(0, false, string(), 0);
     bool is_ok = true;
-    while (tokenizer.next(&mds)) {
-        if (! entrymap.parse(tokenizer)) {
+    if (1 < threads) {
+        file.close();
+        const int fd = open(cpname.c_str(), O_RDONLY);
+        if (fd < 0) {
+            const int err = errno;
             KFS_LOG_STREAM_FATAL <<
-                cpname << ":" << tokenizer.getEntryCount() <<
-                ":" << tokenizer.getEntry() <<
+                cpname << ": " << QCUtils::SysError(err) <<
             KFS_LOG_EOM;
-            is_ok = false;
-            break;
+            return false;
         }
-        if (! restoreChecksum.empty()) {
-            if (tokenizer.next()) {
+        const size_t kSectionSize = size_t(8) << 20;
+        CheckpointLoader loader(cpname, fd, threads, kSectionSize,
+            entrymap, mds, scanner, filter, leafScanner);
+        is_ok = loader.Load();
+        close(fd);
+    } else {
+        const int64_t start = microseconds();
+        DETokenizer tokenizer(file);
+        while (tokenizer.next(&mds)) {
+            if (! entrymap.parse(tokenizer)) {
                 KFS_LOG_STREAM_FATAL <<
-                    cpname << ": entry after checksum" <<
+                    cpname << ":" << tokenizer.getEntryCount() <<
+                    ":" << tokenizer.getEntry() <<
                 KFS_LOG_EOM;
                 is_ok = false;
+                break;
+            }
+            if (! restoreChecksum.empty()) {
+                if (tokenizer.next()) {
+                    KFS_LOG_STREAM_FATAL <<
+                        cpname << ": entry after checksum" <<
+                    KFS_LOG_EOM;
+                    is_ok = false;
+                }
+                break;
             }
-            break;
         }
-    }
-    if (is_ok && ! file.eof()) {
-        KFS_LOG_STREAM_FATAL <<
-            "error " << cpname << ":" << tokenizer.getEntryCount() <<
-            ":" << tokenizer.getEntry() <<
+        if (is_ok && ! file.eof()) {
+            KFS_LOG_STREAM_FATAL <<
+                "error " << cpname << ":" << tokenizer.getEntryCount() <<
+                ":" << tokenizer.getEntry() <<
+            KFS_LOG_EOM;
+            is_ok = false;
+        }
+        file.close();
+        KFS_LOG_STREAM_INFO <<
+            "checkpoint load: " << cpname <<
+            " entries: "        << tokenizer.getEntryCount() <<
+            " total: "          << ((microseconds() - start) * 1e-6) <<
+            " sec." <<
         KFS_LOG_EOM;
-        is_ok = false;
     }
-    file.close();
     if (is_ok && lastLineChecksumFlag) {
         const string md = mds.GetMd();
         if (restoreChecksum != md) {
@@ -573,18 +1581,6 @@ Restorer::rebuild(const string cpname, int16_t minReplicas)
             is_ok = false;
         }
     }
-    const MetaFattr* fa;
-    if (is_ok && ! (
-            (fa = metatree.getFattr(ROOTFID)) &&
-            lookupFattr(ROOTFID, "/") == fa &&
-            lookupFattr(ROOTFID, ".") == fa &&
-            lookupFattr(ROOTFID, "..") == fa)) {
-        KFS_LOG_STREAM_FATAL <<
-            cpname <<
-            ": invalid or missing root directory" <<
-        KFS_LOG_EOM;
-        is_ok = false;
-    }
     return is_ok;
 }
 
@@ -34,14 +34,72 @@ namespace KFS
 using std::ifstream;
 using std::string;
 
+class MFattr;
+class DiskEntry;
+class Key;
+
+/*
+ * Checkpoint scanner interface. Restorer::scan() invokes the scanner methods
+ * for directory entries and file attributes in the checkpoint order, without
+ * building the meta tree. The chunk info entries are skipped.
+ */
+class CheckpointScanner
+{
+public:
+    virtual bool dentry(const string& name, fid_t id, fid_t parent) = 0;
+    virtual bool fattr(const MFattr& attr) = 0;
+protected:
+    CheckpointScanner()
+        {}
+    virtual ~CheckpointScanner()
+        {}
+};
+
+/*
+ * Checkpoint filter interface. Restorer::rebuild() with the filter restores
+ * only the tree leaves that the filter accepts, all other checkpoint entries
+ * are restored the same way as with the full rebuild. The filter is invoked
+ * with the leaf keys in the checkpoint order.
+ */
+class CheckpointFilter
+{
+public:
+    virtual bool accept(const Key& key) = 0;
+    //!< chunk info leaf, the chunk id is passed along with the leaf key
+    virtual bool accept(const Key& key, chunkId_t chunkId) = 0;
+protected:
+    CheckpointFilter()
+        {}
+    virtual ~CheckpointFilter()
+        {}
+};
+
+/*
+ * Checkpoint leaf scanner interface. Restorer::scan() invokes the scanner
+ * with the key and the entry text of each tree leaf in the checkpoint order,
+ * without building the meta tree, or modifying any other state. The entry
+ * text does not include the line terminator.
+ */
+class CheckpointLeafScanner
+{
+public:
+    virtual bool leaf(const Key& key, const string& entry) = 0;
+protected:
+    CheckpointLeafScanner()
+        {}
+    virtual ~CheckpointLeafScanner()
+        {}
+};
+
 /*!
  * \brief state for restoring from a checkpoint file
  */
 class Restorer
 {
 public:
-    Restorer()
-        : file()
+    Restorer(int loadThreads = 0)
+        : file(),
+          threads(loadThreads)
         {}
     ~Restorer()
         {}
@@ -49,10 +107,32 @@ public:
      * process the CP file.  also, if the # of replicas of a file is below
      * the specified value, bump up replication.  this allows us to change
      * the filesystem wide degree of replication in a simple manner.
+     * with more than one load thread the checkpoint is parsed in parallel.
      */
     bool rebuild(string cpname, int16_t minNumReplicasPerFile = 1);
+    /*
+     * rebuild the meta tree from the subset of the CP file tree leaves that
+     * the filter accepts.
+     */
+    bool rebuild(const string& cpname, CheckpointFilter& filter);
+    /*
+     * scan the CP file without building the meta tree. the checkpoint
+     * checksum is verified the same way as with rebuild.
+     */
+    bool scan(const string& cpname, CheckpointScanner& scanner);
+    /*
+     * scan the CP file tree leaves, and verify the checkpoint checksum,
+     * without building the meta tree.
+     */
+    bool scan(const string& cpname, CheckpointLeafScanner& scanner);
 private:
     ifstream file;          //!< the CP file
+    int      threads;       //!< checkpoint parser threads
+
+    bool build(const string& cpname, DiskEntry& entrymap);
+    bool load(const string& cpname, DiskEntry& entrymap,
+        CheckpointScanner* scanner, CheckpointFilter* filter = 0,
+        CheckpointLeafScanner* leafScanner = 0);
 private:
     // No copy.
     Restorer(const Restorer&);
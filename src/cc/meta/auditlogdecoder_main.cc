@@ -0,0 +1,268 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/16
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Decode binary audit log files into text, one line per request. See
+// AuditLog.h for the binary audit log format description.
+//
+//----------------------------------------------------------------------------
+
+#include "AuditLog.h"
+
+#include <zlib.h>
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+namespace KFS
+{
+using std::cout;
+using std::cerr;
+using std::istream;
+using std::ifstream;
+using std::ostream;
+using std::vector;
+using std::string;
+
+template<typename T> static void
+Read(const char*& ioPtr, T& outVal)
+{
+    const char*       ptr    = ioPtr;
+    ioPtr += sizeof(outVal);
+    const char* const endPtr = ioPtr;
+    outVal = 0;
+    while (ptr < endPtr) {
+        outVal <<= 8;
+        outVal |= (*ptr++ & 0xFF);
+    }
+}
+
+static bool
+ShowRecords(const char* ptr, const char* endPtr, uint32_t count, bool gmtFlag,
+    ostream& os)
+{
+    string   name;
+    string   ip;
+    uint32_t cnt = 0;
+    while (ptr + 2 <= endPtr) {
+        uint16_t len = 0;
+        Read(ptr, len);
+        if (len < AuditLog::kBinaryRecordFixedSize || endPtr < ptr + len) {
+            return false;
+        }
+        const char* const recEndPtr = ptr + len;
+        int64_t  time     = 0;
+        int64_t  duration = 0;
+        int64_t  seq      = 0;
+        int64_t  fid      = 0;
+        int32_t  status   = 0;
+        uint32_t authUid  = 0;
+        uint32_t euser    = 0;
+        uint32_t egroup   = 0;
+        uint8_t  nameLen  = 0;
+        uint8_t  ipLen    = 0;
+        Read(ptr, time);
+        Read(ptr, duration);
+        Read(ptr, seq);
+        Read(ptr, fid);
+        Read(ptr, status);
+        Read(ptr, authUid);
+        Read(ptr, euser);
+        Read(ptr, egroup);
+        Read(ptr, nameLen);
+        if (recEndPtr < ptr + nameLen + 1) {
+            return false;
+        }
+        name.assign(ptr, nameLen);
+        ptr += nameLen;
+        Read(ptr, ipLen);
+        if (recEndPtr < ptr + ipLen) {
+            return false;
+        }
+        ip.assign(ptr, ipLen);
+        ptr = recEndPtr;
+        const time_t sec = (time_t)(time / 1000000);
+        struct tm    tm;
+        char         buf[64];
+        if (! (gmtFlag ? gmtime_r(&sec, &tm) : localtime_r(&sec, &tm)) ||
+                strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm) <= 0) {
+            buf[0] = 0;
+        }
+        const int64_t usec = time % 1000000;
+        os << buf << '.';
+        os.width(6);
+        os.fill('0');
+        os << usec;
+        os <<
+            " op: "       << name <<
+            " seq: "      << seq <<
+            " fid: "      << fid <<
+            " status: "   << status <<
+            " usec: "     << duration <<
+            " auth-uid: " << authUid <<
+            " euser: "    << euser <<
+            " egroup: "   << egroup <<
+            " ip: "       << ip <<
+        "\n";
+        cnt++;
+    }
+    return (ptr == endPtr && cnt == count);
+}
+
+static int
+DecodeAuditLog(istream& in, const char* fileName, bool gmtFlag)
+{
+    vector<char> buf;
+    vector<char> rawBuf;
+    int64_t      blocks = 0;
+    for (; ;) {
+        char header[AuditLog::kBinaryBlockHeaderSize];
+        if (! in.read(header, sizeof(header))) {
+            if (in.gcount() == 0 && in.eof()) {
+                break;
+            }
+            cerr << fileName << ": truncated block header: " << blocks << "\n";
+            return -EIO;
+        }
+        const char* ptr    = header;
+        uint32_t    magic  = 0;
+        uint32_t    flags  = 0;
+        uint32_t    count  = 0;
+        uint32_t    rawLen = 0;
+        uint32_t    len    = 0;
+        uint32_t    crc    = 0;
+        Read(ptr, magic);
+        Read(ptr, flags);
+        Read(ptr, count);
+        Read(ptr, rawLen);
+        Read(ptr, len);
+        Read(ptr, crc);
+        if (magic != (uint32_t)AuditLog::kBinaryMagic) {
+            cerr << fileName << ": invalid block header: " << blocks << "\n";
+            return -EINVAL;
+        }
+        buf.resize(len + 1);
+        if (! in.read(&buf[0], len)) {
+            cerr << fileName << ": truncated block: " << blocks << "\n";
+            return -EIO;
+        }
+        if (crc != (uint32_t)crc32(crc32(0L, Z_NULL, 0),
+                reinterpret_cast<const Bytef*>(&buf[0]), (uInt)len)) {
+            cerr << fileName << ": block checksum mismatch: " << blocks <<
+                "\n";
+            return -EINVAL;
+        }
+        const char* recPtr = &buf[0];
+        if ((flags & AuditLog::kBinaryFlagCompressed) != 0) {
+            rawBuf.resize(rawLen + 1);
+            uLongf    outLen = rawLen;
+            const int status = uncompress(
+                reinterpret_cast<Bytef*>(&rawBuf[0]), &outLen,
+                reinterpret_cast<const Bytef*>(&buf[0]), (uLong)len);
+            if (status != Z_OK || outLen != rawLen) {
+                cerr << fileName << ": block decompression failure: " <<
+                    blocks << " status: " << status << "\n";
+                return -EINVAL;
+            }
+            recPtr = &rawBuf[0];
+        } else if (rawLen != len) {
+            cerr << fileName << ": invalid block length: " << blocks << "\n";
+            return -EINVAL;
+        }
+        if (! ShowRecords(recPtr, recPtr + rawLen, count, gmtFlag, cout)) {
+            cerr << fileName << ": invalid block records: " << blocks << "\n";
+            return -EINVAL;
+        }
+        blocks++;
+    }
+    cout.flush();
+    if (! cout) {
+        cerr << fileName << ": write failure\n";
+        return -EIO;
+    }
+    return 0;
+}
+
+static int
+AuditLogDecoderMain(int argc, char** argv)
+{
+    int  optchar;
+    bool help    = false;
+    bool gmtFlag = false;
+    int  status  = 0;
+
+    while ((optchar = getopt(argc, argv, "hu")) != -1) {
+        switch (optchar) {
+            case 'u':
+                gmtFlag = true;
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                status = 1;
+                break;
+        }
+    }
+    if (help || status != 0 || argc <= optind) {
+        (status ? cerr : cout) << "Usage: " << argv[0] <<
+            " [-u show time in UTC]"
+            " <binary audit log file> [<binary audit log file>...]\n"
+            "Decode binary audit log files into text, one line per request.\n"
+            "Use - to read from standard input.\n"
+        ;
+        return (help ? 0 : 1);
+    }
+    for (int i = optind; i < argc; i++) {
+        if (strcmp(argv[i], "-") == 0) {
+            if (DecodeAuditLog(std::cin, "stdin", gmtFlag) != 0) {
+                status = 1;
+            }
+            continue;
+        }
+        ifstream in(argv[i], ifstream::in | ifstream::binary);
+        if (! in) {
+            cerr << argv[i] << ": failed to open\n";
+            status = 1;
+            continue;
+        }
+        if (DecodeAuditLog(in, argv[i], gmtFlag) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+    return KFS::AuditLogDecoderMain(argc, argv);
+}
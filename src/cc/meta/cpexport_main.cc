@@ -0,0 +1,555 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/16
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Export file system name space from a checkpoint into compact columnar
+// binary files, without building the meta tree. The checkpoint is parsed in
+// parallel by the checkpoint loader threads.
+//
+// Both the name space and the directory aggregates files start with 8 bytes
+// file header: magic and version, followed by row groups. Each row group
+// starts with 20 bytes header: magic, row count, column count, data length,
+// and crc32 of the data. The header is followed by the columns' data, every
+// column stored contiguously, with fixed width values. All integers are big
+// endian.
+//
+// Name space file columns: id (8), parent (8), type (1), size (8),
+// replication (2), striper type (1), stripes (2), recovery stripes (2),
+// stripe size (4), mtime (8), user (4), group (4), mode (2).
+// The directory aggregates file columns: id (8), parent (8), files (8),
+// directories (8), bytes (8), recursive files (8), recursive directories (8),
+// recursive bytes (8).
+//
+//----------------------------------------------------------------------------
+
+#include "Restorer.h"
+#include "Checkpoint.h"
+#include "meta.h"
+#include "util.h"
+#include "common/MdStream.h"
+#include "common/MsgLogger.h"
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+
+namespace KFS
+{
+using std::cout;
+using std::cerr;
+using std::ofstream;
+using std::vector;
+using std::map;
+using std::sort;
+using std::max;
+using std::make_pair;
+
+const uint32_t kCpExportMagic         = 0x51464358;
+const uint32_t kCpExportDirsMagic     = 0x51464344;
+const uint32_t kCpExportRowGroupMagic = 0x51465247;
+const uint32_t kCpExportVersion       = 1;
+
+class ColumnarWriter
+{
+public:
+    ColumnarWriter(
+        const int*    widths,
+        int           columnCount,
+        uint32_t      magic,
+        size_t        rowGroupSize)
+        : mWidths(widths, widths + columnCount),
+          mColumns(columnCount),
+          mMagic(magic),
+          mRowGroupSize(rowGroupSize),
+          mRowCount(0),
+          mRowsTotal(0),
+          mFileName(),
+          mStream(),
+          mBuf()
+    {
+        for (int i = 0; i < columnCount; i++) {
+            mColumns[i].reserve(mWidths[i] * mRowGroupSize);
+        }
+    }
+    bool Open(const string& fileName)
+    {
+        mFileName = fileName;
+        mStream.open(fileName.c_str(),
+            ofstream::out | ofstream::binary | ofstream::trunc);
+        char  header[2 * sizeof(uint32_t)];
+        char* ptr = header;
+        Put(ptr, mMagic);
+        Put(ptr, kCpExportVersion);
+        if (! mStream || ! mStream.write(header, sizeof(header))) {
+            cerr << fileName << ": failed to create\n";
+            return false;
+        }
+        return true;
+    }
+    template<typename T> void Append(int column, T val)
+    {
+        vector<char>& col = mColumns[column];
+        const size_t  pos = col.size();
+        col.resize(pos + sizeof(val));
+        char* ptr = &col[pos];
+        Put(ptr, val);
+    }
+    bool EndRow()
+    {
+        return (++mRowCount < mRowGroupSize || Flush());
+    }
+    bool Close()
+    {
+        if (! Flush()) {
+            return false;
+        }
+        mStream.close();
+        if (mStream.fail()) {
+            cerr << mFileName << ": write failure\n";
+            return false;
+        }
+        return true;
+    }
+    int64_t GetRowCount() const
+        { return (mRowsTotal + mRowCount); }
+private:
+    const vector<int>    mWidths;
+    vector<vector<char> > mColumns;
+    const uint32_t       mMagic;
+    const size_t         mRowGroupSize;
+    size_t               mRowCount;
+    int64_t              mRowsTotal;
+    string               mFileName;
+    ofstream             mStream;
+    vector<char>         mBuf;
+
+    template<typename T> static void Put(char*& ioPtr, T val)
+    {
+        char* const endPtr = ioPtr + sizeof(val);
+        char*       ptr    = endPtr;
+        while (ioPtr < ptr) {
+            *--ptr = (char)(val & 0xFF);
+            val >>= 8;
+        }
+        ioPtr = endPtr;
+    }
+    bool Flush()
+    {
+        if (mRowCount <= 0) {
+            return true;
+        }
+        const size_t kHeaderSize = 5 * sizeof(uint32_t);
+        mBuf.resize(kHeaderSize);
+        for (size_t i = 0; i < mColumns.size(); i++) {
+            if (mColumns[i].size() != mRowCount * mWidths[i]) {
+                cerr << mFileName << ": invalid column: " << i << "\n";
+                return false;
+            }
+            mBuf.insert(mBuf.end(), mColumns[i].begin(), mColumns[i].end());
+            mColumns[i].clear();
+        }
+        const uint32_t len = (uint32_t)(mBuf.size() - kHeaderSize);
+        char*          ptr = &mBuf[0];
+        Put(ptr, kCpExportRowGroupMagic);
+        Put(ptr, (uint32_t)mRowCount);
+        Put(ptr, (uint32_t)mColumns.size());
+        Put(ptr, len);
+        Put(ptr, (uint32_t)crc32(crc32(0L, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(&mBuf[kHeaderSize]), (uInt)len));
+        mRowsTotal += mRowCount;
+        mRowCount = 0;
+        if (! mStream.write(&mBuf[0], mBuf.size())) {
+            cerr << mFileName << ": write failure\n";
+            return false;
+        }
+        return true;
+    }
+private:
+    ColumnarWriter(const ColumnarWriter&);
+    ColumnarWriter& operator=(const ColumnarWriter&);
+};
+
+/*
+ * Joins directory entries with the file attributes, and writes name space
+ * rows. The checkpoint entries are ordered by the parent directory id for
+ * directory entries, and by the file id for file attributes, therefore the
+ * directory entry typically precedes the corresponding file attribute. Only
+ * the entries that are not yet matched are kept in memory.
+ */
+class CpExporter : public CheckpointScanner
+{
+public:
+    enum
+    {
+        kColId,
+        kColParent,
+        kColType,
+        kColSize,
+        kColReplication,
+        kColStriperType,
+        kColStripes,
+        kColRecoveryStripes,
+        kColStripeSize,
+        kColMtime,
+        kColUser,
+        kColGroup,
+        kColMode,
+        kColCount
+    };
+    enum
+    {
+        kDirColId,
+        kDirColParent,
+        kDirColFiles,
+        kDirColDirs,
+        kDirColBytes,
+        kDirColTotalFiles,
+        kDirColTotalDirs,
+        kDirColTotalBytes,
+        kDirColCount
+    };
+    CpExporter(
+        size_t rowGroupSize)
+        : CheckpointScanner(),
+          mWriter(kColWidths, kColCount, kCpExportMagic, rowGroupSize),
+          mDirsWriter(kDirColWidths, kDirColCount, kCpExportDirsMagic,
+            rowGroupSize),
+          mParents(),
+          mPendingAttrs(),
+          mDirs(),
+          mOrphanCount(0),
+          mOkFlag(true)
+        {}
+    virtual ~CpExporter()
+        {}
+    bool Open(const string& fileName)
+    {
+        return (mWriter.Open(fileName) && mDirsWriter.Open(fileName + ".dirs"));
+    }
+    virtual bool dentry(const string& name, fid_t id, fid_t parent)
+    {
+        if (name == "." || name == "..") {
+            return true;
+        }
+        if (! mParents.insert(make_pair(id, parent)).second) {
+            cerr << "duplicate directory entry: " << id << "\n";
+            return false;
+        }
+        return true;
+    }
+    virtual bool fattr(const MFattr& attr)
+    {
+        Parents::iterator const it = mParents.find(attr.id());
+        if (it == mParents.end()) {
+            mPendingAttrs.push_back(attr);
+            return true;
+        }
+        const fid_t parent = it->second;
+        mParents.erase(it);
+        return Add(attr, parent);
+    }
+    bool Finish()
+    {
+        for (PendingAttrs::const_iterator it = mPendingAttrs.begin();
+                mOkFlag && it != mPendingAttrs.end();
+                ++it) {
+            Parents::iterator const pit = mParents.find(it->id());
+            fid_t parent = -1;
+            if (pit == mParents.end()) {
+                mOrphanCount++;
+            } else {
+                parent = pit->second;
+                mParents.erase(pit);
+            }
+            Add(*it, parent);
+        }
+        PendingAttrs().swap(mPendingAttrs);
+        if (! mParents.empty()) {
+            cerr << "directory entries without attributes: " <<
+                mParents.size() << "\n";
+        }
+        if (0 < mOrphanCount) {
+            cerr << "attributes without directory entries: " <<
+                mOrphanCount << "\n";
+        }
+        return (mOkFlag && WriteDirs() && mWriter.Close() &&
+            mDirsWriter.Close());
+    }
+    int64_t GetRowCount() const
+        { return mWriter.GetRowCount(); }
+    int64_t GetDirRowCount() const
+        { return mDirsWriter.GetRowCount(); }
+private:
+    struct DirStats
+    {
+        DirStats()
+            : mParent(-1),
+              mDepth(-1),
+              mFiles(0),
+              mDirs(0),
+              mBytes(0),
+              mTotalFiles(0),
+              mTotalDirs(0),
+              mTotalBytes(0),
+              mAttrFlag(false)
+            {}
+        fid_t   mParent;
+        int     mDepth;
+        int64_t mFiles;
+        int64_t mDirs;
+        int64_t mBytes;
+        int64_t mTotalFiles;
+        int64_t mTotalDirs;
+        int64_t mTotalBytes;
+        bool    mAttrFlag;
+    };
+    typedef map<fid_t, fid_t>    Parents;
+    typedef vector<MFattr>       PendingAttrs;
+    typedef map<fid_t, DirStats> Dirs;
+    typedef std::pair<int, Dirs::iterator> DirRef;
+    struct DirRefCmp
+    {
+        bool operator()(const DirRef& l, const DirRef& r) const
+            { return (r.first < l.first); }
+    };
+
+    static const int kColWidths[kColCount];
+    static const int kDirColWidths[kDirColCount];
+
+    ColumnarWriter mWriter;
+    ColumnarWriter mDirsWriter;
+    Parents        mParents;
+    PendingAttrs   mPendingAttrs;
+    Dirs           mDirs;
+    int64_t        mOrphanCount;
+    bool           mOkFlag;
+
+    bool Add(const MFattr& attr, fid_t parent)
+    {
+        const bool        dirFlag = attr.type == KFS_DIR;
+        const chunkOff_t  size    = dirFlag ? chunkOff_t(0) :
+            max(chunkOff_t(0), attr.filesize);
+        mWriter.Append(kColId,              (int64_t)attr.id());
+        mWriter.Append(kColParent,          (int64_t)parent);
+        mWriter.Append(kColType,            (uint8_t)attr.type);
+        mWriter.Append(kColSize,            (int64_t)(dirFlag ?
+            chunkOff_t(-1) : attr.filesize));
+        mWriter.Append(kColReplication,     (int16_t)attr.numReplicas);
+        mWriter.Append(kColStriperType,     (uint8_t)attr.striperType);
+        mWriter.Append(kColStripes,         (uint16_t)attr.numStripes);
+        mWriter.Append(kColRecoveryStripes, (uint16_t)attr.numRecoveryStripes);
+        mWriter.Append(kColStripeSize,      (uint32_t)attr.stripeSize);
+        mWriter.Append(kColMtime,           (int64_t)attr.mtime);
+        mWriter.Append(kColUser,            (uint32_t)attr.user);
+        mWriter.Append(kColGroup,           (uint32_t)attr.group);
+        mWriter.Append(kColMode,            (uint16_t)attr.mode);
+        if (! mWriter.EndRow()) {
+            mOkFlag = false;
+            return false;
+        }
+        if (dirFlag) {
+            DirStats& dir = mDirs[attr.id()];
+            dir.mParent   = parent;
+            dir.mAttrFlag = true;
+        }
+        if (0 <= parent && parent != attr.id()) {
+            DirStats& dir = mDirs[parent];
+            if (dirFlag) {
+                dir.mDirs++;
+            } else {
+                dir.mFiles++;
+                dir.mBytes += size;
+            }
+        }
+        return true;
+    }
+    int GetDepth(Dirs::iterator it)
+    {
+        // Walk up to the first directory with known depth, then assign depth
+        // on the way back down.
+        vector<Dirs::iterator> path;
+        while (it->second.mDepth < 0) {
+            const fid_t parent = it->second.mParent;
+            Dirs::iterator const pit = (parent < 0 || parent == it->first ||
+                path.size() > mDirs.size()) ?
+                mDirs.end() : mDirs.find(parent);
+            if (pit == mDirs.end()) {
+                it->second.mDepth = 0;
+                break;
+            }
+            path.push_back(it);
+            it = pit;
+        }
+        int depth = it->second.mDepth;
+        while (! path.empty()) {
+            path.back()->second.mDepth = ++depth;
+            path.pop_back();
+        }
+        return depth;
+    }
+    bool WriteDirs()
+    {
+        vector<DirRef> dirs;
+        dirs.reserve(mDirs.size());
+        for (Dirs::iterator it = mDirs.begin(); it != mDirs.end(); ++it) {
+            dirs.push_back(DirRef(GetDepth(it), it));
+        }
+        // Roll up the totals from the deepest directories to the root.
+        sort(dirs.begin(), dirs.end(), DirRefCmp());
+        for (vector<DirRef>::const_iterator it = dirs.begin();
+                it != dirs.end();
+                ++it) {
+            DirStats& dir = it->second->second;
+            dir.mTotalFiles += dir.mFiles;
+            dir.mTotalDirs  += dir.mDirs;
+            dir.mTotalBytes += dir.mBytes;
+            if (0 < it->first) {
+                DirStats& parent = mDirs[dir.mParent];
+                parent.mTotalFiles += dir.mTotalFiles;
+                parent.mTotalDirs  += dir.mTotalDirs;
+                parent.mTotalBytes += dir.mTotalBytes;
+            }
+        }
+        dirs.clear();
+        for (Dirs::const_iterator it = mDirs.begin(); it != mDirs.end(); ++it) {
+            const DirStats& dir = it->second;
+            if (! dir.mAttrFlag) {
+                cerr << "directory without attributes: " << it->first << "\n";
+            }
+            mDirsWriter.Append(kDirColId,         (int64_t)it->first);
+            mDirsWriter.Append(kDirColParent,     (int64_t)dir.mParent);
+            mDirsWriter.Append(kDirColFiles,      dir.mFiles);
+            mDirsWriter.Append(kDirColDirs,       dir.mDirs);
+            mDirsWriter.Append(kDirColBytes,      dir.mBytes);
+            mDirsWriter.Append(kDirColTotalFiles, dir.mTotalFiles);
+            mDirsWriter.Append(kDirColTotalDirs,  dir.mTotalDirs);
+            mDirsWriter.Append(kDirColTotalBytes, dir.mTotalBytes);
+            if (! mDirsWriter.EndRow()) {
+                return false;
+            }
+        }
+        return true;
+    }
+private:
+    CpExporter(const CpExporter&);
+    CpExporter& operator=(const CpExporter&);
+};
+
+const int CpExporter::kColWidths[CpExporter::kColCount] = {
+    8, 8, 1, 8, 2, 1, 2, 2, 4, 8, 4, 4, 2
+};
+const int CpExporter::kDirColWidths[CpExporter::kDirColCount] = {
+    8, 8, 8, 8, 8, 8, 8, 8
+};
+
+static int
+CpExportMain(int argc, char** argv)
+{
+    int    optchar;
+    bool   help         = false;
+    string cpdir;
+    string cpfile;
+    string outFn;
+    string lockfn;
+    int    threads      = 4;
+    int    rowGroupSize = 64 << 10;
+    int    status       = 0;
+
+    while ((optchar = getopt(argc, argv, "hc:f:o:L:t:r:")) != -1) {
+        switch (optchar) {
+            case 'L':
+                lockfn = optarg;
+                break;
+            case 'c':
+                cpdir = optarg;
+                break;
+            case 'f':
+                cpfile = optarg;
+                break;
+            case 'o':
+                outFn = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'r':
+                rowGroupSize = atoi(optarg);
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                status = 1;
+                break;
+        }
+    }
+
+    if (help || status != 0 || outFn.empty() || rowGroupSize <= 0) {
+        (status ? cerr : cout) << "Usage: " << argv[0] << "\n"
+            "-o <output fn> directory aggregates are written into"
+                " <output fn>.dirs\n"
+            "[-L <lockfile>]\n"
+            "[-c <cpdir>]\n"
+            "[-f <checkpoint file> default: <cpdir>/latest]\n"
+            "[-t <checkpoint parser threads> default: 4]\n"
+            "[-r <rows per row group> default: 65536]\n"
+        ;
+        return (help ? 0 : 1);
+    }
+
+    MdStream::Init();
+    MsgLogger::Init(0, MsgLogger::kLogLevelINFO);
+
+    checkpointer_setup_paths(cpdir);
+    if (! lockfn.empty()) {
+        acquire_lockfile(lockfn, 10);
+    }
+    CpExporter exporter((size_t)rowGroupSize);
+    Restorer   restorer(threads);
+    if (! exporter.Open(outFn) ||
+            ! restorer.scan(cpfile.empty() ? LASTCP : cpfile, exporter) ||
+            ! exporter.Finish()) {
+        status = 1;
+    } else {
+        KFS_LOG_STREAM_INFO <<
+            "exported: " << exporter.GetRowCount() <<
+            " directories: " << exporter.GetDirRowCount() <<
+        KFS_LOG_EOM;
+    }
+
+    MdStream::Cleanup();
+    return status;
+}
+
+} // namespace KFS
+
+int
+main(int argc, char** argv)
+{
+    return KFS::CpExportMain(argc, argv);
+}
@@ -0,0 +1,163 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/16
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Chunk server map memory use and throughput benchmark. The map hash
+// table implementation is selected at compile time, the build produces
+// csmapbench with the configured implementation, and csmapbench_flat with
+// the open addressing hash table (KFS_CSMAP_FLAT_TABLE), in order to compare
+// the implementations side by side on the same host.
+//
+//----------------------------------------------------------------------------
+
+#include "CSMap.h"
+#include "meta.h"
+#include "common/time.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <algorithm>
+
+namespace KFS
+{
+using std::cout;
+using std::cerr;
+using std::max;
+
+// Measure the chunk server map memory use and throughput with the chunk count
+// large enough to exceed cpu caches.
+static int
+CSMapBenchmark(chunkId_t chunkCount)
+{
+    CSMap            map;
+    MetaFattr* const fattr = MetaFattr::create(KFS_FILE, 1, 1,
+        kKfsUserRoot, kKfsGroupRoot, 0644, microseconds());
+    int64_t          start = microseconds();
+    for (chunkId_t cid = 1; cid <= chunkCount; cid++) {
+        bool newEntryFlag = false;
+        if (! map.Insert(fattr, (chunkOff_t)cid * CHUNKSIZE, cid, 1,
+                newEntryFlag) || ! newEntryFlag) {
+            cerr << "duplicate chunk id: " << cid << "\n";
+            return 1;
+        }
+    }
+    const int64_t insertTime = microseconds() - start;
+    const size_t  storage    = map.GetAllocator().GetStorageSize();
+    const size_t  tableBytes = map.GetTableByteCount();
+    // Random order lookups, the step is prime, and co-prime with any
+    // reasonable chunk count.
+    const chunkId_t kStep = 1000003;
+    chunkId_t       cid   = 0;
+    start = microseconds();
+    for (chunkId_t i = 0; i < chunkCount; i++) {
+        cid = (cid + kStep) % chunkCount;
+        if (! map.Find(cid + 1)) {
+            cerr << "missing chunk entry: " << (cid + 1) << "\n";
+            return 1;
+        }
+    }
+    const int64_t findTime = microseconds() - start;
+    // Replication check scan walks the state list.
+    chunkId_t count = 0;
+    start = microseconds();
+    map.First(CSMap::Entry::kStateNone);
+    while (map.Next(CSMap::Entry::kStateNone)) {
+        count++;
+    }
+    const int64_t scanTime = microseconds() - start;
+    if (count != chunkCount) {
+        cerr << "invalid state list entry count: " << count << "\n";
+        return 1;
+    }
+    start = microseconds();
+    for (cid = 1; cid <= chunkCount; cid++) {
+        if (map.Erase(cid) != 1) {
+            cerr << "failed to erase chunk entry: " << cid << "\n";
+            return 1;
+        }
+    }
+    const int64_t eraseTime = microseconds() - start;
+    // The file attribute is intentionally not destroyed, in order not to
+    // depend on the meta tree node implementation.
+    const double kUsec = 1e6;
+    cout <<
+        "table: "          << CSMap::GetTableType() <<
+        " chunks: "        << chunkCount <<
+        " entry size: "    << map.GetAllocator().GetItemSize() <<
+        " bytes/chunk:"
+        " entries: "       << (double)storage / chunkCount <<
+        " table: "         << (double)tableBytes / chunkCount <<
+        " ops/sec:"
+        " insert: "        << chunkCount * kUsec / max(int64_t(1), insertTime) <<
+        " find: "          << chunkCount * kUsec / max(int64_t(1), findTime) <<
+        " scan: "          << chunkCount * kUsec / max(int64_t(1), scanTime) <<
+        " erase: "         << chunkCount * kUsec / max(int64_t(1), eraseTime) <<
+    "\n";
+    return 0;
+}
+
+static int
+CSMapBenchmarkMain(int argc, char** argv)
+{
+    int       optchar;
+    bool      help       = false;
+    int       status     = 0;
+    chunkId_t chunkCount = chunkId_t(10) << 20;
+    int       runs       = 3;
+
+    while ((optchar = getopt(argc, argv, "hn:r:")) != -1) {
+        switch (optchar) {
+            case 'n':
+                chunkCount = (chunkId_t)atoll(optarg);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'h':
+                help = true;
+                break;
+            default:
+                status = 1;
+                break;
+        }
+    }
+    if (help || status != 0 || optind < argc || chunkCount <= 0 || runs <= 0) {
+        (help ? cout : cerr) << "Usage: " << argv[0] <<
+            " [-n <chunk count>, default: 10485760]"
+            " [-r <number of runs>, default: 3]\n"
+            "Measure chunk server map memory use and throughput.\n"
+        ;
+        return (help ? 0 : 1);
+    }
+    for (int i = 0; i < runs && status == 0; i++) {
+        status = CSMapBenchmark(chunkCount);
+    }
+    return status;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+    return KFS::CSMapBenchmarkMain(argc, argv);
+}
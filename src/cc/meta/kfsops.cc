@@ -46,6 +46,14 @@ using std::make_pair;
 const string kParentDir("..");
 const string kThisDir(".");
 
+// Compare the dentry name in place, without copying it into a string.
+static inline bool
+IsThisOrParentDir(const MetaDentry& de)
+{
+    return (de.getNameLen() <= kParentDir.size() &&
+        (de.compareName(kThisDir) == 0 || de.compareName(kParentDir) == 0));
+}
+
 const string DUMPSTERDIR("dumpster");
 
 inline void
@@ -172,7 +180,7 @@ Tree::link(fid_t dir, const string& fname, FileType type, fid_t myID,
     if (fattr) {
         assert(parent);
         fattr->parent = parent;
-        parent->mtime = mtime;
+        modify(parent)->mtime = mtime;
         insert(fattr);
     }
     if (newFattr) {
@@ -267,7 +275,8 @@ Tree::create(fid_t dir, const string& fname, fid_t *newFid,
     }
     UpdateNumFiles(1);
     updateCounts(fa, 0, 1, 0);
-    fa->minSTier = 0 == numReplicas ? parent->maxSTier : parent->minSTier;
+    modify(fa)->minSTier =
+        0 == numReplicas ? parent->maxSTier : parent->minSTier;
     fa->maxSTier = parent->maxSTier;
     if (newFattr) {
         *newFattr = fa;
@@ -371,7 +380,7 @@ Tree::setFileSize(MetaFattr* fa, chunkOff_t size, int64_t nfiles, int64_t ndirs)
         return;
     }
     updateCounts(fa, size - getFileSize(fa), nfiles, ndirs);
-    fa->filesize = size;
+    modify(fa)->filesize = size;
 }
 
 /*!
@@ -437,7 +446,7 @@ Tree::remove(fid_t dir, const string& fname, const string& pathname,
         gLayoutManager.DeleteFile(*fa);
     }
     UpdateNumFiles(-1);
-    parent->mtime = mtime;
+    modify(parent)->mtime = mtime;
     setFileSize(fa, 0, -1, 0);
 
     unlink(dir, fname, fa, false);
@@ -507,6 +516,8 @@ Tree::mkdir(fid_t dir, const string& dname,
     }
     updateCounts(fattr, 0, 0, 1);
     if (parent) {
+        modify(parent);
+        modify(fattr);
         parent->mtime = mtime;
         fattr->minSTier = parent->minSTier;
         fattr->maxSTier = parent->maxSTier;
@@ -592,7 +603,7 @@ Tree::rmdir(fid_t dir, const string& dname, const string& pathname,
     }
     invalidatePathCache(pathname, dname, fa);
     UpdateNumDirs(-1);
-    parent->mtime = mtime;
+    modify(parent)->mtime = mtime;
     setFileSize(fa, 0, 0, -1);
     unlink(myID, kThisDir, fa, true);
     unlink(myID, kParentDir, fa, true);
@@ -600,6 +611,154 @@ Tree::rmdir(fid_t dir, const string& dname, const string& pathname,
     return 0;
 }
 
+/*!
+ * \brief incrementally check that the user can remove every entry in the sub
+ * tree. Directories are scanned depth first with the explicit stack, at most
+ * check.maxEntries directory entries are checked per invocation.
+ * The sub tree modifications made between the invocations by other requests
+ * are not re-validated, the same as with the client side tree traversal.
+ * \param[in,out] check  check state, the stack must contain the sub tree
+ * root directory prior to the first invocation
+ * \return      0 if every directory in the sub tree is writable and
+ * searchable, and no entry is protected by the sticky bit; -EAGAIN if more
+ * entries remain to be checked; -EACCES otherwise.
+ */
+int
+Tree::canRemoveSubtree(RmdirsCheck& check, kfsUid_t euser, kfsGid_t egroup)
+{
+    StTmp<vector<MetaDentry*> > dentriesTmp(mDentriesTmp);
+    vector<MetaDentry*>&        v      = dentriesTmp.Get();
+    int                         budget = max(2, check.maxEntries);
+    while (! check.stack.empty()) {
+        if (budget <= 0) {
+            return -EAGAIN;
+        }
+        const fid_t      dir = check.stack.back().first;
+        MetaFattr* const fa  = getFattr(dir);
+        if (! fa || fa->type != KFS_DIR) {
+            // Removed or replaced by other requests since it was queued.
+            check.stack.pop_back();
+            continue;
+        }
+        v.clear();
+        bool moreFlag = false;
+        if (check.stack.back().second.empty()) {
+            if (! fa->CanWrite(euser, egroup) ||
+                    ! fa->CanSearch(euser, egroup)) {
+                return -EACCES;
+            }
+            if (readdir(dir, v, max(2, budget), &moreFlag) != 0) {
+                return -EACCES;
+            }
+        } else if (readdir(dir, check.stack.back().second, v, budget,
+                moreFlag, true) != 0) {
+            check.stack.pop_back();
+            continue;
+        }
+        budget -= (int)v.size();
+        if (moreFlag && ! v.empty()) {
+            check.stack.back().second.assign(
+                v.back()->getNamePtr(), v.back()->getNameLen());
+        } else {
+            check.stack.pop_back();
+        }
+        for (vector<MetaDentry*>::const_iterator it = v.begin();
+                it != v.end();
+                ++it) {
+            if (IsThisOrParentDir(**it)) {
+                continue;
+            }
+            const MetaFattr* const cfa = getFattr((*it)->id());
+            if (! cfa) {
+                panic("rmdirs: null file attribute");
+                return -EFAULT;
+            }
+            if (IsDeleteRestricted(fa, cfa, euser)) {
+                return -EACCES;
+            }
+            if (cfa->type == KFS_DIR) {
+                check.stack.push_back(make_pair(cfa->id(), string()));
+            }
+        }
+    }
+    return 0;
+}
+
+/*!
+ * \brief remove a directory along with all its content.
+ * The directory is detached from the name space by moving it into the
+ * dumpster; the sub tree is reclaimed incrementally by reclaimDumpster().
+ * \param[in] dir   file id of the parent directory
+ * \param[in] dname name of directory
+ * \param[in] pathname  fully qualified path to dname
+ * \param[in,out] todumpster    dumpster name suffix, the directory id is
+ * used if negative
+ * \param[in,out] check  incremental sub tree permission check state, required
+ * for non root users
+ * \return      status code (zero on success), -EAGAIN if the sub tree
+ * permission check is not complete yet, and rmdirs must be invoked again with
+ * the same check state
+ */
+int
+Tree::rmdirs(fid_t dir, const string& dname, const string& pathname,
+    fid_t& todumpster, kfsUid_t euser, kfsGid_t egroup, int64_t mtime,
+    RmdirsCheck* check)
+{
+    MetaFattr* fa     = 0;
+    MetaFattr* parent = 0;
+    const int  status = lookup(dir, dname, euser, egroup, fa, &parent);
+    if (status != 0) {
+        return status;
+    }
+    if (! fa || ! parent) {
+        panic("rmdirs: null file or parent attribute");
+        return -EFAULT;
+    }
+    if (dir == ROOTFID && (dname == DUMPSTERDIR || dname == "/")) {
+        KFS_LOG_STREAM_INFO << "attempt to delete: /" <<
+            dname << KFS_LOG_EOM;
+        return -EPERM;
+    }
+    if (dname == kThisDir) {
+        return -EINVAL;
+    }
+    if (dname == kParentDir) {
+        return -ENOTEMPTY;
+    }
+    if (fa->type != KFS_DIR) {
+        return -ENOTDIR;
+    }
+    if (! parent->CanWrite(euser, egroup)) {
+        return -EACCES;
+    }
+    if (IsDeleteRestricted(parent, fa, euser)) {
+        return -EPERM;
+    }
+    if (euser != kKfsUserRoot) {
+        if (! check) {
+            return -EACCES;
+        }
+        if (check->dir != fa->id()) {
+            // First invocation, or the path now refers to another directory.
+            check->dir = fa->id();
+            check->stack.clear();
+            check->stack.push_back(make_pair(fa->id(), string()));
+        }
+        const int ret = canRemoveSubtree(*check, euser, egroup);
+        if (ret != 0) {
+            return ret;
+        }
+        check->dir = -1;
+    }
+    if (todumpster <= 0) {
+        todumpster = fa->id();
+    }
+    invalidatePathCache(pathname, dname, fa, true);
+    KFS_LOG_STREAM_DEBUG << "moving directory " << dname << " to dumpster" <<
+    KFS_LOG_EOM;
+    return moveToDumpster(dir, dname, todumpster, mtime);
+}
+
 /*!
  * \brief return attributes for the specified object
  * \param[in] fid   the object's file id
@@ -626,7 +785,7 @@ Tree::getDentry(fid_t dir, const string& fname)
     }
     while (n && key == n->getkey(p)) {
         MetaDentry* const de = refine<MetaDentry>(n->leaf(p));
-        if (de->getHash() == hash && de->getName() == fname) {
+        if (de->getHash() == hash && de->compareName(fname) == 0) {
             return de;
         }
         if (++p == n->children()) {
@@ -658,8 +817,7 @@ Tree::getDentry(fid_t fid)
     while (m != NULL) {
         if (m->metaType() == KFS_DENTRY &&
                 (d = refine<MetaDentry>(m))->id() == fid) {
-            const string& name = d->getName();
-            if (name != kThisDir && name != kParentDir) {
+            if (! IsThisOrParentDir(*d)) {
                 return d;
             }
         }
@@ -710,7 +868,7 @@ public:
         if (! mListAllFlag && mFids.find(fa.id()) == mFids.end()) {
             return true;
         }
-        mOs << dirpath << de.getName() <<
+        de.showName(mOs << dirpath) <<
             ' ' << fa.id() <<
             ' ' << fa.filesize <<
             ' ' << DisplayIsoDateTime(fa.mtime) <<
@@ -766,6 +924,7 @@ Tree::recomputeDirSize()
 void
 Tree::recomputeDirSize(MetaFattr* dirattr)
 {
+    modify(dirattr);
     dirattr->filesize    = 0;
     dirattr->dirCount()  = 0;
     dirattr->fileCount() = 0;
@@ -780,11 +939,8 @@ Tree::recomputeDirSize(MetaFattr* dirattr)
     for (Node* p;
             (p = it.parent()) && p->getkey(it.index()) == dkey;
             it.next()) {
-        MetaDentry&   entry     = *refine<MetaDentry>(it.current());
-        const string& entryname = entry.getName();
-        if (entry.id() == dir ||
-                entryname == kThisDir ||
-                entryname == kParentDir) {
+        MetaDentry& entry = *refine<MetaDentry>(it.current());
+        if (entry.id() == dir || IsThisOrParentDir(entry)) {
             MetaFattr* const fa = entry.id() == dir ?
                 dirattr : dirattr->parent;
             if (! fa) {
@@ -848,9 +1004,7 @@ Tree::changeDirReplication(MetaFattr* dirattr, int16_t numReplicas,
     vector<MetaDentry*>&        entries = dentriesTmp.Get();
     readdir(dir, entries);
     for (uint32_t i = 0; i < entries.size(); i++) {
-        const string& entryname = entries[i]->getName();
-        if (entryname == kThisDir || entryname == kParentDir ||
-                entries[i]->id() == dir) {
+        if (IsThisOrParentDir(*entries[i]) || entries[i]->id() == dir) {
             continue;
         }
         MetaFattr *fa = getFattr(entries[i]->id());
@@ -899,16 +1053,14 @@ Tree::getPathname(const MetaFattr* fa)
         while (n && dkey == n->getkey(p)) {
             const MetaDentry* const de =
                 refine<MetaDentry>(n->leaf(p));
-            if (de->id() == curid) {
-                const string& name = de->getName();
-                if (name != kThisDir && name != kParentDir) {
-                    if (path.empty()) {
-                        path = name;
-                    } else {
-                        path = name + "/" + path;
-                    }
-                    break;
+            if (de->id() == curid && ! IsThisOrParentDir(*de)) {
+                if (path.empty()) {
+                    de->appendName(path);
+                } else {
+                    path.insert(0, 1, '/');
+                    path.insert(0, de->getNamePtr(), de->getNameLen());
                 }
+                break;
             }
             if (++p == n->children()) {
                 p = 0;
@@ -1133,6 +1285,7 @@ Tree::updateCounts(MetaFattr* fa, chunkOff_t nbytes, int64_t nfiles, int64_t ndi
         if (parent->type != KFS_DIR) {
             panic("invalid parent pointer");
         }
+        modify(parent);
         parent->filesize    += nbytes;
         parent->fileCount() += nfiles;
         parent->dirCount()  += ndirs;
@@ -1193,13 +1346,19 @@ Tree::readdir(fid_t dir, vector<MetaDentry*>& v,
 
 int
 Tree::readdir(fid_t dir, const string& fnameStart,
-        vector<MetaDentry*>& v, int maxEntries, bool& moreEntriesFlag)
+        vector<MetaDentry*>& v, int maxEntries, bool& moreEntriesFlag,
+        bool resumeFlag)
 {
     moreEntriesFlag = false;
     const KeyData hash = MetaDentry::nameHash(fnameStart);
     const Key     key(KFS_DENTRY, dir, hash);
     int           kp;
-    Node* const   l = findLeaf(key, kp);
+    Node*         l = findLeaf(key, kp);
+    if (! l && resumeFlag) {
+        // The start entry and all entries with the same name hash were
+        // removed, resume from the next name hash.
+        l = lowerBound(key, kp);
+    }
     if (! l) {
         return -ENOENT;
     }
@@ -1208,7 +1367,7 @@ Tree::readdir(fid_t dir, const string& fnameStart,
     Node*    p;
     while ((p = it.parent()) && p->getkey(it.index()) == key) {
         MetaDentry* const de = refine<MetaDentry>(it.current());
-        if (de->getHash() == hash && de->getName() == fnameStart) {
+        if (de->getHash() == hash && de->compareName(fnameStart) == 0) {
             it.next();
             foundFlag = true;
             break;
@@ -1216,7 +1375,14 @@ Tree::readdir(fid_t dir, const string& fnameStart,
         it.next();
     }
     if (! foundFlag) {
-        return -ENOENT;
+        if (! resumeFlag) {
+            return -ENOENT;
+        }
+        // The start entry was removed. The order of the entries with the
+        // same name hash is not defined, therefore restart at the first
+        // entry with the start entry hash, in order not to skip any of
+        // the remaining entries with the same hash.
+        it = LeafIter(l, kp);
     }
     const PartialMatch dkey(KFS_DENTRY, dir);
     int                maxRet = maxEntries <= 0 ? -1 : maxEntries;
@@ -1595,6 +1761,8 @@ Tree::assignChunkId(fid_t file, chunkOff_t offset,
                         c->chunkVersion == chunkVersion) {
                     return -EEXIST;
                 }
+                modify(c);
+                modify(fa);
                 c->chunkVersion = chunkVersion;
                 if (appendReplayFlag && ! fa->IsStriped()) {
                     const chunkOff_t size = max(
@@ -1631,6 +1799,7 @@ Tree::assignChunkId(fid_t file, chunkOff_t offset,
         }
     }
     // insert succeeded; so, bump the chunkcount.
+    modify(fa);
     if (0 != fa->numReplicas) {
         fa->chunkcount()++;
     }
@@ -1727,6 +1896,8 @@ Tree::coalesceBlocks(MetaFattr* srcFa, MetaFattr* dstFa,
     getalloc(srcFa->id(), chunkInfo);
     srcFid = srcFa->id();
     dstFid = dstFa->id();
+    modify(srcFa);
+    modify(dstFa);
     const chunkOff_t dstStartPos = dstFa->nextChunkOffset();
     if (! chunkInfo.empty()) {
         // Flush the fid cache.
@@ -1853,6 +2024,7 @@ Tree::truncate(fid_t file, chunkOff_t offset, const int64_t* mtime,
     if (fa->filesize == offset) {
         return 0;
     }
+    modify(fa);
     if (0 == fa->numReplicas) {
         if (! setEofHintFlag || 0 <= endOffset ||
                 (0 < offset && fa->nextChunkOffset() <= 0) ||
@@ -2064,7 +2236,7 @@ Tree::rename(fid_t parent, const string& oldname, const string& newname,
     const bool kRemoveDirPrefixFlag = true;
     invalidatePathCache(oldpath, oldname, sfattr, kRemoveDirPrefixFlag);
 
-    sdfattr->mtime = mtime;
+    modify(sdfattr)->mtime = mtime;
     if (t == KFS_DIR && ddfattr) {
         // get rid of the linkage of the "old" ..
         unlink(srcfid, kParentDir, sfattr, true);
@@ -2088,7 +2260,7 @@ Tree::rename(fid_t parent, const string& oldname, const string& newname,
             sfattr->dirCount() + 1 : 0;
         setFileSize(sfattr, 0, -fileCnt, -dirCnt);
         sfattr->parent = ddfattr;
-        ddfattr->mtime = mtime;
+        modify(ddfattr)->mtime = mtime;
         // Set both parent and dentry attribute, ensuring that dentry
         // attribute is setup, in order to make consistency check in
         // recomputeDirSize() work.
@@ -2146,6 +2318,7 @@ Tree::changeFileReplication(MetaFattr* fa, int16_t numReplicas,
                 (maxSTier < kKfsSTierMin || kKfsSTierMax < maxSTier)))) {
         return -EINVAL;
     }
+    modify(fa);
     if (minSTier != kKfsSTierUndef) {
         fa->minSTier = minSTier;
         if (fa->maxSTier < minSTier) {
@@ -2258,4 +2431,153 @@ Tree::cleanupDumpster()
     readdir(dir, v);
     for_each(v.begin(), v.end(), RemoveDumpsterEntry(dir));
 }
+
+/*!
+ * \brief Park the dumpster entry that cannot be removed, in order to exclude
+ * it from the subsequent reclaim runs.
+ */
+void
+Tree::parkDumpsterEntry(fid_t parent, const string& name, fid_t fid,
+    const char* op, int status)
+{
+    KFS_LOG_STREAM_ERROR << "reclaim dumpster: " << op << " " <<
+        name << " dir: " << parent << " status: " << status <<
+        " parking: " << fid <<
+    KFS_LOG_EOM;
+    mDumpsterParked.insert(fid);
+}
+
+/*!
+ * \brief remove the content of the dumpster directory
+ * \param[in] parent    parent directory id
+ * \param[in] name      directory name
+ * \param[in] dir       directory id
+ * \param[in,out] budget    remaining number of entries and chunks to delete
+ * \return      true if the directory was removed; if the directory was not
+ * removed, and is now parked, then no work remains in its sub tree
+ */
+bool
+Tree::reclaimDumpsterDir(fid_t parent, const string& name, fid_t dir,
+    int64_t& budget, int64_t mtime)
+{
+    StTmp<vector<MetaDentry*> > dentriesTmp(mDentriesTmp);
+    vector<MetaDentry*>&        v = dentriesTmp.Get();
+    bool                        moreFlag = false;
+    // Parked entries are read, and skipped, in order to make progress when
+    // these are at the beginning of the directory.
+    const int                   maxRead  = (int)min(
+        budget + (int64_t)mDumpsterParked.size(), int64_t(1) << 20) + 2;
+    if (readdir(dir, v, maxRead, &moreFlag) != 0) {
+        return false;
+    }
+    // Copy names and ids, as the dentries are deleted below.
+    vector<pair<string, fid_t> > entries;
+    entries.reserve(v.size());
+    for (vector<MetaDentry*>::const_iterator it = v.begin();
+            it != v.end();
+            ++it) {
+        if (! IsThisOrParentDir(**it) &&
+                mDumpsterParked.find((*it)->id()) == mDumpsterParked.end()) {
+            entries.push_back(make_pair(string(), (*it)->id()));
+            (*it)->appendName(entries.back().first);
+        }
+    }
+    for (vector<pair<string, fid_t> >::const_iterator it = entries.begin();
+            it != entries.end() && 0 < budget;
+            ++it) {
+        const MetaFattr* const fa = getFattr(it->second);
+        if (! fa) {
+            panic("reclaim dumpster: null file attribute");
+            return false;
+        }
+        if (fa->type == KFS_DIR) {
+            if (! reclaimDumpsterDir(dir, it->first, it->second,
+                    budget, mtime) &&
+                    mDumpsterParked.find(it->second) ==
+                        mDumpsterParked.end()) {
+                moreFlag = true;
+            }
+            continue;
+        }
+        budget -= 1 + max(int64_t(0), fa->chunkcount());
+        fid_t     todumpster = -1;
+        const int status     = remove(dir, it->first, string(), todumpster,
+            kKfsUserRoot, kKfsGroupRoot, mtime);
+        if (status != 0) {
+            parkDumpsterEntry(dir, it->first, it->second, "remove", status);
+        }
+    }
+    if (budget <= 0 || moreFlag) {
+        return false;
+    }
+    if (! emptydir(dir)) {
+        // All remaining entries are parked.
+        parkDumpsterEntry(parent, name, dir, "parked entries", -ENOTEMPTY);
+        return false;
+    }
+    budget--;
+    const int status = rmdir(parent, name, string(),
+        kKfsUserRoot, kKfsGroupRoot, mtime);
+    if (status != 0) {
+        parkDumpsterEntry(parent, name, dir, "rmdir", status);
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief Incrementally delete directory sub trees moved into the dumpster
+ * by rmdirs. Files are handled by cleanupDumpster.
+ * \param[in] maxEntries    max number of files, directories, and chunks to
+ * delete
+ * \return      true if more work remains
+ */
+bool
+Tree::reclaimDumpster(int maxEntries)
+{
+    MetaFattr* fa = 0;
+    lookup(ROOTFID, DUMPSTERDIR, kKfsUserRoot, kKfsGroupRoot, fa);
+    if (! fa) {
+        return false;
+    }
+    const fid_t                 dumpster = fa->id();
+    StTmp<vector<MetaDentry*> > dentriesTmp(mDentriesTmp);
+    vector<MetaDentry*>&        v = dentriesTmp.Get();
+    readdir(dumpster, v);
+    vector<pair<string, fid_t> > dirs;
+    for (vector<MetaDentry*>::const_iterator it = v.begin();
+            it != v.end();
+            ++it) {
+        if (IsThisOrParentDir(**it)) {
+            continue;
+        }
+        const MetaFattr* const cfa = getFattr((*it)->id());
+        if (cfa && cfa->type == KFS_DIR &&
+                mDumpsterParked.find(cfa->id()) == mDumpsterParked.end()) {
+            dirs.push_back(make_pair(string(), cfa->id()));
+            (*it)->appendName(dirs.back().first);
+        }
+    }
+    if (dirs.empty()) {
+        // Retry the parked entries with the next run.
+        mDumpsterParked.clear();
+        return false;
+    }
+    const int64_t mtime  = microseconds();
+    int64_t       budget = max(1, maxEntries);
+    bool          moreFlag = false;
+    for (vector<pair<string, fid_t> >::const_iterator it = dirs.begin();
+            it != dirs.end();
+            ++it) {
+        if (budget <= 0 || (! reclaimDumpsterDir(
+                    dumpster, it->first, it->second, budget, mtime) &&
+                mDumpsterParked.find(it->second) == mDumpsterParked.end())) {
+            moreFlag = true;
+        }
+        if (budget <= 0) {
+            break;
+        }
+    }
+    return moreFlag;
+}
 } // namespace KFS
@@ -22,6 +22,7 @@
  * implied. See the License for the specific language governing
  * permissions and limitations under the License.
  */
+#include <cerrno>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -32,268 +33,10 @@
 namespace KFS
 {
 
-using std::for_each;
-using std::hex;
 using std::cerr;
 
 Tree metatree;
 
-/*!
- * \brief Insert a child node at the indicated position.
- * \param[in] child the node to be inserted
- * \param[in] pos   the index where it should go
- */
-void
-Node::addChild(Key *k, MetaNode *child, int pos)
-{
-    openHole(pos, 1);
-    childKey[pos] = *k;
-    childNode[pos] = child;
-}
-
-/*!
- * \brief remove child and shift remaining entries to fill in the hole
- * \param[in] pos index of the child node
- *
- */
-void
-Node::remove(int pos)
-{
-    assert(pos >= 0 && pos < count);
-    Meta *m = leaf(pos);
-    m->destroy();
-    closeHole(pos, 1);
-}
-
-void
-Node::moveChildren(Node *dest, int start, int n)
-{
-    for (int i = 0; i != n; i++)
-        dest->appendChild(childKey[start + i], childNode[start + i]);
-    childKey[start] = Key(KFS_SENTINEL, 0);
-    childNode[start] = NULL;
-}
-
-/*!
- * \brief split a full node
- * \param[in] t the tree (in case we add a new root)
- * \param[in] father    the parent of this node
- * \param[in] pos   position of this node in parent
- * \return  pointer to newly constructed sibling node
- *
- * Split this node (which is assumed to be full) into two
- * pieces, adding a new pointer to the father node, and if
- * necessary, a new root to the tree.  We split full nodes
- * as we traverse the tree downwards, so it should never
- * happen that the father node is full at this point.
- */
-Node *
-Node::split(Tree *t, Node *father, int pos)
-{
-    Node *brother = Node::create(flags());
-
-    brother->linkToPeer(next);
-    linkToPeer(brother);
-    moveChildren(brother, count - NSPLIT, NSPLIT);
-    count -= NSPLIT;
-    if (father == NULL) {   // this must be the root
-        assert(t->getroot() == this);
-        t->pushroot(brother);
-    } else {
-        assert(!father->isfull());
-        assert(father->child(pos) == this);
-        father->resetKey(pos);
-        Key k = brother->key();
-        father->addChild(&k, brother, 1 + pos);
-    }
-    return brother;
-}
-
-/*
- * Create a space in the link array by moving everything
- * with index >= _pos_ by _skip_ spaces to the right.
- * N.B. Node must not be full
- */
-void
-Node::openHole(int pos, int skip)
-{
-    count += skip;
-    assert(count <= NKEY);
-    for (int i = count - 1; i >= pos + skip; --i) {
-        childKey[i] = childKey[i - skip];
-        childNode[i] = childNode[i - skip];
-    }
-}
-
-/*
- * Fill in a hole created by moving or deleting child pointers.
- * pos is the beginning of the hole and skip is its size.
- */
-void
-Node::closeHole(int pos, int skip)
-{
-    assert(skip < count);
-    count -= skip;
-    for (int i = pos; i != count; i++) {
-        childKey[i] = childKey[i + skip];
-        childNode[i] = childNode[i + skip];
-    }
-    childKey[count] = Key(KFS_SENTINEL, 0);
-    childNode[count] = NULL;
-}
-
-/*
- * Insert a new metadata item at the specified position
- * in this node, after making space by moving everything
- * with index >= pos to the right.
- */
-void
-Node::insertData(Key *k, Meta *item, int pos)
-{
-    assert(hasleaves());
-    addChild(k, item, pos);
-}
-
-/*
- * This node is absorbed by its left neighbor.
- */
-void
-Node::absorb(Node *l)
-{
-    assert(count + l->children() <= NKEY);
-    moveChildren(l, 0, count);
-    count = 0;
-    l->next = next;
-}
-
-/*!
- * \brief join an underfull node with its neighbor if possible
- * \param[in] pos   position of underfull child
- * \return      true if operation succeeded
- *
- * If the underfull child node at position pos has a
- * neighbor on either side that can absorb it, combine
- * the two nodes into one.
- *
- * Don't do the merge if the resulting node would be completely
- * full, since in that case, balanceNeighbor is probably a better
- * remedy.
- *
- * Return true if merge took place.
- */
-bool
-Node::mergeNeighbor(int pos)
-{
-    assert(!hasleaves());
-    Node *left = leftNeighbor(pos);
-    Node *right = rightNeighbor(pos);
-    Node *middle = child(pos);
-    int mkids = middle->children();
-    int base;
-
-    if (left != NULL && mkids + left->children() < NKEY) {
-        middle->absorb(left);
-        base = pos - 1;
-    } else if (right != NULL && mkids + right->children() < NKEY) {
-        right->absorb(middle);
-        base = pos;
-    } else
-        return false;
-
-    childKey[base] = childKey[base + 1];
-    childNode[base + 1]->destroy();
-    closeHole(base + 1, 1);
-
-    return true;
-}
-
-/*
- * Move n children from _start_ in this node to the
- * beginning of _dest.
- */
-void
-Node::insertChildren(Node *dest, int start, int n)
-{
-    count -= n;
-    for (int i = 0; i != n; i++)
-        dest->placeChild(childKey[start + i], childNode[start + i], i);
-}
-
-/*
- * Move nshift children from the right end of this node
- * to the beginning of _dest_.
- */
-void
-Node::shiftRight(Node *dest, int nshift)
-{
-    dest->openHole(0, nshift);
-    insertChildren(dest, count - nshift, nshift);
-}
-
-/*
- * Move nshift children from the beginning of this node
- * to the end of _dest_.
- */
-void
-Node::shiftLeft(Node *dest, int nshift)
-{
-    moveChildren(dest, 0, nshift);
-    closeHole(0, nshift);
-}
-
-/*
- * Adjust the key for this position to match the rightmost
- * key of the child node; corrects the key value following
- * movement of children between nodes.
- */
-void
-Node::resetKey(int pos)
-{
-    Node *c = child(pos);
-    assert(c != NULL);
-    childKey[pos] = c->key();
-}
-
-/*!
- * \brief fill an underfull node by borrowing from neighbor
- * \param[in] pos   position of underfull child
- * \return      true if operation succeeded
- *
- * If the underfull child node at position pos has a neighbor
- * that is not underfull, borrow from it to bring this one up
- * to strength.  Return true if the operation succeeded.
- */
-bool
-Node::balanceNeighbor(int pos)
-{
-    assert(!hasleaves());
-    Node *left = leftNeighbor(pos);
-    Node *right = rightNeighbor(pos);
-    Node *middle = child(pos);
-    int lc = (left == NULL) ? -1 : left->children();
-    int rc = (right == NULL) ? -1 : right->children();
-
-    Node *donor = (lc >= rc) ? left : right;
-    if (donor == NULL)
-        return false;
-
-    int nmove = donor->excess();
-    if (nmove <= 0)
-        return false;
-
-    assert(nmove + middle->children() <= NKEY);
-
-    if (donor == left) {
-        left->shiftRight(middle, nmove);
-        resetKey(pos - 1);
-    } else {
-        right->shiftLeft(middle, nmove);
-        resetKey(pos);
-    }
-
-    return true;
-}
-
 /*!
  * \brief Insert the specified item in the tree.
  * \param item  the item to be inserted
@@ -317,6 +60,13 @@ Tree::insert(Meta *item)
     Node *n = root, *dad = NULL;
     int cpos, dpos = -1;
 
+    if (mLeafChangeObserver) {
+        mLeafChangeObserver->leafChanging(mkey);
+    }
+    if (mLeafAccessObserver) {
+        mLeafAccessObserver->leafAccess(mkey);
+    }
+
     for (;;) {
         cpos = n->findplace(mkey);
         if (n->isfull()) {
@@ -337,6 +87,121 @@ Tree::insert(Meta *item)
     return 0;
 }
 
+/*!
+ * \brief start bulk load.
+ * \return  0 on success, -EINVAL if the tree is not empty
+ *
+ * The current (empty) tree remains intact, and searchable, until the bulk
+ * load finishes.
+ */
+int
+Tree::bulkLoadStart()
+{
+    if (mBulkLoadFlag || ! root->hasleaves() || root->children() != 1) {
+        return -EINVAL;
+    }
+    mBulkLevels.clear();
+    mBulkFirst    = 0;
+    mBulkLastKey  = Key(KFS_UNINIT, 0);
+    mBulkLoadFlag = true;
+    return 0;
+}
+
+/*
+ * Append child to the rightmost node at the specified level. Full node is
+ * linked to its new right peer, and appended to the parent level, creating
+ * a new level if needed. Nodes are added to the parent level only when
+ * complete, therefore the parent keys are always the nodes' final rightmost
+ * keys.
+ */
+void
+Tree::bulkAppend(const Key& k, MetaNode* child, size_t level)
+{
+    if (mBulkLevels.size() <= level) {
+        assert(mBulkLevels.size() == level);
+        Node* const n = Node::create(level == 0 ? META_LEVEL1 : 0);
+        mBulkLevels.push_back(n);
+        if (level == 0) {
+            mBulkFirst = n;
+        }
+    }
+    Node* n = mBulkLevels[level];
+    if (n->isfull()) {
+        Node* const brother = Node::create(n->flags());
+        n->linkToPeer(brother);
+        mBulkLevels[level] = brother;
+        bulkAppend(n->key(), n, level + 1);
+        n = brother;
+    }
+    n->appendChild(k, child);
+}
+
+/*!
+ * \brief append next item to the tree being bulk loaded.
+ * \param[in] m the item, its key must not be less than the key of the
+ *      previously appended item
+ * \return  0 on success, -EINVAL if bulk load is not in progress, or
+ *      the item is out of key order
+ */
+int
+Tree::bulkLoadAppend(Meta *m)
+{
+    if (! mBulkLoadFlag) {
+        return -EINVAL;
+    }
+    const Key k = m->key();
+    if (k < mBulkLastKey) {
+        return -EINVAL;
+    }
+    mBulkLastKey = k;
+    bulkAppend(k, m, 0);
+    return 0;
+}
+
+/*!
+ * \brief complete the bulk load
+ *
+ * Append the sentinel, and then close the rightmost node at each level,
+ * bottom up. All nodes, except the rightmost at each level, are full. If the
+ * rightmost node is underfull, balance it with its left neighbor, in order
+ * to preserve the minimum fill invariant that the deletion relies on.
+ * The node at the top level becomes the new root.
+ */
+int
+Tree::bulkLoadFinish()
+{
+    if (! mBulkLoadFlag) {
+        return -EINVAL;
+    }
+    bulkAppend(Key(KFS_SENTINEL, 0), NULL, 0);
+    size_t level = 0;
+    for (; level + 1 < mBulkLevels.size(); level++) {
+        Node* const n   = mBulkLevels[level];
+        Node* const dad = mBulkLevels[level + 1];
+        const int   pos = dad->children() - 1;
+        if (n->isdepleted()) {
+            Node* const left = dad->child(pos);
+            assert(left->peer() == n);
+            const int nshift = (left->children() - n->children()) / 2;
+            if (0 < nshift) {
+                left->shiftRight(n, nshift);
+                dad->resetKey(pos);
+            }
+        }
+        bulkAppend(n->key(), n, level + 1);
+    }
+    Node* const top = mBulkLevels[level];
+    top->setflag(META_ROOT);
+    root->destroy();
+    root  = top;
+    first = mBulkFirst;
+    hgt   = (int)mBulkLevels.size();
+    mBulkLevels.clear();
+    mBulkFirst    = 0;
+    mBulkLoadFlag = false;
+    return 0;
+}
+
 /*
  * If searching carries us into a new level-1 node below, shift the
  * next level of the descent path over by one, repeating as necessary
@@ -374,6 +239,13 @@ Tree::del(Meta *m)
     Node *dad;
     bool removed = false;
 
+    if (mLeafChangeObserver) {
+        mLeafChangeObserver->leafChanging(mkey);
+    }
+    if (mLeafAccessObserver) {
+        mLeafAccessObserver->leafAccess(mkey);
+    }
+
     /*
      *  Descend to the appropriate leaf, remembering the
      *  path that we traverse from the root.
@@ -495,22 +367,6 @@ Tree::poproot()
  * Output commands for debugging.
  */
 
-/*!
- * \brief print all metadata belonging to this leaf node
- */
-ostream&
-Node::showSelf(ostream& os) const
-{
-    const ostream::fmtflags f = os.flags();
-    os <<
-        "internal/"  << this <<
-        "/children/" << children() <<
-        "/flags/"    << hex << flags()
-    ;
-    os.flags(f);
-    return os;
-}
-
 void
 showNode(MetaNode *n)
 {
@@ -518,12 +374,6 @@ showNode(MetaNode *n)
         n->show(cerr) << '\n';
 }
 
-void
-Node::showChildren() const
-{
-    for_each(childNode, childNode + count, showNode);
-}
-
 /*!
  * \brief dump out all of the metadata items for debugging
  */
@@ -41,6 +41,11 @@
 #include <algorithm>
 #include <set>
 #include <map>
+#include <iostream>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
 
 namespace KFS {
 using std::string;
@@ -50,9 +55,108 @@ using std::set;
 using std::ostream;
 using std::map;
 using std::less;
+using std::pair;
 
 class Tree;
 
+/*!
+ * \brief return the number of keys less than test
+ *
+ * The keys are stored as separate arrays of the key high and low words.
+ * Binary search narrows the range down to a few cache lines, then the keys
+ * in the range are compared without branches, with SSE4.2 64 bit compares
+ * if the code is compiled with SSE4.2 enabled, and TSimdFlag is set.
+ * The build enables SSE4.2 with QFS_META_SSE42 cmake option.
+ * \param[in] hi     keys high words
+ * \param[in] lo     keys low words
+ * \param[in] count  number of keys
+ * \param[in] thi    test key high word
+ * \param[in] tlo    test key low word, with the mask applied
+ * \param[in] mask   mask applied to the keys' low words
+ */
+template<bool TSimdFlag>
+inline static int
+keyLowerBoundT(const uint64_t* hi, const uint64_t* lo, int count,
+    uint64_t thi, uint64_t tlo, uint64_t mask)
+{
+    const int kLinearSearchLen = 16;
+    int       first            = 0;
+    int       len              = count;
+    while (kLinearSearchLen < len) {
+        const int half = len / 2;
+        const int mid  = first + half;
+        if (hi[mid] < thi || (hi[mid] == thi && (lo[mid] & mask) < tlo)) {
+            first = mid + 1;
+            len  -= half + 1;
+        } else {
+            len = half;
+        }
+    }
+    const uint64_t* const h = hi + first;
+    const uint64_t* const l = lo + first;
+    int i = 0;
+    int n = 0;
+#if defined(__SSE4_2__)
+    if (TSimdFlag) {
+        // No unsigned 64 bit compare, flip the sign bit, and use signed
+        // compare.
+        const __m128i bias = _mm_set1_epi64x((long long)(uint64_t(1) << 63));
+        const __m128i th   =
+            _mm_xor_si128(_mm_set1_epi64x((long long)thi), bias);
+        const __m128i tl   =
+            _mm_xor_si128(_mm_set1_epi64x((long long)tlo), bias);
+        const __m128i m    = _mm_set1_epi64x((long long)mask);
+        __m128i       acc  = _mm_setzero_si128();
+        for (; i + 2 <= len; i += 2) {
+            const __m128i kh = _mm_xor_si128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i)),
+                bias);
+            const __m128i kl = _mm_xor_si128(_mm_and_si128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(l + i)), m),
+                bias);
+            const __m128i lt = _mm_or_si128(
+                _mm_cmpgt_epi64(th, kh),
+                _mm_and_si128(_mm_cmpeq_epi64(th, kh), _mm_cmpgt_epi64(tl, kl))
+            );
+            // Less than compare result is -1, subtract to count.
+            acc = _mm_sub_epi64(acc, lt);
+        }
+        n += (int)_mm_cvtsi128_si64(acc) +
+            (int)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+    }
+#endif
+    for (; i < len; i++) {
+        n += (int)((h[i] < thi) | ((h[i] == thi) & ((l[i] & mask) < tlo)));
+    }
+    return first + n;
+}
+
+inline static int
+keyLowerBound(const uint64_t* hi, const uint64_t* lo, int count,
+    uint64_t thi, uint64_t tlo, uint64_t mask)
+{
+    return keyLowerBoundT<true>(hi, lo, count, thi, tlo, mask);
+}
+
+//!< scalar key search, used to validate the vector compare path
+inline static int
+keyLowerBoundScalar(const uint64_t* hi, const uint64_t* lo, int count,
+    uint64_t thi, uint64_t tlo, uint64_t mask)
+{
+    return keyLowerBoundT<false>(hi, lo, count, thi, tlo, mask);
+}
+
+//!< return true if the key search uses vector compares
+inline static bool
+keyLowerBoundIsSimd()
+{
+#if defined(__SSE4_2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
 /*!
  * \brief an internal node in the KFS search tree.
  *
@@ -60,55 +164,68 @@ class Tree;
  * to nodes lower in the tree or to metadata at the leaves.
  * Each is linked to the following node at the same level in
  * the tree to allow linear traversal.
+ *
+ * The fanout is a template parameter in order to allow to measure the
+ * effect of the node size, see devtools/metatreenode_main.cc. The key high
+ * and low words are stored in separate arrays, the key search mostly scans
+ * the high words. With the fanout multiple of 8 each key word array
+ * occupies whole 64 byte cache lines.
  */
-class Node: public MetaNode {
-    static const int NKEY = 32;
-    // should size the node to near 4k; 120 gets us there...
-    // static const int NKEY = 120;
+template<int TNKey>
+class NodeT: public MetaNode {
+public:
+    static const int NKEY = TNKey;
+private:
     static const int NSPLIT = NKEY / 2;
     static const int NFEWEST = NKEY - NSPLIT;
 
     int count;          //!< how many children
-    Key childKey[NKEY];     //!< children's key values
+    NodeT *next;        //!< following peer node
+    uint64_t childKeyHi[NKEY];  //!< children's key values high words
+    uint64_t childKeyLo[NKEY];  //!< children's key values low words
     MetaNode *childNode[NKEY];  //!< and pointers to them
 
-    Node *next;         //!< following peer node
-
-    void placeChild(Key k, MetaNode *n, int p)
+    void setKey(int p, const Key& k)
     {
-        childKey[p] = k;
+        childKeyHi[p] = k.hi;
+        childKeyLo[p] = k.lo;
+    }
+    void placeChild(const Key& k, MetaNode *n, int p)
+    {
+        setKey(p, k);
         childNode[p] = n;
     }
-    void appendChild(Key k, MetaNode *n)
+    void copyChild(int p, const NodeT* src, int sp)
     {
-        placeChild(k, n, count);
-        ++count;
+        childKeyHi[p] = src->childKeyHi[sp];
+        childKeyLo[p] = src->childKeyLo[sp];
+        childNode[p]  = src->childNode[sp];
     }
-    void moveChildren(Node *dest, int start, int n);
-    void insertChildren(Node *dest, int start, int n);
-    void absorb(Node *dest);
+    void moveChildren(NodeT *dest, int start, int n);
+    void insertChildren(NodeT *dest, int start, int n);
+    void absorb(NodeT *dest);
     int excess() { return (count - NFEWEST) / 2; }
-    void linkToPeer(Node *n) { next = n; }
     void openHole(int pos, int skip);
     void closeHole(int pos, int skip);
-    Node *leftNeighbor(int pos)
+    NodeT *leftNeighbor(int pos)
     {
         return (pos == 0) ? NULL : child(pos - 1);
     }
-    Node *rightNeighbor(int pos)
+    NodeT *rightNeighbor(int pos)
     {
         return (pos == count - 1) ? NULL : child(pos + 1);
     }
-    void shiftLeft(Node *dest, int nshift);
-    void shiftRight(Node *dest, int nshift);
+    void shiftLeft(NodeT *dest, int nshift);
+    void shiftRight(NodeT *dest, int nshift);
+    friend class Tree;      //!< bulk load balances the rightmost nodes
 protected:
-    Node(int f): MetaNode(KFS_INTERNAL, f), count(0), next(NULL) { }
-    ~Node() {}
+    NodeT(int f): MetaNode(KFS_INTERNAL, f), count(0), next(NULL) { }
+    ~NodeT() {}
 public:
-    static Node* create(int f) { return new (allocate<Node>()) Node(f); }
+    static NodeT* create(int f) { return new (allocate<NodeT>()) NodeT(f); }
     void destroySelf()
     {
-        this->~Node();
+        this->~NodeT();
         deallocate(this);
     }
     bool hasleaves() const { return testflag(META_LEVEL1); }
@@ -116,7 +233,7 @@ public:
     bool isfull() const { return (count == NKEY); } //!< full
     bool isdepleted() const { return (count < NFEWEST); } //!< underfull
     /*!
-    * \brief binary search to locate key within node
+    * \brief search to locate key within node
     * \param[in] test   the key that we are looking for
     * \return       the position of first key >= test;
     *           can be off the end of the array
@@ -124,24 +241,33 @@ public:
     template<typename MATCH>
     int findplace(const MATCH &test) const
     {
-        const Key* const p = lower_bound(childKey, childKey + count, test);
-        return p - childKey;
+        return keyLowerBound(childKeyHi, childKeyLo, count,
+            test.getHi(), test.getLo(), test.getLoMask());
     }
     //! \brief rightmost (largest) key in node
-    Key keySelf() const { return childKey[count - 1]; }
-    Node *child(int n) const        //! \brief accessor
+    Key keySelf() const { return getkey(count - 1); }
+    NodeT *child(int n) const       //! \brief accessor
     {
-        return static_cast <Node *> (childNode[n]);
+        return static_cast <NodeT *> (childNode[n]);
     }
     Meta *leaf(int n) const         //! \brief accessor
     {
         return static_cast <Meta *> (childNode[n]);
     }
-    const Key &getkey(int n) const { return childKey[n]; } //!< accessor
-    Node *split(Tree *t, Node *father, int pos);    //!< split full node
+    Key getkey(int n) const         //!< accessor
+        { return Key(childKeyHi[n], childKeyLo[n]); }
+    //!< append child to the end of non full node, used by bulk load
+    void appendChild(const Key& k, MetaNode *n)
+    {
+        assert(count < NKEY);
+        placeChild(k, n, count);
+        ++count;
+    }
+    void linkToPeer(NodeT *n) { next = n; }
+    NodeT *split(Tree *t, NodeT *father, int pos);  //!< split full node
     void addChild(Key *k, MetaNode *child, int pos); //!< insert child node
     void insertData(Key *key, Meta *item, int pos); //!< insert data item
-    Node *peer() const { return next; } //!< return adjacent node
+    NodeT *peer() const { return next; } //!< return adjacent node
     int children() const { return count; } //!< how many children
     bool mergeNeighbor(int pos);        //!< merge underfull nodes
     bool balanceNeighbor(int pos);      //!< borrow from full node
@@ -165,6 +291,9 @@ public:
     void showChildren() const;
 };
 
+//! Meta tree node fanout.
+typedef NodeT<32> Node;
+
 /*!
  * \brief for iterating through leaf nodes
  */
@@ -190,6 +319,41 @@ public:
     }
 };
 
+/*!
+ * \brief leaf change observer
+ *
+ * Invoked before a leaf is inserted, removed, or modified in place with
+ * Tree::modify(), with the key of the leaf. The in process checkpoint uses it to save the images of
+ * the leaves that it has not written yet.
+ */
+class LeafChangeObserver
+{
+public:
+    virtual void leafChanging(const Key& key) = 0;
+protected:
+    LeafChangeObserver() {}
+    virtual ~LeafChangeObserver() {}
+};
+
+/*!
+ * \brief leaf access observer
+ *
+ * Invoked with the search key on every leaf search, insert, and remove, and
+ * with the chunk id when the layout manager's chunk lookup by id does not
+ * find the chunk. The log compactor uses it to find the checkpoint leaves
+ * that the log replay depends on.
+ */
+class LeafAccessObserver
+{
+public:
+    virtual void leafAccess(const Key& key) = 0;
+    virtual void leafAccess(const PartialMatch& key) = 0;
+    virtual void chunkNotFound(chunkId_t chunkId) = 0;
+protected:
+    LeafAccessObserver() {}
+    virtual ~LeafAccessObserver() {}
+};
+
 template<MetaType TId, typename T>
 class MetaIterator
 {
@@ -279,7 +443,7 @@ public:
         }
         if (fa.type == KFS_DIR) {
             mCurPath.resize(mPathLen.back());
-            mCurPath += de.getName();
+            de.appendName(mCurPath);
         }
         const string& dir = mCurPath;
         return mFunctor(dir, de, fa, depth);
@@ -294,6 +458,27 @@ protected:
     PathListerT& operator=(const PathListerT&);
 };
 
+/*!
+ * \brief state of the incremental rmdirs sub tree permission check
+ *
+ * The directories that remain to be checked are kept in the explicit stack
+ * along with the name to resume the directory scan from, in order to bound
+ * the work per Tree::rmdirs() invocation, and to avoid recursion.
+ */
+struct RmdirsCheck
+{
+    typedef vector<pair<fid_t, string> > Stack;
+
+    RmdirsCheck(int maxEntries = 4 << 10)
+        : dir(-1),
+          maxEntries(maxEntries),
+          stack()
+        {}
+    fid_t dir;        //!< sub tree root directory being checked
+    int   maxEntries; //!< max number of entries to check per invocation
+    Stack stack;      //!< directories to check, and scan resume names
+};
+
 //! If a cache entry hasn't been accessed in 600 secs, remove it from cache
 const int FID_CACHE_ENTRY_EXPIRE_INTERVAL = 600;
 //! Once in 10 mins cleanup the cache
@@ -333,11 +518,22 @@ class Tree {
     StTmp<vector<MetaDentry*> >::Tmp    mDentriesTmp;
     int64_t mFileSystemId;
     int64_t mCrTime;
+    vector<Node*> mBulkLevels;  //!< rightmost node at each level, leaves first
+    Node*   mBulkFirst;         //!< leftmost level-1 node of the new tree
+    Key     mBulkLastKey;       //!< last appended key
+    bool    mBulkLoadFlag;
+    LeafChangeObserver* mLeafChangeObserver;
+    LeafAccessObserver* mLeafAccessObserver;
+    //!< dumpster entries that reclaim failed to remove
+    set<fid_t>          mDumpsterParked;
 
 
     template<typename MATCH>
     Node* lowerBound(const MATCH &k, int& kp) const
     {
+        if (mLeafAccessObserver) {
+            mLeafAccessObserver->leafAccess(k);
+        }
         Node *n = root;
         int p = n->findplace(k);
 
@@ -365,6 +561,11 @@ class Tree {
         kfsUid_t user, kfsGid_t group, kfsMode_t mode,
         MetaFattr* parent, MetaFattr** newFattr, int64_t mtime);
     bool emptydir(fid_t dir);
+    int canRemoveSubtree(RmdirsCheck& check, kfsUid_t euser, kfsGid_t egroup);
+    bool reclaimDumpsterDir(fid_t parent, const string& name, fid_t dir,
+        int64_t& budget, int64_t mtime);
+    void parkDumpsterEntry(fid_t parent, const string& name, fid_t fid,
+        const char* op, int status);
     bool is_descendant(fid_t src, fid_t dst, const MetaFattr* dstFa);
     void shift_path(vector <pathlink> &path);
     void recomputeDirSize(MetaFattr* dirattr);
@@ -400,6 +601,7 @@ class Tree {
         ChunkIterator& cit, MetaChunkInfo*& ci) const;
     void setFileSize(MetaFattr* fa, chunkOff_t size,
         int64_t nfiles, int64_t ndirs);
+    void bulkAppend(const Key& k, MetaNode* child, size_t level);
 public:
     Tree()
         : root(0),
@@ -413,7 +615,14 @@ public:
           mChunkInfosTmp(),
           mDentriesTmp(),
           mFileSystemId(-1),
-          mCrTime()
+          mCrTime(),
+          mBulkLevels(),
+          mBulkFirst(0),
+          mBulkLastKey(),
+          mBulkLoadFlag(false),
+          mLeafChangeObserver(0),
+          mLeafAccessObserver(0),
+          mDumpsterParked()
     {
         root = Node::create(META_ROOT|META_LEVEL1);
         root->insertData(new Key(KFS_SENTINEL, 0), NULL, 0);
@@ -441,6 +650,10 @@ public:
     {
         mIsPathToFidCacheEnabled = true;
     }
+    bool isPathToFidCacheEnabled() const
+    {
+        return mIsPathToFidCacheEnabled;
+    }
     void setUpdatePathSpaceUsage(bool flag)
     {
         const bool recomputeFlag = ! mUpdatePathSpaceUsage && flag;
@@ -452,6 +665,52 @@ public:
     bool getUpdatePathSpaceUsageFlag() const
         { return mUpdatePathSpaceUsage; }
     int insert(Meta *m);            //!< add data item
+    /*!
+     * \brief bulk load: build the tree bottom up from key ordered items.
+     * The tree must be empty. The items are appended to fully packed level-1
+     * nodes, and the internal nodes are built level by level as the lower
+     * level nodes fill up. The tree is not searchable until
+     * bulkLoadFinish() is invoked.
+     */
+    int bulkLoadStart();
+    //!< append next item; returns -EINVAL if item is out of key order
+    int bulkLoadAppend(Meta *m);
+    //!< finish the bulk load, and make the new tree current
+    int bulkLoadFinish();
+    bool isBulkLoading() const { return mBulkLoadFlag; }
+    void setLeafChangeObserver(LeafChangeObserver* observer)
+        { mLeafChangeObserver = observer; }
+    //!< the single in place leaf modification point: notifies the leaf change
+    //!< observer, and returns the leaf to modify. The leaves must not be
+    //!< modified in place other than through the returned pointer.
+    template<typename T>
+    T* modify(T* m) const
+    {
+        if (mLeafChangeObserver) {
+            mLeafChangeObserver->leafChanging(m->key());
+        }
+        return m;
+    }
+    void setLeafAccessObserver(LeafAccessObserver* observer)
+        { mLeafAccessObserver = observer; }
+    //!< must be invoked when chunk lookup by id does not find the chunk.
+    //!< The log replay looks up chunks by the log chunk id only in
+    //!< LayoutManager::ReplayBeginChangeChunkVersion() and
+    //!< LayoutManager::ReplayPendingMakeStable(), both invoke this method.
+    //!< All other replay chunk accesses, including the allocate replay chunk
+    //!< mapping check, go through the file chunk leaves by file id and
+    //!< offset first, and are recorded by leafAccess(). A new replay lookup
+    //!< by chunk id must invoke this method as well, or log compaction
+    //!< stream mode will not load the chunk.
+    void chunkNotFound(chunkId_t chunkId) const
+    {
+        if (mLeafAccessObserver) {
+            mLeafAccessObserver->chunkNotFound(chunkId);
+        }
+    }
+    //!< return the level-1 node and position of the first key >= k
+    Node* leafLowerBound(const Key& k, int& kp) const
+        { return lowerBound(k, kp); }
     int del(Meta *m);           //!< remove data item
     Node *getroot() { return root; }    //!< return root node
     Node *firstLeaf() { return first; } //!< leftmost leaf
@@ -502,10 +761,13 @@ public:
         fid_t* newFid, MetaFattr** newFattr, int64_t mtime);
     int rmdir(fid_t dir, const string& dname, const string& pathname,
         kfsUid_t euser, kfsGid_t egroup, int64_t mtime);
+    int rmdirs(fid_t dir, const string& dname, const string& pathname,
+        fid_t& todumpster, kfsUid_t euser, kfsGid_t egroup, int64_t mtime,
+        RmdirsCheck* check = 0);
     int readdir(fid_t dir, vector<MetaDentry*>& result,
         int maxEntries = 0, bool* moreEntriesFlag = 0);
     int readdir(fid_t dir, const string& fnameStart, vector<MetaDentry*>& v,
-        int maxEntries, bool& moreEntriesFlag);
+        int maxEntries, bool& moreEntriesFlag, bool resumeFlag = false);
     int getalloc(fid_t fid, vector <MetaChunkInfo *> &result);
     int getalloc(fid_t fid, MetaFattr*& fa, vector<MetaChunkInfo*>& v,
         int maxChunks);
@@ -527,7 +789,9 @@ public:
     void setFileSize(MetaFattr* fa, chunkOff_t offset)
         { setFileSize(fa, offset, 0, 0); }
     void invalidateFileSize(MetaFattr* fa) const
-        { fa->filesize = -(fa->filesize + 1); }
+    {
+        modify(fa)->filesize = -(fa->filesize + 1);
+    }
     chunkOff_t getFileSize(const MetaFattr& fa) const {
         return (fa.filesize >= 0 ?
                 fa.filesize : chunkOff_t(-1) - fa.filesize);
@@ -545,6 +809,7 @@ public:
     int moveToDumpster(fid_t dir, const string& fname, fid_t todumpster,
         int64_t mtime);
     void cleanupDumpster();
+    bool reclaimDumpster(int maxEntries);
 
     /*!
      * \brief Write-allocation
@@ -663,6 +928,285 @@ public:
     DentryIterator readDir(fid_t dir) const;
 };
 
+/*!
+ * \brief Insert a child node at the indicated position.
+ * \param[in] child the node to be inserted
+ * \param[in] pos   the index where it should go
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::addChild(Key *k, MetaNode *child, int pos)
+{
+    openHole(pos, 1);
+    placeChild(*k, child, pos);
+}
+
+/*!
+ * \brief remove child and shift remaining entries to fill in the hole
+ * \param[in] pos index of the child node
+ *
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::remove(int pos)
+{
+    assert(pos >= 0 && pos < count);
+    Meta *m = leaf(pos);
+    m->destroy();
+    closeHole(pos, 1);
+}
+
+template<int TNKey> inline void
+NodeT<TNKey>::moveChildren(NodeT *dest, int start, int n)
+{
+    for (int i = 0; i != n; i++) {
+        assert(dest->count < NKEY);
+        dest->copyChild(dest->count++, this, start + i);
+    }
+    placeChild(Key(KFS_SENTINEL, 0), NULL, start);
+}
+
+/*!
+ * \brief split a full node
+ * \param[in] t the tree (in case we add a new root)
+ * \param[in] father    the parent of this node
+ * \param[in] pos   position of this node in parent
+ * \return  pointer to newly constructed sibling node
+ *
+ * Split this node (which is assumed to be full) into two
+ * pieces, adding a new pointer to the father node, and if
+ * necessary, a new root to the tree.  We split full nodes
+ * as we traverse the tree downwards, so it should never
+ * happen that the father node is full at this point.
+ */
+template<int TNKey> inline NodeT<TNKey> *
+NodeT<TNKey>::split(Tree *t, NodeT *father, int pos)
+{
+    NodeT *brother = NodeT::create(flags());
+
+    brother->linkToPeer(next);
+    linkToPeer(brother);
+    moveChildren(brother, count - NSPLIT, NSPLIT);
+    count -= NSPLIT;
+    if (father == NULL) {   // this must be the root
+        assert(t->getroot() == this);
+        t->pushroot(brother);
+    } else {
+        assert(!father->isfull());
+        assert(father->child(pos) == this);
+        father->resetKey(pos);
+        Key k = brother->key();
+        father->addChild(&k, brother, 1 + pos);
+    }
+    return brother;
+}
+
+/*
+ * Create a space in the link array by moving everything
+ * with index >= _pos_ by _skip_ spaces to the right.
+ * N.B. Node must not be full
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::openHole(int pos, int skip)
+{
+    count += skip;
+    assert(count <= NKEY);
+    for (int i = count - 1; i >= pos + skip; --i) {
+        copyChild(i, this, i - skip);
+    }
+}
+
+/*
+ * Fill in a hole created by moving or deleting child pointers.
+ * pos is the beginning of the hole and skip is its size.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::closeHole(int pos, int skip)
+{
+    assert(skip < count);
+    count -= skip;
+    for (int i = pos; i != count; i++) {
+        copyChild(i, this, i + skip);
+    }
+    placeChild(Key(KFS_SENTINEL, 0), NULL, count);
+}
+
+/*
+ * Insert a new metadata item at the specified position
+ * in this node, after making space by moving everything
+ * with index >= pos to the right.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::insertData(Key *k, Meta *item, int pos)
+{
+    assert(hasleaves());
+    addChild(k, item, pos);
+}
+
+/*
+ * This node is absorbed by its left neighbor.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::absorb(NodeT *l)
+{
+    assert(count + l->children() <= NKEY);
+    moveChildren(l, 0, count);
+    count = 0;
+    l->next = next;
+}
+
+/*!
+ * \brief join an underfull node with its neighbor if possible
+ * \param[in] pos   position of underfull child
+ * \return      true if operation succeeded
+ *
+ * If the underfull child node at position pos has a
+ * neighbor on either side that can absorb it, combine
+ * the two nodes into one.
+ *
+ * Don't do the merge if the resulting node would be completely
+ * full, since in that case, balanceNeighbor is probably a better
+ * remedy.
+ *
+ * Return true if merge took place.
+ */
+template<int TNKey> inline bool
+NodeT<TNKey>::mergeNeighbor(int pos)
+{
+    assert(!hasleaves());
+    NodeT *left = leftNeighbor(pos);
+    NodeT *right = rightNeighbor(pos);
+    NodeT *middle = child(pos);
+    int mkids = middle->children();
+    int base;
+
+    if (left != NULL && mkids + left->children() < NKEY) {
+        middle->absorb(left);
+        base = pos - 1;
+    } else if (right != NULL && mkids + right->children() < NKEY) {
+        right->absorb(middle);
+        base = pos;
+    } else
+        return false;
+
+    setKey(base, getkey(base + 1));
+    childNode[base + 1]->destroy();
+    closeHole(base + 1, 1);
+
+    return true;
+}
+
+/*
+ * Move n children from _start_ in this node to the
+ * beginning of _dest.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::insertChildren(NodeT *dest, int start, int n)
+{
+    count -= n;
+    for (int i = 0; i != n; i++)
+        dest->copyChild(i, this, start + i);
+}
+
+/*
+ * Move nshift children from the right end of this node
+ * to the beginning of _dest_.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::shiftRight(NodeT *dest, int nshift)
+{
+    dest->openHole(0, nshift);
+    insertChildren(dest, count - nshift, nshift);
+}
+
+/*
+ * Move nshift children from the beginning of this node
+ * to the end of _dest_.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::shiftLeft(NodeT *dest, int nshift)
+{
+    moveChildren(dest, 0, nshift);
+    closeHole(0, nshift);
+}
+
+/*
+ * Adjust the key for this position to match the rightmost
+ * key of the child node; corrects the key value following
+ * movement of children between nodes.
+ */
+template<int TNKey> inline void
+NodeT<TNKey>::resetKey(int pos)
+{
+    NodeT *c = child(pos);
+    assert(c != NULL);
+    setKey(pos, c->key());
+}
+
+/*!
+ * \brief fill an underfull node by borrowing from neighbor
+ * \param[in] pos   position of underfull child
+ * \return      true if operation succeeded
+ *
+ * If the underfull child node at position pos has a neighbor
+ * that is not underfull, borrow from it to bring this one up
+ * to strength.  Return true if the operation succeeded.
+ */
+template<int TNKey> inline bool
+NodeT<TNKey>::balanceNeighbor(int pos)
+{
+    assert(!hasleaves());
+    NodeT *left = leftNeighbor(pos);
+    NodeT *right = rightNeighbor(pos);
+    NodeT *middle = child(pos);
+    int lc = (left == NULL) ? -1 : left->children();
+    int rc = (right == NULL) ? -1 : right->children();
+
+    NodeT *donor = (lc >= rc) ? left : right;
+    if (donor == NULL)
+        return false;
+
+    int nmove = donor->excess();
+    if (nmove <= 0)
+        return false;
+
+    assert(nmove + middle->children() <= NKEY);
+
+    if (donor == left) {
+        left->shiftRight(middle, nmove);
+        resetKey(pos - 1);
+    } else {
+        right->shiftLeft(middle, nmove);
+        resetKey(pos);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief print all metadata belonging to this leaf node
+ */
+template<int TNKey> inline ostream&
+NodeT<TNKey>::showSelf(ostream& os) const
+{
+    const ostream::fmtflags f = os.flags();
+    os <<
+        "internal/"  << this <<
+        "/children/" << children() <<
+        "/flags/"    << std::hex << flags()
+    ;
+    os.flags(f);
+    return os;
+}
+
+template<int TNKey> inline void
+NodeT<TNKey>::showChildren() const
+{
+    for (int i = 0; i < count; i++) {
+        if (childNode[i] != NULL) {
+            childNode[i]->show(std::cerr) << '\n';
+        }
+    }
+}
+
 /*!
  * \brief return all metadata with the specified key
  * \param[in] node  leftmost leaf node in which the key appears
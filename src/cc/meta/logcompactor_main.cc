@@ -31,9 +31,26 @@
 // files, it creates a symlink to point the "LAST" closed log file; when log
 // compaction is done, we only compact upto the last closed log file.
 //
+// With the stream option the tool loads only the part of the checkpoint that
+// the log replay depends on, and writes the new checkpoint by merging the
+// replay result with the rest of the checkpoint as a stream. The part of the
+// checkpoint the replay depends on is determined iteratively: each pass runs
+// in a child process, loads the current working set from the checkpoint,
+// replays the logs with the tree access recording, and returns the tree
+// leaves and the chunks that the replay accessed, but that were not loaded.
+// The pass that finds no new leaves writes the new checkpoint. Memory use is
+// proportional to the number of the objects the log replay accesses, not to
+// the namespace size.
+// Each pass loads the checkpoint, therefore if the working set does not
+// converge within the pass limit, or stops growing, the tool falls back to
+// the full checkpoint load and log replay.
+// The directories sizes are not re-computed in this mode, the meta server
+// re-computes the directories sizes on startup.
+//
 //----------------------------------------------------------------------------
 
 #include "kfstree.h"
+#include "meta.h"
 #include "Logger.h"
 #include "Checkpoint.h"
 #include "Restorer.h"
@@ -41,29 +58,400 @@
 #include "util.h"
 #include "common/MsgLogger.h"
 #include "common/MdStream.h"
+#include "qcdio/QCUtils.h"
 
 #include <iostream>
+#include <sstream>
+#include <set>
+#include <vector>
 #include <cassert>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 namespace KFS
 {
 using std::cout;
 using std::cerr;
+using std::set;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::ostringstream;
+using std::istringstream;
 
 static int
-RestoreCheckpoint(const string& lockfn, bool allowEmptyCheckpointFlag)
+RestoreCheckpoint(const string& lockfn, bool allowEmptyCheckpointFlag,
+    int threads)
 {
     if (! lockfn.empty()) {
         acquire_lockfile(lockfn, 10);
     }
     if (! allowEmptyCheckpointFlag || file_exists(LASTCP)) {
-        Restorer r;
+        Restorer r(threads);
         return (r.rebuild(LASTCP) ? 0 : -EIO);
     } else {
         return metatree.new_tree();
     }
 }
 
+/*
+ * Log replay working set: the subset of the checkpoint tree leaves that the
+ * log replay accesses, recorded with the granularity that the checkpoint can
+ * be filtered with: the file attribute along with all file chunks, the
+ * directory with all its entries, and the directory entry key. The directory
+ * entries are always loaded with the parent directory attribute. The chunks
+ * that the replay looks up by chunk id are resolved into the file ids by the
+ * next checkpoint load. The working set additions are also kept in the text
+ * form, in order to pass these from the replay pass child process.
+ */
+class ReplayWorkingSet :
+    public LeafAccessObserver,
+    public CheckpointFilter
+{
+public:
+    ReplayWorkingSet()
+        : LeafAccessObserver(),
+          CheckpointFilter(),
+          mFids(),
+          mDirs(),
+          mDentries(),
+          mChunkIds(),
+          mResolvedFids(),
+          mAdded()
+    {
+        // The root directory entries that restore verifies.
+        const char* const kRootNames[] = { "/", ".", ".." };
+        for (size_t i = 0; i < sizeof(kRootNames) / sizeof(kRootNames[0]);
+                i++) {
+            AddDentry(Key(KFS_DENTRY, ROOTFID,
+                MetaDentry::nameHash(kRootNames[i])));
+        }
+    }
+    virtual ~ReplayWorkingSet()
+        {}
+    virtual void leafAccess(const Key& key)
+    {
+        switch (key.getType()) {
+            case KFS_FATTR:
+            case KFS_CHUNKINFO:
+                AddFid(key.getData1());
+                break;
+            case KFS_DENTRY:
+                AddDentry(key);
+                break;
+            default:
+                break;
+        }
+    }
+    virtual void leafAccess(const PartialMatch& key)
+    {
+        switch (key.getType()) {
+            case KFS_FATTR:
+            case KFS_CHUNKINFO:
+                AddFid(key.getData1());
+                break;
+            case KFS_DENTRY:
+                AddDir(key.getData1());
+                break;
+            default:
+                break;
+        }
+    }
+    virtual void chunkNotFound(chunkId_t chunkId)
+    {
+        if (mChunkIds.insert(chunkId).second) {
+            mAdded << "c " << chunkId << "\n";
+        }
+    }
+    virtual bool accept(const Key& key)
+    {
+        switch (key.getType()) {
+            case KFS_FATTR:
+            case KFS_CHUNKINFO:
+                return (mFids.find(key.getData1()) != mFids.end());
+            case KFS_DENTRY:
+                return (mDirs.find(key.getData1()) != mDirs.end() ||
+                    mDentries.find(MakeDentryKey(key)) != mDentries.end());
+            default:
+                break;
+        }
+        return false;
+    }
+    virtual bool accept(const Key& key, chunkId_t chunkId)
+    {
+        // The file attribute precedes its chunks in the checkpoint, and it
+        // is too late to load the file now.
+        if (mChunkIds.find(chunkId) != mChunkIds.end()) {
+            mResolvedFids.push_back(key.getData1());
+        }
+        return accept(key);
+    }
+    //!< add the files of the chunks resolved by the last checkpoint load
+    void AddResolved()
+    {
+        for (Fids::const_iterator it = mResolvedFids.begin();
+                it != mResolvedFids.end();
+                ++it) {
+            AddFid(*it);
+        }
+        mResolvedFids.clear();
+    }
+    string GetAdded() const
+        { return mAdded.str(); }
+    void ClearAdded()
+        { mAdded.str(string()); }
+    //!< add the records returned by GetAdded()
+    bool Add(const string& records)
+    {
+        istringstream is(records);
+        char          type;
+        while (is >> type) {
+            if (type == 'e') {
+                uint64_t hi = 0;
+                uint64_t lo = 0;
+                if (! (is >> hi >> lo)) {
+                    return false;
+                }
+                AddDentry(DentryKey(hi, lo));
+                continue;
+            }
+            int64_t id = -1;
+            if (! (is >> id) || id < 0) {
+                return false;
+            }
+            switch (type) {
+                case 'f': AddFid((fid_t)id);            break;
+                case 'd': AddDir((fid_t)id);            break;
+                case 'c': chunkNotFound((chunkId_t)id); break;
+                default:  return false;
+            }
+        }
+        return is.eof();
+    }
+    size_t GetSize() const
+    {
+        return (mFids.size() + mDirs.size() + mDentries.size() +
+            mChunkIds.size());
+    }
+    ostream& Display(ostream& os) const
+    {
+        return (os <<
+            "files: "         << mFids.size() <<
+            " directories: "  << mDirs.size() <<
+            " entries: "      << mDentries.size() <<
+            " chunks: "       << mChunkIds.size()
+        );
+    }
+private:
+    // The directory entry key can not be constructed from the key data, as
+    // the low order bits are discarded, use the key bits instead.
+    typedef pair<uint64_t, uint64_t> DentryKey;
+    typedef set<fid_t>               Ids;
+    typedef set<DentryKey>           DentryKeys;
+    typedef set<chunkId_t>           ChunkIds;
+    typedef vector<fid_t>            Fids;
+
+    Ids           mFids;
+    Ids           mDirs;
+    DentryKeys    mDentries;
+    ChunkIds      mChunkIds;
+    Fids          mResolvedFids;
+    ostringstream mAdded;
+
+    static DentryKey MakeDentryKey(const Key& key)
+        { return DentryKey(key.getHi(), key.getLo()); }
+    void AddFid(fid_t fid)
+    {
+        if (mFids.insert(fid).second) {
+            mAdded << "f " << fid << "\n";
+        }
+    }
+    void AddDir(fid_t dir)
+    {
+        AddFid(dir);
+        if (mDirs.insert(dir).second) {
+            mAdded << "d " << dir << "\n";
+        }
+    }
+    void AddDentry(const Key& key)
+    {
+        const fid_t dir = key.getData1();
+        AddFid(dir);
+        if (mDirs.find(dir) == mDirs.end()) {
+            AddDentry(MakeDentryKey(key));
+        }
+    }
+    void AddDentry(const DentryKey& key)
+    {
+        if (mDentries.insert(key).second) {
+            mAdded << "e " << key.first << " " << key.second << "\n";
+        }
+    }
+private:
+    ReplayWorkingSet(const ReplayWorkingSet&);
+    ReplayWorkingSet& operator=(const ReplayWorkingSet&);
+};
+
+static bool
+WriteAll(int fd, const string& data)
+{
+    const char*       ptr = data.data();
+    const char* const end = ptr + data.size();
+    while (ptr < end) {
+        const ssize_t nwr = write(fd, ptr, end - ptr);
+        if (nwr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += nwr;
+    }
+    return true;
+}
+
+static bool
+ReadAll(int fd, string& data)
+{
+    char buf[64 << 10];
+    for (; ;) {
+        const ssize_t nrd = read(fd, buf, sizeof(buf));
+        if (nrd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (nrd == 0) {
+            break;
+        }
+        data.append(buf, nrd);
+    }
+    return true;
+}
+
+/*
+ * Replay pass, runs in the child process. Load the working set, replay the
+ * logs, and write the working set additions into the pipe. Write the new
+ * checkpoint if there are no additions.
+ */
+static int
+ReplayPass(ReplayWorkingSet& ws, int threads, int pass, int fd)
+{
+    metatree.setLeafAccessObserver(&ws);
+    Restorer r(threads);
+    if (! r.rebuild(LASTCP, ws)) {
+        return -EIO;
+    }
+    ws.AddResolved();
+    const seq_t lastcp = oplog.checkpointed();
+    replayer.setIgnoreErrorsFlag(true);
+    int status = replayer.playLogs();
+    metatree.setLeafAccessObserver(0);
+    if (status != 0) {
+        return status;
+    }
+    const string added = ws.GetAdded();
+    ostringstream wsos;
+    ws.Display(wsos);
+    KFS_LOG_STREAM_INFO <<
+        "replay pass: "  << pass <<
+        " errors: "      << replayer.getErrorCount() <<
+        " added: "       << added.size() << " bytes"
+        " working set: " << wsos.str() <<
+    KFS_LOG_EOM;
+    if (! added.empty()) {
+        return (WriteAll(fd, added) ? 0 : -EIO);
+    }
+    if (0 < replayer.getErrorCount()) {
+        KFS_LOG_STREAM_FATAL <<
+            "log replay failed: " << replayer.getErrorCount() << " errors" <<
+        KFS_LOG_EOM;
+        return -EINVAL;
+    }
+    if (lastcp == oplog.checkpointed()) {
+        return 0;
+    }
+    return cp.merge_CP(LASTCP, ws, threads);
+}
+
+/*
+ * Run replay passes in the child processes, in order to start each pass with
+ * the empty tree, and the initial state, until the working set stops growing.
+ * The child processes start their own loggers, as the logger thread does not
+ * survive fork().
+ * Return -EAGAIN if the working set does not converge in maxPasses passes,
+ * or if a pass makes no progress, in order to fall back to full compaction.
+ */
+static int
+StreamCompaction(int threads, int maxPasses)
+{
+    ReplayWorkingSet ws;
+    for (int pass = 1; ; pass++) {
+        if (maxPasses < pass) {
+            cerr << "stream compaction: working set did not converge in " <<
+                maxPasses << " passes: ";
+            ws.Display(cerr) << "\n";
+            return -EAGAIN;
+        }
+        ws.ClearAdded();
+        int fds[2];
+        if (pipe(fds)) {
+            const int err = errno;
+            cerr << QCUtils::SysError(err, "pipe") << "\n";
+            return (err > 0 ? -err : -EIO);
+        }
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            MsgLogger::Init(0, MsgLogger::kLogLevelINFO);
+            const int status = ReplayPass(ws, threads, pass, fds[1]);
+            close(fds[1]);
+            MsgLogger::Stop();
+            _exit(status == 0 ? 0 : 1);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            const int err = errno;
+            close(fds[0]);
+            cerr << QCUtils::SysError(err, "fork") << "\n";
+            return (err > 0 ? -err : -EIO);
+        }
+        string     added;
+        const bool readOkFlag = ReadAll(fds[0], added);
+        close(fds[0]);
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                const int err = errno;
+                cerr << QCUtils::SysError(err, "waitpid") << "\n";
+                return (err > 0 ? -err : -EIO);
+            }
+        }
+        if (! readOkFlag || ! WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cerr << "replay pass: " << pass << " failed\n";
+            return -EIO;
+        }
+        if (added.empty()) {
+            return 0;
+        }
+        const size_t size = ws.GetSize();
+        if (! ws.Add(added)) {
+            cerr << "replay pass: " << pass << " invalid working set\n";
+            return -EINVAL;
+        }
+        if (ws.GetSize() <= size) {
+            cerr << "replay pass: " << pass << " no progress: ";
+            ws.Display(cerr) << "\n";
+            return -EAGAIN;
+        }
+    }
+    return 0;
+}
+
 static int
 LogCompactorMain(int argc, char** argv)
 {
@@ -75,9 +463,12 @@ LogCompactorMain(int argc, char** argv)
     string  cpdir;
     string  lockFn;
     bool    allowEmptyCheckpointFlag = false;
+    int     threads = 0;
     int     status = 0;
+    bool    streamFlag = false;
+    int     maxPasses = 16;
 
-    while ((optchar = getopt(argc, argv, "hpl:c:r:L:e:")) != -1) {
+    while ((optchar = getopt(argc, argv, "hpsl:c:r:L:e:t:P:")) != -1) {
         switch (optchar) {
             case 'L':
                 lockFn = optarg;
@@ -100,12 +491,25 @@ LogCompactorMain(int argc, char** argv)
             case 'e':
                 allowEmptyCheckpointFlag = atoi(optarg) != 0;
                 break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 's':
+                streamFlag = true;
+                break;
+            case 'P':
+                maxPasses = atoi(optarg);
+                break;
             default:
                 status = 1;
                 break;
         }
     }
 
+    if (streamFlag && numReplicasPerFile > 0) {
+        cerr << "-r is not supported with -s\n";
+        status = 1;
+    }
     if (help || status != 0) {
         (status ? cerr : cout) << "Usage: " << argv[0] <<
             "[-L <lockfile>]\n"
@@ -113,16 +517,37 @@ LogCompactorMain(int argc, char** argv)
             "[-c <cpdir>]\n"
             "[-r <# of replicas> set replication to this value for all files]\n"
             "[-e {0|1} allow empty checkpoint]\n"
+            "[-t <# of threads> parse checkpoint with this number of threads,"
+                " and write new checkpoint in parallel with formatting]\n"
+            "[-s stream mode: load only the part of the checkpoint that the"
+                " log replay depends on, and merge the replay result with"
+                " the checkpoint]\n"
+            "[-P <max # of passes> stream mode replay pass limit, fall back"
+                " to full compaction when exceeded, default 16]\n"
         ;
         return status;
     }
 
     MdStream::Init();
-    MsgLogger::Init(0, MsgLogger::kLogLevelINFO);
-
     logger_setup_paths(logdir);
     checkpointer_setup_paths(cpdir);
-    if ((status = RestoreCheckpoint(lockFn, allowEmptyCheckpointFlag)) == 0) {
+    cp.setWriteThreadFlag(1 < threads);
+    if (streamFlag && file_exists(LASTCP)) {
+        // The replay passes run in the child processes, and start their own
+        // loggers.
+        if (! lockFn.empty()) {
+            acquire_lockfile(lockFn, 10);
+            lockFn.clear();
+        }
+        if ((status = StreamCompaction(threads, maxPasses)) != -EAGAIN) {
+            MdStream::Cleanup();
+            return (status == 0 ? 0 : 1);
+        }
+        cerr << "falling back to full compaction\n";
+    }
+    MsgLogger::Init(0, MsgLogger::kLogLevelINFO);
+    if ((status = RestoreCheckpoint(
+            lockFn, allowEmptyCheckpointFlag, threads)) == 0) {
         const seq_t lastcp = oplog.checkpointed();
         if ((status = replayer.playLogs()) == 0) {
             metatree.recomputeDirSize();
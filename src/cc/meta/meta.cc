@@ -45,8 +45,7 @@ UniqueID chunkID(1, ROOTFID);
 inline ostream&
 MetaDentry::showSelf(ostream& os) const
 {
-    return (os <<
-    "dentry/name/" << name <<
+    return (showName(os << "dentry/name/") <<
     "/id/"         << id() <<
     "/parent/"     << dir
     );
@@ -58,7 +57,8 @@ MetaDentry::matchSelf(const Meta *m) const
     // Try not to fetch name, save 1 dram miss by comparing hash instead.
     return (m->metaType() == KFS_DENTRY &&
         hash == refine<MetaDentry>(m)->hash &&
-        refine<MetaDentry>(m)->compareName(name) == 0);
+        refine<MetaDentry>(m)->compareName(
+            getNamePtr(), getNameLen()) == 0);
 }
 
 inline ostream&
@@ -35,6 +35,9 @@
 #include <ostream>
 #include <string>
 #include <cassert>
+#include <algorithm>
+
+#include <string.h>
 
 namespace KFS {
 
@@ -108,7 +111,7 @@ class MetaDentry: public Meta {
     fid_t      dir;  //!< id of parent directory
     KeyData    hash;
     MetaFattr* fattr;
-    string     name; //!< name of this entry
+    char*      name; //!< length prefixed name of this entry
 protected:
     MetaDentry(fid_t parent, const string& fname, fid_t myID, MetaFattr* fa)
         : Meta(KFS_DENTRY),
@@ -116,7 +119,7 @@ protected:
           dir(parent),
           hash(nameHash(fname)),
           fattr(fa),
-          name(fname)
+          name(allocateName(fname.data(), fname.size()))
           {}
 
     MetaDentry(const MetaDentry *other)
@@ -125,10 +128,28 @@ protected:
           dir(other->dir),
           hash(other->hash),
           fattr(other->fattr),
-          name(other->name)
+          name(allocateName(other->getNamePtr(), other->getNameLen()))
           {}
-    ~MetaDentry() {}
+    ~MetaDentry() { deallocateName(name); }
 public:
+    //!< Name storage counters, reported by STATS.
+    struct NameStats
+    {
+        NameStats()
+            : count(0),
+              bytes(0),
+              storageBytes(0),
+              largeCount(0),
+              stringBytes(0)
+            {}
+        size_t count;        //!< names in use
+        size_t bytes;        //!< name bytes, excluding length prefix
+        size_t storageBytes; //!< allocated name storage bytes
+        size_t largeCount;   //!< names that do not fit into the pools
+        size_t stringBytes;  //!< estimated equivalent std::string bytes
+    };
+    static const NameStats& getNameStats()
+        { return nameStats(); }
     static inline KeyData nameHash(const string& name)
     {
         // Key(t,d1,d2) discards d2 low order bits.
@@ -157,16 +178,146 @@ public:
     Key keySelf() const { return Key(KFS_DENTRY, dir, hash); }
     inline ostream& showSelf(ostream& os) const;
     //!< accessor that returns the name of this Dentry
-    const string& getName() const { return name; }
+    string getName() const { return string(getNamePtr(), getNameLen()); }
+    //!< name accessors that do not copy the name
+    size_t getNameLen() const
+        { return getNameLen(name); }
+    const char* getNamePtr() const
+        { return (name + nameHdrSize(getNameLen())); }
+    string& appendName(string& str) const
+        { return str.append(getNamePtr(), getNameLen()); }
+    ostream& showName(ostream& os) const
+        { return os.write(getNamePtr(), (std::streamsize)getNameLen()); }
     fid_t getDir() const { return dir; }
     KeyData getHash() const { return hash; }
-    const int compareName(const string& test) const {
-        return name.compare(test);
+    int compareName(const char* test, size_t len) const {
+        const size_t nlen = getNameLen();
+        const int    ret  = memcmp(getNamePtr(), test, std::min(nlen, len));
+        return (ret != 0 ? ret : (nlen < len ? -1 : (len < nlen ? 1 : 0)));
+    }
+    int compareName(const string& test) const {
+        return compareName(test.data(), test.size());
     }
     int checkpoint(ostream &file) const;
     bool matchSelf(const Meta *test) const;
     MetaFattr* getFattr() const { return fattr; }
     void setFattr(MetaFattr* fa) { fattr = fa; }
+private:
+    // The names are stored in the size class pools, with one byte length
+    // prefix, in order to avoid per name heap allocation and std::string
+    // overhead. The names longer than 254 bytes have 4 byte length after
+    // 0xFF prefix byte. The names that do not fit into the largest size
+    // class are allocated from the heap.
+    enum
+    {
+        kNameQuantum      = 8,
+        kNameClassCount   = 16,
+        kNameMaxPoolSize  = kNameQuantum * kNameClassCount,
+        kNameLongLen      = 0xFF,
+        kNameLongHdrSize  = 1 + sizeof(uint32_t)
+    };
+    template<int TClass>
+    struct NameBlock
+    {
+        char data[(TClass + 1) * kNameQuantum];
+    };
+    static NameStats& nameStats()
+    {
+        static NameStats stats;
+        return stats;
+    }
+    static size_t nameHdrSize(size_t len)
+        { return (len < kNameLongLen ? 1 : kNameLongHdrSize); }
+    static size_t nameStorageSize(size_t size)
+    {
+        return (size <= kNameMaxPoolSize ?
+            (size + kNameQuantum - 1) / kNameQuantum * kNameQuantum : size);
+    }
+    static size_t stringFootprint(size_t len)
+    {
+        // Assume small string buffer of 15 bytes, and 16 bytes malloc
+        // overhead and alignment.
+        return (sizeof(string) +
+            (len < 16 ? size_t(0) : (len + 1 + 8 + 15) / 16 * 16));
+    }
+    // The class number is always valid, the modulo only bounds the
+    // recursive instantiation.
+    template<int TClass>
+    static char* allocateNameBlock(int sizeClass)
+    {
+        return (sizeClass == TClass ?
+            static_cast<char*>(allocate<NameBlock<TClass> >()) :
+            allocateNameBlock<(TClass + 1) % kNameClassCount>(sizeClass));
+    }
+    template<int TClass>
+    static void deallocateNameBlock(int sizeClass, char* ptr)
+    {
+        if (sizeClass == TClass) {
+            deallocate(reinterpret_cast<NameBlock<TClass>*>(ptr));
+        } else {
+            deallocateNameBlock<(TClass + 1) % kNameClassCount>(
+                sizeClass, ptr);
+        }
+    }
+    static char* allocateName(const char* str, size_t len)
+    {
+        const size_t hdr     = nameHdrSize(len);
+        const size_t size    = hdr + len;
+        const size_t storage = nameStorageSize(size);
+        char* const  ret     = size <= kNameMaxPoolSize ?
+            allocateNameBlock<0>((int)(storage / kNameQuantum - 1)) :
+            new char[size];
+        if (hdr == 1) {
+            ret[0] = (char)len;
+        } else {
+            const uint32_t len32 = (uint32_t)len;
+            ret[0] = (char)kNameLongLen;
+            memcpy(ret + 1, &len32, sizeof(len32));
+        }
+        memcpy(ret + hdr, str, len);
+        NameStats& stats = nameStats();
+        stats.count++;
+        stats.bytes        += len;
+        stats.storageBytes += storage;
+        stats.stringBytes  += stringFootprint(len);
+        if (kNameMaxPoolSize < size) {
+            stats.largeCount++;
+        }
+        return ret;
+    }
+    static void deallocateName(char* ptr)
+    {
+        const size_t len     = getNameLen(ptr);
+        const size_t size    = nameHdrSize(len) + len;
+        const size_t storage = nameStorageSize(size);
+        NameStats&   stats   = nameStats();
+        assert(0 < stats.count && len <= stats.bytes &&
+            storage <= stats.storageBytes);
+        stats.count--;
+        stats.bytes        -= len;
+        stats.storageBytes -= storage;
+        stats.stringBytes  -= stringFootprint(len);
+        if (size <= kNameMaxPoolSize) {
+            deallocateNameBlock<0>((int)(storage / kNameQuantum - 1), ptr);
+        } else {
+            stats.largeCount--;
+            delete [] ptr;
+        }
+    }
+    static size_t getNameLen(const char* ptr)
+    {
+        const size_t len = (unsigned char)ptr[0];
+        if (len < kNameLongLen) {
+            return len;
+        }
+        uint32_t len32;
+        memcpy(&len32, ptr + 1, sizeof(len32));
+        return len32;
+    }
+    // The name is owned by the dentry, and released by the destructor.
+    // Non copyable.
+    MetaDentry(const MetaDentry&);
+    MetaDentry& operator=(const MetaDentry&);
 };
 
 class BaseFattr {
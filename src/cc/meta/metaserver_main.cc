@@ -371,6 +371,7 @@ MetaServer::SetParameters(const Properties& props)
             mLogRotateIntervalSec));
 
     logger_set_rotate_interval(mLogRotateIntervalSec);
+    oplog.setParameters(props);
 
     string chunkmapDumpDir = props.getValue("metaServer.chunkmapDumpDir", ".");
     setChunkmapDumpDir(chunkmapDumpDir);
@@ -548,6 +549,7 @@ MetaServer::Startup(const Properties& props, bool createEmptyFsFlag)
                     KFS_LOG_STREAM_INFO << "start servicing" << KFS_LOG_EOM;
                     // The following only returns after receiving SIGQUIT.
                     okFlag = gNetDispatch.Start();
+                    logger_shutdown();
                 }
             }
         } else {
@@ -688,6 +690,7 @@ MetaServer::Startup(bool createEmptyFsFlag, bool createEmptyFsIfNoCpExistsFlag)
     setAbortOnPanic(mStartupAbortOnPanicFlag);
     int  status;
     bool rollChunkIdSeedFlag;
+    const int64_t startTime = microseconds();
     if (createEmptyFsFlag && file_exists(LASTCP)) {
         KFS_LOG_STREAM_INFO <<
             "failed to crete empty files system:"
@@ -699,7 +702,8 @@ MetaServer::Startup(bool createEmptyFsFlag, bool createEmptyFsIfNoCpExistsFlag)
             (! createEmptyFsIfNoCpExistsFlag || file_exists(LASTCP))) {
         // Init fs id if needed, leave create time 0, restorer will set these
         // unless fsinfo entry doesn't exit.
-        Restorer r;
+        Restorer r(mStartupProperties.getValue(
+            "metaServer.checkpoint.loadThreads", 0));
         status = r.rebuild(LASTCP, mMinReplicasPerFile) ? 0 : -EIO;
         rollChunkIdSeedFlag = true;
     } else {
@@ -726,6 +730,7 @@ MetaServer::Startup(bool createEmptyFsFlag, bool createEmptyFsIfNoCpExistsFlag)
         KFS_LOG_EOM;
         return false;
     }
+    const int64_t restoreTime = microseconds();
     KFS_LOG_STREAM_INFO << "replaying logs" << KFS_LOG_EOM;
     status = replayer.playAllLogs();
     if (status != 0) {
@@ -743,6 +748,7 @@ MetaServer::Startup(bool createEmptyFsFlag, bool createEmptyFsIfNoCpExistsFlag)
                 minRollChunkIdSeed - max(int64_t(0), replayer.getRollSeeds()));
         }
     }
+    const int64_t replayTime = microseconds();
     // get the sizes of all dirs up-to-date
     KFS_LOG_STREAM_INFO << "updating space utilization" << KFS_LOG_EOM;
     metatree.setUpdatePathSpaceUsage(true);
@@ -756,14 +762,27 @@ MetaServer::Startup(bool createEmptyFsFlag, bool createEmptyFsIfNoCpExistsFlag)
     // remove all the file entries from that dir, the space for the
     // chunks of the file will get reclaimed: chunkservers will tell us
     // about chunks we don't know and those will nuked due to staleness
+    const int64_t spaceUpdateTime = microseconds();
     emptyDumpsterDir();
     logger_init(mLogRotateIntervalSec);
+    const int64_t dumpsterTime = microseconds();
     if ((status = checkpointer_init()) != 0) {
         KFS_LOG_STREAM_FATAL << "checkpoint initialization failure: " <<
             QCUtils::SysError(-status) <<
         KFS_LOG_EOM;
         return false;
     }
+    const int64_t endTime = microseconds();
+    KFS_LOG_STREAM_INFO <<
+        "startup time:"
+        " checkpoint load: "    << (restoreTime     - startTime)       * 1e-6 <<
+        " log replay: "         << (replayTime      - restoreTime)     * 1e-6 <<
+        " space utilization: "  << (spaceUpdateTime - replayTime)      * 1e-6 <<
+        " dumpster cleanup: "   << (dumpsterTime    - spaceUpdateTime) * 1e-6 <<
+        " initial checkpoint: " << (endTime         - dumpsterTime)    * 1e-6 <<
+        " total: "              << (endTime         - startTime)       * 1e-6 <<
+        " sec." <<
+    KFS_LOG_EOM;
     if (metatree.GetFsId() <= 0) {
         submit_request(new MetaSetFsInfo(fsid, 0));
     }
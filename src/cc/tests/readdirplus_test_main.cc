@@ -0,0 +1,298 @@
+//---------------------------------------------------------- -*- Mode: C++ -*-
+// $Id$
+//
+// Created 2026/10/16
+//
+// Copyright 2026 Quantcast Corp.
+//
+// This file is part of Kosmos File System (KFS).
+//
+// Licensed under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+// \brief Paged readdirplus test: list directory one page at a time, with
+// the entries removed between the pages, and with the pages that end in the
+// middle of the entries with the same name hash. Verify that the listing
+// does not lose any entry that was not removed.
+//----------------------------------------------------------------------------
+
+#include "libclient/KfsClient.h"
+#include "common/MsgLogger.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <sstream>
+
+using std::cout;
+using std::cerr;
+using std::string;
+using std::vector;
+using std::set;
+using std::map;
+using std::ostringstream;
+using namespace KFS;
+
+// The names with the same 32 bit meta server directory entry name hash.
+static const char* const kSameHash1[] = {
+    "h10049114", "h10148104", "h11031114", "h11130104", "h11233134",
+    "h11332124", "h11435154", "h11534144", "h11637174", "h11736164",
+    "h11839194", "h11938184", 0
+};
+static const char* const kSameHash2[] = {
+    "h4804037", "h4824235", "h4834136", "h4844433", "h4854334",
+    "h4864631", "h4874532", "h4894730", 0
+};
+static const char* const kSameHash3[] = {
+    "h760193", "h763181", "h770013", "h771025", "h773001", "h776037",
+    "h777049", 0
+};
+static const char* const* const kSameHashGroups[] = {
+    kSameHash1, kSameHash2, kSameHash3, 0
+};
+
+enum RemoveMode
+{
+    kRemoveNone,
+    kRemoveCursor,
+    kRemoveCursorHash
+};
+
+typedef vector<string>    Names;
+typedef set<string>       NameSet;
+typedef map<string, int>  Groups;
+
+static string
+ToString(int val)
+{
+    ostringstream os;
+    os << val;
+    return os.str();
+}
+
+static int
+CreateFiles(KfsClient& client, const string& dir, const Names& names)
+{
+    int status = client.Mkdirs(dir.c_str());
+    if (status < 0) {
+        cerr << dir << ": " << ErrorCodeToStr(status) << "\n";
+        return status;
+    }
+    for (Names::const_iterator it = names.begin(); it != names.end(); ++it) {
+        const string path = dir + "/" + *it;
+        const int    fd   = client.Create(path.c_str());
+        if (fd < 0) {
+            cerr << path << ": " << ErrorCodeToStr(fd) << "\n";
+            return fd;
+        }
+        client.Close(fd);
+    }
+    return 0;
+}
+
+static int
+Remove(KfsClient& client, const string& dir, const string& name,
+    NameSet& removed)
+{
+    if (! removed.insert(name).second) {
+        return 0;
+    }
+    const string path   = dir + "/" + name;
+    const int    status = client.Remove(path.c_str());
+    if (status < 0) {
+        cerr << path << ": " << ErrorCodeToStr(status) << "\n";
+    }
+    return status;
+}
+
+static int
+RunCase(KfsClient& client, const string& dir, const Names& names,
+    const Groups& groups, int pageSize, RemoveMode mode)
+{
+    int status = CreateFiles(client, dir, names);
+    if (status != 0) {
+        return status;
+    }
+    NameSet             listed;
+    NameSet             removed;
+    string              cursor;
+    bool                moreFlag  = true;
+    int                 dupCount  = 0;
+    int                 pageCount = 0;
+    vector<KfsFileAttr> page;
+    while (moreFlag) {
+        if ((status = client.ReaddirPlus(
+                dir.c_str(), cursor, page, moreFlag, pageSize)) != 0) {
+            cerr << dir << ": page: " << pageCount << " " <<
+                ErrorCodeToStr(status) << "\n";
+            return status;
+        }
+        pageCount++;
+        for (vector<KfsFileAttr>::const_iterator it = page.begin();
+                it != page.end();
+                ++it) {
+            if (it->filename == "." || it->filename == "..") {
+                continue;
+            }
+            if (! listed.insert(it->filename).second) {
+                dupCount++;
+            }
+        }
+        if (! moreFlag || mode == kRemoveNone) {
+            continue;
+        }
+        // Remove the cursor entry, and optionally all the entries with the
+        // cursor name hash, before fetching the next page.
+        Groups::const_iterator const git = groups.find(cursor);
+        if (mode == kRemoveCursorHash && git != groups.end()) {
+            for (Groups::const_iterator it = groups.begin();
+                    it != groups.end();
+                    ++it) {
+                if (it->second == git->second &&
+                        (status = Remove(client, dir, it->first, removed))
+                        != 0) {
+                    return status;
+                }
+            }
+        } else if ((status = Remove(client, dir, cursor, removed)) != 0) {
+            return status;
+        }
+    }
+    const NameSet created(names.begin(), names.end());
+    for (NameSet::const_iterator it = listed.begin();
+            it != listed.end();
+            ++it) {
+        if (created.find(*it) == created.end()) {
+            cerr << dir << ": unexpected entry: " << *it << "\n";
+            status = -1;
+        }
+    }
+    for (NameSet::const_iterator it = created.begin();
+            it != created.end();
+            ++it) {
+        if (listed.find(*it) == listed.end() &&
+                removed.find(*it) == removed.end()) {
+            cerr << dir << ": missing entry: " << *it << "\n";
+            status = -1;
+        }
+    }
+    if (mode == kRemoveNone && dupCount != 0) {
+        // Without removes the resume position is exact.
+        cerr << dir << ": duplicate entries: " << dupCount << "\n";
+        status = -1;
+    }
+    cout << dir <<
+        " page size: " << pageSize <<
+        " pages: "     << pageCount <<
+        " listed: "    << listed.size() <<
+        " removed: "   << removed.size() <<
+        " duplicates: "<< dupCount <<
+        (status == 0 ? " passed" : " failed") <<
+    "\n";
+    const int rmStatus = client.Rmdirs(dir.c_str());
+    if (status == 0 && rmStatus < 0) {
+        cerr << dir << ": " << ErrorCodeToStr(rmStatus) << "\n";
+        status = rmStatus;
+    }
+    return status;
+}
+
+static int
+ReaddirPlusTest(KfsClient& client, const string& dir)
+{
+    Names  unique;
+    Names  mixed;
+    Groups groups;
+    for (int i = 0; i < 100; i++) {
+        unique.push_back("f" + ToString(i));
+    }
+    for (int g = 0; kSameHashGroups[g]; g++) {
+        for (int i = 0; kSameHashGroups[g][i]; i++) {
+            mixed.push_back(kSameHashGroups[g][i]);
+            groups[mixed.back()] = g;
+        }
+    }
+    mixed.insert(mixed.end(), unique.begin(), unique.begin() + 20);
+    int status;
+    if ((status = RunCase(client, dir + "/unique-none",
+            unique, groups, 7, kRemoveNone)) != 0 ||
+        (status = RunCase(client, dir + "/unique-cursor",
+            unique, groups, 7, kRemoveCursor)) != 0) {
+        return status;
+    }
+    // Page sizes that end pages in the middle of the same hash entries.
+    const int kPageSizes[] = { 1, 3, 5, 8 };
+    for (size_t i = 0; i < sizeof(kPageSizes) / sizeof(kPageSizes[0]); i++) {
+        const string sfx = "-" + ToString(kPageSizes[i]);
+        if ((status = RunCase(client, dir + "/hash-none" + sfx,
+                mixed, groups, kPageSizes[i], kRemoveNone)) != 0 ||
+            (status = RunCase(client, dir + "/hash-cursor" + sfx,
+                mixed, groups, kPageSizes[i], kRemoveCursor)) != 0 ||
+            (status = RunCase(client, dir + "/hash-all" + sfx,
+                mixed, groups, kPageSizes[i], kRemoveCursorHash)) != 0) {
+            return status;
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    int         optchar;
+    const char* metaserver = 0;
+    int         port       = -1;
+    string      dir;
+    bool        help       = false;
+
+    while ((optchar = getopt(argc, argv, "hm:p:d:")) != -1) {
+        switch (optchar) {
+            case 'm':
+                metaserver = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            default:
+                help = true;
+                break;
+        }
+    }
+    if (help || ! metaserver || port < 0 || dir.empty()) {
+        (help ? cout : cerr) << "Usage: " << argv[0] <<
+            " -m <metaserver host> -p <port> -d <test directory>\n"
+            "Paged readdirplus test. The test directory must not exist.\n"
+        ;
+        return (help ? 0 : 1);
+    }
+    MsgLogger::Init(0, MsgLogger::kLogLevelINFO);
+    KfsClient* const client = KfsClient::Connect(metaserver, port, 0);
+    if (! client) {
+        cerr << "failed to connect to " << metaserver << ":" << port << "\n";
+        return 1;
+    }
+    const int status = ReaddirPlusTest(*client, dir);
+    if (status == 0) {
+        client->Rmdirs(dir.c_str());
+    }
+    delete client;
+    MsgLogger::Stop();
+    return (status == 0 ? 0 : 1);
+}
@@ -834,9 +834,17 @@ public:
     {
     public:
         KfsDirIterator(
+            KfsClient*           inClientPtr,
+            const string&        inDirName,
+            bool                 inApproxFileSizeFlag,
             vector<KfsFileAttr>* inAttrsPtr,
             vector<string>*      inNamesPtr)
             : mFetchAttributesFlag(inAttrsPtr != 0),
+              mApproxFileSizeFlag(inApproxFileSizeFlag),
+              mHasMoreEntriesFlag(false),
+              mClientPtr(inClientPtr),
+              mDirName(inDirName),
+              mCursor(),
               mAttrs(),
               mNames(),
               mCur(0),
@@ -850,31 +858,59 @@ public:
         }
         virtual ~KfsDirIterator()
             {}
-        void Next(
+        int FetchNextPage()
+        {
+            // Fetch directory with attributes one page at a time, in order
+            // to bound memory use with large directories.
+            mCur = 0;
+            mAttrs.clear();
+            const int  kMaxEntries          = 0; // Use default.
+            const bool kComputeFileSizeFlag = true;
+            return mClientPtr->ReaddirPlus(
+                mDirName.c_str(),
+                mCursor,
+                mAttrs,
+                mHasMoreEntriesFlag,
+                kMaxEntries,
+                kComputeFileSizeFlag,
+                mApproxFileSizeFlag
+            );
+        }
+        int Next(
             string&         outName,
             const StatBuf*& outStatBufPtr)
         {
             if (mFetchAttributesFlag) {
+                int theRet = 0;
+                while (mCur >= mAttrs.size() && mHasMoreEntriesFlag &&
+                        (theRet = FetchNextPage()) == 0)
+                    {}
                 if (mCur >= mAttrs.size()) {
                     outStatBufPtr = 0;
                     outName.clear();
-                    return;
+                    return theRet;
                 }
                 const KfsFileAttr& theAttr = mAttrs[mCur++];
                 outName = theAttr.filename;
                 ToStat(theAttr, mStatBuf);
                 outStatBufPtr = &mStatBuf;
-                return;
+                return 0;
             }
             outStatBufPtr = 0;
             if (mCur >= mNames.size()) {
                 outName.clear();
-                return;
+                return 0;
             }
             outName = mNames[mCur++];
+            return 0;
         }
     private:
         const bool          mFetchAttributesFlag;
+        const bool          mApproxFileSizeFlag;
+        bool                mHasMoreEntriesFlag;
+        KfsClient* const    mClientPtr;
+        const string        mDirName;
+        string              mCursor;
         vector<KfsFileAttr> mAttrs;
         vector<string>      mNames;
         size_t              mCur;
@@ -883,11 +919,13 @@ public:
     KfsFileSystem(
         const string& inUri,
         bool          inSkipHolesFlag,
-        bool          inFullSparseFileSupportFlag)
+        bool          inFullSparseFileSupportFlag,
+        bool          inDirListApproxFileSizeFlag)
         : FileSystemImpl(inUri),
           KfsClient(),
           mSkipHolesFlag(inSkipHolesFlag),
-          mFullSparseFileSupportFlag(inFullSparseFileSupportFlag)
+          mFullSparseFileSupportFlag(inFullSparseFileSupportFlag),
+          mDirListApproxFileSizeFlag(inDirListApproxFileSizeFlag)
         {}
     virtual ~KfsFileSystem()
         {}
@@ -1077,14 +1115,21 @@ public:
     {
         if (inFetchAttributesFlag) {
             vector<KfsFileAttr> theAttrs;
-            const int theRet = ReaddirPlus(inDirName.c_str(), theAttrs);
-            outDirIteratorPtr =
-                theRet == 0 ? new KfsDirIterator(&theAttrs, 0) : 0;
+            KfsDirIterator* const theItPtr = new KfsDirIterator(
+                this, inDirName, mDirListApproxFileSizeFlag, &theAttrs, 0);
+            const int theRet = theItPtr->FetchNextPage();
+            if (theRet == 0) {
+                outDirIteratorPtr = theItPtr;
+            } else {
+                outDirIteratorPtr = 0;
+                delete theItPtr;
+            }
             return theRet;
         }
         vector<string> theNames;
         const int theRet  = Readdir(inDirName.c_str(), theNames);
-        outDirIteratorPtr = theRet == 0 ? new KfsDirIterator(0, &theNames) : 0;
+        outDirIteratorPtr = theRet == 0 ?
+            new KfsDirIterator(this, inDirName, false, 0, &theNames) : 0;
         return theRet;
     }
     virtual int Close(
@@ -1107,8 +1152,7 @@ public:
             return -EINVAL;
         }
         KfsDirIterator& theIt = *static_cast<KfsDirIterator*>(inDirIteratorPtr);
-        theIt.Next(outName, outStatPtr);
-        return 0;
+        return theIt.Next(outName, outStatPtr);
     }
     virtual int Chmod(
         const string& inPathName,
@@ -1391,6 +1435,7 @@ public:
 private:
     const bool mSkipHolesFlag;
     const bool mFullSparseFileSupportFlag;
+    const bool mDirListApproxFileSizeFlag;
 private:
     KfsFileSystem(
         const KfsFileSystem& inFileSystem);
@@ -1543,7 +1588,9 @@ FileSystem::Get(
             inPropertiesPtr && inPropertiesPtr->getValue(
                 "fs.readSkipHoles", 0) != 0,
             inPropertiesPtr && inPropertiesPtr->getValue(
-                "fs.readFullSparseFileSupport", 0) != 0
+                "fs.readFullSparseFileSupport", 0) != 0,
+            inPropertiesPtr && inPropertiesPtr->getValue(
+                "fs.dirListApproxFileSize", 0) != 0
         );
         if ((theRet = theFsPtr->Init(theAuthority, inPropertiesPtr)) == 0) {
             theImplPtr = theFsPtr;
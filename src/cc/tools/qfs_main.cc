@@ -1229,6 +1229,7 @@ private:
               mMaxReplicas(0),
               mMaxFileSize(0),
               mDirListEntries(),
+              mShownCount(0),
               mDirSummaryFlag(inDirSummaryFlag),
               mDirSummaryMinTier(inDirSummaryMinTier),
               mDirSummaryMaxTier(inDirSummaryMaxTier),
@@ -1307,6 +1308,13 @@ private:
                         }
                         AddEntry(inFs, inPath, theName,
                             theStatPtr ? *theStatPtr : mNullStat);
+                        if (kMaxDirListEntries < mDirListEntries.size()) {
+                            // Bound memory use with large directories.
+                            // The column widths might change between the
+                            // output batches.
+                            mShownCount += mDirListEntries.size();
+                            ShowEntries(inFs);
+                        }
                     }
                     inFs.Close(theItPtr);
                 }
@@ -1319,25 +1327,18 @@ private:
                 }
                 return true;
             }
-            if (mRecursionCount == 0 &&
-                    ! mRecursiveFlag && ! mDirListEntries.empty()) {
-                mOutStream <<
-                    "Found " << mDirListEntries.size() << " items\n";
-            }
             if (mRecursionCount == 0 ||
-                    mDirListEntries.size() > (size_t(32) << 10)) {
-                char* const theEndPtr = mTmBuf + kTmBufLen;
-                mFileSizeWidth = theEndPtr - IntToDecString(
-                    mMaxFileSize, theEndPtr);
-                mReplicasWidth = theEndPtr - IntToDecString(
-                    mMaxReplicas, theEndPtr);
-                for (DirListEntries::const_iterator
-                        theIt = mDirListEntries.begin();
-                        theIt != mDirListEntries.end() && mOutStream;
-                        ++theIt) {
-                    Show(inFs, *theIt);
+                    mDirListEntries.size() > kMaxDirListEntries) {
+                mShownCount += mDirListEntries.size();
+                ShowEntries(inFs);
+            }
+            if (mRecursionCount == 0) {
+                // The entries might be shown in multiple batches, show the
+                // item count at the end.
+                if (! mRecursiveFlag && 0 < mShownCount && mOutStream) {
+                    mOutStream << "Found " << mShownCount << " items\n";
                 }
-                Reset();
+                mShownCount = 0;
             }
             return true;
         }
@@ -1437,6 +1438,7 @@ private:
         typedef vector<DirSummaryEntry> DirSummaryEntries;
 
         enum { kTmBufLen = 128 };
+        static const size_t kMaxDirListEntries = size_t(32) << 10;
         ostream&                  mOutStream;
         const char* const         mOutStreamNamePtr;
         ostream&                  mErrorStream;
@@ -1457,6 +1459,7 @@ private:
         int                       mMaxReplicas;
         int64_t                   mMaxFileSize;
         DirListEntries            mDirListEntries;
+        size_t                    mShownCount;
         bool const                mDirSummaryFlag;
         int const                 mDirSummaryMinTier;
         int const                 mDirSummaryMaxTier;
@@ -1467,6 +1470,22 @@ private:
         char const                mDelimeter;
         char                      mTmBuf[kTmBufLen];
 
+        void ShowEntries(
+            FileSystem& inFs)
+        {
+            char* const theEndPtr = mTmBuf + kTmBufLen;
+            mFileSizeWidth = theEndPtr - IntToDecString(
+                mMaxFileSize, theEndPtr);
+            mReplicasWidth = theEndPtr - IntToDecString(
+                mMaxReplicas, theEndPtr);
+            for (DirListEntries::const_iterator
+                    theIt = mDirListEntries.begin();
+                    theIt != mDirListEntries.end() && mOutStream;
+                    ++theIt) {
+                Show(inFs, *theIt);
+            }
+            Reset();
+        }
         void Reset()
         {
             mDirListEntries.clear();
@@ -4589,6 +4608,10 @@ const char* const KfsTool::sHelpStrings[] =
     "fs.readFullSparseFileSupport = 0\n\t\t\t"
         "zero fill holes, instead of declaring an error.\n\t\t\t"
         "Only has effect with QFS.\n\t\t"
+    "fs.dirListApproxFileSize = 0\n\t\t\t"
+        "-ls[r]* report the sizes of the files being written estimated\n\t\t\t"
+        "by the meta server, instead of querying chunk servers.\n\t\t\t"
+        "Only has effect with QFS.\n\t\t"
     "fs.columnSeparator\n\t\t\t"
         "set -ls[rst]* and -count column delimiter (single character).\n\t\t\t"
         "C escape sequences can be used to specify character code.\n\t\t"
@@ -72,7 +72,11 @@ using std::istringstream;
     f(GET_CHUNK_SERVER_DIRS_COUNTERS,  "stats: output chunk directories" \
                                        " counters") \
     f(GET_REQUEST_COUNTERS,            "stats: get meta server request" \
-                                       " counters") \
+                                       " counters, or per request type" \
+                                       " wait, handle, log, and send" \
+                                       " latency histograms" \
+                                       " [Latency-histograms=1]" \
+    ) \
     f(PING,                            "stats: list current status counters") \
     f(STATS,                           "stats: list RPC counters") \
     f(FSCK,                            "debug: run fsck") \
@@ -194,6 +194,10 @@ final public class KfsAccess
     private final static native
     int stat(long ptr, String path, KfsFileAttr attr);
 
+    private final static native
+    int statBatch(long ptr, String[] paths, KfsFileAttr[] attrs,
+        int[] statuses);
+
     private final static native
     String strerror(long ptr, int err);
 
@@ -851,6 +855,20 @@ final public class KfsAccess
         return stat(cPtr, path, attr);
     }
 
+    // Stat a list of paths with as few meta server round trips as possible.
+    // The per path status is returned in statuses, and the attributes in
+    // attrs elements with the corresponding status 0.
+    public int kfs_statBatch(String[] paths, KfsFileAttr[] attrs,
+        int[] statuses)
+    {
+        for (int i = 0; i < attrs.length; i++) {
+            if (attrs[i] == null) {
+                attrs[i] = new KfsFileAttr();
+            }
+        }
+        return statBatch(cPtr, paths, attrs, statuses);
+    }
+
     public void kfs_retToIOException(int ret) throws IOException
     {
         kfs_retToIOException(ret, null);
@@ -36,6 +36,11 @@ rand='rand-sfmt'
 randseed=1234
 sizes=${sizes-'1 2 3 127 511 1024 65535 65536 65537 70300 1e5 67108864 67108865 100e6 250e6'}
 chksum=${chksum-sha1sum}
+# Meta server directory. If set, compare the meta server in process checkpoint
+# written while the test runs with the checkpoint that log compactor creates
+# from the prior checkpoint and the transaction log segments in between.
+cpcheckmetadir=${cpcheckmetadir-}
+cpchecktimeout=${cpchecktimeout-120}
 
 if [  x"`{ cat /dev/null | $chksum ; } 2>/dev/null`" = x ]; then
     chksum='openssl sha1'
@@ -60,6 +65,77 @@ mytime()
     fi
 }
 
+lastcheckpoint()
+{
+    ls -1 "$cpcheckmetadir/kfscp" \
+        | sed -n -e 's/^chkpt\.\([0-9][0-9]*\)$/\1/p' | sort -n | tail -n 1
+}
+
+checkpointlog()
+{
+    sed -n -e 's/^log\/.*\.\([0-9][0-9]*\)$/\1/p' -e '/^$/q' "$1"
+}
+
+checkpointleaves()
+{
+    # Compare tree leaves only. Log compactor re-computes directory sizes,
+    # and the file modification time can be updated in place ahead of the
+    # corresponding log record.
+    grep -E '^(dentry|fattr|chunkinfo)/' "$1" | sed \
+        -e '/^fattr\/dir\//s/\/filesize\/[^/]*//' \
+        -e 's/\/mtime\/[^/]*//'
+}
+
+checkpointcheck()
+{
+    startcp=$1
+    i=0
+    while true; do
+        endcp=`lastcheckpoint`
+        [ x"$endcp" != x -a x"$endcp" != x"$startcp" ] && break
+        if [ $i -ge $cpchecktimeout ]; then
+            echo "checkpoint check: no checkpoint after $startcp"
+            return 1
+        fi
+        i=`expr $i + 1`
+        sleep 1
+    done
+    cpsrc="$cpcheckmetadir/kfscp"
+    logsrc="$cpcheckmetadir/kfslog"
+    startlog=`checkpointlog "$cpsrc/chkpt.$startcp"`
+    endlog=`checkpointlog "$cpsrc/chkpt.$endcp"`
+    if [ x"$startlog" = x -o x"$endlog" = x ]; then
+        echo "checkpoint check: no log segment in checkpoint header"
+        return 1
+    fi
+    rm -rf cpcheck && mkdir -p cpcheck/kfscp cpcheck/kfslog || return
+    cp "$cpsrc/chkpt.$startcp" cpcheck/kfscp/ || return
+    ln cpcheck/kfscp/"chkpt.$startcp" cpcheck/kfscp/latest || return
+    n=$startlog
+    while [ $n -lt $endlog ]; do
+        cp "$logsrc/log.$n" cpcheck/kfslog/ || return
+        n=`expr $n + 1`
+    done
+    ln cpcheck/kfslog/"log.`expr $endlog - 1`" cpcheck/kfslog/last || return
+    (cd cpcheck && logcompactor -l kfslog -c kfscp) \
+        > cpcheck.log 2>&1 || return
+    if [ ! -f cpcheck/kfscp/"chkpt.$endcp" ]; then
+        echo "checkpoint check: log compactor did not create chkpt.$endcp"
+        return 1
+    fi
+    checkpointleaves "$cpsrc/chkpt.$endcp" > cpcheck-inprocess.txt || return
+    checkpointleaves cpcheck/kfscp/"chkpt.$endcp" > cpcheck-offline.txt \
+        || return
+    if cmp cpcheck-inprocess.txt cpcheck-offline.txt; then
+        echo "checkpoint $endcp check passed"
+        rm -rf cpcheck
+        return 0
+    fi
+    diff cpcheck-inprocess.txt cpcheck-offline.txt | head -n 20
+    echo "checkpoint $endcp check failed"
+    return 1
+}
+
 if [ -x /usr/bin/time ] && /usr/bin/time -v true >/dev/null 2>&1; then
     xtime='/usr/bin/time -v'
 fi
@@ -74,6 +150,10 @@ cd "$log" || exit
 
 $kfsshell rm "$dir" > /dev/null 2>&1
 $kfsshell mkdir "$dir" || exit
+if [ x"$cpcheckmetadir" != x ]; then
+    startcp=`lastcheckpoint`
+    [ x"$startcp" != x ] || exit
+fi
 # sleep 3
 
 rseed=$randseed
@@ -113,6 +193,9 @@ for s in $sizes; do
     fi
     rseed=`expr $rseed + 1`
 done
+if [ $status -eq 0 -a x"$cpcheckmetadir" != x ]; then
+    checkpointcheck "$startcp" || status=1
+fi
 if [ $status -eq 0 ]; then
     if [ x"$removetestdir" = x'yes' ]; then
         $kfsshell rm "$dir" > /dev/null 2>&1
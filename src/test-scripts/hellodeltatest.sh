@@ -0,0 +1,257 @@
+#!/bin/sh
+#
+# $Id$
+#
+# Created 2026/10/16
+#
+# Copyright 2026 Quantcast Corp.
+#
+# This file is part of Kosmos File System (KFS).
+#
+# Licensed under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+# Test incremental (delta) chunk server hello by stopping the chunk server
+# process in order to make the meta server declare it down, and by
+# restarting the meta server. The following cases are tested:
+# 1. Delta hello accepted on re-connect while the server is hibernated.
+# 2. Delta hello rejected by the restarted meta server, and chunk server
+#    falling back to the full hello.
+# 3. Delta hello rejected after hibernation expiry, and chunk server falling
+#    back to the full hello.
+# Uses the meta and chunk server configuration created by qfstest.sh.
+
+ulimit -c unlimited || exit
+
+builddir=`pwd`
+toolsdir=${toolsdir-"$builddir"/src/cc/tools}
+metadir=${metadir-"$builddir"/src/cc/meta}
+chunkdir=${chunkdir-"$builddir"/src/cc/chunk}
+devtoolsdir=${devtoolsdir-`dirname "$toolsdir"`/devtools}
+qfstestdir=${qfstestdir-"$builddir"/qfstest}
+clicfg=${clicfg-"$qfstestdir"/client.prp}
+clirootcfg=${clirootcfg-"$qfstestdir"/clientroot.prp}
+metaport=${metaport-20200}
+metahost=${metahost-127.0.0.1}
+csport=${csport-20400}
+heartbeatinterval=${heartbeatinterval-1}
+heartbeattimeout=${heartbeattimeout-3}
+downdelay=${downdelay-30}
+testfilesize=${testfilesize-3145728}
+maxwait=${maxwait-120}
+
+metalog=metaserver-hellodelta.log
+metaprop=MetaServer-hellodelta.prp
+
+wait_shutdown_complete()
+{
+    pid=$1
+    maxtry=${2-100}
+    k=0
+    while kill -0 $pid 2>/dev/null; do
+        sleep 1
+        k=`expr $k + 1`
+        if [ $k -gt $maxtry ]; then
+            echo "server $pid shutdown failure" 1>&2
+            kill -ABRT $pid
+            sleep 3
+            kill -KILL $pid 2>/dev/null
+            return 1
+        fi
+    done
+    return 0
+}
+
+stop_meta()
+{
+    pid=`cat "$qfstestdir"/meta/metaserver.pid`
+    kill -QUIT $pid
+    wait_shutdown_complete $pid
+}
+
+start_meta()
+{
+    cd "$qfstestdir"/meta || return 1
+    "$metadir"/metaserver "$metaprop" >> "$metalog" 2>&1 &
+    echo $! > metaserver.pid
+    cd "$builddir"
+}
+
+shutdown()
+{
+    sstatus=0
+    cspid=`cat "$qfstestdir"/chunk/$csport/chunkserver.pid`
+    kill -CONT $cspid 2>/dev/null
+    stop_meta || sstatus=1
+    kill -QUIT $cspid
+    wait_shutdown_complete $cspid || sstatus=1
+    return $sstatus
+}
+
+# Wait for the number of the connected chunk servers to become $1.
+wait_up_servers()
+{
+    t=0
+    until [ `"$toolsdir"/qfsadmin -s "$metahost" -p "$metaport" \
+                -f "$clirootcfg" upservers 2>/dev/null | wc -l` -eq $1 ]; do
+        t=`expr $t + 1`
+        if [ $t -gt $maxwait ]; then
+            echo "wait for $1 chunk servers to connect timed out" 1>&2
+            return 1
+        fi
+        sleep 1
+    done
+    return 0
+}
+
+count_log()
+{
+    grep -c "$1" "$qfstestdir/meta/$metalog"
+}
+
+verify_files()
+{
+    for f in $testfiles; do
+        filemd5=`"$toolsdir"/qfs -cfg "$clicfg" \
+            -cat "qfs://$metahost:$metaport/user/$usr/$f" \
+            | openssl md5 | awk '{print $NF}'`
+        if [ x"$testmd5" != x"$filemd5" ]; then
+            echo "$f checksum mismatch: expected: $testmd5" \
+                "actual: $filemd5" 1>&2
+            return 1
+        fi
+    done
+    return 0
+}
+
+put_file()
+{
+    "$devtoolsdir"/rand-sfmt -g $testfilesize 1234 \
+    | "$toolsdir"/qfs -cfg "$clicfg" -D fs.createParams=1 \
+        -put - "qfs://$metahost:$metaport/user/$usr/$1" || return
+    testfiles="$testfiles $1"
+}
+
+# Stop the chunk server process, wait for the meta server to declare it down,
+# sleep the specified time, then resume the chunk server, and wait for it to
+# re-connect.
+pause_chunk_server()
+{
+    cspid=`cat "$qfstestdir"/chunk/$csport/chunkserver.pid`
+    kill -STOP $cspid || return
+    wait_up_servers 0 || return
+    [ $1 -gt 0 ] && sleep $1
+    kill -CONT $cspid || return
+    wait_up_servers 1
+}
+
+# Check that the log pattern $1 count is greater than $2.
+check_count()
+{
+    c=`count_log "$1"`
+    if [ $c -gt $2 ]; then
+        return 0
+    fi
+    echo "$3: expected more than $2 \"$1\" log messages, got: $c" 1>&2
+    return 1
+}
+
+usr=`id -un`
+[ -f "$clicfg"     ] || clicfg=/dev/null
+[ -f "$clirootcfg" ] || clirootcfg=/dev/null
+
+if [ -d "$qfstestdir" ]; then
+    true
+else
+    echo "Directory $qfstestdir does not exist, execute qfstest.sh first."
+    exit 1
+fi
+
+cd "$qfstestdir"/meta || exit
+kill -KILL `cat metaserver.pid` 2>/dev/null
+rm -f kfscp/* kfslog/* "$metalog"
+cp MetaServer.prp "$metaprop" || exit
+{
+    echo "metaServer.chunkServer.heartbeatInterval = $heartbeatinterval"
+    echo "metaServer.chunkServer.heartbeatTimeout = $heartbeattimeout"
+    echo "metaServer.serverDownReplicationDelay = $downdelay"
+    echo "metaServer.chunkServer.helloDeltaEnabled = 1"
+    echo "metaServer.csmap.unittest = 0"
+} >> "$metaprop"
+"$metadir"/metaserver -c "$metaprop" > "$metalog" 2>&1 || {
+    status=$?
+    cat "$metalog"
+    exit $status
+}
+cd "$builddir"
+start_meta || exit
+cd "$qfstestdir"/chunk/$csport || exit
+kill -KILL `cat chunkserver.pid` 2>/dev/null
+rm -rf kfschunk*/*
+rm -f chunkserver-hellodelta.log
+"$chunkdir"/chunkserver ChunkServer.prp > chunkserver-hellodelta.log 2>&1 &
+echo $! > chunkserver.pid
+cd "$builddir"
+
+trap shutdown EXIT
+
+echo "Waiting for chunk server to connect"
+wait_up_servers 1 || exit
+
+testmd5=`"$devtoolsdir"/rand-sfmt -g $testfilesize 1234 \
+    | openssl md5 | awk '{print $NF}'`
+testfiles=''
+status=0
+
+"$toolsdir"/qfs -cfg "$clicfg" \
+    -mkdir "qfs://$metahost:$metaport/user/$usr" || exit
+put_file testhello1.dat || exit
+
+if [ $status -eq 0 ]; then
+    echo "Delta hello accepted after re-connect"
+    # The file is created after the first hello, therefore the delta hello
+    # must report its chunks.
+    put_file testhello2.dat || status=1
+    n=`count_log 'chunks: delta'`
+    pause_chunk_server 0 || status=1
+    check_count 'chunks: delta' $n 'delta accepted' || status=1
+    verify_files || status=1
+fi
+
+if [ $status -eq 0 ]; then
+    echo "Delta hello rejected by restarted meta server"
+    m=`count_log 'chunk inventory generation mismatch'`
+    f=`count_log 'chunks: full'`
+    { stop_meta && start_meta && wait_up_servers 1 ; } || status=1
+    check_count 'chunk inventory generation mismatch' $m 'delta rejected' ||
+        status=1
+    check_count 'chunks: full' $f 'delta rejected' || status=1
+    verify_files || status=1
+fi
+
+if [ $status -eq 0 ]; then
+    echo "Delta hello after hibernation expiry"
+    m=`count_log 'chunk inventory generation mismatch'`
+    f=`count_log 'chunks: full'`
+    pause_chunk_server `expr $downdelay + 5` || status=1
+    check_count 'chunk inventory generation mismatch' $m 'hibernation expiry' ||
+        status=1
+    check_count 'chunks: full' $f 'hibernation expiry' || status=1
+    verify_files || status=1
+fi
+
+trap '' EXIT
+if shutdown && [ $status -eq 0 ]; then
+    echo "Passed all tests"
+    exit 0
+fi
+exit 1
@@ -0,0 +1,134 @@
+#!/bin/sh
+#
+# $Id$
+#
+# Created 2026/10/17
+#
+# Copyright 2026 Quantcast Corp.
+#
+# This file is part of Kosmos File System (KFS).
+#
+# Licensed under the Apache License, Version 2.0
+# (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied. See the License for the specific language governing
+# permissions and limitations under the License.
+#
+# Log compactor stream mode test. Run log compactor in the normal and stream
+# (-s) modes on the copies of the same checkpoint and logs, and compare the
+# resulting checkpoints. The stream mode test with the pass limit set to zero
+# passes verifies the fall back to the full compaction.
+# The first argument is the meta server directory with kfscp and kfslog
+# sub directories, the meta server must not write into it.
+
+metasrvdir=${1-${metasrvdir-`pwd`}}
+lctestdir=${lctestdir-`pwd`/logcompactortest}
+
+checkpointlog()
+{
+    sed -n -e 's/^log\/.*\.\([0-9][0-9]*\)$/\1/p' -e '/^$/q' "$1"
+}
+
+lastlog()
+{
+    # Log "last" is a hard link to the last closed log segment.
+    inode=`ls -i "$1/last" | awk '{print $1}'`
+    ls -i "$1" | awk -v inode="$inode" '$1 == inode {print $2}' \
+        | sed -n -e 's/^log\.\([0-9][0-9]*\)$/\1/p'
+}
+
+checkpointcontent()
+{
+    # The stream mode does not re-compute directory sizes.
+    grep -v -E '^(time|checksum)/' "$1" \
+        | sed -e '/^fattr\/dir\//s/\/filesize\/[^/]*//'
+}
+
+copymeta()
+{
+    rm -rf "$1" && mkdir -p "$1/kfscp" "$1/kfslog" || return
+    cp "$cpfile" "$1/kfscp/" || return
+    ln "$1/kfscp/`basename "$cpfile"`" "$1/kfscp/latest" || return
+    n=$startlog
+    while [ $n -le $endlog ]; do
+        cp "$metasrvdir/kfslog/log.$n" "$1/kfslog/" || return
+        n=`expr $n + 1`
+    done
+    ln "$1/kfslog/log.$endlog" "$1/kfslog/last"
+}
+
+compact()
+{
+    dir=$1
+    shift
+    (cd "$dir" && logcompactor -l kfslog -c kfscp ${1+"$@"}) \
+        > "$dir.log" 2>&1 || {
+        echo "$dir: log compactor failed" 1>&2
+        tail -n 20 "$dir.log" 1>&2
+        return 1
+    }
+    ls -1 "$dir/kfscp" \
+        | sed -n -e 's/^chkpt\.\([0-9][0-9]*\)$/\1/p' | sort -n | tail -n 1
+}
+
+# Find the checkpoint file that "latest" points to.
+cpfile=
+for f in "$metasrvdir/kfscp"/chkpt.*; do
+    if [ "$f" -ef "$metasrvdir/kfscp/latest" ]; then
+        cpfile=$f
+        break
+    fi
+done
+if [ x"$cpfile" = x ]; then
+    echo "$metasrvdir/kfscp: no latest checkpoint"
+    exit 1
+fi
+startlog=`checkpointlog "$cpfile"`
+endlog=`lastlog "$metasrvdir/kfslog"`
+if [ x"$startlog" = x -o x"$endlog" = x ]; then
+    echo "$metasrvdir: no log segments to compact"
+    exit 1
+fi
+if [ $endlog -lt $startlog ]; then
+    echo "log compactor test: no logs after `basename "$cpfile"`, skipped"
+    exit 0
+fi
+
+mkdir -p "$lctestdir" && cd "$lctestdir" || exit
+
+status=0
+for mode in normal stream fallback; do
+    copymeta "$mode" || exit
+    case $mode in
+        normal)   opts= ;;
+        stream)   opts='-s' ;;
+        fallback) opts='-s -P 0' ;;
+    esac
+    lcp=`compact "$mode" $opts` || exit
+    if [ x"$lcp" = x ]; then
+        echo "$mode: log compactor did not create checkpoint"
+        exit 1
+    fi
+    checkpointcontent "$mode/kfscp/chkpt.$lcp" > "$mode.txt" || exit
+    if [ $mode = normal ]; then
+        continue
+    fi
+    if cmp normal.txt "$mode.txt"; then
+        echo "log compactor $mode mode checkpoint $lcp test passed"
+    else
+        diff normal.txt "$mode.txt" | head -n 20
+        echo "log compactor $mode mode checkpoint $lcp test failed"
+        status=1
+    fi
+done
+
+if [ $status -eq 0 ]; then
+    cd .. && rm -rf "$lctestdir"
+fi
+exit $status
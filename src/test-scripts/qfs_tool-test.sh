@@ -392,6 +392,44 @@ tfiletxt="$tdir/testtxt"
 echo 'this is a test' | $qfstool -put - "$tfiletxt"
 test x"`$qfstool -text "$tfilegz"`" = x"`echo 'this is a test'`"
 
+# Test server side remove of a large directory, and the incremental dumpster
+# reclaim of its sub tree.
+tlarge="${testdir}-large"
+tlargebn="large$$"
+rm -rf "$tlarge"
+mkdir "$tlarge"
+for a in 0 1 2 3 4 5 6 7 8 9; do
+    for b in 0 1 2 3 4 5 6 7 8 9; do
+        mkdir -p "$tlarge/$a/$b"
+        for c in 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19; do
+            : > "$tlarge/$a/$b/$c"
+        done
+    done
+done
+$qfstool -copyFromLocal "$tlarge" "$dir/$tlargebn"
+test x"`$qfstool -count "$dir/$tlargebn" | awk '{print $2}'`" = x'2000'
+$qfstool -rmr -skipTrash "$dir/$tlargebn"
+$qfstool -test -e "$dir/$tlargebn" && exit 1
+# Wait for the dumpster reclaim to delete the sub tree.
+k=0
+while $qfstool -D fs.euser=0 -cfg "$qfstoolrootauthcfg" -ls /dumpster \
+        | grep "/dumpster/$tlargebn[0-9]*\$" > /dev/null; do
+    k=`expr $k + 1`
+    [ $k -le 120 ] || exit 1
+    sleep 1
+done
+rm -rf "$tlarge"
+
+# Test paged directory listing resume with the cursor entry or all entries
+# with the cursor name hash removed, and the pages that end in the middle of
+# the entries with the same name hash.
+if [ -x "`which readdirplus_test 2>/dev/null`" ]; then
+    readdirplus_test \
+        -m "`echo "$qfstoolmeta" | sed -e 's/:[0-9]*$//' -e 's/^\[//' -e 's/\]$//'`" \
+        -p "`echo "$qfstoolmeta" | sed -e 's/^.*://'`" \
+        -d "$dir/readdirplus"
+fi
+
 $qfstool -rmr -skipTrash "$dir" "local://$testdir" "local://$testdircp"
 
 echo "`basename "$0"`: passed all tests."
@@ -257,6 +257,7 @@ for dir in  \
         'src/cc/chunk' \
         'src/cc/meta' \
         'src/cc/tools' \
+        'src/cc/tests' \
         'src/cc/libclient' \
         'src/cc/kfsio' \
         'src/cc/qcdio' \
@@ -289,6 +290,9 @@ if [ x"$dontusefuser" != x'yes' ]; then
     [ -x "`which fuser 2>/dev/null`" ] || dontusefuser=yes
 fi
 
+# Meta tree node key search unit test.
+metatreenode -c -n 65536 -l 1 || exit
+
 rm -rf "$testdir"
 mkdir "$testdir" || exit
 mkdir "$metasrvdir" || exit
@@ -390,6 +394,10 @@ metaServer.objectStoreReadCanUsePoxoyOnDifferentHost = 1
 metaServer.objectStoreWriteCanUsePoxoyOnDifferentHost = 1
 metaServer.objectStorePlacementTest = 1
 metaServer.replicationCheckInterval = 0.5
+metaServer.dumpsterReclaimMaxEntries = 64
+metaServer.checkpoint.interval = 5
+metaServer.checkpoint.inProcess = 1
+metaServer.checkpoint.inProcessSliceTimeUsec = 100
 EOF
 
 if [ x"$auth" = x'yes' ]; then
@@ -440,6 +448,7 @@ metaserver -c "$metasrvprop" > "${metaservercreatefsout}" 2>&1 || {
 
 cat >> "$metasrvprop" << EOF
 metaServer.csmap.unittest = 1
+metaServer.replicationPriority.unittest = 1
 EOF
 
 myrunprog metaserver "$metasrvprop" "$metasrvlog" > "${metasrvout}" 2>&1 &
@@ -562,6 +571,7 @@ cppidf="cptest${pidsuf}"
     QFS_CLIENT_CONFIG=$clientenvcfg \
     cptokfsopts='-r 0 -m 15 -l 15 -R 20 -w -1' \
     cpfromkfsopts='-r 0 -w 65537' \
+    cpcheckmetadir="$metasrvdir" \
     cptest.sh &&\
     mv cptest.log cptest-os.log && \
     cptokfsopts='-r 3 -m 1 -l 15 -w -1' \
@@ -751,9 +761,41 @@ done
 
 find "$testdir" -name core\* || status=1
 
+# Compare log compactor stream and normal modes results on the meta server
+# checkpoint and logs, after the shutdown.
+if [ $status -eq 0 ]; then
+    echo "Starting log compactor stream mode test"
+    lctestdir="$testdir/logcompactortest" \
+    logcompactortest.sh "$metasrvdir" > logcompactortest.out 2>&1
+    lcteststatus=$?
+    cat logcompactortest.out
+else
+    lcteststatus=0
+fi
+
+# The delta hello test re-starts the meta and chunk servers with the
+# configuration created above, therefore it runs after the shutdown.
+if [ $status -eq 0 ]; then
+    echo "Starting delta chunk server hello test"
+    qfstestdir="$testdir" \
+    metadir="`dirname "\`which metaserver\`"`" \
+    chunkdir="`dirname "\`which chunkserver\`"`" \
+    toolsdir="`dirname "\`which qfs\`"`" \
+    devtoolsdir="`dirname "\`which rand-sfmt\`"`" \
+    metahost="$metahost" \
+    metaport="$metasrvport" \
+    csport="$chunksrvport" \
+    hellodeltatest.sh > hellodeltatest.out 2>&1
+    hellodeltastatus=$?
+    cat hellodeltatest.out
+else
+    hellodeltastatus=0
+fi
+
 if [ $status -eq 0 -a $cpstatus -eq 0 -a $qfstoolstatus -eq 0 \
         -a $fostatus -eq 0 -a $smstatus -eq 0 \
-        -a $kfsaccessstatus -eq 0 -a $qfscstatus -eq 0 ]; then
+        -a $kfsaccessstatus -eq 0 -a $qfscstatus -eq 0 \
+        -a $hellodeltastatus -eq 0 -a $lcteststatus -eq 0 ]; then
     echo "Passed all tests"
 else
     echo "Test failure"